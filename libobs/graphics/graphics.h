@@ -729,6 +729,9 @@ EXPORT void gs_texture_unmap(gs_texture_t *tex);
  * GL_TEXTURE_RECTANGLE type, which doesn't use normalized texture
  * coordinates, doesn't support mipmapping, and requires address clamping */
 EXPORT bool gs_texture_is_rect(const gs_texture_t *tex);
+/** updates part of a texture, returns false if not supported by the backend */
+EXPORT bool gs_texture_set_image_region(gs_texture_t *tex, uint32_t x, uint32_t y, uint32_t cx, uint32_t cy,
+					const uint8_t *data, uint32_t linesize);
 /**
  * Gets a pointer to the context-specific object associated with the texture.
  * For example, for GL, this is a GLuint*.  For D3D11, ID3D11Texture2D*.
@@ -26,6 +26,7 @@
 #include "../util/util_uint64.h"
 
 #include "audio-io.h"
+#include "audio-mix.h"
 #include "audio-resampler.h"
 
 #ifdef _WIN32
@@ -58,6 +59,7 @@ static inline void audio_input_free(struct audio_input *input)
 
 struct audio_mix {
 	DARRAY(struct audio_input) inputs;
+	size_t clipping_inputs;
 	float buffer[MAX_AUDIO_CHANNELS][AUDIO_OUTPUT_FRAMES];
 	float buffer_unclamped[MAX_AUDIO_CHANNELS][AUDIO_OUTPUT_FRAMES];
 };
@@ -104,9 +106,11 @@ static bool resample_audio_output(struct audio_input *input, struct audio_data *
 	return success;
 }
 
-static inline void do_audio_output(struct audio_output *audio, size_t mix_idx, uint64_t timestamp, uint32_t frames)
+static inline void do_audio_output(struct audio_output *audio, size_t mix_idx, uint64_t timestamp, uint32_t frames,
+				   uint32_t clipping_mixes)
 {
 	struct audio_mix *mix = &audio->mixes[mix_idx];
+	bool unclamped = (clipping_mixes & (1 << mix_idx)) != 0;
 	struct audio_data data;
 
 	pthread_mutex_lock(&audio->input_mutex);
@@ -114,8 +118,10 @@ static inline void do_audio_output(struct audio_output *audio, size_t mix_idx, u
 	for (size_t i = mix->inputs.num; i > 0; i--) {
 		struct audio_input *input = mix->inputs.array + (i - 1);
 
-		float(*buf)[AUDIO_OUTPUT_FRAMES] = input->conversion.allow_clipping ? mix->buffer_unclamped
-										    : mix->buffer;
+		/* a clipping input that connected during this tick gets the
+		 * clamped mix, as the unclamped one was not copied for it */
+		float(*buf)[AUDIO_OUTPUT_FRAMES] = input->conversion.allow_clipping && unclamped ? mix->buffer_unclamped
+												 : mix->buffer;
 		for (size_t i = 0; i < audio->planes; i++)
 			data.data[i] = (uint8_t *)buf[i];
 
@@ -129,7 +135,8 @@ static inline void do_audio_output(struct audio_output *audio, size_t mix_idx, u
 	pthread_mutex_unlock(&audio->input_mutex);
 }
 
-static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
+static inline void clamp_audio_output(struct audio_output *audio, size_t bytes, uint32_t active_mixes,
+				      uint32_t clipping_mixes)
 {
 	size_t float_size = bytes / sizeof(float);
 
@@ -137,22 +144,17 @@ static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 
 		/* do not process mixing if a specific mix is inactive */
-		if (!mix->inputs.num)
+		if ((active_mixes & (1 << mix_idx)) == 0)
 			continue;
 
 		for (size_t plane = 0; plane < audio->planes; plane++) {
 			float *mix_data = mix->buffer[plane];
-			float *mix_end = &mix_data[float_size];
-			/* Unclamped mix is copied directly. */
-			memcpy(mix->buffer_unclamped[plane], mix_data, bytes);
-
-			while (mix_data < mix_end) {
-				float val = *mix_data;
-				val = (val == val) ? val : 0.0f;
-				val = (val > 1.0f) ? 1.0f : val;
-				val = (val < -1.0f) ? -1.0f : val;
-				*(mix_data++) = val;
-			}
+			/* Unclamped mix is copied directly, but only if an
+			 * input asked for it. */
+			if ((clipping_mixes & (1 << mix_idx)) != 0)
+				memcpy(mix->buffer_unclamped[plane], mix_data, bytes);
+
+			audio_mix_clamp(mix_data, float_size);
 		}
 	}
 }
@@ -162,6 +164,7 @@ static void input_and_output(struct audio_output *audio, uint64_t audio_time, ui
 	size_t bytes = AUDIO_OUTPUT_FRAMES * audio->block_size;
 	struct audio_output_data data[MAX_AUDIO_MIXES];
 	uint32_t active_mixes = 0;
+	uint32_t clipping_mixes = 0;
 	uint64_t new_ts = 0;
 	bool success;
 
@@ -176,17 +179,21 @@ static void input_and_output(struct audio_output *audio, uint64_t audio_time, ui
 	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
 		if (audio->mixes[i].inputs.num)
 			active_mixes |= (1 << i);
+		if (audio->mixes[i].clipping_inputs)
+			clipping_mixes |= (1 << i);
 	}
 	pthread_mutex_unlock(&audio->input_mutex);
 
-	/* clear mix buffers */
+	/* clear mix buffers; inactive mixes are not mixed into, so they are
+	 * left as they are */
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 
-		memset(mix->buffer, 0, sizeof(mix->buffer));
-
-		for (size_t i = 0; i < audio->planes; i++)
+		for (size_t i = 0; i < audio->planes; i++) {
+			if ((active_mixes & (1 << mix_idx)) != 0)
+				memset(mix->buffer[i], 0, bytes);
 			data[mix_idx].data[i] = mix->buffer[i];
+		}
 	}
 
 	/* get new audio data */
@@ -195,11 +202,14 @@ static void input_and_output(struct audio_output *audio, uint64_t audio_time, ui
 		return;
 
 	/* clamps audio data to -1.0..1.0 */
-	clamp_audio_output(audio, bytes);
+	clamp_audio_output(audio, bytes, active_mixes, clipping_mixes);
 
-	/* output */
-	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
-		do_audio_output(audio, i, new_ts, AUDIO_OUTPUT_FRAMES);
+	/* output; mixes that gained an input during this tick start on the
+	 * next one, since their buffers were not cleared */
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		if ((active_mixes & (1 << i)) != 0)
+			do_audio_output(audio, i, new_ts, AUDIO_OUTPUT_FRAMES, clipping_mixes);
+	}
 }
 
 static void *audio_thread(void *param)
@@ -319,8 +329,11 @@ bool audio_output_connect(audio_t *audio, size_t mi, const struct audio_convert_
 			input.conversion.samples_per_sec = audio->info.samples_per_sec;
 
 		success = audio_input_init(&input, audio);
-		if (success)
+		if (success) {
 			da_push_back(mix->inputs, &input);
+			if (input.conversion.allow_clipping)
+				mix->clipping_inputs++;
+		}
 	}
 
 	pthread_mutex_unlock(&audio->input_mutex);
@@ -338,6 +351,8 @@ void audio_output_disconnect(audio_t *audio, size_t mix_idx, audio_output_callba
 	size_t idx = audio_get_input_idx(audio, mix_idx, callback, param);
 	if (idx != DARRAY_INVALID) {
 		struct audio_mix *mix = &audio->mixes[mix_idx];
+		if (mix->inputs.array[idx].conversion.allow_clipping)
+			mix->clipping_inputs--;
 		audio_input_free(mix->inputs.array + idx);
 		da_erase(mix->inputs, idx);
 	}
@@ -0,0 +1,100 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+/*
+ * Float sample kernels used by the audio mixing pipeline.  These are SSE2
+ * (NEON through simde on other architectures) and give bit-identical results
+ * to the plain loops they replace.  Buffers do not need to be aligned.
+ */
+
+#include "../util/c99defs.h"
+#include "../util/sse-intrin.h"
+
+/* dst[i] += src[i] */
+static inline void audio_mix_add(float *dst, const float *src, size_t count)
+{
+	const size_t vec_count = count & ~(size_t)7;
+	size_t i = 0;
+
+	for (; i < vec_count; i += 8) {
+		__m128 a0 = _mm_loadu_ps(dst + i);
+		__m128 a1 = _mm_loadu_ps(dst + i + 4);
+		__m128 b0 = _mm_loadu_ps(src + i);
+		__m128 b1 = _mm_loadu_ps(src + i + 4);
+		_mm_storeu_ps(dst + i, _mm_add_ps(a0, b0));
+		_mm_storeu_ps(dst + i + 4, _mm_add_ps(a1, b1));
+	}
+
+	for (; i < count; i++)
+		dst[i] += src[i];
+}
+
+/* replaces NaN with 0.0 and clamps to -1.0..1.0 */
+static inline void audio_mix_clamp(float *data, size_t count)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 minus_one = _mm_set1_ps(-1.0f);
+	const size_t vec_count = count & ~(size_t)3;
+	size_t i = 0;
+
+	for (; i < vec_count; i += 4) {
+		__m128 val = _mm_loadu_ps(data + i);
+		val = _mm_and_ps(val, _mm_cmpeq_ps(val, val));
+		val = _mm_min_ps(val, one);
+		val = _mm_max_ps(val, minus_one);
+		_mm_storeu_ps(data + i, val);
+	}
+
+	for (; i < count; i++) {
+		float val = data[i];
+		val = (val == val) ? val : 0.0f;
+		val = (val > 1.0f) ? 1.0f : val;
+		val = (val < -1.0f) ? -1.0f : val;
+		data[i] = val;
+	}
+}
+
+/* data[i] *= gain */
+static inline void audio_mix_gain(float *data, float gain, size_t count)
+{
+	const __m128 mul = _mm_set1_ps(gain);
+	const size_t vec_count = count & ~(size_t)7;
+	size_t i = 0;
+
+	for (; i < vec_count; i += 8) {
+		__m128 a0 = _mm_loadu_ps(data + i);
+		__m128 a1 = _mm_loadu_ps(data + i + 4);
+		_mm_storeu_ps(data + i, _mm_mul_ps(a0, mul));
+		_mm_storeu_ps(data + i + 4, _mm_mul_ps(a1, mul));
+	}
+
+	for (; i < count; i++)
+		data[i] *= gain;
+}
+
+/* data[i] *= gain[i] */
+static inline void audio_mix_gain_ramp(float *data, const float *gain, size_t count)
+{
+	const size_t vec_count = count & ~(size_t)3;
+	size_t i = 0;
+
+	for (; i < vec_count; i += 4)
+		_mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), _mm_loadu_ps(gain + i)));
+
+	for (; i < count; i++)
+		data[i] *= gain[i];
+}
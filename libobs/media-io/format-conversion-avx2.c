@@ -0,0 +1,199 @@
+/******************************************************************************
+    Copyright (C) 2023 by Lain Bailey <lain@obsproject.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <string.h>
+
+#include "format-conversion-avx2.h"
+
+#if defined(_M_X64) && !defined(_M_ARM64EC) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+bool format_conversion_cpu_has_avx2(void)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	int regs[4];
+
+	__cpuid(regs, 0);
+	if (regs[0] < 7)
+		return false;
+
+	/* the OS has to save the AVX registers as well */
+	__cpuid(regs, 1);
+	if ((regs[2] & (1 << 27)) == 0 || (regs[2] & (1 << 28)) == 0)
+		return false;
+	if ((_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(regs, 7, 0);
+	return (regs[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+/* Splits 8 UYVX pixels into U0-7 and V0-7 in the low lane and Y0-7 in the
+ * low half of the high lane. */
+TARGET_AVX2 static inline __m256i split_uyvx(const uint8_t *img)
+{
+	const __m256i shuffle = _mm256_setr_epi8(1, 5, 9, 13, 0, 4, 8, 12, 2, 6, 10, 14, -1, -1, -1, -1, 1, 5, 9, 13,
+						 0, 4, 8, 12, 2, 6, 10, 14, -1, -1, -1, -1);
+	const __m256i permute = _mm256_setr_epi32(1, 5, 2, 6, 0, 4, 3, 7);
+
+	__m256i val = _mm256_loadu_si256((const __m256i *)img);
+	val = _mm256_shuffle_epi8(val, shuffle);
+	return _mm256_permutevar8x32_epi32(val, permute);
+}
+
+/* Averages the chroma of two split lines over 2x2 blocks, leaving the four U
+ * values in the low lane and the four V values in the high lane as words. */
+TARGET_AVX2 static inline __m256i average_uv(__m256i line1, __m256i line2)
+{
+	__m256i sum = _mm256_add_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(line1)),
+				       _mm256_cvtepu8_epi16(_mm256_castsi256_si128(line2)));
+	sum = _mm256_hadd_epi16(sum, _mm256_setzero_si256());
+	return _mm256_srli_epi16(sum, 2);
+}
+
+TARGET_AVX2 static inline void store_lum(uint8_t *lum_plane, uint32_t lum_pos0, uint32_t lum_pos1, __m256i line1,
+					 __m256i line2)
+{
+	_mm_storel_epi64((__m128i *)(lum_plane + lum_pos0), _mm256_extracti128_si256(line1, 1));
+	_mm_storel_epi64((__m128i *)(lum_plane + lum_pos1), _mm256_extracti128_si256(line2, 1));
+}
+
+TARGET_AVX2 uint32_t compress_uyvx_to_i420_row_avx2(const uint8_t *input, uint32_t in_linesize, uint32_t y,
+						    uint32_t width, uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint8_t *lum_plane = output[0];
+	uint8_t *u_plane = output[1];
+	uint8_t *v_plane = output[2];
+	uint32_t y_pos = y * in_linesize;
+	uint32_t chroma_y_pos = (y >> 1) * out_linesize[1];
+	uint32_t lum_y_pos = y * out_linesize[0];
+	uint32_t x;
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		const uint8_t *img = input + y_pos + x * 4;
+		uint32_t lum_pos0 = lum_y_pos + x;
+
+		__m256i line1 = split_uyvx(img);
+		__m256i line2 = split_uyvx(img + in_linesize);
+
+		store_lum(lum_plane, lum_pos0, lum_pos0 + out_linesize[0], line1, line2);
+
+		__m256i uv = average_uv(line1, line2);
+		uv = _mm256_packus_epi16(uv, uv);
+
+		uint32_t u = (uint32_t)_mm256_extract_epi32(uv, 0);
+		uint32_t v = (uint32_t)_mm256_extract_epi32(uv, 4);
+		memcpy(u_plane + chroma_y_pos + (x >> 1), &u, sizeof(u));
+		memcpy(v_plane + chroma_y_pos + (x >> 1), &v, sizeof(v));
+	}
+
+	return x;
+}
+
+TARGET_AVX2 uint32_t compress_uyvx_to_nv12_row_avx2(const uint8_t *input, uint32_t in_linesize, uint32_t y,
+						    uint32_t width, uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint8_t *lum_plane = output[0];
+	uint8_t *chroma_plane = output[1];
+	uint32_t y_pos = y * in_linesize;
+	uint32_t chroma_y_pos = (y >> 1) * out_linesize[1];
+	uint32_t lum_y_pos = y * out_linesize[0];
+	uint32_t x;
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		const uint8_t *img = input + y_pos + x * 4;
+		uint32_t lum_pos0 = lum_y_pos + x;
+
+		__m256i line1 = split_uyvx(img);
+		__m256i line2 = split_uyvx(img + in_linesize);
+
+		store_lum(lum_plane, lum_pos0, lum_pos0 + out_linesize[0], line1, line2);
+
+		__m256i uv = average_uv(line1, line2);
+		__m128i interleaved = _mm_unpacklo_epi16(_mm256_castsi256_si128(uv), _mm256_extracti128_si256(uv, 1));
+		interleaved = _mm_packus_epi16(interleaved, interleaved);
+
+		_mm_storel_epi64((__m128i *)(chroma_plane + chroma_y_pos + x), interleaved);
+	}
+
+	return x;
+}
+
+TARGET_AVX2 uint32_t convert_uyvx_to_i444_row_avx2(const uint8_t *input, uint32_t in_linesize, uint32_t y,
+						   uint32_t width, uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint8_t *lum_plane = output[0];
+	uint8_t *u_plane = output[1];
+	uint8_t *v_plane = output[2];
+	uint32_t y_pos = y * in_linesize;
+	uint32_t lum_y_pos = y * out_linesize[0];
+	uint32_t x;
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		const uint8_t *img = input + y_pos + x * 4;
+		uint32_t lum_pos0 = lum_y_pos + x;
+		uint32_t lum_pos1 = lum_pos0 + out_linesize[0];
+
+		__m256i line1 = split_uyvx(img);
+		__m256i line2 = split_uyvx(img + in_linesize);
+		__m128i uv1 = _mm256_castsi256_si128(line1);
+		__m128i uv2 = _mm256_castsi256_si128(line2);
+
+		store_lum(lum_plane, lum_pos0, lum_pos1, line1, line2);
+		_mm_storel_epi64((__m128i *)(u_plane + lum_pos0), uv1);
+		_mm_storel_epi64((__m128i *)(u_plane + lum_pos1), uv2);
+		_mm_storel_epi64((__m128i *)(v_plane + lum_pos0), _mm_srli_si128(uv1, 8));
+		_mm_storel_epi64((__m128i *)(v_plane + lum_pos1), _mm_srli_si128(uv2, 8));
+	}
+
+	return x;
+}
+
+TARGET_AVX2 uint32_t decompress_422_row_avx2(const uint32_t *input32, uint32_t *output32, uint32_t width_d2,
+					     bool leading_lum)
+{
+	__m256i keep_mask = _mm256_set1_epi32(leading_lum ? 0xFFFFFF00 : 0xFFFF00FF);
+	__m256i lum_mask = _mm256_set1_epi32(leading_lum ? 0x000000FF : 0x0000FF00);
+	uint32_t x;
+
+	for (x = 0; x + 8 <= width_d2; x += 8) {
+		__m256i dw = _mm256_loadu_si256((const __m256i *)(input32 + x));
+		__m256i dw2 = _mm256_or_si256(_mm256_and_si256(dw, keep_mask),
+					      _mm256_and_si256(_mm256_srli_epi32(dw, 16), lum_mask));
+		__m256i lo = _mm256_unpacklo_epi32(dw, dw2);
+		__m256i hi = _mm256_unpackhi_epi32(dw, dw2);
+
+		_mm256_storeu_si256((__m256i *)(output32 + x * 2), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i *)(output32 + x * 2 + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+
+	return x;
+}
+
+#endif
@@ -0,0 +1,59 @@
+/******************************************************************************
+    Copyright (C) 2023 by Lain Bailey <lain@obsproject.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "../util/c99defs.h"
+
+/*
+ * AVX2 row kernels for format-conversion.c.  Each one converts as much of the
+ * given line(s) as it can in whole vectors and returns the x position it
+ * stopped at, so that the caller can finish the line with the SSE2 kernels.
+ * These live in their own file so that the native AVX2 intrinsics never mix
+ * with the simde SSE2 aliases.
+ *
+ * There are no AVX2 versions of decompress_420/decompress_nv12: they are
+ * bound by store bandwidth and measured no faster than SSE2.
+ */
+
+#if defined(_M_X64) && !defined(_M_ARM64EC) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+
+extern bool format_conversion_cpu_has_avx2(void);
+
+extern uint32_t compress_uyvx_to_i420_row_avx2(const uint8_t *input, uint32_t in_linesize, uint32_t y,
+					       uint32_t width, uint8_t *output[], const uint32_t out_linesize[]);
+extern uint32_t compress_uyvx_to_nv12_row_avx2(const uint8_t *input, uint32_t in_linesize, uint32_t y,
+					       uint32_t width, uint8_t *output[], const uint32_t out_linesize[]);
+extern uint32_t convert_uyvx_to_i444_row_avx2(const uint8_t *input, uint32_t in_linesize, uint32_t y, uint32_t width,
+					      uint8_t *output[], const uint32_t out_linesize[]);
+
+extern uint32_t decompress_422_row_avx2(const uint32_t *input32, uint32_t *output32, uint32_t width_d2,
+					bool leading_lum);
+
+#else
+
+static inline bool format_conversion_cpu_has_avx2(void)
+{
+	return false;
+}
+
+#define compress_uyvx_to_i420_row_avx2(...) 0
+#define compress_uyvx_to_nv12_row_avx2(...) 0
+#define convert_uyvx_to_i444_row_avx2(...) 0
+#define decompress_422_row_avx2(...) 0
+
+#endif
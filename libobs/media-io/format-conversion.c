@@ -15,9 +15,13 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include <string.h>
+
 #include "format-conversion.h"
+#include "format-conversion-avx2.h"
 
 #include "../util/sse-intrin.h"
+#include "../util/threading.h"
 
 /* ...surprisingly, if I don't use a macro to force inlining, it causes the
  * CPU usage to boost by a tremendous amount in debug builds. */
@@ -77,99 +81,255 @@ static FORCE_INLINE uint32_t min_uint32(uint32_t a, uint32_t b)
 	return a < b ? a : b;
 }
 
-void compress_uyvx_to_i420(const uint8_t *input, uint32_t in_linesize, uint32_t start_y, uint32_t end_y,
-			   uint8_t *output[], const uint32_t out_linesize[])
+/* ------------------------------------------------------------------------- */
+/* SSE2 row kernels (simde on non-x86), 4 pixels at a time, starting at x     */
+
+static FORCE_INLINE void compress_uyvx_to_i420_row(const uint8_t *input, uint32_t in_linesize, uint32_t y, uint32_t x,
+						   uint32_t width, uint8_t *output[], const uint32_t out_linesize[])
 {
 	uint8_t *lum_plane = output[0];
 	uint8_t *u_plane = output[1];
 	uint8_t *v_plane = output[2];
-	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
-	uint32_t y;
+	uint32_t y_pos = y * in_linesize;
+	uint32_t chroma_y_pos = (y >> 1) * out_linesize[1];
+	uint32_t lum_y_pos = y * out_linesize[0];
 
 	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
 	__m128i uv_mask = _mm_set1_epi16(0x00FF);
 
-	for (y = start_y; y < end_y; y += 2) {
-		uint32_t y_pos = y * in_linesize;
-		uint32_t chroma_y_pos = (y >> 1) * out_linesize[1];
-		uint32_t lum_y_pos = y * out_linesize[0];
-		uint32_t x;
-
-		for (x = 0; x < width; x += 4) {
-			const uint8_t *img = input + y_pos + x * 4;
-			uint32_t lum_pos0 = lum_y_pos + x;
-			uint32_t lum_pos1 = lum_pos0 + out_linesize[0];
+	for (; x < width; x += 4) {
+		const uint8_t *img = input + y_pos + x * 4;
+		uint32_t lum_pos0 = lum_y_pos + x;
+		uint32_t lum_pos1 = lum_pos0 + out_linesize[0];
 
-			__m128i line1 = _mm_load_si128((const __m128i *)img);
-			__m128i line2 = _mm_load_si128((const __m128i *)(img + in_linesize));
+		__m128i line1 = _mm_load_si128((const __m128i *)img);
+		__m128i line2 = _mm_load_si128((const __m128i *)(img + in_linesize));
 
-			pack_shift(lum_plane, lum_pos0, lum_pos1, line1, line2, lum_mask, 1);
-			pack_ch_2plane(u_plane, v_plane, chroma_y_pos + (x >> 1), line1, line2, uv_mask);
-		}
+		pack_shift(lum_plane, lum_pos0, lum_pos1, line1, line2, lum_mask, 1);
+		pack_ch_2plane(u_plane, v_plane, chroma_y_pos + (x >> 1), line1, line2, uv_mask);
 	}
 }
 
-void compress_uyvx_to_nv12(const uint8_t *input, uint32_t in_linesize, uint32_t start_y, uint32_t end_y,
-			   uint8_t *output[], const uint32_t out_linesize[])
+static FORCE_INLINE void compress_uyvx_to_nv12_row(const uint8_t *input, uint32_t in_linesize, uint32_t y, uint32_t x,
+						   uint32_t width, uint8_t *output[], const uint32_t out_linesize[])
 {
 	uint8_t *lum_plane = output[0];
 	uint8_t *chroma_plane = output[1];
-	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
-	uint32_t y;
+	uint32_t y_pos = y * in_linesize;
+	uint32_t chroma_y_pos = (y >> 1) * out_linesize[1];
+	uint32_t lum_y_pos = y * out_linesize[0];
 
 	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
 	__m128i uv_mask = _mm_set1_epi16(0x00FF);
 
-	for (y = start_y; y < end_y; y += 2) {
-		uint32_t y_pos = y * in_linesize;
-		uint32_t chroma_y_pos = (y >> 1) * out_linesize[1];
-		uint32_t lum_y_pos = y * out_linesize[0];
-		uint32_t x;
-
-		for (x = 0; x < width; x += 4) {
-			const uint8_t *img = input + y_pos + x * 4;
-			uint32_t lum_pos0 = lum_y_pos + x;
-			uint32_t lum_pos1 = lum_pos0 + out_linesize[0];
+	for (; x < width; x += 4) {
+		const uint8_t *img = input + y_pos + x * 4;
+		uint32_t lum_pos0 = lum_y_pos + x;
+		uint32_t lum_pos1 = lum_pos0 + out_linesize[0];
 
-			__m128i line1 = _mm_load_si128((const __m128i *)img);
-			__m128i line2 = _mm_load_si128((const __m128i *)(img + in_linesize));
+		__m128i line1 = _mm_load_si128((const __m128i *)img);
+		__m128i line2 = _mm_load_si128((const __m128i *)(img + in_linesize));
 
-			pack_shift(lum_plane, lum_pos0, lum_pos1, line1, line2, lum_mask, 1);
-			pack_ch_1plane(chroma_plane, chroma_y_pos + x, line1, line2, uv_mask);
-		}
+		pack_shift(lum_plane, lum_pos0, lum_pos1, line1, line2, lum_mask, 1);
+		pack_ch_1plane(chroma_plane, chroma_y_pos + x, line1, line2, uv_mask);
 	}
 }
 
-void convert_uyvx_to_i444(const uint8_t *input, uint32_t in_linesize, uint32_t start_y, uint32_t end_y,
-			  uint8_t *output[], const uint32_t out_linesize[])
+static FORCE_INLINE void convert_uyvx_to_i444_row(const uint8_t *input, uint32_t in_linesize, uint32_t y, uint32_t x,
+						  uint32_t width, uint8_t *output[], const uint32_t out_linesize[])
 {
 	uint8_t *lum_plane = output[0];
 	uint8_t *u_plane = output[1];
 	uint8_t *v_plane = output[2];
-	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
-	uint32_t y;
+	uint32_t y_pos = y * in_linesize;
+	uint32_t lum_y_pos = y * out_linesize[0];
 
 	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
 	__m128i u_mask = _mm_set1_epi32(0x000000FF);
 	__m128i v_mask = _mm_set1_epi32(0x00FF0000);
 
-	for (y = start_y; y < end_y; y += 2) {
-		uint32_t y_pos = y * in_linesize;
-		uint32_t lum_y_pos = y * out_linesize[0];
-		uint32_t x;
+	for (; x < width; x += 4) {
+		const uint8_t *img = input + y_pos + x * 4;
+		uint32_t lum_pos0 = lum_y_pos + x;
+		uint32_t lum_pos1 = lum_pos0 + out_linesize[0];
+
+		__m128i line1 = _mm_load_si128((const __m128i *)img);
+		__m128i line2 = _mm_load_si128((const __m128i *)(img + in_linesize));
+
+		pack_shift(lum_plane, lum_pos0, lum_pos1, line1, line2, lum_mask, 1);
+		pack_val(u_plane, lum_pos0, lum_pos1, line1, line2, u_mask);
+		pack_shift(v_plane, lum_pos0, lum_pos1, line1, line2, v_mask, 2);
+	}
+}
+
+static inline __m128i load_32(const uint8_t *ptr)
+{
+	uint32_t val;
+	memcpy(&val, ptr, sizeof(val));
+	return _mm_cvtsi32_si128((int)val);
+}
+
+/* The decompress kernels finish whatever is left of a line after the SIMD
+ * loops with the original scalar code. */
 
-		for (x = 0; x < width; x += 4) {
-			const uint8_t *img = input + y_pos + x * 4;
-			uint32_t lum_pos0 = lum_y_pos + x;
-			uint32_t lum_pos1 = lum_pos0 + out_linesize[0];
+static FORCE_INLINE void decompress_420_row(const uint8_t *chroma0, const uint8_t *chroma1, const uint8_t *lum0,
+					    const uint8_t *lum1, uint32_t *output0, uint32_t *output1, uint32_t x,
+					    uint32_t width_d2)
+{
+	__m128i zero = _mm_setzero_si128();
+
+	for (; x + 4 <= width_d2; x += 4) {
+		__m128i vu = _mm_unpacklo_epi8(load_32(chroma1 + x), load_32(chroma0 + x));
+		vu = _mm_unpacklo_epi16(vu, vu);
+
+		__m128i l0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(lum0 + x * 2)), zero);
+		__m128i l1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(lum1 + x * 2)), zero);
+
+		_mm_storeu_si128((__m128i *)(output0 + x * 2), _mm_unpacklo_epi16(vu, l0));
+		_mm_storeu_si128((__m128i *)(output0 + x * 2 + 4), _mm_unpackhi_epi16(vu, l0));
+		_mm_storeu_si128((__m128i *)(output1 + x * 2), _mm_unpacklo_epi16(vu, l1));
+		_mm_storeu_si128((__m128i *)(output1 + x * 2 + 4), _mm_unpackhi_epi16(vu, l1));
+	}
+
+	for (; x < width_d2; x++) {
+		uint32_t out = (chroma0[x] << 8) | chroma1[x];
+
+		output0[x * 2] = (lum0[x * 2] << 16) | out;
+		output0[x * 2 + 1] = (lum0[x * 2 + 1] << 16) | out;
+
+		output1[x * 2] = (lum1[x * 2] << 16) | out;
+		output1[x * 2 + 1] = (lum1[x * 2 + 1] << 16) | out;
+	}
+}
+
+static FORCE_INLINE void decompress_nv12_row(const uint16_t *chroma, const uint8_t *lum0, const uint8_t *lum1,
+					     uint32_t *output0, uint32_t *output1, uint32_t x, uint32_t width_d2)
+{
+	__m128i zero = _mm_setzero_si128();
+
+	for (; x + 4 <= width_d2; x += 4) {
+		__m128i uv = _mm_loadl_epi64((const __m128i *)(chroma + x));
+		uv = _mm_unpacklo_epi16(uv, uv);
 
-			__m128i line1 = _mm_load_si128((const __m128i *)img);
-			__m128i line2 = _mm_load_si128((const __m128i *)(img + in_linesize));
+		__m128i uv_lo = _mm_slli_epi32(_mm_unpacklo_epi16(uv, zero), 8);
+		__m128i uv_hi = _mm_slli_epi32(_mm_unpackhi_epi16(uv, zero), 8);
+
+		__m128i l0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(lum0 + x * 2)), zero);
+		__m128i l1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(lum1 + x * 2)), zero);
+
+		_mm_storeu_si128((__m128i *)(output0 + x * 2), _mm_or_si128(uv_lo, _mm_unpacklo_epi16(l0, zero)));
+		_mm_storeu_si128((__m128i *)(output0 + x * 2 + 4), _mm_or_si128(uv_hi, _mm_unpackhi_epi16(l0, zero)));
+		_mm_storeu_si128((__m128i *)(output1 + x * 2), _mm_or_si128(uv_lo, _mm_unpacklo_epi16(l1, zero)));
+		_mm_storeu_si128((__m128i *)(output1 + x * 2 + 4), _mm_or_si128(uv_hi, _mm_unpackhi_epi16(l1, zero)));
+	}
+
+	for (; x < width_d2; x++) {
+		uint32_t out = chroma[x] << 8;
+
+		output0[x * 2] = lum0[x * 2] | out;
+		output0[x * 2 + 1] = lum0[x * 2 + 1] | out;
+
+		output1[x * 2] = lum1[x * 2] | out;
+		output1[x * 2 + 1] = lum1[x * 2 + 1] | out;
+	}
+}
+
+static FORCE_INLINE void decompress_422_row(const uint32_t *input32, uint32_t *output32, uint32_t x,
+					    uint32_t width_d2, bool leading_lum)
+{
+	__m128i keep_mask = _mm_set1_epi32(leading_lum ? 0xFFFFFF00 : 0xFFFF00FF);
+	__m128i lum_mask = _mm_set1_epi32(leading_lum ? 0x000000FF : 0x0000FF00);
+
+	for (; x + 4 <= width_d2; x += 4) {
+		__m128i dw = _mm_loadu_si128((const __m128i *)(input32 + x));
+		__m128i dw2 =
+			_mm_or_si128(_mm_and_si128(dw, keep_mask), _mm_and_si128(_mm_srli_epi32(dw, 16), lum_mask));
+
+		_mm_storeu_si128((__m128i *)(output32 + x * 2), _mm_unpacklo_epi32(dw, dw2));
+		_mm_storeu_si128((__m128i *)(output32 + x * 2 + 4), _mm_unpackhi_epi32(dw, dw2));
+	}
 
-			pack_shift(lum_plane, lum_pos0, lum_pos1, line1, line2, lum_mask, 1);
-			pack_val(u_plane, lum_pos0, lum_pos1, line1, line2, u_mask);
-			pack_shift(v_plane, lum_pos0, lum_pos1, line1, line2, v_mask, 2);
+	for (; x < width_d2; x++) {
+		uint32_t dw = input32[x];
+
+		output32[x * 2] = dw;
+		if (leading_lum) {
+			dw &= 0xFFFFFF00;
+			dw |= (uint8_t)(dw >> 16);
+		} else {
+			dw &= 0xFFFF00FF;
+			dw |= (dw >> 16) & 0xFF00;
 		}
+		output32[x * 2 + 1] = dw;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+static volatile long active_isa = FORMAT_CONVERSION_ISA_AUTO;
+
+static inline bool use_avx2(void)
+{
+	long isa = os_atomic_load_long(&active_isa);
+
+	if (isa == FORMAT_CONVERSION_ISA_AUTO) {
+		isa = format_conversion_cpu_has_avx2() ? FORMAT_CONVERSION_ISA_AVX2 : FORMAT_CONVERSION_ISA_SSE2;
+		os_atomic_set_long(&active_isa, isa);
+	}
+
+	return isa == FORMAT_CONVERSION_ISA_AVX2;
+}
+
+enum format_conversion_isa format_conversion_get_isa(void)
+{
+	return use_avx2() ? FORMAT_CONVERSION_ISA_AVX2 : FORMAT_CONVERSION_ISA_SSE2;
+}
+
+bool format_conversion_set_isa(enum format_conversion_isa isa)
+{
+	if (isa == FORMAT_CONVERSION_ISA_AVX2 && !format_conversion_cpu_has_avx2())
+		return false;
+
+	os_atomic_set_long(&active_isa, isa);
+	return true;
+}
+
+void compress_uyvx_to_i420(const uint8_t *input, uint32_t in_linesize, uint32_t start_y, uint32_t end_y,
+			   uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
+	bool avx2 = use_avx2();
+
+	for (uint32_t y = start_y; y < end_y; y += 2) {
+		uint32_t x = avx2 ? compress_uyvx_to_i420_row_avx2(input, in_linesize, y, width, output, out_linesize)
+				  : 0;
+		compress_uyvx_to_i420_row(input, in_linesize, y, x, width, output, out_linesize);
+	}
+}
+
+void compress_uyvx_to_nv12(const uint8_t *input, uint32_t in_linesize, uint32_t start_y, uint32_t end_y,
+			   uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
+	bool avx2 = use_avx2();
+
+	for (uint32_t y = start_y; y < end_y; y += 2) {
+		uint32_t x = avx2 ? compress_uyvx_to_nv12_row_avx2(input, in_linesize, y, width, output, out_linesize)
+				  : 0;
+		compress_uyvx_to_nv12_row(input, in_linesize, y, x, width, output, out_linesize);
+	}
+}
+
+void convert_uyvx_to_i444(const uint8_t *input, uint32_t in_linesize, uint32_t start_y, uint32_t end_y,
+			  uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
+	bool avx2 = use_avx2();
+
+	for (uint32_t y = start_y; y < end_y; y += 2) {
+		uint32_t x = avx2 ? convert_uyvx_to_i444_row_avx2(input, in_linesize, y, width, output, out_linesize)
+				  : 0;
+		convert_uyvx_to_i444_row(input, in_linesize, y, x, width, output, out_linesize);
 	}
 }
 
@@ -184,25 +344,15 @@ void decompress_420(const uint8_t *const input[], const uint32_t in_linesize[],
 	for (y = start_y_d2; y < height_d2; y++) {
 		const uint8_t *chroma0 = input[1] + y * in_linesize[1];
 		const uint8_t *chroma1 = input[2] + y * in_linesize[2];
-		register const uint8_t *lum0, *lum1;
-		register uint32_t *output0, *output1;
-		uint32_t x;
+		const uint8_t *lum0, *lum1;
+		uint32_t *output0, *output1;
 
 		lum0 = input[0] + y * 2 * in_linesize[0];
 		lum1 = lum0 + in_linesize[0];
 		output0 = (uint32_t *)(output + y * 2 * out_linesize);
 		output1 = (uint32_t *)((uint8_t *)output0 + out_linesize);
 
-		for (x = 0; x < width_d2; x++) {
-			uint32_t out;
-			out = (*(chroma0++) << 8) | *(chroma1++);
-
-			*(output0++) = (*(lum0++) << 16) | out;
-			*(output0++) = (*(lum0++) << 16) | out;
-
-			*(output1++) = (*(lum1++) << 16) | out;
-			*(output1++) = (*(lum1++) << 16) | out;
-		}
+		decompress_420_row(chroma0, chroma1, lum0, lum1, output0, output1, 0, width_d2);
 	}
 }
 
@@ -216,9 +366,8 @@ void decompress_nv12(const uint8_t *const input[], const uint32_t in_linesize[],
 
 	for (y = start_y_d2; y < height_d2; y++) {
 		const uint16_t *chroma;
-		register const uint8_t *lum0, *lum1;
-		register uint32_t *output0, *output1;
-		uint32_t x;
+		const uint8_t *lum0, *lum1;
+		uint32_t *output0, *output1;
 
 		chroma = (const uint16_t *)(input[1] + y * in_linesize[1]);
 		lum0 = input[0] + y * 2 * in_linesize[0];
@@ -226,15 +375,7 @@ void decompress_nv12(const uint8_t *const input[], const uint32_t in_linesize[],
 		output0 = (uint32_t *)(output + y * 2 * out_linesize);
 		output1 = (uint32_t *)((uint8_t *)output0 + out_linesize);
 
-		for (x = 0; x < width_d2; x++) {
-			uint32_t out = *(chroma++) << 8;
-
-			*(output0++) = *(lum0++) | out;
-			*(output0++) = *(lum0++) | out;
-
-			*(output1++) = *(lum1++) | out;
-			*(output1++) = *(lum1++) | out;
-		}
+		decompress_nv12_row(chroma, lum0, lum1, output0, output1, 0, width_d2);
 	}
 }
 
@@ -242,47 +383,16 @@ void decompress_422(const uint8_t *input, uint32_t in_linesize, uint32_t start_y
 		    uint32_t out_linesize, bool leading_lum)
 {
 	uint32_t width_d2 = min_uint32(in_linesize, out_linesize) / 2;
+	bool avx2 = use_avx2();
 	uint32_t y;
 
-	register const uint32_t *input32;
-	register const uint32_t *input32_end;
-	register uint32_t *output32;
-
-	if (leading_lum) {
-		for (y = start_y; y < end_y; y++) {
-			input32 = (const uint32_t *)(input + y * in_linesize);
-			input32_end = input32 + width_d2;
-			output32 = (uint32_t *)(output + y * out_linesize);
-
-			while (input32 < input32_end) {
-				register uint32_t dw = *input32;
+	for (y = start_y; y < end_y; y++) {
+		const uint32_t *input32 = (const uint32_t *)(input + y * in_linesize);
+		uint32_t *output32 = (uint32_t *)(output + y * out_linesize);
+		uint32_t x = 0;
 
-				output32[0] = dw;
-				dw &= 0xFFFFFF00;
-				dw |= (uint8_t)(dw >> 16);
-				output32[1] = dw;
-
-				output32 += 2;
-				input32++;
-			}
-		}
-	} else {
-		for (y = start_y; y < end_y; y++) {
-			input32 = (const uint32_t *)(input + y * in_linesize);
-			input32_end = input32 + width_d2;
-			output32 = (uint32_t *)(output + y * out_linesize);
-
-			while (input32 < input32_end) {
-				register uint32_t dw = *input32;
-
-				output32[0] = dw;
-				dw &= 0xFFFF00FF;
-				dw |= (dw >> 16) & 0xFF00;
-				output32[1] = dw;
-
-				output32 += 2;
-				input32++;
-			}
-		}
+		if (avx2)
+			x = decompress_422_row_avx2(input32, output32, width_d2, leading_lum);
+		decompress_422_row(input32, output32, x, width_d2, leading_lum);
 	}
 }
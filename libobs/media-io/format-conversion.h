@@ -45,6 +45,21 @@ EXPORT void decompress_420(const uint8_t *const input[], const uint32_t in_lines
 EXPORT void decompress_422(const uint8_t *input, uint32_t in_linesize, uint32_t start_y, uint32_t end_y,
 			   uint8_t *output, uint32_t out_linesize, bool leading_lum);
 
+/*
+ * Instruction set used by the functions above.  It is detected from the CPU
+ * on first use, and can be overridden for testing and benchmarking.
+ * SSE2 maps to NEON through simde on non-x86 CPUs.
+ */
+
+enum format_conversion_isa {
+	FORMAT_CONVERSION_ISA_AUTO,
+	FORMAT_CONVERSION_ISA_SSE2,
+	FORMAT_CONVERSION_ISA_AVX2,
+};
+
+EXPORT enum format_conversion_isa format_conversion_get_isa(void);
+EXPORT bool format_conversion_set_isa(enum format_conversion_isa isa);
+
 #ifdef __cplusplus
 }
 #endif
@@ -34,10 +34,27 @@ extern profiler_name_store_t *obs_get_profiler_name_store(void);
 #define MAX_CONVERT_BUFFERS 3
 #define MAX_CACHE_SIZE 16
 
+/* Frames are handed from the graphics thread to the video thread through a
+ * single-producer/single-consumer ring.  The producer only ever writes to
+ * write_idx and the video thread only ever advances dispatch_idx; ownership of
+ * a slot moves between them through the atomic queued_frames counter, so the
+ * graphics thread never has to take a lock.  count/skipped are atomic because
+ * the producer may still append repeats to the newest slot while the ring is
+ * full.
+ *
+ * Threaded inputs hold a reference on each slot they have queued, so a slot
+ * is only handed back to the producer (in ring order, through release_idx)
+ * once it has been fully dispatched and every input is done with it. */
 struct cached_frame_info {
 	struct video_data frame;
-	int skipped;
-	int count;
+	volatile long skipped;
+	volatile long count;
+	volatile long refs;
+};
+
+struct queued_frame {
+	size_t idx;
+	uint64_t timestamp;
 };
 
 struct video_input {
@@ -58,20 +75,29 @@ struct video_input {
 
 	void (*callback)(void *param, struct video_data *frame);
 	void *param;
-};
 
-static inline void video_input_free(struct video_input *input)
-{
-	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-		video_frame_free(&input->frame[i]);
-	video_scaler_destroy(input->scaler);
-}
+	/* threaded inputs are fed through their own bounded queue and call
+	 * the callback from their own thread */
+	bool threaded;
+	struct video_output *video;
+	pthread_t thread;
+	os_sem_t *queue_semaphore;
+	volatile bool stop;
+	volatile bool exited;
+	struct queued_frame queue[MAX_CACHE_SIZE];
+	size_t queue_size;
+	size_t queue_read;
+	size_t queue_write;
+	volatile long queued;
+
+	long total_frames;
+	long skipped_frames;
+};
 
 struct video_output {
 	struct video_output_info info;
 
 	pthread_t thread;
-	pthread_mutex_t data_mutex;
 	bool stop;
 
 	os_sem_t *update_semaphore;
@@ -80,13 +106,19 @@ struct video_output {
 	volatile long total_frames;
 
 	pthread_mutex_t input_mutex;
-	DARRAY(struct video_input) inputs;
+	DARRAY(struct video_input *) inputs;
+	DARRAY(struct video_input *) detached_inputs;
+	volatile bool threaded_inputs;
 
-	size_t available_frames;
-	size_t first_added;
-	size_t last_added;
+	volatile long queued_frames;
+	size_t write_idx;
+	size_t dispatch_idx;
 	struct cached_frame_info cache[MAX_CACHE_SIZE];
 
+	pthread_mutex_t release_mutex;
+	size_t release_idx;
+	size_t dispatched_frames;
+
 	struct video_output *parent;
 
 	volatile bool raw_active;
@@ -123,26 +155,144 @@ static inline bool scale_video_output(struct video_input *input, struct video_da
 	return success;
 }
 
+static void release_frames(struct video_output *video)
+{
+	pthread_mutex_lock(&video->release_mutex);
+
+	while (video->dispatched_frames &&
+	       os_atomic_load_long(&video->cache[video->release_idx].refs) == 0) {
+		if (++video->release_idx == video->info.cache_size)
+			video->release_idx = 0;
+
+		video->dispatched_frames--;
+
+		/* releases the slot back to the graphics thread */
+		os_atomic_dec_long(&video->queued_frames);
+	}
+
+	pthread_mutex_unlock(&video->release_mutex);
+}
+
+static inline void unref_frame(struct video_output *video, size_t idx)
+{
+	if (os_atomic_dec_long(&video->cache[idx].refs) == 0)
+		release_frames(video);
+}
+
+static void video_input_drain(struct video_output *video, struct video_input *input)
+{
+	while (os_atomic_load_long(&input->queued) > 0) {
+		unref_frame(video, input->queue[input->queue_read].idx);
+		if (++input->queue_read == input->queue_size)
+			input->queue_read = 0;
+		os_atomic_dec_long(&input->queued);
+	}
+}
+
+static void video_input_destroy(struct video_output *video, struct video_input *input)
+{
+	if (input->threaded) {
+		video_input_drain(video, input);
+		os_sem_destroy(input->queue_semaphore);
+	}
+
+	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
+		video_frame_free(&input->frame[i]);
+	video_scaler_destroy(input->scaler);
+	bfree(input);
+}
+
+static void video_input_free(struct video_output *video, struct video_input *input)
+{
+	if (input->threaded) {
+		os_atomic_set_bool(&input->stop, true);
+		os_sem_post(input->queue_semaphore);
+		pthread_join(input->thread, NULL);
+	}
+
+	video_input_destroy(video, input);
+}
+
+static void *video_input_thread(void *param)
+{
+	struct video_input *input = param;
+	struct video_output *video = input->video;
+
+	os_set_thread_name("video-io: video input thread");
+
+	while (os_sem_wait(input->queue_semaphore) == 0) {
+		if (os_atomic_load_bool(&input->stop))
+			break;
+
+		struct queued_frame *queued = &input->queue[input->queue_read];
+		struct video_data *cached = &video->cache[queued->idx].frame;
+		struct video_data frame;
+
+		/* the video thread keeps advancing the cached timestamp for
+		 * repeated frames, so use the one captured when queueing */
+		memcpy(frame.data, cached->data, sizeof(frame.data));
+		memcpy(frame.linesize, cached->linesize, sizeof(frame.linesize));
+		frame.timestamp = queued->timestamp;
+
+		if (scale_video_output(input, &frame))
+			input->callback(input->param, &frame);
+
+		unref_frame(video, queued->idx);
+		if (++input->queue_read == input->queue_size)
+			input->queue_read = 0;
+		os_atomic_dec_long(&input->queued);
+
+		if (os_atomic_load_bool(&input->stop))
+			break;
+	}
+
+	/* hand any frames still queued back right away; an input that
+	 * disconnected itself is joined by the next connect, disconnect or
+	 * close once it has exited */
+	video_input_drain(video, input);
+	os_atomic_set_bool(&input->exited, true);
+	return NULL;
+}
+
+/* returns false if the input's queue was full and the frame was skipped */
+static inline bool queue_video_input(struct video_output *video, struct video_input *input, size_t idx,
+				     uint64_t timestamp)
+{
+	if (os_atomic_load_long(&input->queued) == (long)input->queue_size) {
+		input->skipped_frames++;
+		return false;
+	}
+
+	struct queued_frame *queued = &input->queue[input->queue_write];
+	queued->idx = idx;
+	queued->timestamp = timestamp;
+
+	if (++input->queue_write == input->queue_size)
+		input->queue_write = 0;
+
+	os_atomic_inc_long(&video->cache[idx].refs);
+	os_atomic_inc_long(&input->queued);
+	os_sem_post(input->queue_semaphore);
+	return true;
+}
+
 static inline bool video_output_cur_frame(struct video_output *video)
 {
 	struct cached_frame_info *frame_info;
+	size_t idx = video->dispatch_idx;
+	bool input_skipped = false;
 	bool complete;
-	bool skipped;
 
 	/* -------------------------------- */
 
-	pthread_mutex_lock(&video->data_mutex);
-
-	frame_info = &video->cache[video->first_added];
-
-	pthread_mutex_unlock(&video->data_mutex);
+	frame_info = &video->cache[idx];
 
 	/* -------------------------------- */
 
 	pthread_mutex_lock(&video->input_mutex);
 
 	for (size_t i = 0; i < video->inputs.num; i++) {
-		struct video_input *input = video->inputs.array + i;
+		struct video_input *input = video->inputs.array[i];
 		struct video_data frame = frame_info->frame;
 
 		// an explicit counter is used instead of remainder calculation
@@ -155,32 +305,41 @@ static inline bool video_output_cur_frame(struct video_output *video)
 		if (skip)
 			continue;
 
-		if (scale_video_output(input, &frame))
+		input->total_frames++;
+
+		if (input->threaded) {
+			if (!queue_video_input(video, input, idx, frame.timestamp))
+				input_skipped = true;
+		} else if (scale_video_output(input, &frame)) {
 			input->callback(input->param, &frame);
+		}
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
 
 	/* -------------------------------- */
 
-	pthread_mutex_lock(&video->data_mutex);
-
 	frame_info->frame.timestamp += video->frame_time;
-	complete = --frame_info->count == 0;
-	skipped = frame_info->skipped > 0;
+	complete = os_atomic_dec_long(&frame_info->count) == 0;
 
 	if (complete) {
-		if (++video->first_added == video->info.cache_size)
-			video->first_added = 0;
+		if (++video->dispatch_idx == video->info.cache_size)
+			video->dispatch_idx = 0;
+
+		pthread_mutex_lock(&video->release_mutex);
+		video->dispatched_frames++;
+		pthread_mutex_unlock(&video->release_mutex);
+
+		unref_frame(video, idx);
 
-		if (++video->available_frames == video->info.cache_size)
-			video->last_added = video->first_added;
-	} else if (skipped) {
-		--frame_info->skipped;
+	} else if (os_atomic_load_long(&frame_info->skipped) > 0) {
+		os_atomic_dec_long(&frame_info->skipped);
 		os_atomic_inc_long(&video->skipped_frames);
+		input_skipped = false;
 	}
 
-	pthread_mutex_unlock(&video->data_mutex);
+	if (input_skipped)
+		os_atomic_inc_long(&video->skipped_frames);
 
 	/* -------------------------------- */
 
@@ -232,8 +391,6 @@ static inline void init_cache(struct video_output *video)
 
 		video_frame_init(frame, video->info.format, video->info.width, video->info.height);
 	}
-
-	video->available_frames = video->info.cache_size;
 }
 
 int video_output_open(video_t **video, struct video_output_info *info)
@@ -250,9 +407,9 @@ int video_output_open(video_t **video, struct video_output_info *info)
 	memcpy(&out->info, info, sizeof(struct video_output_info));
 	out->frame_time = util_mul_div64(1000000000ULL, info->fps_den, info->fps_num);
 
-	if (pthread_mutex_init_recursive(&out->data_mutex) != 0)
-		goto fail0;
 	if (pthread_mutex_init_recursive(&out->input_mutex) != 0)
+		goto fail0;
+	if (pthread_mutex_init(&out->release_mutex, NULL) != 0)
 		goto fail1;
 	if (os_sem_init(&out->update_semaphore, 0) != 0)
 		goto fail2;
@@ -267,9 +424,9 @@ int video_output_open(video_t **video, struct video_output_info *info)
 fail3:
 	os_sem_destroy(out->update_semaphore);
 fail2:
-	pthread_mutex_destroy(&out->input_mutex);
+	pthread_mutex_destroy(&out->release_mutex);
 fail1:
-	pthread_mutex_destroy(&out->data_mutex);
+	pthread_mutex_destroy(&out->input_mutex);
 fail0:
 	bfree(out);
 	return VIDEO_OUTPUT_FAIL;
@@ -283,17 +440,32 @@ void video_output_close(video_t *video)
 	video_output_stop(video);
 
 	pthread_mutex_lock(&video->input_mutex);
+	DARRAY(struct video_input *) inputs = {0};
+	da_move(inputs, video->inputs);
+	pthread_mutex_unlock(&video->input_mutex);
+
+	/* input threads may still be inside their callbacks, so they have
+	 * to be joined without input_mutex held */
+	for (size_t i = 0; i < inputs.num; i++)
+		video_input_free(video, inputs.array[i]);
+	da_free(inputs);
+
+	/* inputs that disconnected themselves from their own callback have
+	 * already been stopped, but their threads still reference the output
+	 * until they return */
+	pthread_mutex_lock(&video->input_mutex);
+	da_move(inputs, video->detached_inputs);
+	pthread_mutex_unlock(&video->input_mutex);
 
-	for (size_t i = 0; i < video->inputs.num; i++)
-		video_input_free(&video->inputs.array[i]);
-	da_free(video->inputs);
+	for (size_t i = 0; i < inputs.num; i++)
+		video_input_free(video, inputs.array[i]);
+	da_free(inputs);
 
 	for (size_t i = 0; i < video->info.cache_size; i++)
 		video_frame_free((struct video_frame *)&video->cache[i]);
 
-	pthread_mutex_unlock(&video->input_mutex);
 	os_sem_destroy(video->update_semaphore);
-	pthread_mutex_destroy(&video->data_mutex);
+	pthread_mutex_destroy(&video->release_mutex);
 	pthread_mutex_destroy(&video->input_mutex);
 
 	bfree(video);
@@ -303,7 +475,7 @@ static size_t video_get_input_idx(const video_t *video, void (*callback)(void *p
 				  void *param)
 {
 	for (size_t i = 0; i < video->inputs.num; i++) {
-		struct video_input *input = video->inputs.array + i;
+		struct video_input *input = video->inputs.array[i];
 		if (input->callback == callback && input->param == param)
 			return i;
 	}
@@ -389,6 +561,46 @@ static video_t *get_root(video_t *video)
 	return video;
 }
 
+static bool video_input_start_thread(struct video_input *input, struct video_output *video)
+{
+	input->queue_size = video->info.cache_size / 2;
+	if (!input->queue_size)
+		input->queue_size = 1;
+
+	if (os_sem_init(&input->queue_semaphore, 0) != 0)
+		return false;
+
+	input->threaded = true;
+
+	if (pthread_create(&input->thread, NULL, video_input_thread, input) != 0) {
+		os_sem_destroy(input->queue_semaphore);
+		input->threaded = false;
+		return false;
+	}
+
+	return true;
+}
+
+/* joins inputs that disconnected themselves once their threads have exited */
+static void free_exited_inputs(struct video_output *video)
+{
+	DARRAY(struct video_input *) exited = {0};
+
+	pthread_mutex_lock(&video->input_mutex);
+	for (size_t i = video->detached_inputs.num; i > 0; i--) {
+		struct video_input *input = video->detached_inputs.array[i - 1];
+		if (os_atomic_load_bool(&input->exited)) {
+			da_push_back(exited, &input);
+			da_erase(video->detached_inputs, i - 1);
+		}
+	}
+	pthread_mutex_unlock(&video->input_mutex);
+
+	for (size_t i = 0; i < exited.num; i++)
+		video_input_free(video, exited.array[i]);
+	da_free(exited);
+}
+
 bool video_output_connect(video_t *video, const struct video_scale_info *conversion,
 			  void (*callback)(void *param, struct video_data *frame), void *param)
 {
@@ -397,6 +609,16 @@ bool video_output_connect(video_t *video, const struct video_scale_info *convers
 
 bool video_output_connect2(video_t *video, const struct video_scale_info *conversion, uint32_t frame_rate_divisor,
 			   void (*callback)(void *param, struct video_data *frame), void *param)
+{
+	if (!video)
+		return false;
+
+	bool threaded = os_atomic_load_bool(&get_root(video)->threaded_inputs);
+	return video_output_connect3(video, conversion, frame_rate_divisor, threaded, callback, param);
+}
+
+bool video_output_connect3(video_t *video, const struct video_scale_info *conversion, uint32_t frame_rate_divisor,
+			   bool threaded, void (*callback)(void *param, struct video_data *frame), void *param)
 {
 	bool success = false;
 
@@ -405,34 +627,41 @@ bool video_output_connect2(video_t *video, const struct video_scale_info *conver
 	if (!video || !callback || frame_rate_divisor == 0)
 		return false;
 
+	free_exited_inputs(video);
+
 	pthread_mutex_lock(&video->input_mutex);
 
 	if (video_get_input_idx(video, callback, param) == DARRAY_INVALID) {
-		struct video_input input;
-		memset(&input, 0, sizeof(input));
+		struct video_input *input = bzalloc(sizeof(*input));
 
-		input.callback = callback;
-		input.param = param;
+		input->callback = callback;
+		input->param = param;
+		input->video = video;
 
-		input.frame_rate_divisor = frame_rate_divisor;
+		input->frame_rate_divisor = frame_rate_divisor;
 
 		if (conversion) {
-			input.conversion = *conversion;
+			input->conversion = *conversion;
 		} else {
-			input.conversion.format = video->info.format;
-			input.conversion.width = video->info.width;
-			input.conversion.height = video->info.height;
-			input.conversion.range = video->info.range;
-			input.conversion.colorspace = video->info.colorspace;
+			input->conversion.format = video->info.format;
+			input->conversion.width = video->info.width;
+			input->conversion.height = video->info.height;
+			input->conversion.range = video->info.range;
+			input->conversion.colorspace = video->info.colorspace;
 		}
 
-		if (input.conversion.width == 0)
-			input.conversion.width = video->info.width;
-		if (input.conversion.height == 0)
-			input.conversion.height = video->info.height;
+		if (input->conversion.width == 0)
+			input->conversion.width = video->info.width;
+		if (input->conversion.height == 0)
+			input->conversion.height = video->info.height;
 
-		success = video_input_init(&input, video);
-		if (success) {
+		success = video_input_init(input, video);
+		if (success && threaded)
+			success = video_input_start_thread(input, video);
+
+		if (!success) {
+			video_input_destroy(video, input);
+		} else {
 			if (video->inputs.num == 0) {
 				if (!os_atomic_load_long(&video->gpu_refs)) {
 					reset_frames(video);
@@ -469,13 +698,31 @@ void video_output_disconnect(video_t *video, void (*callback)(void *param, struc
 
 	video = get_root(video);
 
+	struct video_input *input = NULL;
+	bool detached = false;
+
 	pthread_mutex_lock(&video->input_mutex);
 
 	size_t idx = video_get_input_idx(video, callback, param);
 	if (idx != DARRAY_INVALID) {
-		video_input_free(video->inputs.array + idx);
+		input = video->inputs.array[idx];
 		da_erase(video->inputs, idx);
 
+		/* a callback may disconnect its own input; its thread cannot
+		 * join itself, so it is stopped here and joined on close */
+		if (input->threaded && pthread_equal(pthread_self(), input->thread)) {
+			os_atomic_set_bool(&input->stop, true);
+			da_push_back(video->detached_inputs, &input);
+			detached = true;
+		}
+
+		if (input->threaded && input->skipped_frames)
+			blog(LOG_INFO,
+			     "Video input stopped, number of "
+			     "skipped frames due to encoding lag: "
+			     "%ld/%ld",
+			     input->skipped_frames, input->total_frames);
+
 		if (video->inputs.num == 0) {
 			os_atomic_set_bool(&video->raw_active, false);
 			if (!os_atomic_load_long(&video->gpu_refs)) {
@@ -485,6 +732,19 @@ void video_output_disconnect(video_t *video, void (*callback)(void *param, struc
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
+
+	/* the input thread may be blocked on input_mutex in its callback, so
+	 * it can only be joined after the mutex has been released */
+	if (input && !detached)
+		video_input_free(video, input);
+
+	free_exited_inputs(video);
+}
+
+void video_output_set_threaded_inputs(video_t *video, bool enable)
+{
+	if (video)
+		os_atomic_set_bool(&get_root(video)->threaded_inputs, enable);
 }
 
 bool video_output_active(const video_t *video)
@@ -499,42 +759,58 @@ const struct video_output_info *video_output_get_info(const video_t *video)
 	return video ? &video->info : NULL;
 }
 
+/* Appends repeats to the most recently published frame.  Fails if the video
+ * thread has already finished dispatching that frame. */
+static bool add_frame_repeats(struct video_output *video, int count)
+{
+	size_t last = video->write_idx ? video->write_idx - 1 : video->info.cache_size - 1;
+	struct cached_frame_info *cfi = &video->cache[last];
+	long skipped = os_atomic_load_long(&cfi->skipped);
+	long cur = os_atomic_load_long(&cfi->count);
+
+	while (!os_atomic_compare_exchange_long(&cfi->skipped, &skipped, skipped + count))
+		;
+
+	while (cur > 0) {
+		if (os_atomic_compare_exchange_long(&cfi->count, &cur, cur + count))
+			return true;
+	}
+
+	return false;
+}
+
 bool video_output_lock_frame(video_t *video, struct video_frame *frame, int count, uint64_t timestamp)
 {
 	struct cached_frame_info *cfi;
-	bool locked;
 
 	if (!video)
 		return false;
 
 	video = get_root(video);
 
-	pthread_mutex_lock(&video->data_mutex);
-
-	if (video->available_frames == 0) {
-		video->cache[video->last_added].count += count;
-		video->cache[video->last_added].skipped += count;
-		locked = false;
+	if (os_atomic_load_long(&video->queued_frames) == (long)video->info.cache_size) {
+		if (add_frame_repeats(video, count))
+			return false;
 
-	} else {
-		if (video->available_frames != video->info.cache_size) {
-			if (++video->last_added == video->info.cache_size)
-				video->last_added = 0;
+		/* the newest frame has already been dispatched, but threaded
+		 * inputs are still holding every slot, so drop this one */
+		if (os_atomic_load_long(&video->queued_frames) == (long)video->info.cache_size) {
+			for (int i = 0; i < count; i++) {
+				os_atomic_inc_long(&video->total_frames);
+				os_atomic_inc_long(&video->skipped_frames);
+			}
+			return false;
 		}
-
-		cfi = &video->cache[video->last_added];
-		cfi->frame.timestamp = timestamp;
-		cfi->count = count;
-		cfi->skipped = 0;
-
-		memcpy(frame, &cfi->frame, sizeof(*frame));
-
-		locked = true;
 	}
 
-	pthread_mutex_unlock(&video->data_mutex);
+	cfi = &video->cache[video->write_idx];
+	cfi->frame.timestamp = timestamp;
+	os_atomic_set_long(&cfi->count, count);
+	os_atomic_set_long(&cfi->skipped, 0);
+	os_atomic_set_long(&cfi->refs, 1);
 
-	return locked;
+	memcpy(frame, &cfi->frame, sizeof(*frame));
+	return true;
 }
 
 void video_output_unlock_frame(video_t *video)
@@ -544,12 +820,12 @@ void video_output_unlock_frame(video_t *video)
 
 	video = get_root(video);
 
-	pthread_mutex_lock(&video->data_mutex);
+	if (++video->write_idx == video->info.cache_size)
+		video->write_idx = 0;
 
-	video->available_frames--;
+	/* publishes the slot to the video thread */
+	os_atomic_inc_long(&video->queued_frames);
 	os_sem_post(video->update_semaphore);
-
-	pthread_mutex_unlock(&video->data_mutex);
 }
 
 uint64_t video_output_get_frame_time(const video_t *video)
@@ -303,8 +303,12 @@ EXPORT bool video_output_connect(video_t *video, const struct video_scale_info *
 EXPORT bool video_output_connect2(video_t *video, const struct video_scale_info *conversion,
 				  uint32_t frame_rate_divisor, void (*callback)(void *param, struct video_data *frame),
 				  void *param);
+EXPORT bool video_output_connect3(video_t *video, const struct video_scale_info *conversion,
+				  uint32_t frame_rate_divisor, bool threaded,
+				  void (*callback)(void *param, struct video_data *frame), void *param);
 EXPORT void video_output_disconnect(video_t *video, void (*callback)(void *param, struct video_data *frame),
 				    void *param);
+EXPORT void video_output_set_threaded_inputs(video_t *video, bool enable);
 
 EXPORT bool video_output_active(const video_t *video);
 
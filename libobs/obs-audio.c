@@ -18,6 +18,7 @@
 #include <inttypes.h>
 #include "obs-internal.h"
 #include "util/util_uint64.h"
+#include "media-io/audio-mix.h"
 
 struct ts_info {
 	uint64_t start;
@@ -40,13 +41,105 @@ static void push_audio_tree(obs_source_t *parent, obs_source_t *source, void *p)
 	UNUSED_PARAMETER(parent);
 }
 
+/* walks every output channel and audio source to find the sources to render,
+ * children before their parents */
+static void build_render_order(struct obs_core_audio *audio)
+{
+	struct obs_core_data *data = &obs->data;
+	struct obs_source *source;
+
+	pthread_mutex_lock(&obs->video.mixes_mutex);
+	for (size_t j = 0; j < obs->video.mixes.num; j++) {
+		struct obs_view *view = obs->video.mixes.array[j]->view;
+		if (!view)
+			continue;
+
+		pthread_mutex_lock(&view->channels_mutex);
+
+		/* NOTE: these are source channels, not audio channels */
+		for (uint32_t i = 0; i < MAX_CHANNELS; i++) {
+			obs_source_t *source = view->channels[i];
+			if (!source)
+				continue;
+			if (!obs_source_active(source))
+				continue;
+
+			obs_source_enum_active_tree(source, push_audio_tree, audio);
+			push_audio_tree(NULL, source, audio);
+
+			if (obs->video.mixes.array[j] == obs->video.main_mix)
+				da_push_back(audio->root_nodes, &source);
+		}
+		pthread_mutex_unlock(&view->channels_mutex);
+	}
+	pthread_mutex_unlock(&obs->video.mixes_mutex);
+
+	pthread_mutex_lock(&data->audio_sources_mutex);
+
+	source = data->first_audio_source;
+	while (source) {
+		push_audio_tree(NULL, source, audio);
+		source = (struct obs_source *)source->next_audio_source;
+	}
+
+	pthread_mutex_unlock(&data->audio_sources_mutex);
+}
+
+static void cache_render_order(struct obs_core_audio *audio)
+{
+	for (size_t i = 0; i < audio->cached_render_order.num; i++)
+		obs_weak_source_release(audio->cached_render_order.array[i]);
+
+	da_resize(audio->cached_render_order, audio->render_order.num);
+	da_resize(audio->cached_root_nodes, 0);
+
+	for (size_t i = 0; i < audio->render_order.num; i++)
+		audio->cached_render_order.array[i] = obs_source_get_weak_source(audio->render_order.array[i]);
+
+	for (size_t i = 0; i < audio->root_nodes.num; i++) {
+		size_t idx = da_find(audio->render_order, &audio->root_nodes.array[i], 0);
+		if (idx != DARRAY_INVALID)
+			da_push_back(audio->cached_root_nodes, &idx);
+	}
+}
+
+/* takes references to the cached render order, skipping sources that have
+ * been destroyed since, which are left as NULL */
+static void restore_render_order(struct obs_core_audio *audio)
+{
+	da_resize(audio->render_order, audio->cached_render_order.num);
+
+	for (size_t i = 0; i < audio->cached_render_order.num; i++)
+		audio->render_order.array[i] = obs_weak_source_get_source(audio->cached_render_order.array[i]);
+
+	for (size_t i = 0; i < audio->cached_root_nodes.num; i++) {
+		obs_source_t *source = audio->render_order.array[audio->cached_root_nodes.array[i]];
+		if (source)
+			da_push_back(audio->root_nodes, &source);
+	}
+}
+
+static void update_render_order(struct obs_core_audio *audio)
+{
+	long version = os_atomic_load_long(&audio->render_order_version);
+
+	if (version == audio->cached_render_order_version) {
+		restore_render_order(audio);
+		return;
+	}
+
+	build_render_order(audio);
+	cache_render_order(audio);
+	audio->cached_render_order_version = version;
+}
+
 static inline size_t convert_time_to_frames(size_t sample_rate, uint64_t t)
 {
 	return (size_t)util_mul_div64(t, sample_rate, 1000000000ULL);
 }
 
-static inline void mix_audio(struct audio_output_data *mixes, obs_source_t *source, size_t channels, size_t sample_rate,
-			     struct ts_info *ts)
+static inline void mix_audio(struct audio_output_data *mixes, obs_source_t *source, uint32_t mixers, size_t channels,
+			     size_t sample_rate, struct ts_info *ts)
 {
 	size_t total_floats = AUDIO_OUTPUT_FRAMES;
 	size_t start_point = 0;
@@ -63,16 +156,14 @@ static inline void mix_audio(struct audio_output_data *mixes, obs_source_t *sour
 	}
 
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
-		for (size_t ch = 0; ch < channels; ch++) {
-			register float *mix = mixes[mix_idx].data[ch];
-			register float *aud = source->audio_output_buf[mix_idx][ch];
-			register float *end;
+		if ((mixers & (1 << mix_idx)) == 0)
+			continue;
 
-			mix += start_point;
-			end = aud + total_floats;
+		for (size_t ch = 0; ch < channels; ch++) {
+			float *mix = mixes[mix_idx].data[ch];
+			const float *aud = source->audio_output_buf[mix_idx][ch];
 
-			while (aud < end)
-				*(mix++) += *(aud++);
+			audio_mix_add(mix + start_point, aud, total_floats);
 		}
 	}
 }
@@ -465,6 +556,87 @@ static inline void execute_audio_tasks(void)
 	}
 }
 
+struct audio_render_info {
+	struct obs_core_audio *audio;
+	uint32_t mixers;
+	size_t channels;
+	size_t sample_rate;
+	size_t audio_size;
+	uint64_t start_ts;
+};
+
+static void render_audio_source(struct audio_render_info *info, obs_source_t *source)
+{
+	obs_source_audio_render(source, info->mixers, info->channels, info->sample_rate, info->audio_size);
+
+	/* if a source has gone backward in time and we can no
+	 * longer buffer, drop some or all of its audio */
+	if (audio_buffering_maxed(info->audio) && source->audio_ts != 0 && source->audio_ts < info->start_ts) {
+		if (source->info.audio_render) {
+			blog(LOG_DEBUG,
+			     "render audio source %s timestamp has "
+			     "gone backwards",
+			     obs_source_get_name(source));
+
+			/* just avoid further damage */
+			source->audio_pending = true;
+#if DEBUG_AUDIO == 1
+			/* this should really be fixed */
+			assert(false);
+#endif
+		} else {
+			pthread_mutex_lock(&source->audio_buf_mutex);
+			bool rerender = ignore_audio(source, info->channels, info->sample_rate, info->start_ts);
+			pthread_mutex_unlock(&source->audio_buf_mutex);
+
+			/* if we (potentially) recovered, re-render */
+			if (rerender)
+				obs_source_audio_render(source, info->mixers, info->channels, info->sample_rate,
+							info->audio_size);
+		}
+	}
+}
+
+/* sources that never read the audio of other sources can be rendered in any
+ * order, and concurrently with each other */
+static inline bool audio_render_independent(const obs_source_t *source)
+{
+	return !source->info.audio_render && !source->info.enum_active_sources &&
+	       source->info.type != OBS_SOURCE_TYPE_TRANSITION;
+}
+
+static void render_audio_sources(void *param, uint32_t start, uint32_t end)
+{
+	struct audio_render_info *info = param;
+
+	for (uint32_t i = start; i < end; i++)
+		render_audio_source(info, info->audio->parallel_sources.array[i]);
+}
+
+/* renders the independent sources on the task pool, returns true if they no
+ * longer need to be rendered in order */
+static bool render_independent_sources(struct audio_render_info *info)
+{
+	struct obs_core_audio *audio = info->audio;
+
+	if (!os_atomic_load_bool(&obs->audio_parallel_render) || !obs->task_pool)
+		return false;
+
+	da_resize(audio->parallel_sources, 0);
+
+	for (size_t i = 0; i < audio->render_order.num; i++) {
+		obs_source_t *source = audio->render_order.array[i];
+		if (source && audio_render_independent(source))
+			da_push_back(audio->parallel_sources, &source);
+	}
+
+	if (audio->parallel_sources.num < 2)
+		return false;
+
+	os_task_pool_for(obs->task_pool, (uint32_t)audio->parallel_sources.num, 1, render_audio_sources, info);
+	return true;
+}
+
 bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in, uint64_t *out_ts, uint32_t mixers,
 		    struct audio_output_data *mixes)
 {
@@ -492,74 +664,21 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in, uint6
 
 	/* ------------------------------------------------ */
 	/* build audio render order */
-
-	pthread_mutex_lock(&obs->video.mixes_mutex);
-	for (size_t j = 0; j < obs->video.mixes.num; j++) {
-		struct obs_view *view = obs->video.mixes.array[j]->view;
-		if (!view)
-			continue;
-
-		pthread_mutex_lock(&view->channels_mutex);
-
-		/* NOTE: these are source channels, not audio channels */
-		for (uint32_t i = 0; i < MAX_CHANNELS; i++) {
-			obs_source_t *source = view->channels[i];
-			if (!source)
-				continue;
-			if (!obs_source_active(source))
-				continue;
-
-			obs_source_enum_active_tree(source, push_audio_tree, audio);
-			push_audio_tree(NULL, source, audio);
-
-			if (obs->video.mixes.array[j] == obs->video.main_mix)
-				da_push_back(audio->root_nodes, &source);
-		}
-		pthread_mutex_unlock(&view->channels_mutex);
-	}
-	pthread_mutex_unlock(&obs->video.mixes_mutex);
-
-	pthread_mutex_lock(&data->audio_sources_mutex);
-
-	source = data->first_audio_source;
-	while (source) {
-		push_audio_tree(NULL, source, audio);
-		source = (struct obs_source *)source->next_audio_source;
-	}
-
-	pthread_mutex_unlock(&data->audio_sources_mutex);
+	update_render_order(audio);
 
 	/* ------------------------------------------------ */
 	/* render audio data */
+	struct audio_render_info render = {audio, mixers, channels, sample_rate, audio_size, ts.start};
+	bool parallel = render_independent_sources(&render);
+
 	for (size_t i = 0; i < audio->render_order.num; i++) {
 		obs_source_t *source = audio->render_order.array[i];
-		obs_source_audio_render(source, mixers, channels, sample_rate, audio_size);
-
-		/* if a source has gone backward in time and we can no
-		 * longer buffer, drop some or all of its audio */
-		if (audio_buffering_maxed(audio) && source->audio_ts != 0 && source->audio_ts < ts.start) {
-			if (source->info.audio_render) {
-				blog(LOG_DEBUG,
-				     "render audio source %s timestamp has "
-				     "gone backwards",
-				     obs_source_get_name(source));
-
-				/* just avoid further damage */
-				source->audio_pending = true;
-#if DEBUG_AUDIO == 1
-				/* this should really be fixed */
-				assert(false);
-#endif
-			} else {
-				pthread_mutex_lock(&source->audio_buf_mutex);
-				bool rerender = ignore_audio(source, channels, sample_rate, ts.start);
-				pthread_mutex_unlock(&source->audio_buf_mutex);
-
-				/* if we (potentially) recovered, re-render */
-				if (rerender)
-					obs_source_audio_render(source, mixers, channels, sample_rate, audio_size);
-			}
-		}
+		if (!source)
+			continue;
+		if (parallel && audio_render_independent(source))
+			continue;
+
+		render_audio_source(&render, source);
 	}
 
 	/* ------------------------------------------------ */
@@ -590,7 +709,7 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in, uint6
 			pthread_mutex_lock(&source->audio_buf_mutex);
 
 			if (source->audio_output_buf[0][0] && source->audio_ts)
-				mix_audio(mixes, source, channels, sample_rate, &ts);
+				mix_audio(mixes, source, mixers, channels, sample_rate, &ts);
 
 			pthread_mutex_unlock(&source->audio_buf_mutex);
 		}
@@ -65,6 +65,10 @@ static bool init_encoder(struct obs_encoder *encoder, const char *name, obs_data
 	if (pthread_mutex_init(&encoder->roi_mutex, NULL) != 0)
 		return false;
 
+	encoder->packet_pool = encoder_packet_pool_create();
+	if (!encoder->packet_pool)
+		return false;
+
 	if (encoder->orig_info.get_defaults) {
 		encoder->orig_info.get_defaults(encoder->context.settings);
 	}
@@ -307,7 +311,11 @@ static void add_connection(struct obs_encoder *encoder)
 		if (gpu_encode_available(encoder)) {
 			start_gpu_encode(encoder);
 		} else {
-			start_raw_video(encoder->media, &info, encoder->frame_rate_divisor, receive_video, encoder);
+			/* a thread per encoder skips frames independently, which
+			 * would break the frame alignment of grouped encoders */
+			bool threaded = os_atomic_load_bool(&obs->video_encoder_threads) && !encoder->encoder_group;
+			start_raw_video(encoder->media, &info, encoder->frame_rate_divisor, threaded, receive_video,
+					encoder);
 		}
 	}
 
@@ -388,6 +396,7 @@ void obs_encoder_destroy(obs_encoder_t *encoder)
 		da_free(encoder->callbacks);
 		da_free(encoder->roi);
 		da_free(encoder->encoder_packet_times);
+		encoder_packet_pool_destroy(encoder->packet_pool);
 		pthread_mutex_destroy(&encoder->init_mutex);
 		pthread_mutex_destroy(&encoder->callbacks_mutex);
 		pthread_mutex_destroy(&encoder->outputs_mutex);
@@ -1722,14 +1731,175 @@ void obs_encoder_remove_output(struct obs_encoder *encoder, struct obs_output *o
 	pthread_mutex_unlock(&encoder->outputs_mutex);
 }
 
+/* ------------------------------------------------------------------------- */
+/* packet buffer pool                                                        */
+
+/*
+ * Packet data is preceded by a long reference count, which plugins also rely
+ * on when they build their own packets.  Buffers that come from a pool have
+ * POOL_REF_FLAG set in the reference count, and a pool_block header in front
+ * of it, so that the last release can hand them back to the pool instead of
+ * freeing them.
+ *
+ * Buffers are grouped in size classes four to a power of two, so a buffer is
+ * at most 25% larger than its packet.  Packets can sit in delay and replay
+ * buffers for a long time, so this keeps their resident size close to what
+ * plain allocations would use.  Each buffer holds a reference to its pool, so
+ * the pool outlives its encoder for as long as outputs still hold packets
+ * from it.
+ */
+
+#define POOL_REF_FLAG (1L << 30)
+#define POOL_MIN_CLASS_SHIFT 8
+#define POOL_MAX_CLASS_SHIFT 23
+#define POOL_CLASS_STEPS 4
+#define POOL_CLASSES ((POOL_MAX_CLASS_SHIFT - POOL_MIN_CLASS_SHIFT) * POOL_CLASS_STEPS + 1)
+
+/* free buffers kept around per encoder, in bytes */
+#define POOL_MAX_CACHED (32 * 1024 * 1024)
+
+struct pool_block {
+	struct encoder_packet_pool *pool;
+	struct pool_block *next;
+	size_t size_class;
+};
+
+struct encoder_packet_pool {
+	volatile long refs;
+	bool destroyed;
+
+	pthread_mutex_t mutex;
+	struct pool_block *free_blocks[POOL_CLASSES];
+	size_t cached_bytes;
+};
+
+static inline size_t pool_class_size(size_t size_class)
+{
+	size_t shift = size_class / POOL_CLASS_STEPS + POOL_MIN_CLASS_SHIFT;
+	size_t step = size_class % POOL_CLASS_STEPS;
+
+	return ((size_t)1 << shift) + step * (((size_t)1 << shift) / POOL_CLASS_STEPS);
+}
+
+static inline long *pool_block_refs(struct pool_block *block)
+{
+	return (long *)(block + 1);
+}
+
+static inline struct pool_block *pool_block_from_refs(long *p_refs)
+{
+	return (struct pool_block *)p_refs - 1;
+}
+
+struct encoder_packet_pool *encoder_packet_pool_create(void)
+{
+	struct encoder_packet_pool *pool = bzalloc(sizeof(*pool));
+
+	if (pthread_mutex_init(&pool->mutex, NULL) != 0) {
+		bfree(pool);
+		return NULL;
+	}
+
+	pool->refs = 1;
+	return pool;
+}
+
+static void free_pool_blocks(struct encoder_packet_pool *pool)
+{
+	for (size_t i = 0; i < POOL_CLASSES; i++) {
+		struct pool_block *block = pool->free_blocks[i];
+		while (block) {
+			struct pool_block *next = block->next;
+			bfree(block);
+			block = next;
+		}
+
+		pool->free_blocks[i] = NULL;
+	}
+
+	pool->cached_bytes = 0;
+}
+
+static void encoder_packet_pool_release(struct encoder_packet_pool *pool)
+{
+	if (os_atomic_dec_long(&pool->refs) == 0) {
+		pthread_mutex_destroy(&pool->mutex);
+		bfree(pool);
+	}
+}
+
+void encoder_packet_pool_destroy(struct encoder_packet_pool *pool)
+{
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->destroyed = true;
+	free_pool_blocks(pool);
+	pthread_mutex_unlock(&pool->mutex);
+
+	encoder_packet_pool_release(pool);
+}
+
+static long *pool_alloc(struct encoder_packet_pool *pool, size_t size)
+{
+	size_t size_class = 0;
+	struct pool_block *block;
+
+	while (pool_class_size(size_class) < size)
+		size_class++;
+
+	pthread_mutex_lock(&pool->mutex);
+	block = pool->free_blocks[size_class];
+	if (block) {
+		pool->free_blocks[size_class] = block->next;
+		pool->cached_bytes -= pool_class_size(size_class);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (!block) {
+		block = bmalloc(sizeof(*block) + sizeof(long) + pool_class_size(size_class));
+		block->pool = pool;
+		block->size_class = size_class;
+	}
+
+	os_atomic_inc_long(&pool->refs);
+	*pool_block_refs(block) = POOL_REF_FLAG | 1;
+	return pool_block_refs(block);
+}
+
+static void pool_free(long *p_refs)
+{
+	struct pool_block *block = pool_block_from_refs(p_refs);
+	struct encoder_packet_pool *pool = block->pool;
+	size_t bytes = pool_class_size(block->size_class);
+
+	pthread_mutex_lock(&pool->mutex);
+	if (!pool->destroyed && pool->cached_bytes + bytes <= POOL_MAX_CACHED) {
+		block->next = pool->free_blocks[block->size_class];
+		pool->free_blocks[block->size_class] = block;
+		pool->cached_bytes += bytes;
+		block = NULL;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	bfree(block);
+	encoder_packet_pool_release(pool);
+}
+
 void obs_encoder_packet_create_instance(struct encoder_packet *dst, const struct encoder_packet *src)
 {
+	struct encoder_packet_pool *pool = src->encoder ? src->encoder->packet_pool : NULL;
 	long *p_refs;
 
 	*dst = *src;
-	p_refs = bmalloc(src->size + sizeof(long));
+	if (pool && src->size <= pool_class_size(POOL_CLASSES - 1)) {
+		p_refs = pool_alloc(pool, src->size);
+	} else {
+		p_refs = bmalloc(src->size + sizeof(long));
+		*p_refs = 1;
+	}
 	dst->data = (void *)(p_refs + 1);
-	*p_refs = 1;
 	memcpy(dst->data, src->data, src->size);
 }
 
@@ -1753,8 +1923,12 @@ void obs_encoder_packet_release(struct encoder_packet *pkt)
 
 	if (pkt->data) {
 		long *p_refs = ((long *)pkt->data) - 1;
-		if (os_atomic_dec_long(p_refs) == 0)
+		long refs = os_atomic_dec_long(p_refs);
+
+		if (refs == 0)
 			bfree(p_refs);
+		else if (refs == POOL_REF_FLAG)
+			pool_free(p_refs);
 	}
 
 	memset(pkt, 0, sizeof(struct encoder_packet));
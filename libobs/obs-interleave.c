@@ -0,0 +1,173 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "obs-interleave.h"
+
+/* popped entries are only erased from the front of a track once there are at
+ * least this many of them, to keep pops O(1) amortized */
+#define MIN_TRACK_COMPACT 64
+
+bool interleave_entry_before(const struct interleave_entry *a, const struct interleave_entry *b)
+{
+	const struct encoder_packet *pa = &a->packet;
+	const struct encoder_packet *pb = &b->packet;
+
+	if (pa->dts_usec != pb->dts_usec)
+		return pa->dts_usec < pb->dts_usec;
+
+	/* sort video packets with same DTS by track index, to prevent the
+	 * pruning logic from removing additional video tracks */
+	if (pa->type != pb->type)
+		return pa->type == OBS_ENCODER_VIDEO;
+	if (pa->type == OBS_ENCODER_VIDEO && pa->track_idx != pb->track_idx)
+		return pa->track_idx < pb->track_idx;
+
+	return a->seq < b->seq;
+}
+
+static inline bool track_before(struct interleave_queue *iq, size_t a, size_t b)
+{
+	return interleave_entry_before(interleave_track_entry(&iq->tracks[a], 0),
+				       interleave_track_entry(&iq->tracks[b], 0));
+}
+
+static inline void heap_set(struct interleave_queue *iq, size_t pos, size_t track)
+{
+	iq->heap[pos] = track;
+	iq->heap_pos[track] = pos;
+}
+
+static void heap_sift_up(struct interleave_queue *iq, size_t pos)
+{
+	size_t track = iq->heap[pos];
+
+	while (pos) {
+		size_t parent = (pos - 1) / 2;
+		if (!track_before(iq, track, iq->heap[parent]))
+			break;
+
+		heap_set(iq, pos, iq->heap[parent]);
+		pos = parent;
+	}
+
+	heap_set(iq, pos, track);
+}
+
+static void heap_sift_down(struct interleave_queue *iq, size_t pos)
+{
+	size_t track = iq->heap[pos];
+
+	for (;;) {
+		size_t child = pos * 2 + 1;
+		if (child >= iq->heap_size)
+			break;
+		if (child + 1 < iq->heap_size && track_before(iq, iq->heap[child + 1], iq->heap[child]))
+			child++;
+		if (!track_before(iq, iq->heap[child], track))
+			break;
+
+		heap_set(iq, pos, iq->heap[child]);
+		pos = child;
+	}
+
+	heap_set(iq, pos, track);
+}
+
+static void heap_remove(struct interleave_queue *iq, size_t track)
+{
+	size_t pos = iq->heap_pos[track];
+	size_t last = iq->heap[--iq->heap_size];
+
+	if (pos == iq->heap_size)
+		return;
+
+	heap_set(iq, pos, last);
+	heap_sift_down(iq, pos);
+	heap_sift_up(iq, iq->heap_pos[last]);
+}
+
+void interleave_queue_free(struct interleave_queue *iq)
+{
+	for (size_t i = 0; i < INTERLEAVE_MAX_TRACKS; i++) {
+		struct interleave_track *track = &iq->tracks[i];
+
+		for (size_t j = track->start; j < track->entries.num; j++)
+			obs_encoder_packet_release(&track->entries.array[j].packet);
+		da_free(track->entries);
+	}
+
+	memset(iq, 0, sizeof(*iq));
+}
+
+void interleave_queue_push(struct interleave_queue *iq, struct encoder_packet *packet)
+{
+	size_t track_id = interleave_track_index(packet->type, packet->track_idx);
+	struct interleave_track *track = &iq->tracks[track_id];
+	struct interleave_entry entry = {*packet, iq->next_seq++};
+	size_t count = interleave_track_count(track);
+	size_t idx = count;
+
+	/* encoders output monotonic DTS, so this is almost always an append */
+	while (idx && interleave_entry_before(&entry, interleave_track_entry(track, idx - 1)))
+		idx--;
+
+	if (idx == count)
+		da_push_back(track->entries, &entry);
+	else
+		da_insert(track->entries, track->start + idx, &entry);
+	iq->num++;
+
+	if (!count) {
+		heap_set(iq, iq->heap_size++, track_id);
+		heap_sift_up(iq, iq->heap_size - 1);
+	} else if (!idx) {
+		heap_sift_up(iq, iq->heap_pos[track_id]);
+	}
+}
+
+bool interleave_queue_pop(struct interleave_queue *iq, struct encoder_packet *packet)
+{
+	if (!iq->heap_size)
+		return false;
+
+	size_t track_id = iq->heap[0];
+	struct interleave_track *track = &iq->tracks[track_id];
+
+	*packet = interleave_track_entry(track, 0)->packet;
+	iq->num--;
+
+	if (++track->start == track->entries.num) {
+		track->start = 0;
+		da_resize(track->entries, 0);
+		heap_remove(iq, track_id);
+		return true;
+	}
+
+	if (track->start >= MIN_TRACK_COMPACT && track->start * 2 >= track->entries.num) {
+		da_erase_range(track->entries, 0, track->start);
+		track->start = 0;
+	}
+
+	heap_sift_down(iq, 0);
+	return true;
+}
+
+void interleave_queue_resort(struct interleave_queue *iq)
+{
+	/* timestamp offsets are per track, so only the order between tracks
+	 * can change */
+	for (size_t i = iq->heap_size / 2; i > 0; i--)
+		heap_sift_down(iq, i - 1);
+}
@@ -0,0 +1,104 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "util/darray.h"
+#include "obs.h"
+
+/*
+ * Interleaved packet queue used by outputs.
+ *
+ * Packets are kept in one queue per encoder track, and the tracks are merged
+ * by a min-heap keyed on the first packet of each track.  Packets are ordered
+ * by dts_usec; on equal timestamps video comes before audio, video tracks are
+ * ordered by track index, and otherwise packets keep their insertion order.
+ */
+
+#define INTERLEAVE_MAX_TRACKS (MAX_OUTPUT_VIDEO_ENCODERS + MAX_OUTPUT_AUDIO_ENCODERS)
+
+struct interleave_entry {
+	struct encoder_packet packet;
+	uint64_t seq;
+};
+
+struct interleave_track {
+	DARRAY(struct interleave_entry) entries;
+	size_t start;
+};
+
+struct interleave_queue {
+	struct interleave_track tracks[INTERLEAVE_MAX_TRACKS];
+	size_t heap[INTERLEAVE_MAX_TRACKS];
+	size_t heap_pos[INTERLEAVE_MAX_TRACKS];
+	size_t heap_size;
+	size_t num;
+	uint64_t next_seq;
+};
+
+/* releases all queued packets */
+extern void interleave_queue_free(struct interleave_queue *iq);
+
+/* takes ownership of the packet */
+extern void interleave_queue_push(struct interleave_queue *iq, struct encoder_packet *packet);
+extern bool interleave_queue_pop(struct interleave_queue *iq, struct encoder_packet *packet);
+
+/* re-sorts the queue after timestamps of queued packets have changed */
+extern void interleave_queue_resort(struct interleave_queue *iq);
+
+/* true if a is ordered before b */
+extern bool interleave_entry_before(const struct interleave_entry *a, const struct interleave_entry *b);
+
+static inline size_t interleave_queue_size(const struct interleave_queue *iq)
+{
+	return iq->num;
+}
+
+static inline size_t interleave_track_index(enum obs_encoder_type type, size_t track_idx)
+{
+	return type == OBS_ENCODER_VIDEO ? track_idx : MAX_OUTPUT_VIDEO_ENCODERS + track_idx;
+}
+
+static inline size_t interleave_track_count(const struct interleave_track *track)
+{
+	return track->entries.num - track->start;
+}
+
+static inline struct interleave_entry *interleave_track_entry(struct interleave_track *track, size_t idx)
+{
+	return &track->entries.array[track->start + idx];
+}
+
+static inline struct interleave_entry *interleave_queue_front(struct interleave_queue *iq)
+{
+	if (!iq->heap_size)
+		return NULL;
+	return interleave_track_entry(&iq->tracks[iq->heap[0]], 0);
+}
+
+static inline struct interleave_entry *interleave_queue_first(struct interleave_queue *iq, enum obs_encoder_type type,
+							      size_t track_idx)
+{
+	struct interleave_track *track = &iq->tracks[interleave_track_index(type, track_idx)];
+	return interleave_track_count(track) ? interleave_track_entry(track, 0) : NULL;
+}
+
+static inline struct interleave_entry *interleave_queue_last(struct interleave_queue *iq, enum obs_encoder_type type,
+							     size_t track_idx)
+{
+	struct interleave_track *track = &iq->tracks[interleave_track_index(type, track_idx)];
+	size_t count = interleave_track_count(track);
+	return count ? interleave_track_entry(track, count - 1) : NULL;
+}
@@ -38,6 +38,7 @@
 #include "media-io/audio-io.h"
 
 #include "obs.h"
+#include "obs-interleave.h"
 
 #include <obsversion.h>
 #include <caption/caption.h>
@@ -378,6 +379,15 @@ struct obs_core_audio {
 	DARRAY(struct obs_source *) render_order;
 	DARRAY(struct obs_source *) root_nodes;
 
+	/* render order from the last audio graph walk, only walked again once
+	 * render_order_version changes */
+	volatile long render_order_version;
+	long cached_render_order_version;
+	DARRAY(obs_weak_source_t *) cached_render_order;
+	DARRAY(size_t) cached_root_nodes;
+
+	DARRAY(struct obs_source *) parallel_sources;
+
 	uint64_t buffered_ts;
 	struct deque buffered_timestamps;
 	uint64_t buffering_wait_ticks;
@@ -394,7 +404,19 @@ struct obs_core_audio {
 	struct deque tasks;
 };
 
+/* frames shared between the async video caches of all sources */
+struct async_frame_pool {
+	pthread_mutex_t mutex;
+	DARRAY(struct obs_source_frame *) frames;
+	size_t size;
+};
+
 /* user sources, output channels, and displays */
+struct parallel_tick {
+	obs_source_t *source;
+	uint64_t tick_ns;
+};
+
 struct obs_core_data {
 	/* Hash tables (uthash) */
 	struct obs_source *sources;        /* Lookup by UUID (hh_uuid) */
@@ -402,6 +424,7 @@ struct obs_core_data {
 
 	/* Linked lists */
 	struct obs_source *first_audio_source;
+	struct obs_source *first_tick_source;
 	struct obs_display *first_display;
 	struct obs_output *first_output;
 	struct obs_encoder *first_encoder;
@@ -413,6 +436,7 @@ struct obs_core_data {
 	pthread_mutex_t encoders_mutex;
 	pthread_mutex_t services_mutex;
 	pthread_mutex_t audio_sources_mutex;
+	pthread_mutex_t tick_sources_mutex;
 	pthread_mutex_t draw_callbacks_mutex;
 	DARRAY(struct draw_callback) draw_callbacks;
 	DARRAY(struct rendered_callback) rendered_callbacks;
@@ -428,6 +452,9 @@ struct obs_core_data {
 
 	DARRAY(char *) protocols;
 	DARRAY(obs_source_t *) sources_to_tick;
+	DARRAY(struct parallel_tick) parallel_ticks;
+
+	struct async_frame_pool async_frame_pool;
 };
 
 /* user hotkeys */
@@ -496,12 +523,25 @@ struct obs_core {
 	struct obs_core_hotkeys hotkeys;
 
 	os_task_queue_t *destruction_task_thread;
+	os_task_pool_t *task_pool;
+	volatile bool audio_parallel_render;
+	volatile bool video_encoder_threads;
 
 	obs_task_handler_t ui_task_handler;
 };
 
+/* frames at least this tall are copied in bands on the libobs task pool */
+#define MIN_THREADED_COPY_HEIGHT 1080
+
 extern struct obs_core *obs;
 
+/* called whenever the set of sources rendered by the audio thread may have
+ * changed: source activation, output channels, views and audio sources */
+static inline void invalidate_audio_render_order(void)
+{
+	os_atomic_inc_long(&obs->audio.render_order_version);
+}
+
 struct obs_graphics_context {
 	uint64_t last_time;
 	uint64_t interval;
@@ -526,7 +566,7 @@ extern bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in
 extern struct obs_core_video_mix *get_mix_for_video(video_t *video);
 
 extern void start_raw_video(video_t *video, const struct video_scale_info *conversion, uint32_t frame_rate_divisor,
-			    void (*callback)(void *param, struct video_data *frame), void *param);
+			    bool threaded, void (*callback)(void *param, struct video_data *frame), void *param);
 extern void stop_raw_video(video_t *video, void (*callback)(void *param, struct video_data *frame), void *param);
 
 /* ------------------------------------------------------------------------- */
@@ -635,12 +675,74 @@ static inline bool obs_weak_ref_expired(struct obs_weak_ref *ref)
 /* ------------------------------------------------------------------------- */
 /* sources  */
 
+/* a cached frame is unused once the cache holds the only reference to it */
 struct async_frame {
 	struct obs_source_frame *frame;
 	long unused_count;
-	bool used;
 };
 
+#define MAX_ASYNC_FRAMES 30
+#define ASYNC_FRAME_QUEUE_SIZE 32
+
+/* Async frames are passed from the thread outputting video to the graphics
+ * thread through a single-producer/single-consumer ring.  head is only
+ * written by the producer and tail only by the consumer, and each queued
+ * frame holds its own reference.  Producers are serialized by
+ * async_cache_mutex and consumers by async_mutex, so neither side ever waits
+ * on the other.  The producer cannot drop queued frames itself; it asks the
+ * consumer to discard everything up to flush_to instead. */
+struct async_frame_queue {
+	struct obs_source_frame *frames[ASYNC_FRAME_QUEUE_SIZE];
+	volatile long head;
+	volatile long tail;
+	volatile long flush_to;
+	volatile bool flush;
+};
+
+static inline size_t async_frame_queue_count(struct async_frame_queue *queue)
+{
+	unsigned long tail = (unsigned long)os_atomic_load_long(&queue->tail);
+	unsigned long head = (unsigned long)os_atomic_load_long(&queue->head);
+	return (size_t)(head - tail);
+}
+
+/* consumer only, idx must be less than the queue count */
+static inline struct obs_source_frame *async_frame_queue_peek(struct async_frame_queue *queue, size_t idx)
+{
+	unsigned long pos = (unsigned long)os_atomic_load_long(&queue->tail) + idx;
+	return queue->frames[pos % ASYNC_FRAME_QUEUE_SIZE];
+}
+
+/* consumer only, the queue must not be empty */
+static inline struct obs_source_frame *async_frame_queue_pop(struct async_frame_queue *queue)
+{
+	unsigned long tail = (unsigned long)os_atomic_load_long(&queue->tail);
+	struct obs_source_frame *frame = queue->frames[tail % ASYNC_FRAME_QUEUE_SIZE];
+
+	os_atomic_set_long(&queue->tail, (long)(tail + 1));
+	return frame;
+}
+
+/* producer only, fails if MAX_ASYNC_FRAMES frames are already queued */
+static inline bool async_frame_queue_push(struct async_frame_queue *queue, struct obs_source_frame *frame)
+{
+	unsigned long head = (unsigned long)os_atomic_load_long(&queue->head);
+
+	if (async_frame_queue_count(queue) >= MAX_ASYNC_FRAMES)
+		return false;
+
+	queue->frames[head % ASYNC_FRAME_QUEUE_SIZE] = frame;
+	os_atomic_set_long(&queue->head, (long)(head + 1));
+	return true;
+}
+
+/* producer only */
+static inline void async_frame_queue_request_flush(struct async_frame_queue *queue)
+{
+	os_atomic_set_long(&queue->flush_to, os_atomic_load_long(&queue->head));
+	os_atomic_set_bool(&queue->flush, true);
+}
+
 enum audio_action_type {
 	AUDIO_ACTION_VOL,
 	AUDIO_ACTION_MUTE,
@@ -725,6 +827,12 @@ struct obs_source {
 	bool active;
 	bool showing;
 
+	/* sources that need video_tick, see obs_source_schedule_tick */
+	struct obs_source *next_tick_source;
+	struct obs_source **prev_next_tick_source;
+	volatile bool tick_requested;
+	bool ticking;
+
 	/* used to temporarily disable sources if needed */
 	bool enabled;
 
@@ -794,7 +902,8 @@ struct obs_source {
 	bool async_decoupled;
 	struct obs_source_frame *async_preload_frame;
 	DARRAY(struct async_frame) async_cache;
-	DARRAY(struct obs_source_frame *) async_frames;
+	pthread_mutex_t async_cache_mutex;
+	struct async_frame_queue async_queue;
 	pthread_mutex_t async_mutex;
 	uint32_t async_width;
 	uint32_t async_height;
@@ -989,6 +1098,9 @@ extern void obs_source_set_texcoords_centered(obs_source_t *source, bool centere
 extern void obs_source_activate(obs_source_t *source, enum view_type type);
 extern void obs_source_deactivate(obs_source_t *source, enum view_type type);
 extern void obs_source_video_tick(obs_source_t *source, float seconds);
+extern void obs_source_video_tick_state(obs_source_t *source, float seconds);
+extern void obs_source_schedule_tick(obs_source_t *source);
+extern void obs_source_unschedule_tick(obs_source_t *source);
 extern float obs_source_get_target_volume(obs_source_t *source, obs_source_t *target);
 extern uint64_t obs_source_get_last_async_ts(const obs_source_t *source);
 
@@ -1005,6 +1117,9 @@ extern bool update_async_textures(struct obs_source *source, const struct obs_so
 extern bool set_async_texture_size(struct obs_source *source, const struct obs_source_frame *frame);
 extern void remove_async_frame(obs_source_t *source, struct obs_source_frame *frame);
 
+extern bool async_frame_pool_init(struct async_frame_pool *pool);
+extern void async_frame_pool_free(struct async_frame_pool *pool);
+
 extern void set_deinterlace_texture_size(obs_source_t *source);
 extern void deinterlace_process_last_frame(obs_source_t *source, uint64_t sys_time);
 extern void deinterlace_update_async_video(obs_source_t *source);
@@ -1095,7 +1210,7 @@ struct obs_output {
 	pthread_t end_data_capture_thread;
 	os_event_t *stopping_event;
 	pthread_mutex_t interleaved_mutex;
-	DARRAY(struct encoder_packet) interleaved_packets;
+	struct interleave_queue interleaved_packets;
 	int stop_code;
 
 	int reconnect_retry_sec;
@@ -1297,6 +1412,9 @@ struct obs_encoder {
 
 	DARRAY(struct encoder_packet_time) encoder_packet_times;
 
+	/* recycled packet buffers for obs_encoder_packet_create_instance */
+	struct encoder_packet_pool *packet_pool;
+
 	struct pause_data pause;
 
 	const char *profile_encoder_encode_name;
@@ -1317,6 +1435,10 @@ extern void obs_encoder_stop(obs_encoder_t *encoder, encoded_callback_t new_pack
 extern void obs_encoder_add_output(struct obs_encoder *encoder, struct obs_output *output);
 extern void obs_encoder_remove_output(struct obs_encoder *encoder, struct obs_output *output);
 
+struct encoder_packet_pool;
+extern struct encoder_packet_pool *encoder_packet_pool_create(void);
+extern void encoder_packet_pool_destroy(struct encoder_packet_pool *pool);
+
 extern bool start_gpu_encode(obs_encoder_t *encoder);
 extern void stop_gpu_encode(obs_encoder_t *encoder);
 
@@ -1376,6 +1498,8 @@ extern void source_profiler_async_frame_received(obs_source_t *source);
 extern uint64_t source_profiler_source_tick_start(void);
 /* Submit start timestamp for source */
 extern void source_profiler_source_tick_end(obs_source_t *source, uint64_t start);
+/* Submit tick duration for source (for ticks not measured in one piece) */
+extern void source_profiler_source_tick_time(obs_source_t *source, uint64_t duration);
 
 /* Obtain GPU timer and start timestamp for render start of a source. */
 extern uint64_t source_profiler_source_render_begin(gs_timer_t **timer);
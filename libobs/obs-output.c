@@ -228,9 +228,7 @@ fail:
 
 static inline void free_packets(struct obs_output *output)
 {
-	for (size_t i = 0; i < output->interleaved_packets.num; i++)
-		obs_encoder_packet_release(output->interleaved_packets.array + i);
-	da_free(output->interleaved_packets);
+	interleave_queue_free(&output->interleaved_packets);
 }
 
 static inline void clear_raw_audio_buffers(obs_output_t *output)
@@ -1646,17 +1644,18 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 
 static inline void send_interleaved(struct obs_output *output)
 {
-	struct encoder_packet out = output->interleaved_packets.array[0];
+	struct interleave_entry *front = interleave_queue_front(&output->interleaved_packets);
+	struct encoder_packet out;
 	struct encoder_packet_time ept_local = {0};
 	bool found_ept = false;
 
 	/* do not send an interleaved packet if there's no packet of the
 	 * opposing type of a higher timestamp in the interleave buffer.
 	 * this ensures that the timestamps are monotonic */
-	if (!has_higher_opposing_ts(output, &out))
+	if (!has_higher_opposing_ts(output, &front->packet))
 		return;
 
-	da_erase(output->interleaved_packets, 0);
+	interleave_queue_pop(&output->interleaved_packets, &out);
 
 	if (out.type == OBS_ENCODER_VIDEO) {
 		output->total_frames++;
@@ -1741,35 +1740,46 @@ static inline void set_higher_ts(struct obs_output *output, struct encoder_packe
 }
 
 static inline struct encoder_packet *find_first_packet_type(struct obs_output *output, enum obs_encoder_type type,
-							    size_t audio_idx);
-static int find_first_packet_type_idx(struct obs_output *output, enum obs_encoder_type type, size_t audio_idx);
+							    size_t idx)
+{
+	struct interleave_entry *entry = interleave_queue_first(&output->interleaved_packets, type, idx);
+	return entry ? &entry->packet : NULL;
+}
+
+static inline struct encoder_packet *find_last_packet_type(struct obs_output *output, enum obs_encoder_type type,
+							   size_t idx)
+{
+	struct interleave_entry *entry = interleave_queue_last(&output->interleaved_packets, type, idx);
+	return entry ? &entry->packet : NULL;
+}
 
 /* gets the point where audio and video are closest together */
-static size_t get_interleaved_start_idx(struct obs_output *output)
+static struct interleave_entry *get_interleaved_start(struct obs_output *output)
 {
+	struct interleave_queue *iq = &output->interleaved_packets;
 	int64_t closest_diff = 0x7FFFFFFFFFFFFFFFLL;
-	struct encoder_packet *first_video = find_first_packet_type(output, OBS_ENCODER_VIDEO, 0);
-	size_t video_idx = DARRAY_INVALID;
-	size_t idx = 0;
+	struct interleave_entry *first_video = interleave_queue_first(iq, OBS_ENCODER_VIDEO, 0);
+	struct interleave_entry *start = NULL;
 
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet = &output->interleaved_packets.array[i];
-		int64_t diff;
+	for (size_t i = 0; i < MAX_OUTPUT_AUDIO_ENCODERS; i++) {
+		struct interleave_track *track = &iq->tracks[interleave_track_index(OBS_ENCODER_AUDIO, i)];
 
-		if (packet->type != OBS_ENCODER_AUDIO) {
-			if (packet == first_video)
-				video_idx = i;
-			continue;
-		}
+		for (size_t j = 0; j < interleave_track_count(track); j++) {
+			struct interleave_entry *entry = interleave_track_entry(track, j);
+			int64_t diff = llabs(entry->packet.dts_usec - first_video->packet.dts_usec);
+			bool earlier = start && interleave_entry_before(entry, start);
 
-		diff = llabs(packet->dts_usec - first_video->dts_usec);
-		if (diff < closest_diff) {
-			closest_diff = diff;
-			idx = i;
+			if (diff < closest_diff || (diff == closest_diff && earlier)) {
+				closest_diff = diff;
+				start = entry;
+			}
 		}
 	}
 
-	return video_idx < idx ? video_idx : idx;
+	if (!start)
+		return interleave_queue_front(iq);
+
+	return interleave_entry_before(first_video, start) ? first_video : start;
 }
 
 static int64_t get_encoder_duration(struct obs_encoder *encoder)
@@ -1777,44 +1787,40 @@ static int64_t get_encoder_duration(struct obs_encoder *encoder)
 	return (encoder->timebase_num * 1000000LL / encoder->timebase_den) * encoder->framesize;
 }
 
-static int prune_premature_packets(struct obs_output *output)
+static int prune_premature_packets(struct obs_output *output, struct interleave_entry **prune_to)
 {
-	struct encoder_packet *video;
-	int video_idx;
-	int max_idx;
+	struct interleave_entry *video;
+	struct interleave_entry *last;
 	int64_t duration_usec, max_audio_duration_usec = 0;
 	int64_t max_diff = 0;
 	int64_t diff = 0;
 	int audio_encoders = 0;
 
-	video_idx = find_first_packet_type_idx(output, OBS_ENCODER_VIDEO, 0);
-	if (video_idx == -1)
+	video = interleave_queue_first(&output->interleaved_packets, OBS_ENCODER_VIDEO, 0);
+	if (!video)
 		return -1;
 
-	max_idx = video_idx;
-	video = &output->interleaved_packets.array[video_idx];
-	duration_usec = video->timebase_num * 1000000LL / video->timebase_den;
+	last = video;
+	duration_usec = video->packet.timebase_num * 1000000LL / video->packet.timebase_den;
 
 	for (size_t i = 0; i < MAX_OUTPUT_AUDIO_ENCODERS; i++) {
-		struct encoder_packet *audio;
-		int audio_idx;
+		struct interleave_entry *audio;
 		int64_t audio_duration_usec = 0;
 
 		if (!output->audio_encoders[i])
 			continue;
 		audio_encoders++;
 
-		audio_idx = find_first_packet_type_idx(output, OBS_ENCODER_AUDIO, i);
-		if (audio_idx == -1) {
+		audio = interleave_queue_first(&output->interleaved_packets, OBS_ENCODER_AUDIO, i);
+		if (!audio) {
 			output->received_audio = false;
 			return -1;
 		}
 
-		audio = &output->interleaved_packets.array[audio_idx];
-		if (audio_idx > max_idx)
-			max_idx = audio_idx;
+		if (interleave_entry_before(last, audio))
+			last = audio;
 
-		diff = audio->dts_usec - video->dts_usec;
+		diff = audio->packet.dts_usec - video->packet.dts_usec;
 		if (diff > max_diff)
 			max_diff = diff;
 
@@ -1833,91 +1839,74 @@ static int prune_premature_packets(struct obs_output *output)
 		duration_usec = max_audio_duration_usec;
 	}
 
-	return diff > duration_usec ? max_idx + 1 : 0;
+	*prune_to = last;
+	return diff > duration_usec ? 1 : 0;
 }
 
-static void discard_to_idx(struct obs_output *output, size_t idx)
+static void discard_front_packet(struct obs_output *output)
 {
-	for (size_t i = 0; i < idx; i++) {
-		struct encoder_packet *packet = &output->interleaved_packets.array[i];
-		if (packet->type == OBS_ENCODER_VIDEO) {
-			da_pop_front(output->encoder_packet_times[packet->track_idx]);
-		}
-		obs_encoder_packet_release(packet);
+	struct encoder_packet packet;
+
+	interleave_queue_pop(&output->interleaved_packets, &packet);
+	if (packet.type == OBS_ENCODER_VIDEO) {
+		da_pop_front(output->encoder_packet_times[packet.track_idx]);
 	}
+	obs_encoder_packet_release(&packet);
+}
 
-	da_erase_range(output->interleaved_packets, 0, idx);
+/* discards all packets ordered before the given packet, and the packet itself
+ * if inclusive is set.  returns true if any packets were discarded */
+static bool discard_to_entry(struct obs_output *output, const struct interleave_entry *entry, bool inclusive)
+{
+	const struct interleave_entry target = *entry;
+	struct interleave_entry *front;
+	bool discarded = false;
+
+	while ((front = interleave_queue_front(&output->interleaved_packets)) != NULL) {
+		bool before = interleave_entry_before(front, &target);
+		if (!before && !(inclusive && front->seq == target.seq))
+			break;
+
+		discard_front_packet(output);
+		discarded = true;
+	}
+
+	return discarded;
 }
 
 #define DEBUG_STARTING_PACKETS 0
 
 static bool prune_interleaved_packets(struct obs_output *output)
 {
-	size_t start_idx = 0;
-	int prune_start = prune_premature_packets(output);
+	struct interleave_entry *prune_to = NULL;
+	int prune = prune_premature_packets(output, &prune_to);
 
 #if DEBUG_STARTING_PACKETS == 1
-	blog(LOG_DEBUG, "--------- Pruning! %d ---------", prune_start);
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet = &output->interleaved_packets.array[i];
-		blog(LOG_DEBUG, "packet: %s %d, ts: %lld, pruned = %s",
-		     packet->type == OBS_ENCODER_AUDIO ? "audio" : "video", (int)packet->track_idx, packet->dts_usec,
-		     (int)i < prune_start ? "true" : "false");
+	blog(LOG_DEBUG, "--------- Pruning! %d ---------", prune);
+	for (size_t i = 0; i < INTERLEAVE_MAX_TRACKS; i++) {
+		struct interleave_track *track = &output->interleaved_packets.tracks[i];
+		for (size_t j = 0; j < interleave_track_count(track); j++) {
+			struct interleave_entry *entry = interleave_track_entry(track, j);
+			struct encoder_packet *packet = &entry->packet;
+			bool pruned = prune == 1 && (entry == prune_to || interleave_entry_before(entry, prune_to));
+			blog(LOG_DEBUG, "packet: %s %d, ts: %lld, pruned = %s",
+			     packet->type == OBS_ENCODER_AUDIO ? "audio" : "video", (int)packet->track_idx,
+			     packet->dts_usec, pruned ? "true" : "false");
+		}
 	}
 #endif
 
 	/* prunes the first video packet if it's too far away from audio */
-	if (prune_start == -1)
+	if (prune == -1)
 		return false;
-	else if (prune_start != 0)
-		start_idx = (size_t)prune_start;
+	else if (prune != 0)
+		discard_to_entry(output, prune_to, true);
 	else
-		start_idx = get_interleaved_start_idx(output);
-
-	if (start_idx)
-		discard_to_idx(output, start_idx);
+		discard_to_entry(output, get_interleaved_start(output), false);
 
 	return true;
 }
 
-static int find_first_packet_type_idx(struct obs_output *output, enum obs_encoder_type type, size_t idx)
-{
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet = &output->interleaved_packets.array[i];
-
-		if (packet->type == type && packet->track_idx == idx)
-			return (int)i;
-	}
-
-	return -1;
-}
-
-static int find_last_packet_type_idx(struct obs_output *output, enum obs_encoder_type type, size_t idx)
-{
-	for (size_t i = output->interleaved_packets.num; i > 0; i--) {
-		struct encoder_packet *packet = &output->interleaved_packets.array[i - 1];
-
-		if (packet->type == type && packet->track_idx == idx)
-			return (int)(i - 1);
-	}
-
-	return -1;
-}
-
-static inline struct encoder_packet *find_first_packet_type(struct obs_output *output, enum obs_encoder_type type,
-							    size_t audio_idx)
-{
-	int idx = find_first_packet_type_idx(output, type, audio_idx);
-	return (idx != -1) ? &output->interleaved_packets.array[idx] : NULL;
-}
-
-static inline struct encoder_packet *find_last_packet_type(struct obs_output *output, enum obs_encoder_type type,
-							   size_t audio_idx)
-{
-	int idx = find_last_packet_type_idx(output, type, audio_idx);
-	return (idx != -1) ? &output->interleaved_packets.array[idx] : NULL;
-}
-
 static bool get_audio_and_video_packets(struct obs_output *output, struct encoder_packet **video,
 					struct encoder_packet **audio)
 {
@@ -1952,7 +1941,6 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	struct encoder_packet *video[MAX_OUTPUT_VIDEO_ENCODERS] = {0};
 	struct encoder_packet *audio[MAX_OUTPUT_AUDIO_ENCODERS] = {0};
 	struct encoder_packet *last_audio[MAX_OUTPUT_AUDIO_ENCODERS] = {0};
-	size_t start_idx;
 	size_t first_audio_idx;
 	size_t first_video_idx;
 
@@ -1981,9 +1969,7 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	}
 
 	/* clear out excess starting audio if it hasn't been already */
-	start_idx = get_interleaved_start_idx(output);
-	if (start_idx) {
-		discard_to_idx(output, start_idx);
+	if (discard_to_entry(output, get_interleaved_start(output), false)) {
 		if (!get_audio_and_video_packets(output, video, audio))
 			return false;
 	}
@@ -2014,67 +2000,36 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	output->highest_audio_ts -= audio[first_audio_idx]->dts_usec;
 
 	/* apply new offsets to all existing packet DTS/PTS values */
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet = &output->interleaved_packets.array[i];
-		apply_interleaved_packet_offset(output, packet, NULL);
+	for (size_t i = 0; i < INTERLEAVE_MAX_TRACKS; i++) {
+		struct interleave_track *track = &output->interleaved_packets.tracks[i];
+		for (size_t j = 0; j < interleave_track_count(track); j++)
+			apply_interleaved_packet_offset(output, &interleave_track_entry(track, j)->packet, NULL);
 	}
 
 	return true;
 }
 
-static inline void insert_interleaved_packet(struct obs_output *output, struct encoder_packet *out)
-{
-	size_t idx;
-	for (idx = 0; idx < output->interleaved_packets.num; idx++) {
-		struct encoder_packet *cur_packet;
-		cur_packet = output->interleaved_packets.array + idx;
-
-		// sort video packets with same DTS by track index,
-		// to prevent the pruning logic from removing additional
-		// video tracks
-		if (out->dts_usec == cur_packet->dts_usec && out->type == OBS_ENCODER_VIDEO &&
-		    cur_packet->type == OBS_ENCODER_VIDEO && out->track_idx > cur_packet->track_idx)
-			continue;
-
-		if (out->dts_usec == cur_packet->dts_usec && out->type == OBS_ENCODER_VIDEO) {
-			break;
-		} else if (out->dts_usec < cur_packet->dts_usec) {
-			break;
-		}
-	}
-
-	da_insert(output->interleaved_packets, idx, out);
-}
-
 static void resort_interleaved_packets(struct obs_output *output)
 {
-	DARRAY(struct encoder_packet) old_array;
-
-	old_array.da = output->interleaved_packets.da;
-	memset(&output->interleaved_packets, 0, sizeof(output->interleaved_packets));
-
-	for (size_t i = 0; i < old_array.num; i++) {
-		set_higher_ts(output, &old_array.array[i]);
-
-		insert_interleaved_packet(output, &old_array.array[i]);
+	for (size_t i = 0; i < INTERLEAVE_MAX_TRACKS; i++) {
+		struct interleave_track *track = &output->interleaved_packets.tracks[i];
+		for (size_t j = 0; j < interleave_track_count(track); j++)
+			set_higher_ts(output, &interleave_track_entry(track, j)->packet);
 	}
 
-	da_free(old_array);
+	interleave_queue_resort(&output->interleaved_packets);
 }
 
 static void discard_unused_audio_packets(struct obs_output *output, int64_t dts_usec)
 {
-	size_t idx = 0;
-
-	for (; idx < output->interleaved_packets.num; idx++) {
-		struct encoder_packet *p = &output->interleaved_packets.array[idx];
+	struct interleave_entry *front;
 
-		if (p->dts_usec >= dts_usec)
+	while ((front = interleave_queue_front(&output->interleaved_packets)) != NULL) {
+		if (front->packet.dts_usec >= dts_usec)
 			break;
-	}
 
-	if (idx)
-		discard_to_idx(output, idx);
+		discard_front_packet(output);
+	}
 }
 
 static bool purge_encoder_group_keyframe_data(obs_output_t *output, size_t idx)
@@ -2203,7 +2158,7 @@ static void interleave_packets(void *data, struct encoder_packet *packet, struct
 	else
 		check_received(output, packet);
 
-	insert_interleaved_packet(output, &out);
+	interleave_queue_push(&output->interleaved_packets, &out);
 
 	received_video = true;
 	for (size_t i = 0; i < MAX_OUTPUT_VIDEO_ENCODERS; i++) {
@@ -2443,7 +2398,7 @@ static void hook_data_capture(struct obs_output *output)
 			start_video_encoders(output, encoded_callback);
 	} else {
 		if (has_video)
-			start_raw_video(output->video, obs_output_get_video_conversion(output), 1,
+			start_raw_video(output->video, obs_output_get_video_conversion(output), 1, false,
 					default_raw_video_callback, output);
 		if (has_audio)
 			start_raw_audio(output);
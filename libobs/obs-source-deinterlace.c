@@ -19,7 +19,7 @@
 
 static bool ready_deinterlace_frames(obs_source_t *source, uint64_t sys_time)
 {
-	struct obs_source_frame *next_frame = source->async_frames.array[0];
+	struct obs_source_frame *next_frame = async_frame_queue_peek(&source->async_queue, 0);
 	struct obs_source_frame *prev_frame = NULL;
 	struct obs_source_frame *frame = NULL;
 	uint64_t sys_offset = sys_time - source->last_sys_timestamp;
@@ -28,17 +28,17 @@ static bool ready_deinterlace_frames(obs_source_t *source, uint64_t sys_time)
 	size_t idx = 1;
 
 	if (source->async_unbuffered) {
-		while (source->async_frames.num > 2) {
-			da_erase(source->async_frames, 0);
+		while (async_frame_queue_count(&source->async_queue) > 2) {
+			async_frame_queue_pop(&source->async_queue);
 			remove_async_frame(source, next_frame);
-			next_frame = source->async_frames.array[0];
+			next_frame = async_frame_queue_peek(&source->async_queue, 0);
 		}
 
-		if (source->async_frames.num == 2) {
+		if (async_frame_queue_count(&source->async_queue) == 2) {
 			bool prev_frame = true;
 			if (source->async_unbuffered && source->deinterlace_offset) {
-				const uint64_t timestamp = source->async_frames.array[0]->timestamp;
-				const uint64_t after_timestamp = source->async_frames.array[1]->timestamp;
+				const uint64_t timestamp = next_frame->timestamp;
+				const uint64_t after_timestamp = async_frame_queue_peek(&source->async_queue, 1)->timestamp;
 				const uint64_t duration = after_timestamp - timestamp;
 				const uint64_t frame_end = timestamp + source->deinterlace_offset + duration;
 				if (sys_time < frame_end) {
@@ -47,7 +47,7 @@ static bool ready_deinterlace_frames(obs_source_t *source, uint64_t sys_time)
 					source->deinterlace_frame_ts = timestamp - duration;
 				}
 			}
-			source->async_frames.array[0]->prev_frame = prev_frame;
+			next_frame->prev_frame = prev_frame;
 		}
 		source->deinterlace_offset = 0;
 		source->last_frame_ts = next_frame->timestamp;
@@ -74,17 +74,17 @@ static bool ready_deinterlace_frames(obs_source_t *source, uint64_t sys_time)
 			break;
 
 		if (prev_frame) {
-			da_erase(source->async_frames, 0);
+			async_frame_queue_pop(&source->async_queue);
 			remove_async_frame(source, prev_frame);
 		}
 
-		if (source->async_frames.num <= 2) {
+		if (async_frame_queue_count(&source->async_queue) <= 2) {
 			bool exit = true;
 
 			if (prev_frame) {
 				prev_frame->prev_frame = true;
 
-			} else if (!frame && source->async_frames.num == 2) {
+			} else if (!frame && async_frame_queue_count(&source->async_queue) == 2) {
 				exit = false;
 			}
 
@@ -101,7 +101,7 @@ static bool ready_deinterlace_frames(obs_source_t *source, uint64_t sys_time)
 
 		prev_frame = frame;
 		frame = next_frame;
-		next_frame = source->async_frames.array[idx];
+		next_frame = async_frame_queue_peek(&source->async_queue, idx);
 
 		/* more timestamp checking and compensating */
 		if ((next_frame->timestamp - frame_time) > MAX_TS_VAR) {
@@ -124,8 +124,8 @@ static inline bool first_frame(obs_source_t *s)
 	if (s->last_frame_ts)
 		return false;
 
-	if (s->async_frames.num >= 2)
-		s->async_frames.array[0]->prev_frame = true;
+	if (async_frame_queue_count(&s->async_queue) >= 2)
+		async_frame_queue_peek(&s->async_queue, 0)->prev_frame = true;
 	return true;
 }
 
@@ -154,7 +154,7 @@ static inline void deinterlace_get_closest_frames(obs_source_t *s, uint64_t sys_
 		}
 	}
 
-	if (!s->async_frames.num)
+	if (!async_frame_queue_count(&s->async_queue))
 		return;
 
 	half_interval = obs->video.video_half_frame_interval_ns;
@@ -163,15 +163,11 @@ static inline void deinterlace_get_closest_frames(obs_source_t *s, uint64_t sys_
 		uint64_t offset;
 
 		s->prev_async_frame = NULL;
-		s->cur_async_frame = s->async_frames.array[0];
+		s->cur_async_frame = async_frame_queue_pop(&s->async_queue);
 
-		da_erase(s->async_frames, 0);
-
-		if ((s->async_frames.num > 0) && s->cur_async_frame->prev_frame) {
+		if ((async_frame_queue_count(&s->async_queue) > 0) && s->cur_async_frame->prev_frame) {
 			s->prev_async_frame = s->cur_async_frame;
-			s->cur_async_frame = s->async_frames.array[0];
-
-			da_erase(s->async_frames, 0);
+			s->cur_async_frame = async_frame_queue_pop(&s->async_queue);
 
 			s->deinterlace_half_duration =
 				(uint32_t)((s->cur_async_frame->timestamp - s->prev_async_frame->timestamp) / 2);
@@ -21,6 +21,7 @@
 #include "media-io/format-conversion.h"
 #include "media-io/video-frame.h"
 #include "media-io/audio-io.h"
+#include "media-io/audio-mix.h"
 #include "util/threading.h"
 #include "util/platform.h"
 #include "util/util_uint64.h"
@@ -176,6 +177,7 @@ static bool obs_source_init(struct obs_source *source)
 	source->audio_active = true;
 	pthread_mutex_init_value(&source->filter_mutex);
 	pthread_mutex_init_value(&source->async_mutex);
+	pthread_mutex_init_value(&source->async_cache_mutex);
 	pthread_mutex_init_value(&source->audio_mutex);
 	pthread_mutex_init_value(&source->audio_buf_mutex);
 	pthread_mutex_init_value(&source->audio_cb_mutex);
@@ -194,6 +196,8 @@ static bool obs_source_init(struct obs_source *source)
 		return false;
 	if (pthread_mutex_init_recursive(&source->async_mutex) != 0)
 		return false;
+	if (pthread_mutex_init(&source->async_cache_mutex, NULL) != 0)
+		return false;
 	if (pthread_mutex_init(&source->caption_cb_mutex, NULL) != 0)
 		return false;
 	if (pthread_mutex_init(&source->media_actions_mutex, NULL) != 0)
@@ -218,6 +222,61 @@ static bool obs_source_init(struct obs_source *source)
 	return true;
 }
 
+static inline bool source_needs_tick(const struct obs_source *source)
+{
+	/* async sources keep ticking so that their frame queue does not fill
+	 * up with stale frames while they are hidden */
+	if ((source->info.output_flags & (OBS_SOURCE_TICK_WHILE_HIDDEN | OBS_SOURCE_ASYNC)) != 0)
+		return true;
+
+	return os_atomic_load_bool(&source->tick_requested) || os_atomic_load_long(&source->show_refs) > 0 ||
+	       source->showing || source->active || os_atomic_load_long(&source->defer_update_count) > 0;
+}
+
+static inline void remove_tick_source(struct obs_source *source)
+{
+	if (!source->prev_next_tick_source)
+		return;
+
+	*source->prev_next_tick_source = source->next_tick_source;
+	if (source->next_tick_source)
+		source->next_tick_source->prev_next_tick_source = source->prev_next_tick_source;
+
+	source->next_tick_source = NULL;
+	source->prev_next_tick_source = NULL;
+}
+
+/* adds the source to the list of sources ticked by the graphics thread.  call
+ * after changing whatever state the next tick needs to act on. */
+void obs_source_schedule_tick(obs_source_t *source)
+{
+	pthread_mutex_lock(&obs->data.tick_sources_mutex);
+
+	os_atomic_set_bool(&source->tick_requested, true);
+
+	if (!source->prev_next_tick_source) {
+		source->next_tick_source = obs->data.first_tick_source;
+		source->prev_next_tick_source = &obs->data.first_tick_source;
+		if (obs->data.first_tick_source)
+			obs->data.first_tick_source->prev_next_tick_source = &source->next_tick_source;
+		obs->data.first_tick_source = source;
+	}
+
+	pthread_mutex_unlock(&obs->data.tick_sources_mutex);
+}
+
+/* called after the source has been ticked: removes it from the tick list once
+ * it is hidden, inactive and has nothing else pending */
+void obs_source_unschedule_tick(obs_source_t *source)
+{
+	pthread_mutex_lock(&obs->data.tick_sources_mutex);
+
+	if (!source_needs_tick(source))
+		remove_tick_source(source);
+
+	pthread_mutex_unlock(&obs->data.tick_sources_mutex);
+}
+
 static void obs_source_init_finalize(struct obs_source *source)
 {
 	if (is_audio_source(source)) {
@@ -230,8 +289,13 @@ static void obs_source_init_finalize(struct obs_source *source)
 		obs->data.first_audio_source = source;
 
 		pthread_mutex_unlock(&obs->data.audio_sources_mutex);
+
+		invalidate_audio_render_order();
 	}
 
+	if (source_needs_tick(source))
+		obs_source_schedule_tick(source);
+
 	if (!source->context.private) {
 		obs_context_data_insert_name(&source->context, &obs->data.sources_mutex, &obs->data.public_sources);
 	}
@@ -563,10 +627,109 @@ void obs_source_frame_init(struct obs_source_frame *frame, enum video_format for
 	}
 }
 
+/* ------------------------------------------------------------------------- */
+/* async frame pool                                                          */
+
+/* upper bound on the memory held by unused frames in the pool */
+#define MAX_POOLED_FRAME_BYTES (128 * 1024 * 1024)
+
+static size_t get_frame_size(const struct obs_source_frame *frame)
+{
+	uint32_t heights[MAX_AV_PLANES] = {0};
+	size_t size = 0;
+
+	video_frame_get_plane_heights(heights, frame->format, frame->height);
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++)
+		size += (size_t)frame->linesize[i] * heights[i];
+	return size;
+}
+
+bool async_frame_pool_init(struct async_frame_pool *pool)
+{
+	da_init(pool->frames);
+	pool->size = 0;
+	return pthread_mutex_init(&pool->mutex, NULL) == 0;
+}
+
+void async_frame_pool_free(struct async_frame_pool *pool)
+{
+	for (size_t i = 0; i < pool->frames.num; i++)
+		obs_source_frame_destroy(pool->frames.array[i]);
+
+	da_free(pool->frames);
+	pool->size = 0;
+	pthread_mutex_destroy(&pool->mutex);
+}
+
+/* returns a frame with its own planes allocated and all other fields reset,
+ * reusing a pooled frame of the same format and size when one is free */
+static struct obs_source_frame *async_frame_pool_get(enum video_format format, uint32_t width, uint32_t height)
+{
+	struct async_frame_pool *pool = &obs->data.async_frame_pool;
+	struct obs_source_frame *frame = NULL;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	for (size_t i = pool->frames.num; i > 0; i--) {
+		struct obs_source_frame *cur = pool->frames.array[i - 1];
+
+		if (cur->format == format && cur->width == width && cur->height == height) {
+			pool->size -= get_frame_size(cur);
+			da_erase(pool->frames, i - 1);
+			frame = cur;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (!frame)
+		return obs_source_frame_create(format, width, height);
+
+	struct obs_source_frame planes = *frame;
+
+	memset(frame, 0, sizeof(*frame));
+	memcpy(frame->data, planes.data, sizeof(frame->data));
+	memcpy(frame->linesize, planes.linesize, sizeof(frame->linesize));
+	frame->format = format;
+	frame->width = width;
+	frame->height = height;
+	return frame;
+}
+
+/* takes a frame that is no longer referenced, evicting the oldest pooled
+ * frames if the pool would grow past its limit */
+static void async_frame_pool_release(struct obs_source_frame *frame)
+{
+	struct async_frame_pool *pool = &obs->data.async_frame_pool;
+	size_t size = get_frame_size(frame);
+
+	if (size > MAX_POOLED_FRAME_BYTES) {
+		obs_source_frame_destroy(frame);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+
+	while (pool->frames.num && pool->size + size > MAX_POOLED_FRAME_BYTES) {
+		struct obs_source_frame *oldest = pool->frames.array[0];
+
+		pool->size -= get_frame_size(oldest);
+		da_erase(pool->frames, 0);
+		obs_source_frame_destroy(oldest);
+	}
+
+	da_push_back(pool->frames, &frame);
+	pool->size += size;
+
+	pthread_mutex_unlock(&pool->mutex);
+}
+
 static inline void obs_source_frame_decref(struct obs_source_frame *frame)
 {
 	if (os_atomic_dec_long(&frame->refs) == 0)
-		obs_source_frame_destroy(frame);
+		async_frame_pool_release(frame);
 }
 
 static bool obs_source_filter_remove_refless(obs_source_t *source, obs_source_t *filter);
@@ -603,9 +766,15 @@ void obs_source_destroy(struct obs_source *source)
 		*source->prev_next_audio_source = source->next_audio_source;
 		if (source->next_audio_source)
 			source->next_audio_source->prev_next_audio_source = source->prev_next_audio_source;
+
+		invalidate_audio_render_order();
 	}
 	pthread_mutex_unlock(&obs->data.audio_sources_mutex);
 
+	pthread_mutex_lock(&obs->data.tick_sources_mutex);
+	remove_tick_source(source);
+	pthread_mutex_unlock(&obs->data.tick_sources_mutex);
+
 	if (source->filter_parent)
 		obs_source_filter_remove_refless(source->filter_parent, source);
 
@@ -647,6 +816,10 @@ static void obs_source_destroy_defer(struct obs_source *source)
 
 	for (i = 0; i < source->async_cache.num; i++)
 		obs_source_frame_decref(source->async_cache.array[i].frame);
+	while (async_frame_queue_count(&source->async_queue))
+		obs_source_frame_decref(async_frame_queue_pop(&source->async_queue));
+	remove_async_frame(source, source->cur_async_frame);
+	remove_async_frame(source, source->prev_async_frame);
 
 	gs_enter_context(obs->video.graphics);
 	if (source->async_texrender)
@@ -680,7 +853,6 @@ static void obs_source_destroy_defer(struct obs_source *source)
 	da_free(source->audio_cb_list);
 	da_free(source->caption_cb_list);
 	da_free(source->async_cache);
-	da_free(source->async_frames);
 	da_free(source->filters);
 	da_free(source->media_actions);
 	pthread_mutex_destroy(&source->filter_mutex);
@@ -690,6 +862,7 @@ static void obs_source_destroy_defer(struct obs_source *source)
 	pthread_mutex_destroy(&source->audio_mutex);
 	pthread_mutex_destroy(&source->caption_cb_mutex);
 	pthread_mutex_destroy(&source->async_mutex);
+	pthread_mutex_destroy(&source->async_cache_mutex);
 	pthread_mutex_destroy(&source->media_actions_mutex);
 	obs_data_release(source->private_settings);
 	obs_context_data_free(&source->context);
@@ -930,6 +1103,7 @@ void obs_source_update(obs_source_t *source, obs_data_t *settings)
 
 	if (source->info.output_flags & OBS_SOURCE_VIDEO) {
 		os_atomic_inc_long(&source->defer_update_count);
+		obs_source_schedule_tick(source);
 	} else if (source->context.data && source->info.update) {
 		source->info.update(source->context.data, source->context.settings);
 		obs_source_dosignal(source, "source_update", "update");
@@ -1070,7 +1244,8 @@ static void deactivate_tree(obs_source_t *parent, obs_source_t *child, void *par
 
 static void show_tree(obs_source_t *parent, obs_source_t *child, void *param)
 {
-	os_atomic_inc_long(&child->show_refs);
+	if (os_atomic_inc_long(&child->show_refs) == 1)
+		obs_source_schedule_tick(child);
 
 	UNUSED_PARAMETER(parent);
 	UNUSED_PARAMETER(param);
@@ -1089,13 +1264,16 @@ void obs_source_activate(obs_source_t *source, enum view_type type)
 	if (!obs_source_valid(source, "obs_source_activate"))
 		return;
 
-	os_atomic_inc_long(&source->show_refs);
+	if (os_atomic_inc_long(&source->show_refs) == 1)
+		obs_source_schedule_tick(source);
 	obs_source_enum_active_tree(source, show_tree, NULL);
 
 	if (type == MAIN_VIEW) {
 		os_atomic_inc_long(&source->activate_refs);
 		obs_source_enum_active_tree(source, activate_tree, NULL);
 	}
+
+	invalidate_audio_render_order();
 }
 
 void obs_source_deactivate(obs_source_t *source, enum view_type type)
@@ -1114,9 +1292,11 @@ void obs_source_deactivate(obs_source_t *source, enum view_type type)
 			obs_source_enum_active_tree(source, deactivate_tree, NULL);
 		}
 	}
+	invalidate_audio_render_order();
 }
 
 static inline struct obs_source_frame *get_closest_frame(obs_source_t *source, uint64_t sys_time);
+static void flush_async_frames(obs_source_t *source);
 
 static void filter_frame(obs_source_t *source, struct obs_source_frame **ref_frame)
 {
@@ -1187,6 +1367,8 @@ static void async_tick(obs_source_t *source)
 
 	pthread_mutex_lock(&source->async_mutex);
 
+	flush_async_frames(source);
+
 	if (deinterlacing_enabled(source)) {
 		deinterlace_process_last_frame(source, sys_time);
 	} else {
@@ -1210,13 +1392,11 @@ static void async_tick(obs_source_t *source)
 	pthread_mutex_unlock(&source->async_mutex);
 }
 
-void obs_source_video_tick(obs_source_t *source, float seconds)
+/* everything a video tick does except calling the source's video_tick */
+void obs_source_video_tick_state(obs_source_t *source, float seconds)
 {
 	bool now_showing, now_active;
 
-	if (!obs_source_valid(source, "obs_source_video_tick"))
-		return;
-
 	if (source->info.type == OBS_SOURCE_TYPE_TRANSITION)
 		obs_transition_tick(source, seconds);
 
@@ -1279,13 +1459,21 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 		source->active = now_active;
 	}
 
-	if (source->context.data && source->info.video_tick)
-		source->info.video_tick(source->context.data, seconds);
-
 	source->async_rendered = false;
 	source->deinterlace_rendered = false;
 }
 
+void obs_source_video_tick(obs_source_t *source, float seconds)
+{
+	if (!obs_source_valid(source, "obs_source_video_tick"))
+		return;
+
+	obs_source_video_tick_state(source, seconds);
+
+	if (source->context.data && source->info.video_tick)
+		source->info.video_tick(source->context.data, seconds);
+}
+
 /* unless the value is 3+ hours worth of frames, this won't overflow */
 static inline uint64_t conv_frames_to_time(const size_t sample_rate, const size_t frames)
 {
@@ -3219,58 +3407,53 @@ static inline void copy_frame_data_line(struct obs_source_frame *dst, const stru
 }
 
 static inline void copy_frame_data_plane(struct obs_source_frame *dst, const struct obs_source_frame *src,
-					 uint32_t plane, uint32_t lines)
+					 uint32_t plane, uint32_t start, uint32_t end)
 {
 	if (dst->linesize[plane] != src->linesize[plane]) {
-		for (uint32_t y = 0; y < lines; y++)
+		for (uint32_t y = start; y < end; y++)
 			copy_frame_data_line(dst, src, plane, y);
 	} else {
-		memcpy(dst->data[plane], src->data[plane], (size_t)dst->linesize[plane] * (size_t)lines);
+		const size_t offset = (size_t)dst->linesize[plane] * (size_t)start;
+		memcpy(dst->data[plane] + offset, src->data[plane] + offset,
+		       (size_t)dst->linesize[plane] * (size_t)(end - start));
 	}
 }
 
-static void copy_frame_data(struct obs_source_frame *dst, const struct obs_source_frame *src)
+struct frame_copy_info {
+	struct obs_source_frame *dst;
+	const struct obs_source_frame *src;
+};
+
+/* copies rows [start_y, end_y) of every plane; start_y must be even */
+static void copy_frame_data_rows(void *param, uint32_t start_y, uint32_t end_y)
 {
-	dst->flip = src->flip;
-	dst->flags = src->flags;
-	dst->trc = src->trc;
-	dst->full_range = src->full_range;
-	dst->max_luminance = src->max_luminance;
-	dst->timestamp = src->timestamp;
-	memcpy(dst->color_matrix, src->color_matrix, sizeof(float) * 16);
-	if (!dst->full_range) {
-		size_t const size = sizeof(float) * 3;
-		memcpy(dst->color_range_min, src->color_range_min, size);
-		memcpy(dst->color_range_max, src->color_range_max, size);
-	}
+	struct frame_copy_info *copy = param;
+	struct obs_source_frame *dst = copy->dst;
+	const struct obs_source_frame *src = copy->src;
+	const uint32_t start_d2 = start_y / 2;
+	const uint32_t end_d2 = (end_y + 1) / 2;
 
 	switch (src->format) {
 	case VIDEO_FORMAT_I420:
-	case VIDEO_FORMAT_I010: {
-		const uint32_t height = dst->height;
-		const uint32_t half_height = (height + 1) / 2;
-		copy_frame_data_plane(dst, src, 0, height);
-		copy_frame_data_plane(dst, src, 1, half_height);
-		copy_frame_data_plane(dst, src, 2, half_height);
+	case VIDEO_FORMAT_I010:
+		copy_frame_data_plane(dst, src, 0, start_y, end_y);
+		copy_frame_data_plane(dst, src, 1, start_d2, end_d2);
+		copy_frame_data_plane(dst, src, 2, start_d2, end_d2);
 		break;
-	}
 
 	case VIDEO_FORMAT_NV12:
-	case VIDEO_FORMAT_P010: {
-		const uint32_t height = dst->height;
-		const uint32_t half_height = (height + 1) / 2;
-		copy_frame_data_plane(dst, src, 0, height);
-		copy_frame_data_plane(dst, src, 1, half_height);
+	case VIDEO_FORMAT_P010:
+		copy_frame_data_plane(dst, src, 0, start_y, end_y);
+		copy_frame_data_plane(dst, src, 1, start_d2, end_d2);
 		break;
-	}
 
 	case VIDEO_FORMAT_I444:
 	case VIDEO_FORMAT_I422:
 	case VIDEO_FORMAT_I210:
 	case VIDEO_FORMAT_I412:
-		copy_frame_data_plane(dst, src, 0, dst->height);
-		copy_frame_data_plane(dst, src, 1, dst->height);
-		copy_frame_data_plane(dst, src, 2, dst->height);
+		copy_frame_data_plane(dst, src, 0, start_y, end_y);
+		copy_frame_data_plane(dst, src, 1, start_y, end_y);
+		copy_frame_data_plane(dst, src, 2, start_y, end_y);
 		break;
 
 	case VIDEO_FORMAT_YVYU:
@@ -3285,26 +3468,23 @@ static void copy_frame_data(struct obs_source_frame *dst, const struct obs_sourc
 	case VIDEO_FORMAT_AYUV:
 	case VIDEO_FORMAT_V210:
 	case VIDEO_FORMAT_R10L:
-		copy_frame_data_plane(dst, src, 0, dst->height);
+		copy_frame_data_plane(dst, src, 0, start_y, end_y);
 		break;
 
-	case VIDEO_FORMAT_I40A: {
-		const uint32_t height = dst->height;
-		const uint32_t half_height = (height + 1) / 2;
-		copy_frame_data_plane(dst, src, 0, height);
-		copy_frame_data_plane(dst, src, 1, half_height);
-		copy_frame_data_plane(dst, src, 2, half_height);
-		copy_frame_data_plane(dst, src, 3, height);
+	case VIDEO_FORMAT_I40A:
+		copy_frame_data_plane(dst, src, 0, start_y, end_y);
+		copy_frame_data_plane(dst, src, 1, start_d2, end_d2);
+		copy_frame_data_plane(dst, src, 2, start_d2, end_d2);
+		copy_frame_data_plane(dst, src, 3, start_y, end_y);
 		break;
-	}
 
 	case VIDEO_FORMAT_I42A:
 	case VIDEO_FORMAT_YUVA:
 	case VIDEO_FORMAT_YA2L:
-		copy_frame_data_plane(dst, src, 0, dst->height);
-		copy_frame_data_plane(dst, src, 1, dst->height);
-		copy_frame_data_plane(dst, src, 2, dst->height);
-		copy_frame_data_plane(dst, src, 3, dst->height);
+		copy_frame_data_plane(dst, src, 0, start_y, end_y);
+		copy_frame_data_plane(dst, src, 1, start_y, end_y);
+		copy_frame_data_plane(dst, src, 2, start_y, end_y);
+		copy_frame_data_plane(dst, src, 3, start_y, end_y);
 		break;
 
 	case VIDEO_FORMAT_P216:
@@ -3314,6 +3494,27 @@ static void copy_frame_data(struct obs_source_frame *dst, const struct obs_sourc
 	}
 }
 
+static void copy_frame_data(struct obs_source_frame *dst, const struct obs_source_frame *src)
+{
+	dst->flip = src->flip;
+	dst->flags = src->flags;
+	dst->trc = src->trc;
+	dst->full_range = src->full_range;
+	dst->max_luminance = src->max_luminance;
+	dst->timestamp = src->timestamp;
+	memcpy(dst->color_matrix, src->color_matrix, sizeof(float) * 16);
+	if (!dst->full_range) {
+		size_t const size = sizeof(float) * 3;
+		memcpy(dst->color_range_min, src->color_range_min, size);
+		memcpy(dst->color_range_max, src->color_range_max, size);
+	}
+
+	struct frame_copy_info copy = {dst, src};
+	os_task_pool_t *pool = dst->height >= MIN_THREADED_COPY_HEIGHT ? obs->task_pool : NULL;
+
+	os_task_pool_for(pool, dst->height, 2, copy_frame_data_rows, &copy);
+}
+
 void obs_source_frame_copy(struct obs_source_frame *dst, const struct obs_source_frame *src)
 {
 	copy_frame_data(dst, src);
@@ -3328,15 +3529,20 @@ static inline bool async_texture_changed(struct obs_source *source, const struct
 	return source->async_cache_width != frame->width || source->async_cache_height != frame->height || prev != cur;
 }
 
+/* drops the cached frames and has the graphics thread discard all frames
+ * queued so far, along with the ones it is currently holding */
 static inline void free_async_cache(struct obs_source *source)
 {
 	for (size_t i = 0; i < source->async_cache.num; i++)
 		obs_source_frame_decref(source->async_cache.array[i].frame);
 
 	da_resize(source->async_cache, 0);
-	da_resize(source->async_frames, 0);
-	source->cur_async_frame = NULL;
-	source->prev_async_frame = NULL;
+	async_frame_queue_request_flush(&source->async_queue);
+}
+
+static inline bool async_frame_unused(const struct async_frame *af)
+{
+	return os_atomic_load_long(&af->frame->refs) == 1;
 }
 
 #define MAX_UNUSED_FRAME_DURATION 5
@@ -3347,27 +3553,25 @@ static void clean_cache(obs_source_t *source)
 {
 	for (size_t i = source->async_cache.num; i > 0; i--) {
 		struct async_frame *af = &source->async_cache.array[i - 1];
-		if (!af->used) {
+		if (async_frame_unused(af)) {
 			if (++af->unused_count == MAX_UNUSED_FRAME_DURATION) {
-				obs_source_frame_destroy(af->frame);
+				async_frame_pool_release(af->frame);
 				da_erase(source->async_cache, i - 1);
 			}
 		}
 	}
 }
 
-#define MAX_ASYNC_FRAMES 30
-//if return value is not null then do (os_atomic_dec_long(&output->refs) == 0) && obs_source_frame_destroy(output)
+/* returns a copy of the frame holding an extra reference for the queue */
 static inline struct obs_source_frame *cache_video(struct obs_source *source, const struct obs_source_frame *frame)
 {
 	struct obs_source_frame *new_frame = NULL;
 
-	pthread_mutex_lock(&source->async_mutex);
+	pthread_mutex_lock(&source->async_cache_mutex);
 
-	if (source->async_frames.num >= MAX_ASYNC_FRAMES) {
+	if (async_frame_queue_count(&source->async_queue) >= MAX_ASYNC_FRAMES) {
 		free_async_cache(source);
-		source->last_frame_ts = 0;
-		pthread_mutex_unlock(&source->async_mutex);
+		pthread_mutex_unlock(&source->async_cache_mutex);
 		return NULL;
 	}
 
@@ -3384,68 +3588,70 @@ static inline struct obs_source_frame *cache_video(struct obs_source *source, co
 
 	for (size_t i = 0; i < source->async_cache.num; i++) {
 		struct async_frame *af = &source->async_cache.array[i];
-		if (!af->used) {
+		if (async_frame_unused(af)) {
 			new_frame = af->frame;
 			new_frame->format = format;
-			af->used = true;
 			af->unused_count = 0;
+			os_atomic_inc_long(&new_frame->refs);
 			break;
 		}
 	}
 
-	clean_cache(source);
-
 	if (!new_frame) {
 		struct async_frame new_af;
 
-		new_frame = obs_source_frame_create(format, frame->width, frame->height);
+		new_frame = async_frame_pool_get(format, frame->width, frame->height);
 		new_af.frame = new_frame;
-		new_af.used = true;
 		new_af.unused_count = 0;
-		new_frame->refs = 1;
+		new_frame->refs = 2;
 
 		da_push_back(source->async_cache, &new_af);
 	}
 
-	os_atomic_inc_long(&new_frame->refs);
+	clean_cache(source);
 
-	pthread_mutex_unlock(&source->async_mutex);
+	pthread_mutex_unlock(&source->async_cache_mutex);
 
 	copy_frame_data(new_frame, frame);
+	new_frame->prev_frame = false;
 
 	return new_frame;
 }
 
+/* hands the reference taken by cache_video or cache_borrowed_video over to
+ * the frame queue */
+static void queue_cached_video(obs_source_t *source, struct obs_source_frame *output)
+{
+	if (!output)
+		return;
+
+	pthread_mutex_lock(&source->async_cache_mutex);
+	if (async_frame_queue_push(&source->async_queue, output)) {
+		source->async_active = true;
+	} else {
+		free_async_cache(source);
+		obs_source_frame_decref(output);
+	}
+	pthread_mutex_unlock(&source->async_cache_mutex);
+}
+
 static void obs_source_output_video_internal(obs_source_t *source, const struct obs_source_frame *frame)
 {
 	if (!obs_source_valid(source, "obs_source_output_video"))
 		return;
 
 	if (!frame) {
-		pthread_mutex_lock(&source->async_mutex);
+		pthread_mutex_lock(&source->async_cache_mutex);
 		source->async_active = false;
-		source->last_frame_ts = 0;
 		free_async_cache(source);
-		pthread_mutex_unlock(&source->async_mutex);
+		pthread_mutex_unlock(&source->async_cache_mutex);
 		return;
 	}
 
 	source_profiler_async_frame_received(source);
 
 	struct obs_source_frame *output = cache_video(source, frame);
-
-	/* ------------------------------------------- */
-	pthread_mutex_lock(&source->async_mutex);
-	if (output) {
-		if (os_atomic_dec_long(&output->refs) == 0) {
-			obs_source_frame_destroy(output);
-			output = NULL;
-		} else {
-			da_push_back(source->async_frames, &output);
-			source->async_active = true;
-		}
-	}
-	pthread_mutex_unlock(&source->async_mutex);
+	queue_cached_video(source, output);
 }
 
 void obs_source_output_video(obs_source_t *source, const struct obs_source_frame *frame)
@@ -3497,6 +3703,121 @@ void obs_source_output_video2(obs_source_t *source, const struct obs_source_fram
 	obs_source_output_video_internal(source, &new_frame);
 }
 
+static inline struct async_frame *find_cached_frame(struct obs_source *source, struct obs_source_frame *frame)
+{
+	for (size_t i = 0; i < source->async_cache.num; i++) {
+		struct async_frame *af = &source->async_cache.array[i];
+		if (af->frame == frame)
+			return af;
+	}
+
+	return NULL;
+}
+
+static inline void cache_frame(struct obs_source *source, struct obs_source_frame *frame)
+{
+	struct async_frame new_af = {frame, 0};
+
+	os_atomic_inc_long(&frame->refs);
+	da_push_back(source->async_cache, &new_af);
+}
+
+struct obs_source_frame *obs_source_borrow_video_frame(obs_source_t *source, enum video_format format, uint32_t width,
+						       uint32_t height)
+{
+	struct obs_source_frame *frame = NULL;
+
+	if (!obs_source_valid(source, "obs_source_borrow_video_frame"))
+		return NULL;
+	if (format == VIDEO_FORMAT_NONE || !width || !height)
+		return NULL;
+
+	pthread_mutex_lock(&source->async_cache_mutex);
+
+	if (source->async_cache_width == width && source->async_cache_height == height) {
+		for (size_t i = 0; i < source->async_cache.num; i++) {
+			struct async_frame *af = &source->async_cache.array[i];
+
+			if (async_frame_unused(af) && af->frame->format == format) {
+				frame = af->frame;
+				af->unused_count = 0;
+				os_atomic_inc_long(&frame->refs);
+				break;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&source->async_cache_mutex);
+
+	if (!frame) {
+		frame = async_frame_pool_get(format, width, height);
+		frame->refs = 1;
+	}
+
+	return frame;
+}
+
+/* the caller's reference is kept and dropped by queue_cached_video */
+static struct obs_source_frame *cache_borrowed_video(struct obs_source *source, struct obs_source_frame *frame)
+{
+	pthread_mutex_lock(&source->async_cache_mutex);
+
+	if (async_frame_queue_count(&source->async_queue) >= MAX_ASYNC_FRAMES) {
+		free_async_cache(source);
+		pthread_mutex_unlock(&source->async_cache_mutex);
+		obs_source_frame_decref(frame);
+		return NULL;
+	}
+
+	if (async_texture_changed(source, frame)) {
+		free_async_cache(source);
+		source->async_cache_width = frame->width;
+		source->async_cache_height = frame->height;
+	}
+
+	source->async_cache_format = frame->format;
+	source->async_cache_full_range = frame->full_range;
+	source->async_cache_trc = frame->trc;
+
+	/* the frame may have been dropped from the cache while it was being
+	 * filled, or may have come straight from the frame pool */
+	if (!find_cached_frame(source, frame))
+		cache_frame(source, frame);
+
+	clean_cache(source);
+
+	pthread_mutex_unlock(&source->async_cache_mutex);
+	return frame;
+}
+
+void obs_source_output_borrowed_video(obs_source_t *source, struct obs_source_frame *frame)
+{
+	if (!obs_ptr_valid(frame, "obs_source_output_borrowed_video"))
+		return;
+	if (!obs_source_valid(source, "obs_source_output_borrowed_video") || destroying(source)) {
+		obs_source_return_video_frame(source, frame);
+		return;
+	}
+
+	if (!format_is_yuv(frame->format))
+		frame->full_range = true;
+	frame->prev_frame = false;
+
+	source_profiler_async_frame_received(source);
+
+	struct obs_source_frame *output = cache_borrowed_video(source, frame);
+	queue_cached_video(source, output);
+}
+
+void obs_source_return_video_frame(obs_source_t *source, struct obs_source_frame *frame)
+{
+	if (!frame)
+		return;
+
+	UNUSED_PARAMETER(source);
+	obs_source_frame_decref(frame);
+}
+
 void obs_source_set_async_rotation(obs_source_t *source, long rotation)
 {
 	if (source)
@@ -3923,36 +4244,52 @@ void obs_source_output_audio(obs_source_t *source, const struct obs_source_audio
 	pthread_mutex_unlock(&source->filter_mutex);
 }
 
+/* releases a frame taken from the frame queue */
 void remove_async_frame(obs_source_t *source, struct obs_source_frame *frame)
 {
-	if (frame)
+	if (frame) {
 		frame->prev_frame = false;
+		obs_source_frame_decref(frame);
+	}
 
-	for (size_t i = 0; i < source->async_cache.num; i++) {
-		struct async_frame *f = &source->async_cache.array[i];
+	UNUSED_PARAMETER(source);
+}
 
-		if (f->frame == frame) {
-			f->used = false;
-			break;
-		}
-	}
+/* discards the frames queued before the producer's last free_async_cache */
+static void flush_async_frames(obs_source_t *source)
+{
+	struct async_frame_queue *queue = &source->async_queue;
+
+	if (!os_atomic_exchange_bool(&queue->flush, false))
+		return;
+
+	unsigned long flush_to = (unsigned long)os_atomic_load_long(&queue->flush_to);
+
+	while ((long)(flush_to - (unsigned long)os_atomic_load_long(&queue->tail)) > 0)
+		obs_source_frame_decref(async_frame_queue_pop(queue));
+
+	remove_async_frame(source, source->cur_async_frame);
+	remove_async_frame(source, source->prev_async_frame);
+	source->cur_async_frame = NULL;
+	source->prev_async_frame = NULL;
+	source->last_frame_ts = 0;
 }
 
 /* #define DEBUG_ASYNC_FRAMES 1 */
 
 static bool ready_async_frame(obs_source_t *source, uint64_t sys_time)
 {
-	struct obs_source_frame *next_frame = source->async_frames.array[0];
+	struct obs_source_frame *next_frame = async_frame_queue_peek(&source->async_queue, 0);
 	struct obs_source_frame *frame = NULL;
 	uint64_t sys_offset = sys_time - source->last_sys_timestamp;
 	uint64_t frame_time = next_frame->timestamp;
 	uint64_t frame_offset = 0;
 
 	if (source->async_unbuffered) {
-		while (source->async_frames.num > 1) {
-			da_erase(source->async_frames, 0);
+		while (async_frame_queue_count(&source->async_queue) > 1) {
+			async_frame_queue_pop(&source->async_queue);
 			remove_async_frame(source, next_frame);
-			next_frame = source->async_frames.array[0];
+			next_frame = async_frame_queue_peek(&source->async_queue, 0);
 		}
 
 		source->last_frame_ts = next_frame->timestamp;
@@ -3965,7 +4302,7 @@ static bool ready_async_frame(obs_source_t *source, uint64_t sys_time)
 	     "sys_offset: %llu, frame_offset: %llu, "
 	     "number of frames: %lu",
 	     source->last_frame_ts, frame_time, sys_offset, frame_time - source->last_frame_ts,
-	     (unsigned long)source->async_frames.num);
+	     (unsigned long)async_frame_queue_count(&source->async_queue));
 #endif
 
 	/* account for timestamp invalidation */
@@ -3990,7 +4327,7 @@ static bool ready_async_frame(obs_source_t *source, uint64_t sys_time)
 			break;
 
 		if (frame)
-			da_erase(source->async_frames, 0);
+			async_frame_queue_pop(&source->async_queue);
 
 #if DEBUG_ASYNC_FRAMES
 		blog(LOG_DEBUG,
@@ -4002,11 +4339,11 @@ static bool ready_async_frame(obs_source_t *source, uint64_t sys_time)
 
 		remove_async_frame(source, frame);
 
-		if (source->async_frames.num == 1)
+		if (async_frame_queue_count(&source->async_queue) == 1)
 			return true;
 
 		frame = next_frame;
-		next_frame = source->async_frames.array[1];
+		next_frame = async_frame_queue_peek(&source->async_queue, 1);
 
 		/* more timestamp checking and compensating */
 		if ((next_frame->timestamp - frame_time) > MAX_TS_VAR) {
@@ -4030,12 +4367,11 @@ static bool ready_async_frame(obs_source_t *source, uint64_t sys_time)
 
 static inline struct obs_source_frame *get_closest_frame(obs_source_t *source, uint64_t sys_time)
 {
-	if (!source->async_frames.num)
+	if (!async_frame_queue_count(&source->async_queue))
 		return NULL;
 
 	if (!source->last_frame_ts || ready_async_frame(source, sys_time)) {
-		struct obs_source_frame *frame = source->async_frames.array[0];
-		da_erase(source->async_frames, 0);
+		struct obs_source_frame *frame = async_frame_queue_pop(&source->async_queue);
 
 		if (!source->last_frame_ts)
 			source->last_frame_ts = frame->timestamp;
@@ -4061,6 +4397,8 @@ struct obs_source_frame *obs_source_get_frame(obs_source_t *source)
 
 	pthread_mutex_lock(&source->async_mutex);
 
+	flush_async_frames(source);
+
 	frame = source->cur_async_frame;
 	source->cur_async_frame = NULL;
 
@@ -4084,7 +4422,7 @@ void obs_source_release_frame(obs_source_t *source, struct obs_source_frame *fra
 		pthread_mutex_lock(&source->async_mutex);
 
 		if (os_atomic_dec_long(&frame->refs) == 0)
-			obs_source_frame_destroy(frame);
+			async_frame_pool_release(frame);
 		else
 			remove_async_frame(source, frame);
 
@@ -5066,23 +5404,13 @@ static float get_source_volume(obs_source_t *source, uint64_t os_time)
 
 static inline void multiply_output_audio(obs_source_t *source, size_t mix, size_t channels, float vol)
 {
-	register float *out = source->audio_output_buf[mix][0];
-	register float *end = out + AUDIO_OUTPUT_FRAMES * channels;
-
-	while (out < end)
-		*(out++) *= vol;
+	audio_mix_gain(source->audio_output_buf[mix][0], vol, AUDIO_OUTPUT_FRAMES * channels);
 }
 
 static inline void multiply_vol_data(obs_source_t *source, size_t mix, size_t channels, float *vol_data)
 {
-	for (size_t ch = 0; ch < channels; ch++) {
-		register float *out = source->audio_output_buf[mix][ch];
-		register float *end = out + AUDIO_OUTPUT_FRAMES;
-		register float *vol = vol_data;
-
-		while (out < end)
-			*(out++) *= *(vol++);
-	}
+	for (size_t ch = 0; ch < channels; ch++)
+		audio_mix_gain_ramp(source->audio_output_buf[mix][ch], vol_data, AUDIO_OUTPUT_FRAMES);
 }
 
 static inline void apply_audio_action(obs_source_t *source, const struct audio_action *action)
@@ -5557,6 +5885,15 @@ enum obs_icon_type obs_source_get_icon_type(const char *id)
 	return (info) ? info->icon_type : OBS_ICON_TYPE_UNKNOWN;
 }
 
+static void push_media_action(obs_source_t *source, struct media_action *action)
+{
+	pthread_mutex_lock(&source->media_actions_mutex);
+	da_push_back(source->media_actions, action);
+	pthread_mutex_unlock(&source->media_actions_mutex);
+
+	obs_source_schedule_tick(source);
+}
+
 void obs_source_media_play_pause(obs_source_t *source, bool pause)
 {
 	if (!data_valid(source, "obs_source_media_play_pause"))
@@ -5572,9 +5909,7 @@ void obs_source_media_play_pause(obs_source_t *source, bool pause)
 		.pause = pause,
 	};
 
-	pthread_mutex_lock(&source->media_actions_mutex);
-	da_push_back(source->media_actions, &action);
-	pthread_mutex_unlock(&source->media_actions_mutex);
+	push_media_action(source, &action);
 }
 
 void obs_source_media_restart(obs_source_t *source)
@@ -5591,9 +5926,7 @@ void obs_source_media_restart(obs_source_t *source)
 		.type = MEDIA_ACTION_RESTART,
 	};
 
-	pthread_mutex_lock(&source->media_actions_mutex);
-	da_push_back(source->media_actions, &action);
-	pthread_mutex_unlock(&source->media_actions_mutex);
+	push_media_action(source, &action);
 }
 
 void obs_source_media_stop(obs_source_t *source)
@@ -5610,9 +5943,7 @@ void obs_source_media_stop(obs_source_t *source)
 		.type = MEDIA_ACTION_STOP,
 	};
 
-	pthread_mutex_lock(&source->media_actions_mutex);
-	da_push_back(source->media_actions, &action);
-	pthread_mutex_unlock(&source->media_actions_mutex);
+	push_media_action(source, &action);
 }
 
 void obs_source_media_next(obs_source_t *source)
@@ -5629,9 +5960,7 @@ void obs_source_media_next(obs_source_t *source)
 		.type = MEDIA_ACTION_NEXT,
 	};
 
-	pthread_mutex_lock(&source->media_actions_mutex);
-	da_push_back(source->media_actions, &action);
-	pthread_mutex_unlock(&source->media_actions_mutex);
+	push_media_action(source, &action);
 }
 
 void obs_source_media_previous(obs_source_t *source)
@@ -5648,9 +5977,7 @@ void obs_source_media_previous(obs_source_t *source)
 		.type = MEDIA_ACTION_PREVIOUS,
 	};
 
-	pthread_mutex_lock(&source->media_actions_mutex);
-	da_push_back(source->media_actions, &action);
-	pthread_mutex_unlock(&source->media_actions_mutex);
+	push_media_action(source, &action);
 }
 
 int64_t obs_source_media_get_duration(obs_source_t *source)
@@ -5693,9 +6020,7 @@ void obs_source_media_set_time(obs_source_t *source, int64_t ms)
 		.ms = ms,
 	};
 
-	pthread_mutex_lock(&source->media_actions_mutex);
-	da_push_back(source->media_actions, &action);
-	pthread_mutex_unlock(&source->media_actions_mutex);
+	push_media_action(source, &action);
 }
 
 enum obs_media_state obs_source_media_get_state(obs_source_t *source)
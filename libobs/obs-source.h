@@ -203,6 +203,20 @@ enum obs_media_state {
  */
 #define OBS_SOURCE_CAP_DONT_SHOW_PROPERTIES (1 << 16)
 
+/**
+ * Source needs video_tick to be called even when it is not being shown.
+ * Sources without this flag are only ticked while they are shown (or while
+ * they still have a pending update or media action).
+ */
+#define OBS_SOURCE_TICK_WHILE_HIDDEN (1 << 17)
+
+/**
+ * Source's video_tick may be called from a worker thread, at the same time as
+ * the video_tick of other sources with this flag.  The tick must not call any
+ * graphics functions.
+ */
+#define OBS_SOURCE_PARALLEL_TICK (1 << 18)
+
 /** @} */
 
 typedef void (*obs_source_enum_proc_t)(obs_source_t *parent, obs_source_t *child, void *param);
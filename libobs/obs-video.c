@@ -29,6 +29,77 @@
 #include <windows.h>
 #endif
 
+/* filters are ticked along with the source they are attached to, unless they
+ * are already being ticked from the tick list themselves */
+static inline void push_tick_filters(struct obs_core_data *data, obs_source_t *source)
+{
+	pthread_mutex_lock(&source->filter_mutex);
+
+	for (size_t i = 0; i < source->filters.num; i++) {
+		obs_source_t *filter = source->filters.array[i];
+		if (filter->ticking)
+			continue;
+
+		filter = obs_source_get_ref(filter);
+		if (filter) {
+			filter->ticking = true;
+			da_push_back(data->sources_to_tick, &filter);
+		}
+	}
+
+	pthread_mutex_unlock(&source->filter_mutex);
+}
+
+static inline bool tick_in_parallel(const struct obs_source *source)
+{
+	return obs->task_pool && (source->info.output_flags & OBS_SOURCE_PARALLEL_TICK) != 0 &&
+	       source->context.data && source->info.video_tick;
+}
+
+struct parallel_tick_info {
+	struct obs_core_data *data;
+	float seconds;
+	volatile long next;
+};
+
+/* tick costs vary a lot between sources, so rather than ticking a fixed band
+ * each participating thread keeps claiming the next untouched source */
+static void tick_parallel_range(void *param, uint32_t start, uint32_t end)
+{
+	struct parallel_tick_info *info = param;
+	const long count = (long)info->data->parallel_ticks.num;
+	long idx;
+
+	while ((idx = os_atomic_inc_long(&info->next) - 1) < count) {
+		struct parallel_tick *tick = info->data->parallel_ticks.array + idx;
+		obs_source_t *source = tick->source;
+		const uint64_t tick_start = source_profiler_source_tick_start();
+
+		source->info.video_tick(source->context.data, info->seconds);
+
+		if (tick_start)
+			tick->tick_ns += os_gettime_ns() - tick_start;
+	}
+
+	UNUSED_PARAMETER(start);
+	UNUSED_PARAMETER(end);
+}
+
+static void tick_parallel_sources(struct obs_core_data *data, float seconds)
+{
+	struct parallel_tick_info info = {data, seconds, 0};
+
+	if (!data->parallel_ticks.num)
+		return;
+
+	os_task_pool_for(obs->task_pool, (uint32_t)data->parallel_ticks.num, 1, tick_parallel_range, &info);
+
+	for (size_t i = 0; i < data->parallel_ticks.num; i++) {
+		struct parallel_tick *tick = data->parallel_ticks.array + i;
+		source_profiler_source_tick_time(tick->source, tick->tick_ns);
+	}
+}
+
 static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 {
 	struct obs_core_data *data = &obs->data;
@@ -60,26 +131,51 @@ static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 
 	da_clear(data->sources_to_tick);
 
-	pthread_mutex_lock(&data->sources_mutex);
+	pthread_mutex_lock(&data->tick_sources_mutex);
 
-	source = data->sources;
+	source = data->first_tick_source;
 	while (source) {
 		obs_source_t *s = obs_source_get_ref(source);
-		if (s)
+		if (s) {
+			os_atomic_set_bool(&s->tick_requested, false);
+			s->ticking = true;
 			da_push_back(data->sources_to_tick, &s);
-		source = (struct obs_source *)source->context.hh_uuid.next;
+		}
+		source = source->next_tick_source;
 	}
 
-	pthread_mutex_unlock(&data->sources_mutex);
+	pthread_mutex_unlock(&data->tick_sources_mutex);
+
+	for (size_t i = 0, num = data->sources_to_tick.num; i < num; i++)
+		push_tick_filters(data, data->sources_to_tick.array[i]);
 
 	/* ------------------------------------- */
 	/* call the tick function of each source */
 
+	da_clear(data->parallel_ticks);
+
 	for (size_t i = 0; i < data->sources_to_tick.num; i++) {
 		obs_source_t *s = data->sources_to_tick.array[i];
 		const uint64_t start = source_profiler_source_tick_start();
+
+		if (tick_in_parallel(s)) {
+			struct parallel_tick *tick = da_push_back_new(data->parallel_ticks);
+			obs_source_video_tick_state(s, seconds);
+			tick->source = s;
+			tick->tick_ns = start ? os_gettime_ns() - start : 0;
+			continue;
+		}
+
 		obs_source_video_tick(s, seconds);
 		source_profiler_source_tick_end(s, start);
+	}
+
+	tick_parallel_sources(data, seconds);
+
+	for (size_t i = 0; i < data->sources_to_tick.num; i++) {
+		obs_source_t *s = data->sources_to_tick.array[i];
+		s->ticking = false;
+		obs_source_unschedule_tick(s);
 		obs_source_release(s);
 	}
 
@@ -597,135 +693,123 @@ static inline bool download_frame(struct obs_core_video_mix *video, int prev_tex
 	return true;
 }
 
-static const uint8_t *set_gpu_converted_plane(uint32_t width, uint32_t height, uint32_t linesize_input,
-					      uint32_t linesize_output, const uint8_t *in, uint8_t *out)
+static void set_gpu_converted_plane(uint32_t width, uint32_t start_y, uint32_t end_y, uint32_t linesize_input,
+				    uint32_t linesize_output, const uint8_t *in, uint8_t *out)
 {
+	in += (size_t)linesize_input * (size_t)start_y;
+	out += (size_t)linesize_output * (size_t)start_y;
+
 	if ((width == linesize_input) && (width == linesize_output)) {
-		size_t total = (size_t)width * (size_t)height;
-		memcpy(out, in, total);
-		in += total;
+		memcpy(out, in, (size_t)width * (size_t)(end_y - start_y));
 	} else {
-		for (size_t y = 0; y < height; y++) {
+		for (uint32_t y = start_y; y < end_y; y++) {
 			memcpy(out, in, width);
 			out += linesize_output;
 			in += linesize_input;
 		}
 	}
-
-	return in;
 }
 
 static void set_gpu_converted_data(struct video_frame *output, const struct video_data *input,
-				   const struct video_output_info *info)
+				   const struct video_output_info *info, uint32_t start_y, uint32_t end_y)
 {
+	const uint32_t start_y_d2 = start_y / 2;
+	const uint32_t end_y_d2 = end_y / 2;
+
 	switch (info->format) {
 	case VIDEO_FORMAT_I420: {
 		const uint32_t width = info->width;
-		const uint32_t height = info->height;
+		const uint32_t width_d2 = width / 2;
 
-		set_gpu_converted_plane(width, height, input->linesize[0], output->linesize[0], input->data[0],
+		set_gpu_converted_plane(width, start_y, end_y, input->linesize[0], output->linesize[0], input->data[0],
 					output->data[0]);
 
-		const uint32_t width_d2 = width / 2;
-		const uint32_t height_d2 = height / 2;
-
-		set_gpu_converted_plane(width_d2, height_d2, input->linesize[1], output->linesize[1], input->data[1],
-					output->data[1]);
+		set_gpu_converted_plane(width_d2, start_y_d2, end_y_d2, input->linesize[1], output->linesize[1],
+					input->data[1], output->data[1]);
 
-		set_gpu_converted_plane(width_d2, height_d2, input->linesize[2], output->linesize[2], input->data[2],
-					output->data[2]);
+		set_gpu_converted_plane(width_d2, start_y_d2, end_y_d2, input->linesize[2], output->linesize[2],
+					input->data[2], output->data[2]);
 
 		break;
 	}
 	case VIDEO_FORMAT_NV12: {
 		const uint32_t width = info->width;
-		const uint32_t height = info->height;
-		const uint32_t height_d2 = height / 2;
 		if (input->linesize[1]) {
-			set_gpu_converted_plane(width, height, input->linesize[0], output->linesize[0], input->data[0],
-						output->data[0]);
-			set_gpu_converted_plane(width, height_d2, input->linesize[1], output->linesize[1],
+			set_gpu_converted_plane(width, start_y, end_y, input->linesize[0], output->linesize[0],
+						input->data[0], output->data[0]);
+			set_gpu_converted_plane(width, start_y_d2, end_y_d2, input->linesize[1], output->linesize[1],
 						input->data[1], output->data[1]);
 		} else {
-			const uint8_t *const in_uv = set_gpu_converted_plane(width, height, input->linesize[0],
-									     output->linesize[0], input->data[0],
-									     output->data[0]);
-			set_gpu_converted_plane(width, height_d2, input->linesize[0], output->linesize[1], in_uv,
-						output->data[1]);
+			const uint8_t *const in_uv = input->data[0] + (size_t)input->linesize[0] * info->height;
+			set_gpu_converted_plane(width, start_y, end_y, input->linesize[0], output->linesize[0],
+						input->data[0], output->data[0]);
+			set_gpu_converted_plane(width, start_y_d2, end_y_d2, input->linesize[0], output->linesize[1],
+						in_uv, output->data[1]);
 		}
 
 		break;
 	}
 	case VIDEO_FORMAT_I444: {
 		const uint32_t width = info->width;
-		const uint32_t height = info->height;
 
-		set_gpu_converted_plane(width, height, input->linesize[0], output->linesize[0], input->data[0],
+		set_gpu_converted_plane(width, start_y, end_y, input->linesize[0], output->linesize[0], input->data[0],
 					output->data[0]);
 
-		set_gpu_converted_plane(width, height, input->linesize[1], output->linesize[1], input->data[1],
+		set_gpu_converted_plane(width, start_y, end_y, input->linesize[1], output->linesize[1], input->data[1],
 					output->data[1]);
 
-		set_gpu_converted_plane(width, height, input->linesize[2], output->linesize[2], input->data[2],
+		set_gpu_converted_plane(width, start_y, end_y, input->linesize[2], output->linesize[2], input->data[2],
 					output->data[2]);
 
 		break;
 	}
 	case VIDEO_FORMAT_I010: {
 		const uint32_t width = info->width;
-		const uint32_t height = info->height;
-
-		set_gpu_converted_plane(width * 2, height, input->linesize[0], output->linesize[0], input->data[0],
-					output->data[0]);
 
-		const uint32_t height_d2 = height / 2;
+		set_gpu_converted_plane(width * 2, start_y, end_y, input->linesize[0], output->linesize[0],
+					input->data[0], output->data[0]);
 
-		set_gpu_converted_plane(width, height_d2, input->linesize[1], output->linesize[1], input->data[1],
-					output->data[1]);
+		set_gpu_converted_plane(width, start_y_d2, end_y_d2, input->linesize[1], output->linesize[1],
+					input->data[1], output->data[1]);
 
-		set_gpu_converted_plane(width, height_d2, input->linesize[2], output->linesize[2], input->data[2],
-					output->data[2]);
+		set_gpu_converted_plane(width, start_y_d2, end_y_d2, input->linesize[2], output->linesize[2],
+					input->data[2], output->data[2]);
 
 		break;
 	}
 	case VIDEO_FORMAT_P010: {
 		const uint32_t width_x2 = info->width * 2;
-		const uint32_t height = info->height;
-		const uint32_t height_d2 = height / 2;
 		if (input->linesize[1]) {
-			set_gpu_converted_plane(width_x2, height, input->linesize[0], output->linesize[0],
+			set_gpu_converted_plane(width_x2, start_y, end_y, input->linesize[0], output->linesize[0],
 						input->data[0], output->data[0]);
-			set_gpu_converted_plane(width_x2, height_d2, input->linesize[1], output->linesize[1],
-						input->data[1], output->data[1]);
+			set_gpu_converted_plane(width_x2, start_y_d2, end_y_d2, input->linesize[1],
+						output->linesize[1], input->data[1], output->data[1]);
 		} else {
-			const uint8_t *const in_uv = set_gpu_converted_plane(width_x2, height, input->linesize[0],
-									     output->linesize[0], input->data[0],
-									     output->data[0]);
-			set_gpu_converted_plane(width_x2, height_d2, input->linesize[0], output->linesize[1], in_uv,
-						output->data[1]);
+			const uint8_t *const in_uv = input->data[0] + (size_t)input->linesize[0] * info->height;
+			set_gpu_converted_plane(width_x2, start_y, end_y, input->linesize[0], output->linesize[0],
+						input->data[0], output->data[0]);
+			set_gpu_converted_plane(width_x2, start_y_d2, end_y_d2, input->linesize[0],
+						output->linesize[1], in_uv, output->data[1]);
 		}
 
 		break;
 	}
 	case VIDEO_FORMAT_P216: {
 		const uint32_t width_x2 = info->width * 2;
-		const uint32_t height = info->height;
 
-		set_gpu_converted_plane(width_x2, height, input->linesize[0], output->linesize[0], input->data[0],
-					output->data[0]);
+		set_gpu_converted_plane(width_x2, start_y, end_y, input->linesize[0], output->linesize[0],
+					input->data[0], output->data[0]);
 
-		set_gpu_converted_plane(width_x2, height, input->linesize[1], output->linesize[1], input->data[1],
-					output->data[1]);
+		set_gpu_converted_plane(width_x2, start_y, end_y, input->linesize[1], output->linesize[1],
+					input->data[1], output->data[1]);
 
 		break;
 	}
 	case VIDEO_FORMAT_P416: {
-		const uint32_t height = info->height;
-
-		set_gpu_converted_plane(info->width * 2, height, input->linesize[0], output->linesize[0],
+		set_gpu_converted_plane(info->width * 2, start_y, end_y, input->linesize[0], output->linesize[0],
 					input->data[0], output->data[0]);
 
-		set_gpu_converted_plane(info->width * 4, height, input->linesize[1], output->linesize[1],
+		set_gpu_converted_plane(info->width * 4, start_y, end_y, input->linesize[1], output->linesize[1],
 					input->data[1], output->data[1]);
 
 		break;
@@ -756,17 +840,17 @@ static void set_gpu_converted_data(struct video_frame *output, const struct vide
 }
 
 static inline void copy_rgbx_frame(struct video_frame *output, const struct video_data *input,
-				   const struct video_output_info *info)
+				   const struct video_output_info *info, uint32_t start_y, uint32_t end_y)
 {
-	uint8_t *in_ptr = input->data[0];
-	uint8_t *out_ptr = output->data[0];
+	uint8_t *in_ptr = input->data[0] + (size_t)input->linesize[0] * start_y;
+	uint8_t *out_ptr = output->data[0] + (size_t)output->linesize[0] * start_y;
 
 	/* if the line sizes match, do a single copy */
 	if (input->linesize[0] == output->linesize[0]) {
-		memcpy(out_ptr, in_ptr, (size_t)input->linesize[0] * (size_t)info->height);
+		memcpy(out_ptr, in_ptr, (size_t)input->linesize[0] * (size_t)(end_y - start_y));
 	} else {
 		const size_t copy_size = (size_t)info->width * 4;
-		for (size_t y = 0; y < info->height; y++) {
+		for (uint32_t y = start_y; y < end_y; y++) {
 			memcpy(out_ptr, in_ptr, copy_size);
 			in_ptr += input->linesize[0];
 			out_ptr += output->linesize[0];
@@ -774,6 +858,24 @@ static inline void copy_rgbx_frame(struct video_frame *output, const struct vide
 	}
 }
 
+struct output_copy_info {
+	struct video_frame *output;
+	const struct video_data *input;
+	const struct video_output_info *info;
+	bool gpu_conversion;
+};
+
+static void output_copy_rows(void *param, uint32_t start_y, uint32_t end_y)
+{
+	struct output_copy_info *copy = param;
+
+	if (copy->gpu_conversion) {
+		set_gpu_converted_data(copy->output, copy->input, copy->info, start_y, end_y);
+	} else {
+		copy_rgbx_frame(copy->output, copy->input, copy->info, start_y, end_y);
+	}
+}
+
 static inline void output_video_data(struct obs_core_video_mix *video, struct video_data *input_frame, int count)
 {
 	const struct video_output_info *info;
@@ -784,11 +886,16 @@ static inline void output_video_data(struct obs_core_video_mix *video, struct vi
 
 	locked = video_output_lock_frame(video->video, &output_frame, count, input_frame->timestamp);
 	if (locked) {
-		if (video->gpu_conversion) {
-			set_gpu_converted_data(&output_frame, input_frame, info);
-		} else {
-			copy_rgbx_frame(&output_frame, input_frame, info);
-		}
+		struct output_copy_info copy = {
+			.output = &output_frame,
+			.input = input_frame,
+			.info = info,
+			.gpu_conversion = video->gpu_conversion,
+		};
+		os_task_pool_t *pool = info->height >= MIN_THREADED_COPY_HEIGHT ? obs->task_pool : NULL;
+
+		/* bands are kept to an even number of rows for 4:2:0 planes */
+		os_task_pool_for(pool, info->height, 2, output_copy_rows, &copy);
 
 		video_output_unlock_frame(video->video);
 	}
@@ -153,6 +153,8 @@ static inline void set_main_mix()
 {
 	size_t idx = find_mix_for_view(&obs->data.main_view);
 
+	invalidate_audio_render_order();
+
 	struct obs_core_video_mix *mix = NULL;
 	if (idx != DARRAY_INVALID)
 		mix = obs->video.mixes.array[idx];
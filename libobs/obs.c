@@ -872,6 +872,8 @@ static bool obs_init_audio(struct audio_output_info *ai)
 	audio->monitoring_device_name = bstrdup("Default");
 	audio->monitoring_device_id = bstrdup("default");
 
+	invalidate_audio_render_order();
+
 	errorcode = audio_output_open(&audio->audio, ai);
 	if (errorcode == AUDIO_OUTPUT_SUCCESS)
 		return true;
@@ -903,6 +905,12 @@ static void obs_free_audio(void)
 	da_free(audio->render_order);
 	da_free(audio->root_nodes);
 
+	for (size_t i = 0; i < audio->cached_render_order.num; i++)
+		obs_weak_source_release(audio->cached_render_order.array[i]);
+	da_free(audio->cached_render_order);
+	da_free(audio->cached_root_nodes);
+	da_free(audio->parallel_sources);
+
 	da_free(audio->monitors);
 	bfree(audio->monitoring_device_name);
 	bfree(audio->monitoring_device_id);
@@ -926,6 +934,8 @@ static bool obs_init_data(void)
 		goto fail;
 	if (pthread_mutex_init_recursive(&data->audio_sources_mutex) != 0)
 		goto fail;
+	if (pthread_mutex_init_recursive(&data->tick_sources_mutex) != 0)
+		goto fail;
 	if (pthread_mutex_init_recursive(&data->displays_mutex) != 0)
 		goto fail;
 	if (pthread_mutex_init_recursive(&data->outputs_mutex) != 0)
@@ -936,6 +946,8 @@ static bool obs_init_data(void)
 		goto fail;
 	if (pthread_mutex_init_recursive(&obs->data.draw_callbacks_mutex) != 0)
 		goto fail;
+	if (!async_frame_pool_init(&data->async_frame_pool))
+		goto fail;
 
 	if (!obs_view_init(&data->main_view))
 		goto fail;
@@ -1007,6 +1019,7 @@ static void obs_free_data(void)
 
 	pthread_mutex_destroy(&data->sources_mutex);
 	pthread_mutex_destroy(&data->audio_sources_mutex);
+	pthread_mutex_destroy(&data->tick_sources_mutex);
 	pthread_mutex_destroy(&data->displays_mutex);
 	pthread_mutex_destroy(&data->outputs_mutex);
 	pthread_mutex_destroy(&data->encoders_mutex);
@@ -1021,6 +1034,9 @@ static void obs_free_data(void)
 		bfree(data->protocols.array[i]);
 	da_free(data->protocols);
 	da_free(data->sources_to_tick);
+	da_free(data->parallel_ticks);
+
+	async_frame_pool_free(&data->async_frame_pool);
 }
 
 static const char *obs_signals[] = {
@@ -1158,6 +1174,19 @@ const struct obs_source_info audio_line_info = {
 
 extern void log_system_info(void);
 
+/* threads used alongside the calling thread for splitting up frame copies and
+ * similar work; more than this gains nothing once memory bandwidth is the
+ * limit */
+#define MAX_TASK_POOL_THREADS 7
+
+static size_t get_task_pool_threads(void)
+{
+	int cores = os_get_logical_cores() - 1;
+	if (cores <= 0)
+		return 0;
+	return cores > MAX_TASK_POOL_THREADS ? MAX_TASK_POOL_THREADS : (size_t)cores;
+}
+
 static bool obs_init(const char *locale, const char *module_config_path, profiler_name_store_t *store)
 {
 	obs = bzalloc(sizeof(struct obs_core));
@@ -1188,6 +1217,10 @@ static bool obs_init(const char *locale, const char *module_config_path, profile
 	if (!obs->destruction_task_thread)
 		return false;
 
+	obs->task_pool = os_task_pool_create(get_task_pool_threads());
+	if (!obs->task_pool)
+		return false;
+
 	if (module_config_path)
 		obs->module_config_path = bstrdup(module_config_path);
 	obs->locale = bstrdup(locale);
@@ -1360,6 +1393,7 @@ void obs_shutdown(void)
 	obs_free_audio();
 	obs_free_video();
 	os_task_queue_destroy(obs->destruction_task_thread);
+	os_task_pool_destroy(obs->task_pool);
 	obs_free_hotkeys();
 	obs_free_graphics();
 	proc_handler_destroy(obs->procs);
@@ -1554,6 +1588,24 @@ bool obs_reset_audio2(const struct obs_audio_info2 *oai)
 	return obs_init_audio(&ai);
 }
 
+void obs_set_video_encoder_threads(bool enable)
+{
+	if (!obs)
+		return;
+
+	if (os_atomic_set_bool(&obs->video_encoder_threads, enable) != enable)
+		blog(LOG_INFO, "Raw video encoders: %s", enable ? "own threads" : "video thread");
+}
+
+void obs_set_audio_parallel_render(bool enable)
+{
+	if (!obs)
+		return;
+
+	if (os_atomic_set_bool(&obs->audio_parallel_render, enable) != enable)
+		blog(LOG_INFO, "Audio source rendering: %s", enable ? "parallel" : "serial");
+}
+
 bool obs_reset_audio(const struct obs_audio_info *oai)
 {
 	struct obs_audio_info2 oai2 = {
@@ -2925,13 +2977,13 @@ struct obs_core_video_mix *get_mix_for_video(video_t *v)
 	return result;
 }
 
-void start_raw_video(video_t *v, const struct video_scale_info *conversion, uint32_t frame_rate_divisor,
+void start_raw_video(video_t *v, const struct video_scale_info *conversion, uint32_t frame_rate_divisor, bool threaded,
 		     void (*callback)(void *param, struct video_data *frame), void *param)
 {
 	struct obs_core_video_mix *video = get_mix_for_video(v);
 	if (video)
 		os_atomic_inc_long(&video->raw_active);
-	video_output_connect2(v, conversion, frame_rate_divisor, callback, param);
+	video_output_connect3(v, conversion, frame_rate_divisor, threaded, callback, param);
 }
 
 void stop_raw_video(video_t *v, void (*callback)(void *param, struct video_data *frame), void *param)
@@ -2952,7 +3004,7 @@ void obs_add_raw_video_callback2(const struct video_scale_info *conversion, uint
 				 void (*callback)(void *param, struct video_data *frame), void *param)
 {
 	struct obs_core_video_mix *video = obs->video.main_mix;
-	start_raw_video(video->video, conversion, frame_rate_divisor, callback, param);
+	start_raw_video(video->video, conversion, frame_rate_divisor, false, callback, param);
 }
 
 void obs_remove_raw_video_callback(void (*callback)(void *param, struct video_data *frame), void *param)
@@ -417,6 +417,16 @@ EXPORT profiler_name_store_t *obs_get_profiler_name_store(void);
  */
 EXPORT int obs_reset_video(struct obs_video_info *ovi);
 
+/**
+ * Sets whether raw video encoders started after this call run on their own
+ * threads, off by default
+ *
+ * @note Each of these encoders then skips frames on its own when it falls
+ *       behind.  Encoders in an encoder group always stay on the video thread
+ *       so that they keep encoding the same frames.
+ */
+EXPORT void obs_set_video_encoder_threads(bool enable);
+
 /**
  * Sets base audio output format/channels/samples/etc
  *
@@ -425,6 +435,15 @@ EXPORT int obs_reset_video(struct obs_video_info *ovi);
 EXPORT bool obs_reset_audio(const struct obs_audio_info *oai);
 EXPORT bool obs_reset_audio2(const struct obs_audio_info2 *oai);
 
+/**
+ * Sets whether audio sources without audio children are rendered on the
+ * libobs worker threads, off by default
+ *
+ * @note Filters of these sources, including those of sources that use the
+ *       audio_mix callback, may then run concurrently with each other.
+ */
+EXPORT void obs_set_audio_parallel_render(bool enable);
+
 /** Gets the current video settings, returns false if no video */
 EXPORT bool obs_get_video_info(struct obs_video_info *ovi);
 
@@ -1324,6 +1343,24 @@ EXPORT void obs_source_draw(gs_texture_t *image, int x, int y, uint32_t cx, uint
 EXPORT void obs_source_output_video(obs_source_t *source, const struct obs_source_frame *frame);
 EXPORT void obs_source_output_video2(obs_source_t *source, const struct obs_source_frame2 *frame);
 
+/**
+ * Borrows a frame with planes allocated by libobs, so that an async source
+ * can write its video directly into it instead of having it copied by
+ * obs_source_output_video.  The frame must be passed to either
+ * obs_source_output_borrowed_video or obs_source_return_video_frame.
+ */
+EXPORT struct obs_source_frame *obs_source_borrow_video_frame(obs_source_t *source, enum video_format format,
+							      uint32_t width, uint32_t height);
+
+/**
+ * Outputs a frame from obs_source_borrow_video_frame without copying it.
+ * Ownership of the frame is given back to libobs.
+ */
+EXPORT void obs_source_output_borrowed_video(obs_source_t *source, struct obs_source_frame *frame);
+
+/** Gives back a frame from obs_source_borrow_video_frame without outputting it */
+EXPORT void obs_source_return_video_frame(obs_source_t *source, struct obs_source_frame *frame);
+
 EXPORT void obs_source_set_async_rotation(obs_source_t *source, long rotation);
 
 EXPORT void obs_source_output_cea708(obs_source_t *source, const struct obs_source_cea_708 *captions);
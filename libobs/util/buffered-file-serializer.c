@@ -20,18 +20,24 @@
 
 #include "platform.h"
 #include "threading.h"
+#include "darray.h"
 #include "deque.h"
 #include "dstr.h"
 
 static const size_t DEFAULT_BUF_SIZE = 256ULL * 1048576ULL; // 256 MiB
 static const size_t DEFAULT_CHUNK_SIZE = 1048576;           // 1 MiB
 
+/* marked data taking longer than this to reach the file gets a warning */
+static const uint64_t SLOW_MARK_NS = 2000000000ULL;
+
 /* ========================================================================== */
 /* Buffered writer based on ffmpeg-mux implementation                         */
 
+/* a header without data is a mark */
 struct io_header {
 	uint64_t seek_offset;
 	uint64_t data_length;
+	uint64_t queued_ns;
 };
 
 struct io_buffer {
@@ -48,6 +54,9 @@ struct io_buffer {
 
 	size_t buffer_size;
 	size_t chunk_size;
+
+	struct buffered_file_serializer_stats stats;
+	bool falling_behind;
 };
 
 struct file_output_data {
@@ -55,11 +64,40 @@ struct file_output_data {
 	struct io_buffer io;
 };
 
+static void mark_written(struct file_output_data *out, uint64_t queued_ns, uint64_t now)
+{
+	struct buffered_file_serializer_stats *stats = &out->io.stats;
+	uint64_t latency = now - queued_ns;
+	bool slow = latency >= SLOW_MARK_NS;
+
+	pthread_mutex_lock(&out->io.data_mutex);
+	stats->marks++;
+	stats->mark_latency_total_ns += latency;
+	if (latency > stats->mark_latency_max_ns)
+		stats->mark_latency_max_ns = latency;
+	pthread_mutex_unlock(&out->io.data_mutex);
+
+	/* warn once each time writing starts to fall behind */
+	if (slow && !out->io.falling_behind)
+		blog(LOG_WARNING, "Writing to '%s' is falling behind, data took %" PRIu64 " ms to reach the file",
+		     out->filename.array, latency / 1000000);
+	else
+		blog(LOG_DEBUG, "Marked data took %" PRIu64 " ms to reach '%s'", latency / 1000000,
+		     out->filename.array);
+
+	out->io.falling_behind = slow;
+}
+
 static void *io_thread(void *opaque)
 {
 	struct file_output_data *out = opaque;
 	os_set_thread_name("buffered writer i/o thread");
 
+	// Marks whose data is in the current chunk, reported once it has
+	// been written
+	DARRAY(uint64_t) pending_marks;
+	da_init(pending_marks);
+
 	// Chunk collects the writes into a larger batch
 	size_t chunk_used = 0;
 	size_t chunk_size = out->io.chunk_size;
@@ -107,6 +145,12 @@ static void *io_thread(void *opaque)
 				struct io_header header;
 				deque_peek_front(&out->io.data, &header, sizeof(header));
 
+				if (!header.data_length) {
+					deque_pop_front(&out->io.data, NULL, sizeof(header));
+					da_push_back(pending_marks, &header.queued_ns);
+					continue;
+				}
+
 				// Do we need to seek?
 				if (header.seek_offset != current_seek_position) {
 
@@ -147,10 +191,24 @@ static void *io_thread(void *opaque)
 			// Signal that there is more room in the buffer
 			os_event_signal(out->io.buffer_space_available_event);
 
+			// Marks with nothing in front of them are done already
+			if (!chunk_used && !want_seek && pending_marks.num) {
+				pthread_mutex_unlock(&out->io.data_mutex);
+
+				uint64_t now = os_gettime_ns();
+				for (size_t i = 0; i < pending_marks.num; i++)
+					mark_written(out, pending_marks.array[i], now);
+				da_clear(pending_marks);
+
+				pthread_mutex_lock(&out->io.data_mutex);
+			}
+
 			// Try to avoid lots of small writes unless this was the final
-			// data left in the buffer. The buffer might be entirely empty
-			// if we were woken up to exit.
-			if (!force_flush_chunk && (!chunk_used || (chunk_used < 65536 && !shutting_down))) {
+			// data left in the buffer, or marked data is waiting for it.
+			// The buffer might be entirely empty if we were woken up to
+			// exit.
+			if (!force_flush_chunk &&
+			    (!chunk_used || (chunk_used < 65536 && !shutting_down && !pending_marks.num))) {
 				os_event_reset(out->io.new_data_available_event);
 				pthread_mutex_unlock(&out->io.data_mutex);
 				break;
@@ -186,6 +244,13 @@ static void *io_thread(void *opaque)
 				goto error;
 			}
 
+			if (pending_marks.num) {
+				uint64_t now = os_gettime_ns();
+				for (size_t i = 0; i < pending_marks.num; i++)
+					mark_written(out, pending_marks.array[i], now);
+				da_clear(pending_marks);
+			}
+
 			chunk_used = 0;
 			force_flush_chunk = false;
 		}
@@ -198,6 +263,7 @@ static void *io_thread(void *opaque)
 error:
 	if (chunk)
 		bfree(chunk);
+	da_free(pending_marks);
 
 	fclose(out->io.output_file);
 	return NULL;
@@ -274,17 +340,28 @@ static size_t file_output_write(void *opaque, const void *buf, size_t buf_size)
 			// No space, wait for the I/O thread to make space
 			os_event_reset(out->io.buffer_space_available_event);
 			pthread_mutex_unlock(&out->io.data_mutex);
+
+			uint64_t wait_start = os_gettime_ns();
 			os_event_wait(out->io.buffer_space_available_event);
+			uint64_t waited = os_gettime_ns() - wait_start;
+
+			pthread_mutex_lock(&out->io.data_mutex);
+			out->io.stats.stalls++;
+			out->io.stats.stall_total_ns += waited;
+			pthread_mutex_unlock(&out->io.data_mutex);
 			continue;
 		}
 
 		// Calculate how many chunks we can fit into the buffer
 		size_t num_chunks = free_space / (next_chunk_size + sizeof(struct io_header));
 
+		uint64_t queued_ns = os_gettime_ns();
+
 		while (remaining && num_chunks--) {
 			struct io_header header = {
 				.data_length = next_chunk_size,
 				.seek_offset = out->io.next_pos,
+				.queued_ns = queued_ns,
 			};
 
 			// Copy the data into the buffer
@@ -300,6 +377,9 @@ static size_t file_output_write(void *opaque, const void *buf, size_t buf_size)
 			next_chunk_size = min(remaining, out->io.chunk_size);
 		}
 
+		if (out->io.data.size > out->io.stats.max_buffered)
+			out->io.stats.max_buffered = out->io.data.size;
+
 		// Tell the I/O thread that there's new data to be written
 		os_event_signal(out->io.new_data_available_event);
 
@@ -309,6 +389,41 @@ static size_t file_output_write(void *opaque, const void *buf, size_t buf_size)
 	return buf_size - remaining;
 }
 
+void buffered_file_serializer_mark(struct serializer *s)
+{
+	struct file_output_data *out = s->data;
+
+	if (!out || !out->io.active)
+		return;
+
+	pthread_mutex_lock(&out->io.data_mutex);
+
+	struct io_header header = {
+		.seek_offset = out->io.next_pos,
+		.queued_ns = os_gettime_ns(),
+	};
+
+	// Marks are tiny, so they are queued even if the buffer is full
+	deque_push_back(&out->io.data, &header, sizeof(header));
+	os_event_signal(out->io.new_data_available_event);
+
+	pthread_mutex_unlock(&out->io.data_mutex);
+}
+
+void buffered_file_serializer_get_stats(struct serializer *s, struct buffered_file_serializer_stats *stats)
+{
+	struct file_output_data *out = s->data;
+
+	if (!out || !out->io.active) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	pthread_mutex_lock(&out->io.data_mutex);
+	*stats = out->io.stats;
+	pthread_mutex_unlock(&out->io.data_mutex);
+}
+
 static int64_t file_output_get_pos(void *opaque)
 {
 	struct file_output_data *out = opaque;
@@ -383,6 +498,19 @@ void buffered_file_serializer_free(struct serializer *s)
 
 		blog(LOG_DEBUG, "Final buffer capacity: %zu KiB", out->io.data.capacity / 1024);
 
+		struct buffered_file_serializer_stats *stats = &out->io.stats;
+		if (stats->marks || stats->stalls) {
+			blog(LOG_INFO,
+			     "Finished writing '%s': peak buffer %zu KiB, marked data took %.1f ms on average "
+			     "and %.1f ms at most to reach the file, writes waited %" PRIu64 " times (%" PRIu64
+			     " ms) for buffer space",
+			     out->filename.array, stats->max_buffered / 1024,
+			     stats->marks ? (double)stats->mark_latency_total_ns / (double)stats->marks / 1000000.0
+					  : 0.0,
+			     (double)stats->mark_latency_max_ns / 1000000.0, stats->stalls,
+			     stats->stall_total_ns / 1000000);
+		}
+
 		deque_free(&out->io.data);
 	}
 
@@ -27,6 +27,25 @@ EXPORT bool buffered_file_serializer_init(struct serializer *s, const char *path
 					  size_t chunk_size);
 EXPORT void buffered_file_serializer_free(struct serializer *s);
 
+struct buffered_file_serializer_stats {
+	/* marks whose data has been written to the file */
+	uint64_t marks;
+	uint64_t mark_latency_total_ns;
+	uint64_t mark_latency_max_ns;
+
+	/* writes that had to wait for the I/O thread to free up buffer space */
+	uint64_t stalls;
+	uint64_t stall_total_ns;
+
+	size_t max_buffered;
+};
+
+/* Marks the end of a unit of data, such as a fragment.  The I/O thread
+ * measures how long it takes from the mark until everything written before it
+ * is in the file, and warns when that falls far behind. */
+EXPORT void buffered_file_serializer_mark(struct serializer *s);
+EXPORT void buffered_file_serializer_get_stats(struct serializer *s, struct buffered_file_serializer_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -277,3 +277,9 @@ size_t os_process_pipe_write(os_process_pipe_t *pp, const uint8_t *data, size_t
 
 	return 0;
 }
+
+bool os_process_pipe_flush(os_process_pipe_t *pp)
+{
+	/* writes go straight to the pipe handle, there is nothing buffered */
+	return pp && !pp->read_pipe;
+}
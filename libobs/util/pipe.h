@@ -35,6 +35,7 @@ EXPORT int os_process_pipe_destroy(os_process_pipe_t *pp);
 EXPORT size_t os_process_pipe_read(os_process_pipe_t *pp, uint8_t *data, size_t len);
 EXPORT size_t os_process_pipe_read_err(os_process_pipe_t *pp, uint8_t *data, size_t len);
 EXPORT size_t os_process_pipe_write(os_process_pipe_t *pp, const uint8_t *data, size_t len);
+EXPORT bool os_process_pipe_flush(os_process_pipe_t *pp);
 
 EXPORT struct os_process_args *os_process_args_create(const char *executable);
 EXPORT void os_process_args_add_arg(struct os_process_args *args, const char *arg);
@@ -69,6 +69,8 @@ struct profiler_entry {
 	struct ucirclebuf async_frame_ts;
 	/* Timestamps of last N async frames rendered */
 	struct ucirclebuf async_rendered_ts;
+	/* Capture times reported by the source for last N frames */
+	struct ucirclebuf capture;
 
 	UT_hash_handle hh;
 };
@@ -174,6 +176,7 @@ static struct profiler_entry *entry_create(const uintptr_t key)
 	ucirclebuf_init(&ent->render_gpu_sum, profiler_samples);
 	ucirclebuf_init(&ent->async_frame_ts, profiler_samples);
 	ucirclebuf_init(&ent->async_rendered_ts, profiler_samples);
+	ucirclebuf_init(&ent->capture, profiler_samples);
 	return ent;
 }
 
@@ -186,6 +189,7 @@ static void entry_destroy(struct profiler_entry *entry)
 	ucirclebuf_free(&entry->render_gpu_sum);
 	ucirclebuf_free(&entry->async_frame_ts);
 	ucirclebuf_free(&entry->async_rendered_ts);
+	ucirclebuf_free(&entry->capture);
 	bfree(entry);
 }
 
@@ -412,6 +416,21 @@ void source_profiler_async_frame_received(obs_source_t *source)
 	pthread_rwlock_unlock(&hm_rwlock);
 }
 
+void source_profiler_capture_time(obs_source_t *source, uint64_t duration)
+{
+	if (!enabled)
+		return;
+
+	pthread_rwlock_wrlock(&hm_rwlock);
+
+	struct profiler_entry *ent;
+	HASH_FIND_PTR(hm_entries, &source, ent);
+	if (ent)
+		ucirclebuf_push(&ent->capture, duration);
+
+	pthread_rwlock_unlock(&hm_rwlock);
+}
+
 uint64_t source_profiler_source_tick_start(void)
 {
 	if (!enabled)
@@ -425,7 +444,13 @@ void source_profiler_source_tick_end(obs_source_t *source, uint64_t start)
 	if (!enabled)
 		return;
 
-	const uint64_t delta = os_gettime_ns() - start;
+	source_profiler_source_tick_time(source, os_gettime_ns() - start);
+}
+
+void source_profiler_source_tick_time(obs_source_t *source, uint64_t delta)
+{
+	if (!enabled)
+		return;
 
 	struct source_samples *smp = NULL;
 	HASH_FIND_PTR(hm_samples, &source, smp);
@@ -619,6 +644,38 @@ bool source_profiler_fill_result(obs_source_t *source, struct profiler_result *r
 	return !!ent;
 }
 
+bool source_profiler_fill_capture_result(obs_source_t *source, uint64_t *avg, uint64_t *max)
+{
+	if (!enabled || !avg || !max)
+		return false;
+
+	*avg = *max = 0;
+
+	pthread_rwlock_rdlock(&hm_rwlock);
+
+	struct profiler_entry *ent = NULL;
+	HASH_FIND_PTR(hm_entries, &source, ent);
+	if (ent) {
+		size_t idx = 0;
+		uint64_t sum = 0;
+
+		for (; idx < ent->capture.num; idx++) {
+			const uint64_t delta = ent->capture.array[idx];
+			if (delta > *max)
+				*max = delta;
+
+			sum += delta;
+		}
+
+		if (idx)
+			*avg = sum / idx;
+	}
+
+	pthread_rwlock_unlock(&hm_rwlock);
+
+	return !!ent;
+}
+
 profiler_result_t *source_profiler_get_result(obs_source_t *source)
 {
 	profiler_result_t *ret = bmalloc(sizeof(profiler_result_t));
@@ -56,10 +56,16 @@ EXPORT void source_profiler_enable(bool enable);
 /* Enable/disable GPU profiling (applied on next frame) */
 EXPORT void source_profiler_gpu_enable(bool enable);
 
+/* Report the time a source spent capturing a frame outside of its tick,
+ * e.g. on its own capture thread (can be called from any thread) */
+EXPORT void source_profiler_capture_time(obs_source_t *source, uint64_t duration);
+
 /* Get latest profiling results for source (must be freed by user) */
 EXPORT profiler_result_t *source_profiler_get_result(obs_source_t *source);
 /* Update existing profiler results object for source */
 EXPORT bool source_profiler_fill_result(obs_source_t *source, profiler_result_t *result);
+/* Get average and max capture times reported by the source in ns */
+EXPORT bool source_profiler_fill_capture_result(obs_source_t *source, uint64_t *avg, uint64_t *max);
 
 #ifdef __cplusplus
 }
@@ -2,6 +2,8 @@
 #include "bmem.h"
 #include "threading.h"
 #include "deque.h"
+#include "darray.h"
+#include "platform.h"
 
 struct os_task_queue {
 	pthread_t thread;
@@ -162,3 +164,199 @@ static void *tiny_tubular_task_thread(void *param)
 
 	return NULL;
 }
+
+/* ------------------------------------------------------------------------- */
+
+struct os_task_job {
+	struct os_task_job *next;
+
+	os_task_range_t task;
+	void *param;
+	uint32_t count;
+	uint32_t band;
+	long bands;
+	volatile long next_band;
+
+	long wanted_helpers;
+	long active_helpers;
+	os_event_t *done_event;
+};
+
+struct os_task_pool {
+	DARRAY(pthread_t) threads;
+	os_sem_t *sem;
+	volatile bool stop;
+
+	pthread_mutex_t mutex;
+	struct os_task_job *first_job;
+};
+
+static void run_task_job(struct os_task_job *job)
+{
+	for (;;) {
+		long band = os_atomic_inc_long(&job->next_band) - 1;
+		if (band >= job->bands)
+			break;
+
+		uint32_t start = (uint32_t)band * job->band;
+		uint32_t end = start + job->band;
+		if (end > job->count)
+			end = job->count;
+
+		job->task(job->param, start, end);
+	}
+}
+
+static void *task_pool_thread(void *param)
+{
+	struct os_task_pool *pool = param;
+
+	os_set_thread_name("libobs: task pool thread");
+
+	while (os_sem_wait(pool->sem) == 0 && !os_atomic_load_bool(&pool->stop)) {
+		struct os_task_job *job;
+
+		pthread_mutex_lock(&pool->mutex);
+		job = pool->first_job;
+		while (job && !job->wanted_helpers)
+			job = job->next;
+		if (job) {
+			job->wanted_helpers--;
+			job->active_helpers++;
+		}
+		pthread_mutex_unlock(&pool->mutex);
+
+		/* the job was already finished by its caller */
+		if (!job)
+			continue;
+
+		run_task_job(job);
+
+		pthread_mutex_lock(&pool->mutex);
+		if (--job->active_helpers == 0 && job->done_event)
+			os_event_signal(job->done_event);
+		pthread_mutex_unlock(&pool->mutex);
+	}
+
+	return NULL;
+}
+
+os_task_pool_t *os_task_pool_create(size_t threads)
+{
+	struct os_task_pool *pool = bzalloc(sizeof(*pool));
+
+	if (pthread_mutex_init(&pool->mutex, NULL) != 0)
+		goto fail1;
+	if (os_sem_init(&pool->sem, 0) != 0)
+		goto fail2;
+
+	for (size_t i = 0; i < threads; i++) {
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, task_pool_thread, pool) != 0)
+			break;
+		da_push_back(pool->threads, &thread);
+	}
+
+	return pool;
+
+fail2:
+	pthread_mutex_destroy(&pool->mutex);
+fail1:
+	bfree(pool);
+	return NULL;
+}
+
+void os_task_pool_destroy(os_task_pool_t *pool)
+{
+	if (!pool)
+		return;
+
+	os_atomic_set_bool(&pool->stop, true);
+	for (size_t i = 0; i < pool->threads.num; i++)
+		os_sem_post(pool->sem);
+	for (size_t i = 0; i < pool->threads.num; i++)
+		pthread_join(pool->threads.array[i], NULL);
+
+	da_free(pool->threads);
+	os_sem_destroy(pool->sem);
+	pthread_mutex_destroy(&pool->mutex);
+	bfree(pool);
+}
+
+size_t os_task_pool_threads(os_task_pool_t *pool)
+{
+	return pool ? pool->threads.num : 0;
+}
+
+void os_task_pool_for(os_task_pool_t *pool, uint32_t count, uint32_t granularity, os_task_range_t task, void *param)
+{
+	struct os_task_job job = {0};
+	size_t threads = os_task_pool_threads(pool);
+	uint32_t band;
+
+	if (!count)
+		return;
+	if (!granularity)
+		granularity = 1;
+
+	band = (uint32_t)((count + threads) / (threads + 1));
+	band = (band + granularity - 1) / granularity * granularity;
+
+	job.task = task;
+	job.param = param;
+	job.count = count;
+	job.band = band;
+	job.bands = (long)((count + band - 1) / band);
+
+	if (job.bands == 1) {
+		task(param, 0, count);
+		return;
+	}
+
+	const long helpers = job.bands - 1;
+	job.wanted_helpers = helpers;
+
+	pthread_mutex_lock(&pool->mutex);
+	struct os_task_job **last = &pool->first_job;
+	while (*last)
+		last = &(*last)->next;
+	*last = &job;
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (long i = 0; i < helpers; i++)
+		os_sem_post(pool->sem);
+
+	run_task_job(&job);
+
+	/* every band has been claimed at this point, so take back any helper
+	 * slots that have not been picked up and wait for the ones that have */
+	pthread_mutex_lock(&pool->mutex);
+	struct os_task_job **cur = &pool->first_job;
+	while (*cur != &job)
+		cur = &(*cur)->next;
+	*cur = job.next;
+
+	job.wanted_helpers = 0;
+	bool wait = job.active_helpers > 0;
+	if (wait)
+		os_event_init(&job.done_event, OS_EVENT_TYPE_MANUAL);
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (!wait)
+		return;
+
+	if (job.done_event) {
+		os_event_wait(job.done_event);
+		os_event_destroy(job.done_event);
+		return;
+	}
+
+	for (;;) {
+		pthread_mutex_lock(&pool->mutex);
+		wait = job.active_helpers > 0;
+		pthread_mutex_unlock(&pool->mutex);
+		if (!wait)
+			break;
+		os_sleep_ms(0);
+	}
+}
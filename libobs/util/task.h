@@ -17,6 +17,21 @@ EXPORT void os_task_queue_destroy(os_task_queue_t *tt);
 EXPORT bool os_task_queue_wait(os_task_queue_t *tt);
 EXPORT bool os_task_queue_inside(os_task_queue_t *tt);
 
+/* Fixed pool of worker threads for splitting a range of work (e.g. the rows
+ * of a frame) across cores.  The calling thread takes part in the work, and
+ * os_task_pool_for() returns once the whole range has been processed. */
+
+struct os_task_pool;
+typedef struct os_task_pool os_task_pool_t;
+
+typedef void (*os_task_range_t)(void *param, uint32_t start, uint32_t end);
+
+EXPORT os_task_pool_t *os_task_pool_create(size_t threads);
+EXPORT void os_task_pool_destroy(os_task_pool_t *pool);
+EXPORT size_t os_task_pool_threads(os_task_pool_t *pool);
+EXPORT void os_task_pool_for(os_task_pool_t *pool, uint32_t count, uint32_t granularity, os_task_range_t task,
+			     void *param);
+
 #ifdef __cplusplus
 }
 #endif
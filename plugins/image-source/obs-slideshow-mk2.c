@@ -1149,7 +1149,7 @@ struct obs_source_info slideshow_info_mk2 = {
 	.version = 2,
 	.type = OBS_SOURCE_TYPE_INPUT,
 	.output_flags = OBS_SOURCE_VIDEO | OBS_SOURCE_CUSTOM_DRAW | OBS_SOURCE_COMPOSITE |
-			OBS_SOURCE_CONTROLLABLE_MEDIA,
+			OBS_SOURCE_CONTROLLABLE_MEDIA | OBS_SOURCE_TICK_WHILE_HIDDEN,
 	.get_name = ss_getname,
 	.create = ss_create,
 	.destroy = ss_destroy,
@@ -18,13 +18,18 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <stdlib.h>
 #include <inttypes.h>
+#include <xcb/damage.h>
 #include <xcb/randr.h>
 #include <xcb/shm.h>
 #include <xcb/xfixes.h>
 #include <xcb/xinerama.h>
 
 #include <obs-module.h>
+#include <util/darray.h>
 #include <util/dstr.h>
+#include <util/platform.h>
+#include <util/source-profiler.h>
+#include <util/threading.h>
 #include "xcursor-xcb.h"
 #include "xhelpers.h"
 
@@ -34,12 +39,20 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define INVALID_DISPLAY (-1)
 
+/* damaged rows closer than this are fetched with a single request */
+#define DAMAGE_ROW_GAP 16
+
+struct xshm_rows {
+	int_fast32_t y;
+	int_fast32_t cy;
+};
+
 struct xshm_data {
 	obs_source_t *source;
 
 	xcb_connection_t *xcb;
 	xcb_screen_t *xcb_screen;
-	xcb_shm_t *xshm;
+	xcb_shm_t *xshm[2];
 	xcb_xcursor_t *cursor;
 
 	char *server;
@@ -65,6 +78,26 @@ struct xshm_data {
 	bool use_xinerama;
 	bool use_randr;
 	bool advanced;
+	bool use_damage;
+
+	/* with damage tracking only the rows that changed since a segment was
+	 * last written are fetched, and only those are uploaded */
+	xcb_damage_damage_t damage;
+	xcb_xfixes_region_t damage_region;
+	uint8_t *stale_rows[2];
+	DARRAY(struct xshm_rows) fetched_rows[2];
+	DARRAY(xcb_shm_get_image_cookie_t) cookies;
+
+	/* the capture thread fills one shm segment while the other is being
+	 * uploaded in the video tick */
+	pthread_t capture_thread;
+	bool capture_thread_active;
+	os_sem_t *capture_sem;
+	volatile bool capture_stop;
+
+	pthread_mutex_t capture_mutex;
+	int ready_idx;
+	bool capture_pending;
 };
 
 /**
@@ -99,6 +132,9 @@ static bool xshm_check_extensions(xcb_connection_t *xcb)
 	if (!xcb_get_extension_data(xcb, &xcb_randr_id)->present)
 		blog(LOG_INFO, "Missing Randr extension !");
 
+	if (!xcb_get_extension_data(xcb, &xcb_damage_id)->present)
+		blog(LOG_INFO, "Missing Damage extension !");
+
 	return ok;
 }
 
@@ -170,6 +206,227 @@ static int_fast32_t xshm_update_geometry(struct xshm_data *data)
 	return 1;
 }
 
+/**
+ * Fetch the screen contents into a shm segment
+ *
+ * @return false if the image could not be captured
+ */
+static bool xshm_get_image(struct xshm_data *data, xcb_shm_t *shm)
+{
+	xcb_shm_get_image_cookie_t img_c;
+	xcb_shm_get_image_reply_t *img_r;
+
+	img_c = xcb_shm_get_image_unchecked(data->xcb, data->xcb_screen->root, data->adj_x_org, data->adj_y_org,
+					    data->adj_width, data->adj_height, ~0, XCB_IMAGE_FORMAT_Z_PIXMAP,
+					    shm->seg, 0);
+
+	img_r = xcb_shm_get_image_reply(data->xcb, img_c, NULL);
+
+	bool success = img_r != NULL;
+	free(img_r);
+	return success;
+}
+
+/**
+ * Start tracking damage on the root window
+ *
+ * @return false if the server does not support it
+ */
+static bool xshm_damage_init(struct xshm_data *data)
+{
+	xcb_damage_query_version_cookie_t damage_c;
+	xcb_damage_query_version_reply_t *damage_r;
+	xcb_xfixes_query_version_cookie_t xfixes_c;
+	xcb_xfixes_query_version_reply_t *xfixes_r;
+
+	if (!xcb_get_extension_data(data->xcb, &xcb_damage_id)->present)
+		return false;
+
+	/* regions need xfixes 2, which damage depends on anyway */
+	xfixes_c = xcb_xfixes_query_version(data->xcb, XCB_XFIXES_MAJOR_VERSION, XCB_XFIXES_MINOR_VERSION);
+	damage_c = xcb_damage_query_version(data->xcb, XCB_DAMAGE_MAJOR_VERSION, XCB_DAMAGE_MINOR_VERSION);
+	xfixes_r = xcb_xfixes_query_version_reply(data->xcb, xfixes_c, NULL);
+	damage_r = xcb_damage_query_version_reply(data->xcb, damage_c, NULL);
+
+	bool supported = xfixes_r && xfixes_r->major_version >= 2 && damage_r;
+	free(xfixes_r);
+	free(damage_r);
+
+	if (!supported)
+		return false;
+
+	data->damage = xcb_generate_id(data->xcb);
+	xcb_damage_create(data->xcb, data->damage, data->xcb_screen->root, XCB_DAMAGE_REPORT_LEVEL_NON_EMPTY);
+
+	data->damage_region = xcb_generate_id(data->xcb);
+	xcb_xfixes_create_region(data->xcb, data->damage_region, 0, NULL);
+
+	/* nothing has been fetched yet */
+	for (size_t i = 0; i < 2; i++) {
+		data->stale_rows[i] = bmalloc(data->adj_height);
+		memset(data->stale_rows[i], 1, data->adj_height);
+	}
+
+	return true;
+}
+
+static void xshm_damage_free(struct xshm_data *data)
+{
+	if (data->damage) {
+		if (data->xcb) {
+			xcb_damage_destroy(data->xcb, data->damage);
+			xcb_xfixes_destroy_region(data->xcb, data->damage_region);
+		}
+		data->damage = 0;
+		data->damage_region = 0;
+	}
+
+	for (size_t i = 0; i < 2; i++) {
+		bfree(data->stale_rows[i]);
+		data->stale_rows[i] = NULL;
+		da_free(data->fetched_rows[i]);
+	}
+	da_free(data->cookies);
+}
+
+/**
+ * Mark the rows damaged since the last call as stale in both segments
+ */
+static void xshm_mark_damage(struct xshm_data *data)
+{
+	xcb_xfixes_fetch_region_cookie_t region_c;
+	xcb_xfixes_fetch_region_reply_t *region_r;
+	xcb_generic_event_t *event;
+
+	/* only notify events arrive on this connection, the region is what
+	 * matters */
+	while ((event = xcb_poll_for_event(data->xcb)))
+		free(event);
+
+	xcb_damage_subtract(data->xcb, data->damage, XCB_NONE, data->damage_region);
+	region_c = xcb_xfixes_fetch_region(data->xcb, data->damage_region);
+	region_r = xcb_xfixes_fetch_region_reply(data->xcb, region_c, NULL);
+
+	if (!region_r) {
+		for (size_t i = 0; i < 2; i++)
+			memset(data->stale_rows[i], 1, data->adj_height);
+		return;
+	}
+
+	xcb_rectangle_t *rects = xcb_xfixes_fetch_region_rectangles(region_r);
+	int num_rects = xcb_xfixes_fetch_region_rectangles_length(region_r);
+
+	for (int i = 0; i < num_rects; i++) {
+		int_fast32_t x = rects[i].x - data->adj_x_org;
+		int_fast32_t y = rects[i].y - data->adj_y_org;
+		int_fast32_t y_end = y + rects[i].height;
+
+		if (x + rects[i].width <= 0 || x >= data->adj_width)
+			continue;
+
+		if (y < 0)
+			y = 0;
+		if (y_end > data->adj_height)
+			y_end = data->adj_height;
+		if (y >= y_end)
+			continue;
+
+		memset(data->stale_rows[0] + y, 1, y_end - y);
+		memset(data->stale_rows[1] + y, 1, y_end - y);
+	}
+
+	free(region_r);
+}
+
+/**
+ * Fetch the rows of a shm segment that changed since it was last written,
+ * the fetched rows are stored in fetched_rows for the upload
+ *
+ * @return false if nothing changed or the image could not be captured
+ */
+static bool xshm_get_damaged_image(struct xshm_data *data, int idx)
+{
+	uint8_t *stale = data->stale_rows[idx];
+	xcb_shm_t *shm = data->xshm[idx];
+	const uint32_t linesize = data->adj_width * 4;
+	bool success = true;
+
+	xshm_mark_damage(data);
+
+	da_resize(data->fetched_rows[idx], 0);
+	da_resize(data->cookies, 0);
+
+	for (int_fast32_t y = 0; y < data->adj_height; y++) {
+		if (!stale[y])
+			continue;
+
+		struct xshm_rows *last = da_end(data->fetched_rows[idx]);
+		if (last && y - (last->y + last->cy) < DAMAGE_ROW_GAP) {
+			last->cy = y + 1 - last->y;
+		} else {
+			struct xshm_rows rows = {y, 1};
+			da_push_back(data->fetched_rows[idx], &rows);
+		}
+	}
+
+	if (!data->fetched_rows[idx].num)
+		return false;
+
+	/* full width rows are contiguous in the segment, so each run of rows
+	 * lands in place */
+	for (size_t i = 0; i < data->fetched_rows[idx].num; i++) {
+		struct xshm_rows *rows = data->fetched_rows[idx].array + i;
+		xcb_shm_get_image_cookie_t img_c = xcb_shm_get_image_unchecked(
+			data->xcb, data->xcb_screen->root, data->adj_x_org, data->adj_y_org + rows->y,
+			data->adj_width, rows->cy, ~0, XCB_IMAGE_FORMAT_Z_PIXMAP, shm->seg, rows->y * linesize);
+		da_push_back(data->cookies, &img_c);
+	}
+
+	for (size_t i = 0; i < data->cookies.num; i++) {
+		xcb_shm_get_image_reply_t *img_r = xcb_shm_get_image_reply(data->xcb, data->cookies.array[i], NULL);
+		if (!img_r)
+			success = false;
+		free(img_r);
+	}
+
+	if (success)
+		memset(stale, 0, data->adj_height);
+
+	return success;
+}
+
+/**
+ * Capture thread, fetches one image each time the video tick asks for it
+ */
+static void *xshm_capture_thread(void *vptr)
+{
+	XSHM_DATA(vptr);
+	int idx = 0;
+
+	os_set_thread_name("xshm-input: capture");
+
+	while (os_sem_wait(data->capture_sem) == 0) {
+		if (os_atomic_load_bool(&data->capture_stop))
+			break;
+
+		uint64_t start = os_gettime_ns();
+		bool success = data->damage ? xshm_get_damaged_image(data, idx)
+					    : xshm_get_image(data, data->xshm[idx]);
+		source_profiler_capture_time(data->source, os_gettime_ns() - start);
+
+		pthread_mutex_lock(&data->capture_mutex);
+		data->capture_pending = false;
+		if (success)
+			data->ready_idx = idx;
+		pthread_mutex_unlock(&data->capture_mutex);
+
+		if (success)
+			idx ^= 1;
+	}
+
+	return NULL;
+}
+
 /**
  * Returns the name of the plugin
  */
@@ -184,6 +441,18 @@ static const char *xshm_getname(void *unused)
  */
 static void xshm_capture_stop(struct xshm_data *data)
 {
+	if (data->capture_thread_active) {
+		os_atomic_set_bool(&data->capture_stop, true);
+		os_sem_post(data->capture_sem);
+		pthread_join(data->capture_thread, NULL);
+		data->capture_thread_active = false;
+	}
+
+	if (data->capture_sem) {
+		os_sem_destroy(data->capture_sem);
+		data->capture_sem = NULL;
+	}
+
 	obs_enter_graphics();
 
 	if (data->texture) {
@@ -197,11 +466,15 @@ static void xshm_capture_stop(struct xshm_data *data)
 
 	obs_leave_graphics();
 
-	if (data->xshm) {
-		xshm_xcb_detach(data->xshm);
-		data->xshm = NULL;
+	for (size_t i = 0; i < 2; i++) {
+		if (data->xshm[i]) {
+			xshm_xcb_detach(data->xshm[i]);
+			data->xshm[i] = NULL;
+		}
 	}
 
+	xshm_damage_free(data);
+
 	if (data->xcb) {
 		xcb_disconnect(data->xcb);
 		data->xcb = NULL;
@@ -247,10 +520,12 @@ static void xshm_capture_start(struct xshm_data *data)
 		goto fail;
 	}
 
-	data->xshm = xshm_xcb_attach(data->xcb, data->adj_width, data->adj_height);
-	if (!data->xshm) {
-		blog(LOG_ERROR, "failed to attach shm !");
-		goto fail;
+	for (size_t i = 0; i < 2; i++) {
+		data->xshm[i] = xshm_xcb_attach(data->xcb, data->adj_width, data->adj_height);
+		if (!data->xshm[i]) {
+			blog(LOG_ERROR, "failed to attach shm !");
+			goto fail;
+		}
 	}
 
 	data->cursor = xcb_xcursor_init(data->xcb);
@@ -262,6 +537,24 @@ static void xshm_capture_start(struct xshm_data *data)
 
 	obs_leave_graphics();
 
+	if (data->use_damage && !xshm_damage_init(data))
+		blog(LOG_INFO, "damage tracking not available, capturing full frames");
+
+	data->ready_idx = -1;
+	data->capture_pending = false;
+	os_atomic_set_bool(&data->capture_stop, false);
+
+	if (os_sem_init(&data->capture_sem, 0) != 0) {
+		blog(LOG_ERROR, "failed to create capture semaphore !");
+		goto fail;
+	}
+
+	if (pthread_create(&data->capture_thread, NULL, xshm_capture_thread, data) != 0) {
+		blog(LOG_ERROR, "failed to create capture thread !");
+		goto fail;
+	}
+	data->capture_thread_active = true;
+
 	return;
 fail:
 	xshm_capture_stop(data);
@@ -279,6 +572,7 @@ static void xshm_update(void *vptr, obs_data_t *settings)
 	data->screen_id = obs_data_get_int(settings, "screen");
 	data->show_cursor = obs_data_get_bool(settings, "show_cursor");
 	data->advanced = obs_data_get_bool(settings, "advanced");
+	data->use_damage = obs_data_get_bool(settings, "use_damage");
 	data->server = bstrdup(obs_data_get_string(settings, "server"));
 
 	data->cut_top = obs_data_get_int(settings, "cut_top");
@@ -297,6 +591,7 @@ static void xshm_defaults(obs_data_t *defaults, int ver)
 	obs_data_set_default_int(defaults, "screen", ver == 1 ? 0 : INVALID_DISPLAY);
 	obs_data_set_default_bool(defaults, "show_cursor", true);
 	obs_data_set_default_bool(defaults, "advanced", false);
+	obs_data_set_default_bool(defaults, "use_damage", true);
 	obs_data_set_default_int(defaults, "cut_top", 0);
 	obs_data_set_default_int(defaults, "cut_left", 0);
 	obs_data_set_default_int(defaults, "cut_right", 0);
@@ -426,6 +721,7 @@ static obs_properties_t *xshm_properties(void *vptr)
 
 	obs_properties_add_list(props, "screen", obs_module_text("Display"), OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
 	obs_properties_add_bool(props, "show_cursor", obs_module_text("CaptureCursor"));
+	obs_properties_add_bool(props, "use_damage", obs_module_text("CaptureChangedAreas"));
 	obs_property_t *advanced = obs_properties_add_bool(props, "advanced", obs_module_text("AdvancedSettings"));
 
 	prop = obs_properties_add_int(props, "cut_top", obs_module_text("CropTop"), -4096, 4096, 1);
@@ -465,6 +761,7 @@ static void xshm_destroy(void *vptr)
 
 	xshm_capture_stop(data);
 
+	pthread_mutex_destroy(&data->capture_mutex);
 	bfree(data);
 }
 
@@ -476,11 +773,43 @@ static void *xshm_create(obs_data_t *settings, obs_source_t *source)
 	struct xshm_data *data = bzalloc(sizeof(struct xshm_data));
 	data->source = source;
 
+	if (pthread_mutex_init(&data->capture_mutex, NULL) != 0) {
+		bfree(data);
+		return NULL;
+	}
+
 	xshm_update(data, settings);
 
 	return data;
 }
 
+/**
+ * Upload a captured segment, only the fetched rows if damage is tracked
+ */
+static void xshm_upload(struct xshm_data *data, int idx)
+{
+	const uint8_t *image = data->xshm[idx]->data;
+	const uint32_t linesize = data->adj_width * 4;
+
+	if (data->damage) {
+		size_t i = 0;
+
+		for (; i < data->fetched_rows[idx].num; i++) {
+			struct xshm_rows *rows = data->fetched_rows[idx].array + i;
+			if (rows->cy == data->adj_height)
+				break;
+			if (!gs_texture_set_image_region(data->texture, 0, rows->y, data->adj_width, rows->cy,
+							 image + rows->y * linesize, linesize))
+				break;
+		}
+
+		if (i == data->fetched_rows[idx].num)
+			return;
+	}
+
+	gs_texture_set_image(data->texture, image, linesize, false);
+}
+
 /**
  * Prepare the capture data
  */
@@ -494,27 +823,25 @@ static void xshm_video_tick(void *vptr, float seconds)
 	if (!obs_source_showing(data->source))
 		return;
 
-	xcb_shm_get_image_cookie_t img_c;
-	xcb_shm_get_image_reply_t *img_r;
-
-	img_c = xcb_shm_get_image_unchecked(data->xcb, data->xcb_screen->root, data->adj_x_org, data->adj_y_org,
-					    data->adj_width, data->adj_height, ~0, XCB_IMAGE_FORMAT_Z_PIXMAP,
-					    data->xshm->seg, 0);
+	pthread_mutex_lock(&data->capture_mutex);
+	int ready_idx = data->ready_idx;
+	bool request = !data->capture_pending;
+	data->ready_idx = -1;
+	data->capture_pending = true;
+	pthread_mutex_unlock(&data->capture_mutex);
 
-	img_r = xcb_shm_get_image_reply(data->xcb, img_c, NULL);
-
-	if (!img_r)
-		goto exit;
+	/* the next image goes into the other segment, so it can be fetched
+	 * while this one is uploaded */
+	if (request)
+		os_sem_post(data->capture_sem);
 
 	obs_enter_graphics();
 
-	gs_texture_set_image(data->texture, (void *)data->xshm->data, data->adj_width * 4, false);
+	if (ready_idx != -1)
+		xshm_upload(data, ready_idx);
 	xcb_xcursor_update(data->xcb, data->cursor);
 
 	obs_leave_graphics();
-
-exit:
-	free(img_r);
 }
 
 /**
@@ -15,13 +15,19 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <inttypes.h>
 #include <obs-module.h>
+#include <util/bmem.h>
+#include <util/platform.h>
 #include <linux/videodev2.h>
 
 #include "v4l2-decoder.h"
 
 #define blog(level, msg, ...) blog(level, "v4l2-input: decoder: " msg, ##__VA_ARGS__)
 
+/* every frame thread adds a frame of latency, so only use a few of them */
+#define MAX_DECODE_THREADS 4
+
 int v4l2_init_decoder(struct v4l2_decoder *decoder, int pixfmt)
 {
 	if (pixfmt == V4L2_PIX_FMT_MJPEG) {
@@ -55,6 +61,11 @@ int v4l2_init_decoder(struct v4l2_decoder *decoder, int pixfmt)
 
 	decoder->context->flags2 |= AV_CODEC_FLAG2_FAST;
 
+	int threads = os_get_logical_cores();
+	decoder->context->thread_count = threads < MAX_DECODE_THREADS ? threads : MAX_DECODE_THREADS;
+	decoder->context->thread_type = FF_THREAD_FRAME;
+	decoder->can_drop = pixfmt == V4L2_PIX_FMT_MJPEG;
+
 	if (avcodec_open2(decoder->context, decoder->codec, NULL) < 0) {
 		blog(LOG_ERROR, "failed to open codec");
 		return -1;
@@ -68,6 +79,8 @@ int v4l2_init_decoder(struct v4l2_decoder *decoder, int pixfmt)
 void v4l2_destroy_decoder(struct v4l2_decoder *decoder)
 {
 	blog(LOG_DEBUG, "destroying avcodec");
+	v4l2_stop_decoder(decoder);
+
 	if (decoder->frame) {
 		av_frame_free(&decoder->frame);
 	}
@@ -84,26 +97,9 @@ void v4l2_destroy_decoder(struct v4l2_decoder *decoder)
 	}
 }
 
-int v4l2_decode_frame(struct obs_source_frame *out, uint8_t *data, size_t length, struct v4l2_decoder *decoder)
+static void set_frame_format(struct obs_source_frame *out, enum AVPixelFormat format)
 {
-	decoder->packet->data = data;
-	decoder->packet->size = length;
-	if (avcodec_send_packet(decoder->context, decoder->packet) < 0) {
-		blog(LOG_ERROR, "failed to send frame to codec");
-		return -1;
-	}
-
-	if (avcodec_receive_frame(decoder->context, decoder->frame) < 0) {
-		blog(LOG_ERROR, "failed to receive frame from codec");
-		return -1;
-	}
-
-	for (uint_fast32_t i = 0; i < MAX_AV_PLANES; ++i) {
-		out->data[i] = decoder->frame->data[i];
-		out->linesize[i] = decoder->frame->linesize[i];
-	}
-
-	switch (decoder->context->pix_fmt) {
+	switch (format) {
 	case AV_PIX_FMT_GRAY8:
 		out->format = VIDEO_FORMAT_Y800;
 		break;
@@ -122,6 +118,228 @@ int v4l2_decode_frame(struct obs_source_frame *out, uint8_t *data, size_t length
 	default:
 		break;
 	}
+}
+
+static void track_frame(struct v4l2_decoder *decoder, int64_t pts, uint64_t queued_ns)
+{
+	size_t oldest = 0;
+
+	/* frames the codec never returned are overwritten eventually */
+	for (size_t i = 0; i < V4L2_DECODE_TRACKED_FRAMES; i++) {
+		if (!decoder->pending[i].queued_ns) {
+			oldest = i;
+			break;
+		}
+		if (decoder->pending[i].queued_ns < decoder->pending[oldest].queued_ns)
+			oldest = i;
+	}
+
+	decoder->pending[oldest].pts = pts;
+	decoder->pending[oldest].queued_ns = queued_ns;
+}
+
+static void frame_decoded(struct v4l2_decoder *decoder, int64_t pts)
+{
+	uint64_t now = os_gettime_ns();
+
+	for (size_t i = 0; i < V4L2_DECODE_TRACKED_FRAMES; i++) {
+		if (decoder->pending[i].queued_ns && decoder->pending[i].pts == pts) {
+			uint64_t latency = now - decoder->pending[i].queued_ns;
+
+			decoder->latency_total_ns += latency;
+			if (latency > decoder->latency_max_ns)
+				decoder->latency_max_ns = latency;
+
+			decoder->pending[i].queued_ns = 0;
+			break;
+		}
+	}
+
+	decoder->decoded++;
+}
+
+static void decode_failed(struct v4l2_decoder *decoder, const char *msg)
+{
+	/* a broken frame does not stop the capture, only report the first */
+	if (!decoder->failed++)
+		blog(LOG_ERROR, "%s", msg);
+}
+
+static void decode_slot(struct v4l2_decoder *decoder, struct v4l2_decode_slot *slot)
+{
+	decoder->packet->data = slot->data;
+	decoder->packet->size = (int)slot->size;
+	decoder->packet->pts = (int64_t)slot->timestamp;
+
+	if (avcodec_send_packet(decoder->context, decoder->packet) < 0) {
+		decode_failed(decoder, "failed to send frame to codec");
+		return;
+	}
+
+	track_frame(decoder, decoder->packet->pts, slot->queued_ns);
+
+	/* with frame threading, the codec returns frames several packets
+	 * after they were sent */
+	for (;;) {
+		int ret = avcodec_receive_frame(decoder->context, decoder->frame);
+		if (ret == AVERROR(EAGAIN))
+			break;
+		if (ret < 0) {
+			decode_failed(decoder, "failed to receive frame from codec");
+			break;
+		}
+
+		for (uint_fast32_t i = 0; i < MAX_AV_PLANES; ++i) {
+			decoder->out.data[i] = decoder->frame->data[i];
+			decoder->out.linesize[i] = decoder->frame->linesize[i];
+		}
+
+		set_frame_format(&decoder->out, decoder->frame->format);
+		decoder->out.timestamp = (uint64_t)decoder->frame->pts;
+		obs_source_output_video(decoder->source, &decoder->out);
+
+		frame_decoded(decoder, decoder->frame->pts);
+	}
+}
+
+static void *decode_thread(void *param)
+{
+	struct v4l2_decoder *decoder = param;
+
+	os_set_thread_name("v4l2: decode");
+
+	for (;;) {
+		struct v4l2_decode_slot *slot;
+
+		os_sem_wait(decoder->queued_sem);
+		if (os_atomic_load_bool(&decoder->stop))
+			break;
+
+		pthread_mutex_lock(&decoder->mutex);
+		slot = &decoder->slots[decoder->head];
+		pthread_mutex_unlock(&decoder->mutex);
+
+		decode_slot(decoder, slot);
+
+		pthread_mutex_lock(&decoder->mutex);
+		decoder->head = (decoder->head + 1) % V4L2_DECODE_QUEUE_SIZE;
+		decoder->count--;
+		pthread_mutex_unlock(&decoder->mutex);
+
+		os_sem_post(decoder->free_sem);
+	}
+
+	return NULL;
+}
+
+int v4l2_start_decoder(struct v4l2_decoder *decoder, obs_source_t *source, const struct obs_source_frame *frame)
+{
+	decoder->source = source;
+	decoder->out = *frame;
+	decoder->head = 0;
+	decoder->count = 0;
+	decoder->stop = false;
+	decoder->decoded = 0;
+	decoder->failed = 0;
+	decoder->latency_total_ns = 0;
+	decoder->latency_max_ns = 0;
+	decoder->dropped = 0;
+	memset(decoder->pending, 0, sizeof(decoder->pending));
 
+	if (pthread_mutex_init(&decoder->mutex, NULL) != 0)
+		return -1;
+	if (os_sem_init(&decoder->queued_sem, 0) != 0)
+		goto fail_queued;
+	if (os_sem_init(&decoder->free_sem, V4L2_DECODE_QUEUE_SIZE) != 0)
+		goto fail_free;
+	if (pthread_create(&decoder->thread, NULL, decode_thread, decoder) != 0)
+		goto fail_thread;
+
+	decoder->thread_active = true;
+	blog(LOG_DEBUG, "started decode thread with %d frame threads", decoder->context->thread_count);
 	return 0;
+
+fail_thread:
+	os_sem_destroy(decoder->free_sem);
+fail_free:
+	os_sem_destroy(decoder->queued_sem);
+fail_queued:
+	pthread_mutex_destroy(&decoder->mutex);
+	blog(LOG_ERROR, "failed to start decode thread");
+	return -1;
+}
+
+void v4l2_stop_decoder(struct v4l2_decoder *decoder)
+{
+	if (!decoder->thread_active)
+		return;
+
+	os_atomic_set_bool(&decoder->stop, true);
+	os_sem_post(decoder->queued_sem);
+	pthread_join(decoder->thread, NULL);
+	decoder->thread_active = false;
+
+	os_sem_destroy(decoder->queued_sem);
+	os_sem_destroy(decoder->free_sem);
+	pthread_mutex_destroy(&decoder->mutex);
+
+	for (size_t i = 0; i < V4L2_DECODE_QUEUE_SIZE; i++) {
+		bfree(decoder->slots[i].data);
+		memset(&decoder->slots[i], 0, sizeof(decoder->slots[i]));
+	}
+
+	/* let the next capture start from a clean codec state */
+	avcodec_flush_buffers(decoder->context);
+
+	blog(LOG_INFO,
+	     "decoded %" PRIu64 " frames, latency: %.2f ms average, %.2f ms max, "
+	     "%ld buffers dropped, %" PRIu64 " frames failed",
+	     decoder->decoded,
+	     decoder->decoded ? (double)decoder->latency_total_ns / (double)decoder->decoded / 1000000.0 : 0.0,
+	     (double)decoder->latency_max_ns / 1000000.0, os_atomic_load_long(&decoder->dropped), decoder->failed);
+}
+
+bool v4l2_decoder_push(struct v4l2_decoder *decoder, const uint8_t *data, size_t length, uint64_t timestamp)
+{
+	struct v4l2_decode_slot *slot;
+	bool full;
+
+	if (decoder->can_drop) {
+		pthread_mutex_lock(&decoder->mutex);
+		full = decoder->count == V4L2_DECODE_QUEUE_SIZE;
+		pthread_mutex_unlock(&decoder->mutex);
+
+		if (full) {
+			os_atomic_inc_long(&decoder->dropped);
+			return false;
+		}
+	}
+
+	os_sem_wait(decoder->free_sem);
+
+	/* the slot after the queued ones is only touched by this thread until
+	 * it is counted */
+	pthread_mutex_lock(&decoder->mutex);
+	slot = &decoder->slots[(decoder->head + decoder->count) % V4L2_DECODE_QUEUE_SIZE];
+	pthread_mutex_unlock(&decoder->mutex);
+
+	if (slot->capacity < length + AV_INPUT_BUFFER_PADDING_SIZE) {
+		bfree(slot->data);
+		slot->capacity = length + AV_INPUT_BUFFER_PADDING_SIZE;
+		slot->data = bmalloc(slot->capacity);
+	}
+
+	/* the codec may read past the end of the data */
+	memcpy(slot->data, data, length);
+	memset(slot->data + length, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+	slot->size = length;
+	slot->timestamp = timestamp;
+	slot->queued_ns = os_gettime_ns();
+
+	pthread_mutex_lock(&decoder->mutex);
+	decoder->count++;
+	pthread_mutex_unlock(&decoder->mutex);
+
+	os_sem_post(decoder->queued_sem);
+	return true;
 }
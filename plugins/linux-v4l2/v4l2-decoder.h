@@ -21,10 +21,29 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 extern "C" {
 #endif
 
+#include <obs.h>
+#include <util/threading.h>
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/pixfmt.h>
 
+/** number of compressed buffers that can wait for the decode thread */
+#define V4L2_DECODE_QUEUE_SIZE 4
+
+/** number of frames the latency of which can be tracked at once */
+#define V4L2_DECODE_TRACKED_FRAMES 16
+
+/**
+ * Compressed frame waiting for the decode thread
+ */
+struct v4l2_decode_slot {
+	uint8_t *data;
+	size_t size;
+	size_t capacity;
+	uint64_t timestamp;
+	uint64_t queued_ns;
+};
+
 /**
  * Data structure for decoder
  */
@@ -33,6 +52,34 @@ struct v4l2_decoder {
 	AVCodecContext *context;
 	AVPacket *packet;
 	AVFrame *frame;
+
+	/* decode thread */
+	obs_source_t *source;
+	struct obs_source_frame out;
+	pthread_t thread;
+	bool thread_active;
+	volatile bool stop;
+	bool can_drop;
+
+	/* queue of compressed frames, the capture thread fills the slot after
+	 * the last queued one and the decode thread empties the first one */
+	struct v4l2_decode_slot slots[V4L2_DECODE_QUEUE_SIZE];
+	size_t head;
+	size_t count;
+	pthread_mutex_t mutex;
+	os_sem_t *queued_sem;
+	os_sem_t *free_sem;
+
+	/* statistics */
+	struct {
+		int64_t pts;
+		uint64_t queued_ns;
+	} pending[V4L2_DECODE_TRACKED_FRAMES];
+	uint64_t decoded;
+	uint64_t failed;
+	uint64_t latency_total_ns;
+	uint64_t latency_max_ns;
+	volatile long dropped;
 };
 
 /**
@@ -53,15 +100,38 @@ int v4l2_init_decoder(struct v4l2_decoder *decoder, int pixfmt);
 void v4l2_destroy_decoder(struct v4l2_decoder *decoder);
 
 /**
- * Decode a jpeg or h264 frame into an obs frame
+ * Start the decode thread.
+ * Frames are decoded on a separate thread with frame threading enabled, and
+ * are output to the source in the order they were pushed.
  *
- * @param out the obs frame to decode into
- * @param data the codec data
- * @param length length of the data
  * @param decoder the decoder as initialized by v4l2_init_decoder
+ * @param source the source to output decoded frames to
+ * @param frame template for the output frames, as prepared for capture
  * @return non-zero on failure
  */
-int v4l2_decode_frame(struct obs_source_frame *out, uint8_t *data, size_t length, struct v4l2_decoder *decoder);
+int v4l2_start_decoder(struct v4l2_decoder *decoder, obs_source_t *source, const struct obs_source_frame *frame);
+
+/**
+ * Stop the decode thread and log its statistics.
+ * Frames that are still queued are discarded.
+ *
+ * @param decoder the decoder structure
+ */
+void v4l2_stop_decoder(struct v4l2_decoder *decoder);
+
+/**
+ * Queue a jpeg or h264 frame for decoding.
+ * The data is copied, so the capture buffer can be requeued right away.
+ * If the queue is full, a jpeg frame is dropped while a h264 frame waits for
+ * space, since every following frame may depend on it.
+ *
+ * @param decoder the decoder structure
+ * @param data the codec data
+ * @param length length of the data
+ * @param timestamp timestamp of the frame
+ * @return false if the frame was dropped
+ */
+bool v4l2_decoder_push(struct v4l2_decoder *decoder, const uint8_t *data, size_t length, uint64_t timestamp);
 
 #ifdef __cplusplus
 }
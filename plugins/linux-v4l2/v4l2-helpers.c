@@ -30,9 +30,14 @@ int_fast32_t v4l2_start_capture(int_fast32_t dev, struct v4l2_buffer_data *buf)
 
 	memset(&enq, 0, sizeof(enq));
 	enq.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-	enq.memory = V4L2_MEMORY_MMAP;
+	enq.memory = buf->memory;
 
 	for (enq.index = 0; enq.index < buf->count; ++enq.index) {
+		if (buf->memory == V4L2_MEMORY_USERPTR) {
+			enq.m.userptr = (unsigned long)buf->info[enq.index].start;
+			enq.length = buf->info[enq.index].length;
+		}
+
 		if (v4l2_ioctl(dev, VIDIOC_QBUF, &enq) < 0) {
 			blog(LOG_ERROR, "unable to queue buffer");
 			return -1;
@@ -82,7 +87,7 @@ int_fast32_t v4l2_query_all_buffers(int_fast32_t dev, struct v4l2_buffer_data *b
 	for (uint_fast32_t i = 0; i < buf_data->count; i++) {
 		buf.index = i;
 		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		buf.memory = V4L2_MEMORY_MMAP;
+		buf.memory = buf_data->memory;
 		if (v4l2_ioctl(dev, VIDIOC_QUERYBUF, &buf) < 0) {
 			blog(LOG_DEBUG, "failed to read buffer data for buffer #%ld", i);
 		} else {
@@ -118,6 +123,7 @@ int_fast32_t v4l2_create_mmap(int_fast32_t dev, struct v4l2_buffer_data *buf)
 
 	buf->count = req.count;
 	buf->info = bzalloc(req.count * sizeof(struct v4l2_mmap_info));
+	buf->memory = V4L2_MEMORY_MMAP;
 
 	memset(&map, 0, sizeof(map));
 	map.type = req.type;
@@ -142,9 +148,38 @@ int_fast32_t v4l2_create_mmap(int_fast32_t dev, struct v4l2_buffer_data *buf)
 	return 0;
 }
 
+int_fast32_t v4l2_create_userptr(int_fast32_t dev, struct v4l2_buffer_data *buf)
+{
+	struct v4l2_requestbuffers req;
+
+	memset(&req, 0, sizeof(req));
+	req.count = 4;
+	req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	req.memory = V4L2_MEMORY_USERPTR;
+
+	if (v4l2_ioctl(dev, VIDIOC_REQBUFS, &req) < 0) {
+		blog(LOG_DEBUG, "Request for user pointer buffers failed");
+		return -1;
+	}
+
+	if (req.count < 2) {
+		blog(LOG_DEBUG, "Device returned less than 2 user pointer buffers");
+		req.count = 0;
+		v4l2_ioctl(dev, VIDIOC_REQBUFS, &req);
+		return -1;
+	}
+
+	buf->count = req.count;
+	buf->info = bzalloc(req.count * sizeof(struct v4l2_mmap_info));
+	buf->memory = V4L2_MEMORY_USERPTR;
+
+	return 0;
+}
+
 int_fast32_t v4l2_destroy_mmap(struct v4l2_buffer_data *buf)
 {
-	for (uint_fast32_t i = 0; i < buf->count; ++i) {
+	/* user pointer memory belongs to the frames it was borrowed with */
+	for (uint_fast32_t i = 0; i < buf->count && buf->memory != V4L2_MEMORY_USERPTR; ++i) {
 		if (buf->info[i].start != MAP_FAILED && buf->info[i].start != 0)
 			v4l2_munmap(buf->info[i].start, buf->info[i].length);
 	}
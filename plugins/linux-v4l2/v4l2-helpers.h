@@ -38,6 +38,8 @@ struct v4l2_mmap_info {
 	size_t length;
 	/** start address of the mapped buffer */
 	void *start;
+	/** frame that provides the memory for user pointer buffers */
+	struct obs_source_frame *frame;
 };
 
 /**
@@ -48,6 +50,8 @@ struct v4l2_buffer_data {
 	uint_fast32_t count;
 	/** memory info for mapped buffers */
 	struct v4l2_mmap_info *info;
+	/** V4L2_MEMORY_MMAP or V4L2_MEMORY_USERPTR */
+	uint32_t memory;
 };
 
 /**
@@ -229,9 +233,26 @@ int_fast32_t v4l2_query_all_buffers(int_fast32_t dev, struct v4l2_buffer_data *b
  */
 int_fast32_t v4l2_create_mmap(int_fast32_t dev, struct v4l2_buffer_data *buf);
 
+/**
+ * Request user pointer buffers
+ *
+ * This tries to get at least 2, preferably 4, buffers that capture into
+ * memory provided by the application. The memory has to be assigned to
+ * every buffer before the capture is started.
+ *
+ * @param dev handle for the v4l2 device
+ * @param buf buffer data
+ *
+ * @return negative on failure
+ */
+int_fast32_t v4l2_create_userptr(int_fast32_t dev, struct v4l2_buffer_data *buf);
+
 /**
  * Destroy the memory mapping for buffers
  *
+ * The memory of user pointer buffers is left alone, their frames have to be
+ * given back by the caller first.
+ *
  * @param buf buffer data
  *
  * @return negative on failure
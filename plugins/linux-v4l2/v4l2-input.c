@@ -93,12 +93,14 @@ struct v4l2_data {
 
 	bool auto_reset;
 	int timeout_frames;
+	bool force_mmap;
 };
 
 /* forward declarations */
 static void v4l2_init(struct v4l2_data *data);
 static void v4l2_terminate(struct v4l2_data *data);
 static void v4l2_update(void *vptr, obs_data_t *settings);
+static void v4l2_free_userptr(struct v4l2_data *data);
 
 /**
  * Prepare the output frame structure for obs and compute plane offsets
@@ -154,6 +156,55 @@ static void v4l2_prep_obs_frame(struct v4l2_data *data, struct obs_source_frame
 	}
 }
 
+/**
+ * Output the frame a user pointer buffer captured into
+ *
+ * The buffer is given a newly borrowed frame to capture into next, so it can
+ * be requeued right away while libobs holds on to the captured frame.
+ */
+static void v4l2_output_userptr(struct v4l2_data *data, struct v4l2_buffer *buf, const struct obs_source_frame *out)
+{
+	struct v4l2_mmap_info *info = &data->buffers.info[buf->index];
+	struct obs_source_frame *frame = info->frame;
+	struct obs_source_frame *next;
+
+	next = obs_source_borrow_video_frame(data->source, frame->format, frame->width, frame->height);
+
+	frame->timestamp = out->timestamp;
+	frame->flags = out->flags;
+	memcpy(frame->color_matrix, out->color_matrix, sizeof(frame->color_matrix));
+	memcpy(frame->color_range_min, out->color_range_min, sizeof(frame->color_range_min));
+	memcpy(frame->color_range_max, out->color_range_max, sizeof(frame->color_range_max));
+	obs_source_output_borrowed_video(data->source, frame);
+
+	info->frame = next;
+	info->start = next->data[0];
+	buf->m.userptr = (unsigned long)info->start;
+	buf->length = info->length;
+}
+
+/**
+ * Replace user pointer buffers the driver would not capture into
+ *
+ * Some drivers accept user pointers when buffers are requested, but then
+ * reject the memory when it is queued or when streaming starts.
+ */
+static int v4l2_fallback_to_mmap(struct v4l2_data *data)
+{
+	blog(LOG_WARNING, "%s: unable to capture into user pointer buffers, falling back to mapped buffers",
+	     data->device_id);
+
+	v4l2_stop_capture(data->dev);
+	v4l2_free_userptr(data);
+
+	if (v4l2_create_mmap(data->dev, &data->buffers) < 0) {
+		blog(LOG_ERROR, "%s: failed to map buffers", data->device_id);
+		return -1;
+	}
+
+	return v4l2_start_capture(data->dev, &data->buffers);
+}
+
 /*
  * Worker thread to get video data
  */
@@ -172,6 +223,7 @@ static void *v4l2_thread(void *vptr)
 	int fps_num, fps_denom;
 	float ffps;
 	uint64_t timeout_usec;
+	bool decode;
 
 	blog(LOG_DEBUG, "%s: new capture thread", data->device_id);
 	os_set_thread_name("v4l2: capture");
@@ -185,8 +237,10 @@ static void *v4l2_thread(void *vptr)
 	blog(LOG_INFO, "%s: select timeout set to %" PRIu64 " (%dx frame periods)", data->device_id, timeout_usec,
 	     data->timeout_frames);
 
-	if (v4l2_start_capture(data->dev, &data->buffers) < 0)
-		goto exit;
+	if (v4l2_start_capture(data->dev, &data->buffers) < 0) {
+		if (data->buffers.memory != V4L2_MEMORY_USERPTR || v4l2_fallback_to_mmap(data) < 0)
+			goto exit;
+	}
 
 	blog(LOG_DEBUG, "%s: new capture started", data->device_id);
 
@@ -196,6 +250,12 @@ static void *v4l2_thread(void *vptr)
 
 	blog(LOG_DEBUG, "%s: obs frame prepared", data->device_id);
 
+	/* compressed frames are decoded on their own thread, so that buffers
+	 * go back to the device as soon as they are copied */
+	decode = data->pixfmt == V4L2_PIX_FMT_MJPEG || data->pixfmt == V4L2_PIX_FMT_H264;
+	if (decode && v4l2_start_decoder(&data->decoder, data->source, &out) < 0)
+		goto exit;
+
 	while (os_event_try(data->event) == EAGAIN) {
 		FD_ZERO(&fds);
 		FD_SET(data->dev, &fds);
@@ -232,7 +292,7 @@ static void *v4l2_thread(void *vptr)
 		}
 
 		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		buf.memory = V4L2_MEMORY_MMAP;
+		buf.memory = data->buffers.memory;
 
 		if (v4l2_ioctl(data->dev, VIDIOC_DQBUF, &buf) < 0) {
 			if (errno == EAGAIN) {
@@ -253,16 +313,15 @@ static void *v4l2_thread(void *vptr)
 
 		start = (uint8_t *)data->buffers.info[buf.index].start;
 
-		if (data->pixfmt == V4L2_PIX_FMT_MJPEG || data->pixfmt == V4L2_PIX_FMT_H264) {
-			if (v4l2_decode_frame(&out, start, buf.bytesused, &data->decoder) < 0) {
-				blog(LOG_ERROR, "failed to unpack jpeg or h264");
-				break;
-			}
+		if (decode) {
+			v4l2_decoder_push(&data->decoder, start, buf.bytesused, out.timestamp);
+		} else if (data->buffers.memory == V4L2_MEMORY_USERPTR) {
+			v4l2_output_userptr(data, &buf, &out);
 		} else {
 			for (uint_fast32_t i = 0; i < MAX_AV_PLANES; ++i)
 				out.data[i] = start + plane_offsets[i];
+			obs_source_output_video(data->source, &out);
 		}
-		obs_source_output_video(data->source, &out);
 
 		if (v4l2_ioctl(data->dev, VIDIOC_QBUF, &buf) < 0) {
 			blog(LOG_ERROR, "%s: failed to enqueue buffer", data->device_id);
@@ -274,6 +333,9 @@ static void *v4l2_thread(void *vptr)
 
 	blog(LOG_INFO, "%s: Stopped capture after %" PRIu64 " frames", data->device_id, frames);
 
+	if (decode)
+		v4l2_stop_decoder(&data->decoder);
+
 exit:
 	v4l2_stop_capture(data->dev);
 	return NULL;
@@ -297,6 +359,7 @@ static void v4l2_defaults(obs_data_t *settings)
 	obs_data_set_default_bool(settings, "buffering", true);
 	obs_data_set_default_bool(settings, "auto_reset", false);
 	obs_data_set_default_int(settings, "timeout_frames", 5);
+	obs_data_set_default_bool(settings, "force_mmap", false);
 }
 
 /**
@@ -807,6 +870,8 @@ static obs_properties_t *v4l2_properties(void *vptr)
 
 	obs_properties_add_int(props, "timeout_frames", obs_module_text("FramesUntilTimeout"), 2, 120, 1);
 
+	obs_properties_add_bool(props, "force_mmap", obs_module_text("ForceMmap"));
+
 	// a group to contain the camera control
 	obs_properties_t *ctrl_props = obs_properties_create();
 	obs_properties_add_group(props, "controls", obs_module_text("CameraCtrls"), OBS_GROUP_NORMAL, ctrl_props);
@@ -823,6 +888,69 @@ static obs_properties_t *v4l2_properties(void *vptr)
 	return props;
 }
 
+/**
+ * Set up buffers that capture straight into borrowed frames
+ *
+ * This only works for single plane formats that libobs lays out the same way
+ * the device does, and only with drivers that support user pointers.
+ * Everything else uses memory mapped buffers, which are copied by libobs.
+ */
+static bool v4l2_init_userptr(struct v4l2_data *data)
+{
+	const enum video_format format = v4l2_to_obs_video_format(data->pixfmt);
+	struct v4l2_format fmt;
+
+	if (format == VIDEO_FORMAT_NONE)
+		return false;
+
+	memset(&fmt, 0, sizeof(fmt));
+	fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if (v4l2_ioctl(data->dev, VIDIOC_G_FMT, &fmt) < 0)
+		return false;
+
+	if (v4l2_create_userptr(data->dev, &data->buffers) < 0)
+		return false;
+
+	for (uint_fast32_t i = 0; i < data->buffers.count; ++i) {
+		struct v4l2_mmap_info *info = &data->buffers.info[i];
+		struct obs_source_frame *frame;
+
+		frame = obs_source_borrow_video_frame(data->source, format, data->width, data->height);
+		info->frame = frame;
+		if (!frame || frame->data[1] || frame->linesize[0] != (uint32_t)data->linesize)
+			goto fail;
+
+		info->start = frame->data[0];
+		info->length = (size_t)frame->linesize[0] * frame->height;
+		if (info->length < fmt.fmt.pix.sizeimage)
+			goto fail;
+	}
+
+	return true;
+
+fail:
+	v4l2_free_userptr(data);
+	return false;
+}
+
+static void v4l2_free_userptr(struct v4l2_data *data)
+{
+	struct v4l2_requestbuffers req;
+
+	/* make the driver let go of the memory before the frames go back */
+	memset(&req, 0, sizeof(req));
+	req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	req.memory = V4L2_MEMORY_USERPTR;
+	v4l2_ioctl(data->dev, VIDIOC_REQBUFS, &req);
+
+	for (uint_fast32_t i = 0; i < data->buffers.count; ++i) {
+		if (data->buffers.info[i].frame)
+			obs_source_return_video_frame(data->source, data->buffers.info[i].frame);
+	}
+
+	v4l2_destroy_mmap(&data->buffers);
+}
+
 static void v4l2_terminate(struct v4l2_data *data)
 {
 	if (data->thread) {
@@ -835,7 +963,11 @@ static void v4l2_terminate(struct v4l2_data *data)
 	if (data->pixfmt == V4L2_PIX_FMT_MJPEG || data->pixfmt == V4L2_PIX_FMT_H264) {
 		v4l2_destroy_decoder(&data->decoder);
 	}
-	v4l2_destroy_mmap(&data->buffers);
+
+	if (data->buffers.count && data->buffers.memory == V4L2_MEMORY_USERPTR)
+		v4l2_free_userptr(data);
+	else
+		v4l2_destroy_mmap(&data->buffers);
 
 	if (data->dev != -1) {
 		v4l2_close(data->dev);
@@ -946,8 +1078,11 @@ static void v4l2_init(struct v4l2_data *data)
 	v4l2_unpack_tuple(&fps_num, &fps_denom, data->framerate);
 	blog(LOG_INFO, "Framerate: %.2f fps", (float)fps_denom / fps_num);
 
-	/* map buffers */
-	if (v4l2_create_mmap(data->dev, &data->buffers) < 0) {
+	/* capture into frames borrowed from libobs where possible, and map
+	 * buffers otherwise */
+	if (!data->force_mmap && v4l2_init_userptr(data)) {
+		blog(LOG_INFO, "Capturing into %" PRIuFAST32 " user pointer buffers", data->buffers.count);
+	} else if (v4l2_create_mmap(data->dev, &data->buffers) < 0) {
 		blog(LOG_ERROR, "Failed to map buffers");
 		goto fail;
 	}
@@ -1014,6 +1149,7 @@ static bool v4l2_settings_changed(struct v4l2_data *data, obs_data_t *settings)
 		}
 
 		res |= data->color_range != obs_data_get_int(settings, "color_range");
+		res |= data->force_mmap != obs_data_get_bool(settings, "force_mmap");
 	} else {
 		res = true;
 	}
@@ -1051,6 +1187,7 @@ static void v4l2_update(void *vptr, obs_data_t *settings)
 	data->color_range = obs_data_get_int(settings, "color_range");
 	data->auto_reset = obs_data_get_bool(settings, "auto_reset");
 	data->timeout_frames = obs_data_get_int(settings, "timeout_frames");
+	data->force_mmap = obs_data_get_bool(settings, "force_mmap");
 
 	v4l2_update_source_flags(data, settings);
 
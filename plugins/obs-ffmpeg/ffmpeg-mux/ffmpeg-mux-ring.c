@@ -0,0 +1,327 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "ffmpeg-mux-ring.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* keeps the ring data cache line aligned */
+#define HEADER_SIZE 64
+#define RECORD_ALIGN 8
+
+static volatile long ring_counter = 0;
+
+static inline size_t record_size(uint32_t size)
+{
+	return (sizeof(struct ffm_packet_info) + size + RECORD_ALIGN - 1) & ~(size_t)(RECORD_ALIGN - 1);
+}
+
+static void set_mapping(struct ffm_ring *ring, void *mem)
+{
+	ring->header = mem;
+	ring->data = (uint8_t *)mem + HEADER_SIZE;
+	ring->size = ring->header->size;
+}
+
+#ifdef _WIN32
+static bool map_shared_memory(struct ffm_ring *ring, bool create)
+{
+	wchar_t *wname = NULL;
+	void *mem;
+
+	if (!os_utf8_to_wcs_ptr(ring->name, 0, &wname))
+		return false;
+
+	if (create) {
+		ring->handle = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD)ring->map_size,
+						  wname);
+		if (ring->handle && GetLastError() == ERROR_ALREADY_EXISTS) {
+			CloseHandle(ring->handle);
+			ring->handle = NULL;
+		}
+	} else {
+		ring->handle = OpenFileMappingW(FILE_MAP_ALL_ACCESS, false, wname);
+	}
+
+	bfree(wname);
+
+	if (!ring->handle)
+		return false;
+
+	mem = MapViewOfFile(ring->handle, FILE_MAP_ALL_ACCESS, 0, 0, ring->map_size);
+	if (!mem) {
+		CloseHandle(ring->handle);
+		ring->handle = NULL;
+		return false;
+	}
+
+	if (!ring->map_size) {
+		MEMORY_BASIC_INFORMATION info;
+		VirtualQuery(mem, &info, sizeof(info));
+		ring->map_size = info.RegionSize;
+	}
+
+	set_mapping(ring, mem);
+	return true;
+}
+
+static void unmap_shared_memory(struct ffm_ring *ring)
+{
+	UnmapViewOfFile(ring->header);
+	CloseHandle(ring->handle);
+}
+#else
+static bool map_shared_memory(struct ffm_ring *ring, bool create)
+{
+	int fd;
+	void *mem;
+
+	if (create) {
+		fd = shm_open(ring->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (fd == -1)
+			return false;
+
+		if (ftruncate(fd, (off_t)ring->map_size) != 0) {
+			close(fd);
+			shm_unlink(ring->name);
+			return false;
+		}
+	} else {
+		struct stat st;
+
+		fd = shm_open(ring->name, O_RDWR, 0);
+		if (fd == -1)
+			return false;
+
+		if (fstat(fd, &st) != 0 || st.st_size < HEADER_SIZE) {
+			close(fd);
+			return false;
+		}
+
+		ring->map_size = (size_t)st.st_size;
+	}
+
+	mem = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (mem == MAP_FAILED) {
+		if (create)
+			shm_unlink(ring->name);
+		return false;
+	}
+
+	/* both sides have it mapped once the consumer opened it, so the name
+	 * does not need to outlive that */
+	if (!create)
+		shm_unlink(ring->name);
+
+	set_mapping(ring, mem);
+	return true;
+}
+
+static void unmap_shared_memory(struct ffm_ring *ring)
+{
+	munmap(ring->header, ring->map_size);
+
+	/* in case the consumer never got to open it */
+	if (ring->owner)
+		shm_unlink(ring->name);
+}
+#endif
+
+bool ffm_ring_create(struct ffm_ring *ring, uint32_t size)
+{
+	long id = os_atomic_inc_long(&ring_counter);
+
+	memset(ring, 0, sizeof(*ring));
+
+	/* macOS limits shared memory names to 31 characters */
+#ifdef _WIN32
+	snprintf(ring->name, sizeof(ring->name), "Local\\obs-mux-%lu-%ld", GetCurrentProcessId(), id);
+#else
+	snprintf(ring->name, sizeof(ring->name), "/obs-mux-%d-%ld", (int)getpid(), id);
+#endif
+
+	ring->map_size = HEADER_SIZE + (size_t)size;
+	ring->owner = true;
+
+	if (!map_shared_memory(ring, true))
+		return false;
+
+	/* fresh mappings are zero filled, only the size needs to be set */
+	ring->header->size = size;
+	ring->size = size;
+	return true;
+}
+
+bool ffm_ring_open(struct ffm_ring *ring, const char *name)
+{
+	memset(ring, 0, sizeof(*ring));
+	snprintf(ring->name, sizeof(ring->name), "%s", name);
+
+	if (!map_shared_memory(ring, false))
+		return false;
+
+	/* the size has to be a power of two that fits the mapping, anything
+	 * else did not come from ffm_ring_create */
+	if (!ring->size || (ring->size & (ring->size - 1)) != 0 || HEADER_SIZE + (size_t)ring->size > ring->map_size) {
+		unmap_shared_memory(ring);
+		memset(ring, 0, sizeof(*ring));
+		return false;
+	}
+
+	return true;
+}
+
+void ffm_ring_close(struct ffm_ring *ring)
+{
+	if (ring->header)
+		unmap_shared_memory(ring);
+	memset(ring, 0, sizeof(*ring));
+}
+
+/* ------------------------------------------------------------------------- */
+/* producer                                                                  */
+
+bool ffm_ring_fits(const struct ffm_ring *ring, uint32_t size)
+{
+	return record_size(size) <= ring->size / 4;
+}
+
+bool ffm_ring_write(struct ffm_ring *ring, const struct ffm_packet_info *info, const uint8_t *data)
+{
+	struct ffm_ring_header *header = ring->header;
+	unsigned long write_pos = (unsigned long)os_atomic_load_long(&header->write_pos);
+	unsigned long read_pos = (unsigned long)os_atomic_load_long(&header->read_pos);
+	size_t need = record_size(info->size);
+	size_t offset = write_pos & (ring->size - 1);
+	size_t to_end = ring->size - offset;
+	size_t skip = to_end < need ? to_end : 0;
+
+	if ((size_t)(write_pos - read_pos) + skip + need > ring->size)
+		return false;
+
+	/* records never wrap.  a tail too small to hold a header is skipped by
+	 * both sides implicitly, anything larger gets a padding record */
+	if (skip) {
+		if (skip >= sizeof(*info)) {
+			struct ffm_packet_info padding = {
+				.type = FFM_PACKET_PADDING,
+				.size = (uint32_t)(skip - sizeof(*info)),
+			};
+			memcpy(ring->data + offset, &padding, sizeof(padding));
+		}
+
+		write_pos += (unsigned long)skip;
+		offset = 0;
+	}
+
+	memcpy(ring->data + offset, info, sizeof(*info));
+	if (info->size)
+		memcpy(ring->data + offset + sizeof(*info), data, info->size);
+
+	os_atomic_set_long(&header->write_pos, (long)(write_pos + need));
+	return true;
+}
+
+bool ffm_ring_empty(struct ffm_ring *ring)
+{
+	return os_atomic_load_long(&ring->header->read_pos) == os_atomic_load_long(&ring->header->write_pos);
+}
+
+/* true if the consumer went to wait on the pipe and has to be woken up with a
+ * FFM_PACKET_WAKE message, only ever returns true once per wait */
+bool ffm_ring_wake_needed(struct ffm_ring *ring)
+{
+	volatile long *waiting = &ring->header->consumer_waiting;
+
+	return os_atomic_load_long(waiting) && os_atomic_exchange_long(waiting, 0);
+}
+
+/* packets too large for the ring go through the pipe instead.  the producer
+ * waits for each of them to be muxed before writing to the ring again, so the
+ * order of packets is kept */
+void ffm_ring_sent_on_pipe(struct ffm_ring *ring)
+{
+	ring->pipe_packets_sent++;
+}
+
+bool ffm_ring_pipe_done(struct ffm_ring *ring)
+{
+	return os_atomic_load_long(&ring->header->pipe_packets_done) == ring->pipe_packets_sent;
+}
+
+/* ------------------------------------------------------------------------- */
+/* consumer                                                                  */
+
+bool ffm_ring_peek(struct ffm_ring *ring, struct ffm_packet_info *info, uint8_t **data)
+{
+	struct ffm_ring_header *header = ring->header;
+
+	for (;;) {
+		unsigned long read_pos = (unsigned long)os_atomic_load_long(&header->read_pos);
+		unsigned long write_pos = (unsigned long)os_atomic_load_long(&header->write_pos);
+		size_t offset = read_pos & (ring->size - 1);
+		size_t to_end = ring->size - offset;
+
+		if (read_pos == write_pos)
+			return false;
+
+		if (to_end >= sizeof(*info)) {
+			memcpy(info, ring->data + offset, sizeof(*info));
+
+			if (info->type != FFM_PACKET_PADDING) {
+				*data = ring->data + offset + sizeof(*info);
+				ring->pending = record_size(info->size);
+				return true;
+			}
+		}
+
+		os_atomic_set_long(&header->read_pos, (long)(read_pos + to_end));
+	}
+}
+
+/* releases the record returned by the last ffm_ring_peek */
+void ffm_ring_pop(struct ffm_ring *ring)
+{
+	unsigned long read_pos = (unsigned long)os_atomic_load_long(&ring->header->read_pos);
+
+	os_atomic_set_long(&ring->header->read_pos, (long)(read_pos + ring->pending));
+	ring->pending = 0;
+}
+
+/* the consumer has to check the ring again after setting this, since the
+ * producer may have written a record just before */
+void ffm_ring_set_waiting(struct ffm_ring *ring, bool waiting)
+{
+	os_atomic_set_long(&ring->header->consumer_waiting, waiting ? 1 : 0);
+}
+
+void ffm_ring_pipe_packet_done(struct ffm_ring *ring)
+{
+	os_atomic_inc_long(&ring->header->pipe_packets_done);
+}
@@ -0,0 +1,76 @@
+/*
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include "ffmpeg-mux.h"
+
+/*
+ * Single producer, single consumer ring in shared memory that carries the
+ * messages from obs-ffmpeg to the ffmpeg-mux process, so packet data is not
+ * copied through a pipe.  Each record is a struct ffm_packet_info followed by
+ * its data, and records never wrap around the end of the buffer, so the
+ * consumer can mux straight out of the ring.
+ *
+ * The pipe stays open for control messages: the name of the ring, wake-ups
+ * for a consumer that is waiting on the pipe because the ring was empty, and
+ * packets that are too large for the ring.
+ */
+
+#define FFM_RING_SIZE (16 * 1024 * 1024)
+
+struct ffm_ring_header {
+	volatile long write_pos;
+	volatile long read_pos;
+	volatile long consumer_waiting;
+	volatile long pipe_packets_done;
+	uint32_t size;
+};
+
+struct ffm_ring {
+	struct ffm_ring_header *header;
+	uint8_t *data;
+	uint32_t size;
+	size_t map_size;
+	char name[64];
+	bool owner;
+#ifdef _WIN32
+	void *handle;
+#endif
+
+	/* producer */
+	long pipe_packets_sent;
+
+	/* consumer */
+	size_t pending;
+};
+
+extern bool ffm_ring_create(struct ffm_ring *ring, uint32_t size);
+extern bool ffm_ring_open(struct ffm_ring *ring, const char *name);
+extern void ffm_ring_close(struct ffm_ring *ring);
+
+/* producer */
+extern bool ffm_ring_fits(const struct ffm_ring *ring, uint32_t size);
+extern bool ffm_ring_write(struct ffm_ring *ring, const struct ffm_packet_info *info, const uint8_t *data);
+extern bool ffm_ring_empty(struct ffm_ring *ring);
+extern bool ffm_ring_wake_needed(struct ffm_ring *ring);
+extern void ffm_ring_sent_on_pipe(struct ffm_ring *ring);
+extern bool ffm_ring_pipe_done(struct ffm_ring *ring);
+
+/* consumer */
+extern bool ffm_ring_peek(struct ffm_ring *ring, struct ffm_packet_info *info, uint8_t **data);
+extern void ffm_ring_pop(struct ffm_ring *ring);
+extern void ffm_ring_set_waiting(struct ffm_ring *ring, bool waiting);
+extern void ffm_ring_pipe_packet_done(struct ffm_ring *ring);
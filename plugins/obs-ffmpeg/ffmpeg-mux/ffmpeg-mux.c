@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "ffmpeg-mux.h"
+#include "ffmpeg-mux-ring.h"
 
 #include <util/threading.h>
 #include <util/platform.h>
@@ -612,24 +613,110 @@ static size_t safe_read(void *vdata, size_t size)
 	return total;
 }
 
-static bool ffmpeg_mux_get_header(struct ffmpeg_mux *ffm)
+/* ------------------------------------------------------------------------- */
+
+/* messages come through stdin until obs-ffmpeg hands over a shared memory
+ * ring, after which stdin only carries wake-ups and oversized packets.  this
+ * outlives ffmpeg_mux_free, which is called when the output file changes */
+static struct mux_input {
+	struct ffm_ring ring;
+	bool ring_open;
+	bool from_ring;
+	struct resize_buf buf;
+} input = {0};
+
+static bool open_ring(uint8_t *data, uint32_t size)
 {
-	struct ffm_packet_info info = {0};
+	char name[64];
 
-	bool success = safe_read(&info, sizeof(info)) == sizeof(info);
-	if (success) {
-		uint8_t *data = malloc(info.size);
+	if (input.ring_open || size >= sizeof(name)) {
+		fprintf(stderr, "Invalid shared memory message\n");
+		return false;
+	}
 
-		if (safe_read(data, info.size) == info.size) {
-			ffmpeg_mux_header(ffm, data, &info);
-		} else {
-			success = false;
+	memcpy(name, data, size);
+	name[size] = 0;
+
+	input.ring_open = ffm_ring_open(&input.ring, name);
+	if (!input.ring_open)
+		fprintf(stderr, "Couldn't open shared memory '%s'\n", name);
+
+	return input.ring_open;
+}
+
+/* reads the next message.  the data stays valid until finish_message */
+static bool read_message(struct ffm_packet_info *info, uint8_t **data)
+{
+	for (;;) {
+		if (input.ring_open) {
+			if (ffm_ring_peek(&input.ring, info, data)) {
+				input.from_ring = true;
+				return true;
+			}
+
+			/* check once more after announcing the wait, in case
+			 * obs-ffmpeg wrote to the ring without seeing it */
+			ffm_ring_set_waiting(&input.ring, true);
+			if (ffm_ring_peek(&input.ring, info, data)) {
+				ffm_ring_set_waiting(&input.ring, false);
+				input.from_ring = true;
+				return true;
+			}
+		}
+
+		if (safe_read(info, sizeof(*info)) != sizeof(*info))
+			return false;
+
+		if (input.ring_open)
+			ffm_ring_set_waiting(&input.ring, false);
+
+		resize_buf_resize(&input.buf, info->size);
+		if (info->size && safe_read(input.buf.buf, info->size) != info->size)
+			return false;
+
+		if (info->type == FFM_PACKET_WAKE)
+			continue;
+
+		if (info->type == FFM_PACKET_SHARED_MEMORY) {
+			if (!open_ring(input.buf.buf, info->size))
+				return false;
+			continue;
 		}
 
-		free(data);
+		*data = input.buf.buf;
+		input.from_ring = false;
+		return true;
 	}
+}
+
+static void finish_message(void)
+{
+	if (input.from_ring)
+		ffm_ring_pop(&input.ring);
+	else if (input.ring_open)
+		ffm_ring_pipe_packet_done(&input.ring);
+}
+
+static void free_input(void)
+{
+	if (input.ring_open)
+		ffm_ring_close(&input.ring);
+	resize_buf_free(&input.buf);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static bool ffmpeg_mux_get_header(struct ffmpeg_mux *ffm)
+{
+	struct ffm_packet_info info = {0};
+	uint8_t *data;
 
-	return success;
+	if (!read_message(&info, &data))
+		return false;
+
+	ffmpeg_mux_header(ffm, data, &info);
+	finish_message();
+	return true;
 }
 
 static inline bool ffmpeg_mux_get_extra_data(struct ffmpeg_mux *ffm)
@@ -1097,15 +1184,16 @@ static inline bool ffmpeg_mux_packet(struct ffmpeg_mux *ffm, uint8_t *buf, struc
 	return ret >= 0;
 }
 
-static inline bool read_change_file(struct ffmpeg_mux *ffm, uint32_t size, struct resize_buf *filename, int argc,
-				    char **argv)
+static inline bool read_change_file(struct ffmpeg_mux *ffm, uint8_t *data, uint32_t size, struct resize_buf *filename,
+				    int argc, char **argv)
 {
 	resize_buf_resize(filename, size + 1);
-	if (safe_read(filename->buf, size) != size) {
-		return false;
-	}
+	memcpy(filename->buf, data, size);
 	filename->buf[size] = 0;
 
+	/* the new headers follow right after this */
+	finish_message();
+
 #ifdef ENABLE_FFMPEG_MUX_DEBUG
 	fprintf(stderr, "info: New output file name: %s\n", filename->buf);
 #endif
@@ -1137,8 +1225,8 @@ int main(int argc, char *argv[])
 {
 	struct ffm_packet_info info = {0};
 	struct ffmpeg_mux ffm = {0};
-	struct resize_buf rb = {0};
 	struct resize_buf rb_filename = {0};
+	uint8_t *data;
 	bool fail = false;
 	int ret;
 
@@ -1168,23 +1256,18 @@ int main(int argc, char *argv[])
 		return ret;
 	}
 
-	while (!fail && safe_read(&info, sizeof(info)) == sizeof(info)) {
+	while (!fail && read_message(&info, &data)) {
 		if (info.type == FFM_PACKET_CHANGE_FILE) {
-			fail = !read_change_file(&ffm, info.size, &rb_filename, argc, argv);
+			fail = !read_change_file(&ffm, data, info.size, &rb_filename, argc, argv);
 			continue;
 		}
 
-		resize_buf_resize(&rb, info.size);
-
-		if (safe_read(rb.buf, info.size) == info.size) {
-			fail = !ffmpeg_mux_packet(&ffm, rb.buf, &info);
-		} else {
-			fail = true;
-		}
+		fail = !ffmpeg_mux_packet(&ffm, data, &info);
+		finish_message();
 	}
 
 	ffmpeg_mux_free(&ffm);
-	resize_buf_free(&rb);
+	free_input();
 	resize_buf_free(&rb_filename);
 
 #ifdef _WIN32
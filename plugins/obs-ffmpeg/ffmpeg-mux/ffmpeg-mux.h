@@ -23,6 +23,11 @@ enum ffm_packet_type {
 	FFM_PACKET_VIDEO,
 	FFM_PACKET_AUDIO,
 	FFM_PACKET_CHANGE_FILE,
+
+	/* transport messages, see ffmpeg-mux-ring.h */
+	FFM_PACKET_SHARED_MEMORY,
+	FFM_PACKET_WAKE,
+	FFM_PACKET_PADDING,
 };
 
 #define FFM_SUCCESS 0
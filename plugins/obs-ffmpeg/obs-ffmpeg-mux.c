@@ -15,6 +15,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 #include "ffmpeg-mux/ffmpeg-mux.h"
+#include "ffmpeg-mux/ffmpeg-mux-ring.h"
 #include "obs-ffmpeg-mux.h"
 #include "obs-ffmpeg-formats.h"
 
@@ -53,6 +54,18 @@ static inline void replay_buffer_clear(struct ffmpeg_muxer *stream)
 	}
 
 	deque_free(&stream->packets);
+
+	if (stream->disk_buffer) {
+		/* a save may still be reading from the disk buffer */
+		if (stream->mux_thread_joinable) {
+			pthread_join(stream->mux_thread, NULL);
+			stream->mux_thread_joinable = false;
+		}
+
+		replay_disk_destroy(stream->disk_buffer);
+		stream->disk_buffer = NULL;
+	}
+
 	stream->cur_size = 0;
 	stream->cur_time = 0;
 	stream->max_size = 0;
@@ -73,7 +86,7 @@ static void ffmpeg_mux_destroy(void *data)
 	da_free(stream->mux_packets);
 	deque_free(&stream->packets);
 
-	os_process_pipe_destroy(stream->pipe);
+	stop_pipe(stream);
 	dstr_free(&stream->path);
 	dstr_free(&stream->printable_path);
 	dstr_free(&stream->stream_key);
@@ -302,12 +315,61 @@ static void build_command_line(struct ffmpeg_muxer *stream, os_process_args_t **
 	add_muxer_params(*args, stream);
 }
 
+/* hands the muxer a shared memory ring to read packets from, the pipe is used
+ * for everything if the ring cannot be created.  returns false if the pipe
+ * broke, as the muxer can no longer make sense of what it reads from it */
+static bool start_ring(struct ffmpeg_muxer *stream)
+{
+	struct ffm_ring *ring = bzalloc(sizeof(*ring));
+	struct ffm_packet_info info = {.type = FFM_PACKET_SHARED_MEMORY};
+
+	if (!ffm_ring_create(ring, FFM_RING_SIZE)) {
+		warn("Failed to create shared memory for packets, sending them through the pipe");
+		bfree(ring);
+		return true;
+	}
+
+	info.size = (uint32_t)strlen(ring->name);
+
+	if (os_process_pipe_write(stream->pipe, (const uint8_t *)&info, sizeof(info)) != sizeof(info) ||
+	    os_process_pipe_write(stream->pipe, (const uint8_t *)ring->name, info.size) != info.size ||
+	    !os_process_pipe_flush(stream->pipe)) {
+		warn("Failed to send shared memory name to the muxer");
+		ffm_ring_close(ring);
+		bfree(ring);
+		return false;
+	}
+
+	stream->ring = ring;
+	return true;
+}
+
 void start_pipe(struct ffmpeg_muxer *stream, const char *path)
 {
 	os_process_args_t *args = NULL;
 	build_command_line(stream, &args, path);
 	stream->pipe = os_process_pipe_create2(args, "w");
 	os_process_args_destroy(args);
+
+	if (stream->pipe && !start_ring(stream)) {
+		os_process_pipe_destroy(stream->pipe);
+		stream->pipe = NULL;
+	}
+}
+
+int stop_pipe(struct ffmpeg_muxer *stream)
+{
+	int ret = os_process_pipe_destroy(stream->pipe);
+	stream->pipe = NULL;
+
+	/* the muxer has exited at this point */
+	if (stream->ring) {
+		ffm_ring_close(stream->ring);
+		bfree(stream->ring);
+		stream->ring = NULL;
+	}
+
+	return ret;
 }
 
 static void set_file_not_readable_error(struct ffmpeg_muxer *stream, obs_data_t *settings, const char *path)
@@ -466,8 +528,7 @@ int deactivate(struct ffmpeg_muxer *stream, int code)
 	}
 
 	if (active(stream)) {
-		ret = os_process_pipe_destroy(stream->pipe);
-		stream->pipe = NULL;
+		ret = stop_pipe(stream);
 
 		os_atomic_set_bool(&stream->active, false);
 		os_atomic_set_bool(&stream->sent_headers, false);
@@ -600,10 +661,96 @@ static void generate_filename(struct ffmpeg_muxer *stream, struct dstr *dst, boo
 	obs_data_release(settings);
 }
 
+static bool pipe_write_message(struct ffmpeg_muxer *stream, const struct ffm_packet_info *info, const uint8_t *data)
+{
+	size_t ret;
+
+	ret = os_process_pipe_write(stream->pipe, (const uint8_t *)info, sizeof(*info));
+	if (ret != sizeof(*info)) {
+		warn("os_process_pipe_write for info structure failed");
+		signal_failure(stream);
+		return false;
+	}
+
+	ret = os_process_pipe_write(stream->pipe, data, info->size);
+	if (ret != info->size) {
+		warn("os_process_pipe_write for packet data failed");
+		signal_failure(stream);
+		return false;
+	}
+
+	/* with a ring, anything that goes through the pipe is something the
+	 * muxer is waiting on */
+	if (stream->ring && !os_process_pipe_flush(stream->pipe)) {
+		warn("os_process_pipe_flush failed");
+		signal_failure(stream);
+		return false;
+	}
+
+	return true;
+}
+
+static inline bool send_wake(struct ffmpeg_muxer *stream)
+{
+	struct ffm_packet_info info = {.type = FFM_PACKET_WAKE};
+	return pipe_write_message(stream, &info, NULL);
+}
+
+/* waits a millisecond for the muxer to make progress.  every so often it gets
+ * woken up through the pipe, which also notices if it has exited */
+static inline bool wait_for_muxer(struct ffmpeg_muxer *stream, int *waited)
+{
+	if (++*waited % 100 == 0 && !send_wake(stream))
+		return false;
+
+	os_sleep_ms(1);
+	return true;
+}
+
+static bool write_large_message(struct ffmpeg_muxer *stream, const struct ffm_packet_info *info, const uint8_t *data)
+{
+	struct ffm_ring *ring = stream->ring;
+	int waited = 0;
+
+	while (!ffm_ring_empty(ring)) {
+		if (!wait_for_muxer(stream, &waited))
+			return false;
+	}
+
+	if (!pipe_write_message(stream, info, data))
+		return false;
+
+	ffm_ring_sent_on_pipe(ring);
+
+	while (!ffm_ring_pipe_done(ring)) {
+		if (!wait_for_muxer(stream, &waited))
+			return false;
+	}
+
+	return true;
+}
+
+static bool write_message(struct ffmpeg_muxer *stream, const struct ffm_packet_info *info, const uint8_t *data)
+{
+	struct ffm_ring *ring = stream->ring;
+	int waited = 0;
+
+	if (!ring)
+		return pipe_write_message(stream, info, data);
+	if (!ffm_ring_fits(ring, info->size))
+		return write_large_message(stream, info, data);
+
+	while (!ffm_ring_write(ring, info, data)) {
+		if (!wait_for_muxer(stream, &waited))
+			return false;
+	}
+
+	return ffm_ring_wake_needed(ring) ? send_wake(stream) : true;
+}
+
 bool write_packet(struct ffmpeg_muxer *stream, struct encoder_packet *packet)
 {
 	bool is_video = packet->type == OBS_ENCODER_VIDEO;
-	size_t ret;
 
 	struct ffm_packet_info info = {.pts = packet->pts,
 				       .dts = packet->dts,
@@ -622,19 +769,8 @@ bool write_packet(struct ffmpeg_muxer *stream, struct encoder_packet *packet)
 		}
 	}
 
-	ret = os_process_pipe_write(stream->pipe, (const uint8_t *)&info, sizeof(info));
-	if (ret != sizeof(info)) {
-		warn("os_process_pipe_write for info structure failed");
-		signal_failure(stream);
+	if (!write_message(stream, &info, packet->data))
 		return false;
-	}
-
-	ret = os_process_pipe_write(stream->pipe, packet->data, packet->size);
-	if (ret != packet->size) {
-		warn("os_process_pipe_write for packet data failed");
-		signal_failure(stream);
-		return false;
-	}
 
 	stream->total_bytes += packet->size;
 
@@ -711,25 +847,10 @@ static inline bool should_split(struct ffmpeg_muxer *stream, struct encoder_pack
 
 static bool send_new_filename(struct ffmpeg_muxer *stream, const char *filename)
 {
-	size_t ret;
 	uint32_t size = (uint32_t)strlen(filename);
 	struct ffm_packet_info info = {.type = FFM_PACKET_CHANGE_FILE, .size = size};
 
-	ret = os_process_pipe_write(stream->pipe, (const uint8_t *)&info, sizeof(info));
-	if (ret != sizeof(info)) {
-		warn("os_process_pipe_write for info structure failed");
-		signal_failure(stream);
-		return false;
-	}
-
-	ret = os_process_pipe_write(stream->pipe, (const uint8_t *)filename, size);
-	if (ret != size) {
-		warn("os_process_pipe_write for packet data failed");
-		signal_failure(stream);
-		return false;
-	}
-
-	return true;
+	return write_message(stream, &info, (const uint8_t *)filename);
 }
 
 static bool prepare_split_file(struct ffmpeg_muxer *stream, struct encoder_packet *packet)
@@ -974,6 +1095,9 @@ static void replay_buffer_destroy(void *data)
 	ffmpeg_mux_destroy(data);
 }
 
+/* used for the disk buffer when no maximum size is set */
+#define DEFAULT_DISK_BUFFER_SIZE ((size_t)2048 * 1024 * 1024)
+
 static bool replay_buffer_start(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
@@ -986,6 +1110,16 @@ static bool replay_buffer_start(void *data)
 	obs_data_t *s = obs_output_get_settings(stream->output);
 	stream->max_time = obs_data_get_int(s, "max_time_sec") * 1000000LL;
 	stream->max_size = obs_data_get_int(s, "max_size_mb") * (1024 * 1024);
+
+	const char *disk_dir = obs_data_get_string(s, "disk_buffer_dir");
+	if (disk_dir && *disk_dir) {
+		size_t capacity = stream->max_size ? (size_t)stream->max_size : DEFAULT_DISK_BUFFER_SIZE;
+
+		stream->disk_buffer = replay_disk_create(disk_dir, capacity);
+		if (!stream->disk_buffer)
+			warn("Could not create disk buffer in '%s', buffering in memory instead", disk_dir);
+	}
+
 	obs_data_release(s);
 
 	os_atomic_set_bool(&stream->active, true);
@@ -1059,13 +1193,24 @@ static inline void replay_buffer_purge(struct ffmpeg_muxer *stream, struct encod
 		purge(stream);
 }
 
-static void insert_packet(mux_packets_t *packets, struct encoder_packet *packet, int64_t video_offset,
+static inline int disk_segment_of(struct ffmpeg_muxer *stream, struct encoder_packet *packet)
+{
+	return stream->disk_buffer ? replay_disk_segment_of(stream->disk_buffer, packet->data) : -1;
+}
+
+/* packet data in the disk buffer is not reference counted; the segments it is
+ * stored in are pinned for the duration of the save instead */
+static void insert_packet(struct ffmpeg_muxer *stream, struct encoder_packet *packet, int64_t video_offset,
 			  int64_t *audio_offsets, int64_t video_pts_offset, int64_t *audio_dts_offsets)
 {
+	mux_packets_t *packets = &stream->mux_packets;
 	struct encoder_packet pkt;
 	size_t idx;
 
-	obs_encoder_packet_ref(&pkt, packet);
+	if (disk_segment_of(stream, packet) != -1)
+		pkt = *packet;
+	else
+		obs_encoder_packet_ref(&pkt, packet);
 
 	if (pkt.type == OBS_ENCODER_VIDEO) {
 		pkt.dts_usec -= video_offset;
@@ -1086,6 +1231,45 @@ static void insert_packet(mux_packets_t *packets, struct encoder_packet *packet,
 	da_insert(*packets, idx, &pkt);
 }
 
+static void pin_disk_segments(struct ffmpeg_muxer *stream)
+{
+	for (int i = 0; i < REPLAY_DISK_SEGMENTS; i++)
+		stream->disk_pinned[i] = false;
+
+	for (size_t i = 0; i < stream->mux_packets.num; i++) {
+		int seg = disk_segment_of(stream, &stream->mux_packets.array[i]);
+		if (seg == -1)
+			continue;
+
+		if (!stream->disk_pinned[seg]) {
+			replay_disk_pin(stream->disk_buffer, seg);
+			stream->disk_pinned[seg] = true;
+		}
+
+		stream->disk_last_use[seg] = i;
+	}
+}
+
+static void release_mux_packet(struct ffmpeg_muxer *stream, size_t idx)
+{
+	struct encoder_packet *pkt = &stream->mux_packets.array[idx];
+	int seg = disk_segment_of(stream, pkt);
+
+	if (seg == -1) {
+		obs_encoder_packet_release(pkt);
+		return;
+	}
+
+	/* the rest of the save no longer reads from this segment, so the
+	 * buffer can go back to writing into it */
+	if (stream->disk_pinned[seg] && stream->disk_last_use[seg] == idx) {
+		stream->disk_pinned[seg] = false;
+		replay_disk_unpin(stream->disk_buffer, seg);
+	}
+
+	memset(pkt, 0, sizeof(*pkt));
+}
+
 static void *replay_buffer_mux_thread(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
@@ -1112,17 +1296,16 @@ static void *replay_buffer_mux_thread(void *data)
 			error = true;
 			goto error;
 		}
-		obs_encoder_packet_release(pkt);
+		release_mux_packet(stream, i);
 	}
 
 	info("Wrote replay buffer to '%s'", stream->path.array);
 
 error:
-	os_process_pipe_destroy(stream->pipe);
-	stream->pipe = NULL;
+	stop_pipe(stream);
 	if (error) {
 		for (size_t i = 0; i < stream->mux_packets.num; i++)
-			obs_encoder_packet_release(&stream->mux_packets.array[i]);
+			release_mux_packet(stream, i);
 	}
 	da_free(stream->mux_packets);
 	os_atomic_set_bool(&stream->muxing, false);
@@ -1139,7 +1322,8 @@ error:
 static void replay_buffer_save(struct ffmpeg_muxer *stream)
 {
 	const size_t size = sizeof(struct encoder_packet);
-	size_t num_packets = stream->packets.size / size;
+	size_t num_packets = stream->disk_buffer ? replay_disk_num_packets(stream->disk_buffer)
+						 : stream->packets.size / size;
 
 	da_reserve(stream->mux_packets, num_packets);
 
@@ -1155,7 +1339,10 @@ static void replay_buffer_save(struct ffmpeg_muxer *stream)
 
 	for (size_t i = 0; i < num_packets; i++) {
 		struct encoder_packet *pkt;
-		pkt = deque_data(&stream->packets, i * size);
+		if (stream->disk_buffer)
+			pkt = replay_disk_packet_at(stream->disk_buffer, i);
+		else
+			pkt = deque_data(&stream->packets, i * size);
 
 		if (pkt->type == OBS_ENCODER_VIDEO) {
 			if (!found_video) {
@@ -1171,10 +1358,12 @@ static void replay_buffer_save(struct ffmpeg_muxer *stream)
 			}
 		}
 
-		insert_packet(&stream->mux_packets, pkt, video_offset, audio_offsets, video_pts_offset,
-			      audio_dts_offsets);
+		insert_packet(stream, pkt, video_offset, audio_offsets, video_pts_offset, audio_dts_offsets);
 	}
 
+	if (stream->disk_buffer)
+		pin_disk_segments(stream);
+
 	generate_filename(stream, &stream->path, true);
 
 	os_atomic_set_bool(&stream->muxing, true);
@@ -1220,17 +1409,22 @@ static void replay_buffer_data(void *data, struct encoder_packet *packet)
 		}
 	}
 
-	obs_encoder_packet_ref(&pkt, packet);
-	replay_buffer_purge(stream, &pkt);
+	if (stream->disk_buffer) {
+		replay_disk_purge(stream->disk_buffer, packet->dts_usec, stream->max_time);
+		replay_disk_push(stream->disk_buffer, packet);
+	} else {
+		obs_encoder_packet_ref(&pkt, packet);
+		replay_buffer_purge(stream, &pkt);
 
-	if (!stream->packets.size)
-		stream->cur_time = pkt.dts_usec;
-	stream->cur_size += pkt.size;
+		if (!stream->packets.size)
+			stream->cur_time = pkt.dts_usec;
+		stream->cur_size += pkt.size;
 
-	deque_push_back(&stream->packets, packet, sizeof(*packet));
+		deque_push_back(&stream->packets, packet, sizeof(*packet));
 
-	if (packet->type == OBS_ENCODER_VIDEO && packet->keyframe)
-		stream->keyframes++;
+		if (packet->type == OBS_ENCODER_VIDEO && packet->keyframe)
+			stream->keyframes++;
+	}
 
 	if (stream->save_ts && packet->sys_dts_usec >= stream->save_ts) {
 		if (os_atomic_load_bool(&stream->muxing))
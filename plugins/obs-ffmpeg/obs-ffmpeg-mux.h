@@ -9,11 +9,16 @@
 #include <util/platform.h>
 #include <util/threading.h>
 
+#include "obs-ffmpeg-replay-disk.h"
+
 typedef DARRAY(struct encoder_packet) mux_packets_t;
 
+struct ffm_ring;
+
 struct ffmpeg_muxer {
 	obs_output_t *output;
 	os_process_pipe_t *pipe;
+	struct ffm_ring *ring;
 	int64_t stop_ts;
 	uint64_t total_bytes;
 	bool sent_headers;
@@ -37,6 +42,9 @@ struct ffmpeg_muxer {
 	obs_hotkey_id hotkey;
 	volatile bool muxing;
 	mux_packets_t mux_packets;
+	struct replay_disk *disk_buffer;
+	size_t disk_last_use[REPLAY_DISK_SEGMENTS];
+	bool disk_pinned[REPLAY_DISK_SEGMENTS];
 
 	/* split file */
 	bool found_video;
@@ -69,6 +77,7 @@ struct ffmpeg_muxer {
 bool stopping(struct ffmpeg_muxer *stream);
 bool active(struct ffmpeg_muxer *stream);
 void start_pipe(struct ffmpeg_muxer *stream, const char *path);
+int stop_pipe(struct ffmpeg_muxer *stream);
 bool write_packet(struct ffmpeg_muxer *stream, struct encoder_packet *packet);
 bool send_headers(struct ffmpeg_muxer *stream);
 int deactivate(struct ffmpeg_muxer *stream, int code);
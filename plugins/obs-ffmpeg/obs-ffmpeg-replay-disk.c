@@ -0,0 +1,293 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#include "obs-ffmpeg-replay-disk.h"
+
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define SEGMENT_SIZE_ALIGN (1024 * 1024)
+#define PACKET_ALIGN 16
+
+#ifdef _WIN32
+static bool map_segment(struct replay_disk_segment *seg, const char *path, size_t size)
+{
+	wchar_t *wpath = NULL;
+
+	if (!os_utf8_to_wcs_ptr(path, 0, &wpath))
+		return false;
+
+	/* the file is removed by the system once the last handle is closed */
+	seg->file = CreateFileW(wpath, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_NEW,
+				FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+	bfree(wpath);
+
+	if (seg->file == INVALID_HANDLE_VALUE) {
+		seg->file = NULL;
+		return false;
+	}
+
+	/* creating the mapping extends the file to its full size */
+	seg->mapping = CreateFileMappingW(seg->file, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32),
+					  (DWORD)(size & 0xFFFFFFFF), NULL);
+	if (!seg->mapping)
+		return false;
+
+	seg->data = MapViewOfFile(seg->mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	return seg->data != NULL;
+}
+
+static void unmap_segment(struct replay_disk_segment *seg, size_t size)
+{
+	if (seg->data)
+		UnmapViewOfFile(seg->data);
+	if (seg->mapping)
+		CloseHandle(seg->mapping);
+	if (seg->file)
+		CloseHandle(seg->file);
+
+	UNUSED_PARAMETER(size);
+}
+#else
+static bool map_segment(struct replay_disk_segment *seg, const char *path, size_t size)
+{
+	int fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	bool success = false;
+	void *data;
+
+	if (fd == -1)
+		return false;
+
+	/* allocate the blocks up front where possible, so running out of disk
+	 * space shows up here instead of as a fault while writing packets */
+#ifdef __linux__
+	if (posix_fallocate(fd, 0, (off_t)size) != 0)
+		goto fail;
+#else
+	if (ftruncate(fd, (off_t)size) != 0)
+		goto fail;
+#endif
+
+	data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (data != MAP_FAILED) {
+		seg->data = data;
+		success = true;
+	}
+
+fail:
+	/* the mapping keeps the file alive, and nothing is left behind on disk
+	 * if the process goes away */
+	close(fd);
+	unlink(path);
+	return success;
+}
+
+static void unmap_segment(struct replay_disk_segment *seg, size_t size)
+{
+	if (seg->data)
+		munmap(seg->data, size);
+}
+#endif
+
+struct replay_disk *replay_disk_create(const char *dir, size_t capacity)
+{
+	struct replay_disk *rd = bzalloc(sizeof(*rd));
+	char *id = os_generate_uuid();
+	struct dstr path = {0};
+	bool success = true;
+
+	rd->segment_size = capacity / REPLAY_DISK_SEGMENTS;
+	rd->segment_size = (rd->segment_size + SEGMENT_SIZE_ALIGN - 1) / SEGMENT_SIZE_ALIGN * SEGMENT_SIZE_ALIGN;
+
+	for (int i = 0; i < REPLAY_DISK_SEGMENTS; i++) {
+		dstr_printf(&path, "%s/obs-replay-%s-%d.tmp", dir, id, i);
+
+		if (!map_segment(&rd->segments[i], path.array, rd->segment_size)) {
+			blog(LOG_WARNING, "[replay buffer] Failed to create disk buffer segment '%s'", path.array);
+			success = false;
+			break;
+		}
+	}
+
+	dstr_free(&path);
+	bfree(id);
+
+	if (!success) {
+		replay_disk_destroy(rd);
+		return NULL;
+	}
+
+	blog(LOG_INFO, "[replay buffer] Using %d disk buffer segments of %zu MB in '%s'", REPLAY_DISK_SEGMENTS,
+	     rd->segment_size / (1024 * 1024), dir);
+	return rd;
+}
+
+static bool pop_front(struct replay_disk *rd)
+{
+	struct replay_disk_packet entry;
+	bool keyframe;
+
+	deque_pop_front(&rd->packets, &entry, sizeof(entry));
+
+	keyframe = entry.packet.type == OBS_ENCODER_VIDEO && entry.packet.keyframe;
+	if (keyframe)
+		rd->keyframes--;
+
+	if (entry.segment >= 0)
+		rd->segments[entry.segment].packets--;
+	else
+		obs_encoder_packet_release(&entry.packet);
+
+	if (rd->packets.size) {
+		struct replay_disk_packet *first = deque_data(&rd->packets, 0);
+		rd->cur_time = first->packet.dts_usec;
+	} else {
+		rd->cur_time = 0;
+	}
+
+	return keyframe;
+}
+
+static void skip_to_keyframe(struct replay_disk *rd)
+{
+	while (rd->packets.size) {
+		struct replay_disk_packet *first = deque_data(&rd->packets, 0);
+		if (first->packet.type == OBS_ENCODER_VIDEO && first->packet.keyframe)
+			return;
+
+		pop_front(rd);
+	}
+}
+
+void replay_disk_destroy(struct replay_disk *rd)
+{
+	if (!rd)
+		return;
+
+	while (rd->packets.size)
+		pop_front(rd);
+	deque_free(&rd->packets);
+
+	for (int i = 0; i < REPLAY_DISK_SEGMENTS; i++)
+		unmap_segment(&rd->segments[i], rd->segment_size);
+
+	bfree(rd);
+}
+
+/* drops every packet stored in the segment so that it can be overwritten */
+static bool claim_segment(struct replay_disk *rd, int idx)
+{
+	struct replay_disk_segment *seg = &rd->segments[idx];
+
+	if (os_atomic_load_long(&seg->pins) > 0)
+		return false;
+
+	if (seg->packets) {
+		while (seg->packets)
+			pop_front(rd);
+		skip_to_keyframe(rd);
+	}
+
+	return true;
+}
+
+static bool store_on_disk(struct replay_disk *rd, struct replay_disk_packet *entry)
+{
+	const size_t size = entry->packet.size;
+	struct replay_disk_segment *seg;
+
+	if (size > rd->segment_size)
+		return false;
+
+	/* packets never straddle two segments, and even empty packets need to
+	 * point inside of the segment they are counted in */
+	if (rd->cur_offset + size >= rd->segment_size) {
+		int next = (rd->cur_segment + 1) % REPLAY_DISK_SEGMENTS;
+		if (!claim_segment(rd, next))
+			return false;
+
+		rd->cur_segment = next;
+		rd->cur_offset = 0;
+	}
+
+	seg = &rd->segments[rd->cur_segment];
+	memcpy(seg->data + rd->cur_offset, entry->packet.data, size);
+
+	entry->packet.data = seg->data + rd->cur_offset;
+	entry->segment = rd->cur_segment;
+	seg->packets++;
+
+	rd->cur_offset += (size + PACKET_ALIGN - 1) & ~(size_t)(PACKET_ALIGN - 1);
+	return true;
+}
+
+void replay_disk_push(struct replay_disk *rd, struct encoder_packet *packet)
+{
+	struct replay_disk_packet entry = {.packet = *packet};
+
+	if (!store_on_disk(rd, &entry)) {
+		obs_encoder_packet_ref(&entry.packet, packet);
+		entry.segment = -1;
+	}
+
+	if (!rd->packets.size)
+		rd->cur_time = packet->dts_usec;
+
+	deque_push_back(&rd->packets, &entry, sizeof(entry));
+
+	if (packet->type == OBS_ENCODER_VIDEO && packet->keyframe)
+		rd->keyframes++;
+}
+
+void replay_disk_purge(struct replay_disk *rd, int64_t dts_usec, int64_t max_time)
+{
+	if (!rd->packets.size || rd->keyframes <= 2)
+		return;
+
+	while (rd->packets.size && (dts_usec - rd->cur_time) > max_time) {
+		if (pop_front(rd))
+			skip_to_keyframe(rd);
+	}
+}
+
+int replay_disk_segment_of(const struct replay_disk *rd, const uint8_t *data)
+{
+	for (int i = 0; i < REPLAY_DISK_SEGMENTS; i++) {
+		const uint8_t *start = rd->segments[i].data;
+		if (data >= start && data < start + rd->segment_size)
+			return i;
+	}
+
+	return -1;
+}
+
+void replay_disk_pin(struct replay_disk *rd, int segment)
+{
+	os_atomic_inc_long(&rd->segments[segment].pins);
+}
+
+void replay_disk_unpin(struct replay_disk *rd, int segment)
+{
+	os_atomic_dec_long(&rd->segments[segment].pins);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <obs-module.h>
+#include <util/deque.h>
+
+/* Disk-backed storage for the replay buffer.  Packet data is written into a
+ * ring of preallocated, memory-mapped segment files, and only the packet
+ * metadata is kept in memory.  When a segment is reused, every packet stored
+ * in it is dropped from the front of the buffer.
+ *
+ * Segments can be pinned while a save is still reading from them.  A pinned
+ * segment is not overwritten: packets that would go into it are kept in
+ * memory instead until the save is done with it. */
+
+#define REPLAY_DISK_SEGMENTS 8
+
+struct replay_disk_segment {
+	uint8_t *data;
+#ifdef _WIN32
+	void *file;
+	void *mapping;
+#endif
+
+	/* buffered packets that are stored in this segment */
+	size_t packets;
+
+	/* saves that are still reading from this segment */
+	volatile long pins;
+};
+
+struct replay_disk_packet {
+	struct encoder_packet packet;
+
+	/* -1 if the packet data is held in memory */
+	int segment;
+};
+
+struct replay_disk {
+	struct replay_disk_segment segments[REPLAY_DISK_SEGMENTS];
+	size_t segment_size;
+	int cur_segment;
+	size_t cur_offset;
+
+	struct deque packets;
+	int64_t cur_time;
+	int keyframes;
+};
+
+extern struct replay_disk *replay_disk_create(const char *dir, size_t capacity);
+extern void replay_disk_destroy(struct replay_disk *rd);
+
+extern void replay_disk_push(struct replay_disk *rd, struct encoder_packet *packet);
+extern void replay_disk_purge(struct replay_disk *rd, int64_t dts_usec, int64_t max_time);
+
+extern int replay_disk_segment_of(const struct replay_disk *rd, const uint8_t *data);
+extern void replay_disk_pin(struct replay_disk *rd, int segment);
+extern void replay_disk_unpin(struct replay_disk *rd, int segment);
+
+static inline size_t replay_disk_num_packets(const struct replay_disk *rd)
+{
+	return rd->packets.size / sizeof(struct replay_disk_packet);
+}
+
+static inline struct encoder_packet *replay_disk_packet_at(struct replay_disk *rd, size_t idx)
+{
+	struct replay_disk_packet *entry = deque_data(&rd->packets, idx * sizeof(struct replay_disk_packet));
+	return &entry->packet;
+}
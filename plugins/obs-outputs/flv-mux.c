@@ -72,7 +72,7 @@ enum datatype_t {
 	DATA_TYPE_OBJECT_END = 9,
 };
 
-static void s_wa4cc(struct serializer *s, enum audio_id_t id)
+static const char *audio_fourcc(enum audio_id_t id)
 {
 	switch (id) {
 	case AUDIO_CODEC_NONE:
@@ -80,15 +80,13 @@ static void s_wa4cc(struct serializer *s, enum audio_id_t id)
 		break;
 
 	case AUDIO_CODEC_AAC:
-		s_w8(s, 'm');
-		s_w8(s, 'p');
-		s_w8(s, '4');
-		s_w8(s, 'a');
-		break;
+		return "mp4a";
 	}
+
+	return "\0\0\0\0";
 }
 
-static void s_w4cc(struct serializer *s, enum video_id_t id)
+static const char *video_fourcc(enum video_id_t id)
 {
 	switch (id) {
 	case CODEC_NONE:
@@ -96,28 +94,23 @@ static void s_w4cc(struct serializer *s, enum video_id_t id)
 		break;
 
 	case CODEC_AV1:
-		s_w8(s, 'a');
-		s_w8(s, 'v');
-		s_w8(s, '0');
-		s_w8(s, '1');
-		break;
+		return "av01";
 	case CODEC_HEVC:
 #ifdef ENABLE_HEVC
-		s_w8(s, 'h');
-		s_w8(s, 'v');
-		s_w8(s, 'c');
-		s_w8(s, '1');
-		break;
+		return "hvc1";
 #else
 		assert(0);
 #endif
 	case CODEC_H264:
-		s_w8(s, 'a');
-		s_w8(s, 'v');
-		s_w8(s, 'c');
-		s_w8(s, '1');
-		break;
+		return "avc1";
 	}
+
+	return "\0\0\0\0";
+}
+
+static void s_w4cc(struct serializer *s, enum video_id_t id)
+{
+	s_write(s, video_fourcc(id), 4);
 }
 
 static void s_wstring(struct serializer *s, const char *str)
@@ -309,50 +302,34 @@ void flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size, bool w
 static int32_t last_time = 0;
 #endif
 
-static void flv_video(struct serializer *s, int32_t dts_offset, struct encoder_packet *packet, bool is_header)
+static inline void tag_w8(struct flv_tag *tag, uint8_t u8)
 {
-	int64_t offset = packet->pts - packet->dts;
-	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
-
-	if (!packet->data || !packet->size)
-		return;
-
-	s_w8(s, RTMP_PACKET_TYPE_VIDEO);
-
-#ifdef DEBUG_TIMESTAMPS
-	blog(LOG_DEBUG, "Video: %lu", time_ms);
-
-	if (last_time > time_ms)
-		blog(LOG_DEBUG, "Non-monotonic");
-
-	last_time = time_ms;
-#endif
-
-	s_wb24(s, (uint32_t)packet->size + 5);
-	s_wb24(s, (uint32_t)time_ms);
-	s_w8(s, (time_ms >> 24) & 0x7F);
-	s_wb24(s, 0);
-
-	/* these are the 5 extra bytes mentioned above */
-	s_w8(s, packet->keyframe ? 0x17 : 0x27);
-	s_w8(s, is_header ? 0 : 1);
-	s_wb24(s, get_ms_time(packet, offset));
-	s_write(s, packet->data, packet->size);
-
-	write_previous_tag_size(s);
+	tag->header[tag->header_size++] = u8;
 }
 
-static void flv_audio(struct serializer *s, int32_t dts_offset, struct encoder_packet *packet, bool is_header)
+static inline void tag_wb24(struct flv_tag *tag, uint32_t u24)
 {
-	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
+	tag_w8(tag, (uint8_t)(u24 >> 16));
+	tag_w8(tag, (uint8_t)(u24 >> 8));
+	tag_w8(tag, (uint8_t)u24);
+}
 
-	if (!packet->data || !packet->size)
-		return;
+static inline void tag_w4cc(struct flv_tag *tag, const char *fourcc)
+{
+	memcpy(tag->header + tag->header_size, fourcc, 4);
+	tag->header_size += 4;
+}
 
-	s_w8(s, RTMP_PACKET_TYPE_AUDIO);
+static inline bool tag_init(struct flv_tag *tag, uint8_t type, int32_t time_ms, struct encoder_packet *packet)
+{
+	tag->type = type;
+	tag->time_ms = time_ms;
+	tag->header_size = 0;
+	tag->data = packet->data;
+	tag->size = packet->size;
 
 #ifdef DEBUG_TIMESTAMPS
-	blog(LOG_DEBUG, "Audio: %lu", time_ms);
+	blog(LOG_DEBUG, "%s: %lu", type == RTMP_PACKET_TYPE_VIDEO ? "Video" : "Audio", time_ms);
 
 	if (last_time > time_ms)
 		blog(LOG_DEBUG, "Non-monotonic");
@@ -360,116 +337,114 @@ static void flv_audio(struct serializer *s, int32_t dts_offset, struct encoder_p
 	last_time = time_ms;
 #endif
 
-	s_wb24(s, (uint32_t)packet->size + 2);
-	s_wb24(s, (uint32_t)time_ms);
-	s_w8(s, (time_ms >> 24) & 0x7F);
-	s_wb24(s, 0);
-
-	/* these are the two extra bytes mentioned above */
-	s_w8(s, 0xaf);
-	s_w8(s, is_header ? 0 : 1);
-	s_write(s, packet->data, packet->size);
-
-	write_previous_tag_size(s);
+	return packet->data && packet->size;
 }
 
-void flv_packet_mux(struct encoder_packet *packet, int32_t dts_offset, uint8_t **output, size_t *size, bool is_header)
+/* Writes the whole tag, including the size of the tag at the end */
+static void flv_write_tag(const struct flv_tag *tag, uint8_t **output, size_t *size)
 {
 	struct array_output_data data;
 	struct serializer s;
 
 	array_output_serializer_init(&s, &data);
 
-	if (packet->type == OBS_ENCODER_VIDEO)
-		flv_video(&s, dts_offset, packet, is_header);
-	else
-		flv_audio(&s, dts_offset, packet, is_header);
+	s_w8(&s, tag->type);
+	s_wb24(&s, (uint32_t)flv_tag_body_size(tag));
+	s_wtimestamp(&s, tag->time_ms);
+	s_wb24(&s, 0); // always 0
+
+	s_write(&s, tag->header, tag->header_size);
+	s_write(&s, tag->data, tag->size);
+
+	write_previous_tag_size(&s);
 
 	*output = data.bytes.array;
 	*size = data.bytes.num;
 }
 
-void flv_packet_audio_ex(struct encoder_packet *packet, enum audio_id_t codec_id, int32_t dts_offset, uint8_t **output,
-			 size_t *size, int type, size_t idx)
+bool flv_tag_mux(struct flv_tag *tag, struct encoder_packet *packet, int32_t dts_offset, bool is_header)
 {
-	struct array_output_data data;
-	struct serializer s;
-
-	array_output_serializer_init(&s, &data);
+	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
 
-	assert(packet->type == OBS_ENCODER_AUDIO);
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		if (!tag_init(tag, RTMP_PACKET_TYPE_VIDEO, time_ms, packet))
+			return false;
 
-	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
+		tag_w8(tag, packet->keyframe ? 0x17 : 0x27);
+		tag_w8(tag, is_header ? 0 : 1);
+		tag_wb24(tag, get_ms_time(packet, packet->pts - packet->dts));
+	} else {
+		if (!tag_init(tag, RTMP_PACKET_TYPE_AUDIO, time_ms, packet))
+			return false;
 
-	bool is_multitrack = idx > 0;
+		tag_w8(tag, 0xaf);
+		tag_w8(tag, is_header ? 0 : 1);
+	}
 
-	if (!packet->data || !packet->size)
-		return;
+	return true;
+}
 
-	int header_metadata_size = 5; // w8+wa4cc
-	if (is_multitrack)
-		header_metadata_size += 2; // w8 + w8
+void flv_packet_mux(struct encoder_packet *packet, int32_t dts_offset, uint8_t **output, size_t *size, bool is_header)
+{
+	struct flv_tag tag;
 
-	s_w8(&s, RTMP_PACKET_TYPE_AUDIO);
+	if (flv_tag_mux(&tag, packet, dts_offset, is_header)) {
+		flv_write_tag(&tag, output, size);
+	} else {
+		*output = NULL;
+		*size = 0;
+	}
+}
 
-#ifdef DEBUG_TIMESTAMPS
-	blog(LOG_DEBUG, "Audio: %lu", time_ms);
+static bool flv_tag_audio_ex(struct flv_tag *tag, struct encoder_packet *packet, enum audio_id_t codec_id,
+			     int32_t dts_offset, int type, size_t idx)
+{
+	assert(packet->type == OBS_ENCODER_AUDIO);
 
-	if (last_time > time_ms)
-		blog(LOG_DEBUG, "Non-monotonic");
+	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
 
-	last_time = time_ms;
-#endif
+	bool is_multitrack = idx > 0;
 
-	s_wb24(&s, (uint32_t)packet->size + header_metadata_size);
-	s_wb24(&s, (uint32_t)time_ms);
-	s_w8(&s, (time_ms >> 24) & 0x7F);
-	s_wb24(&s, 0);
+	if (!tag_init(tag, RTMP_PACKET_TYPE_AUDIO, time_ms, packet))
+		return false;
 
-	s_w8(&s, AUDIO_HEADER_EX | (is_multitrack ? AUDIO_PACKETTYPE_MULTITRACK : type));
+	tag_w8(tag, AUDIO_HEADER_EX | (is_multitrack ? AUDIO_PACKETTYPE_MULTITRACK : type));
 	if (is_multitrack) {
-		s_w8(&s, MULTITRACKTYPE_ONE_TRACK | type);
-		s_wa4cc(&s, codec_id);
-		s_w8(&s, (uint8_t)idx);
+		tag_w8(tag, MULTITRACKTYPE_ONE_TRACK | type);
+		tag_w4cc(tag, audio_fourcc(codec_id));
+		tag_w8(tag, (uint8_t)idx);
 	} else {
-		s_wa4cc(&s, codec_id);
+		tag_w4cc(tag, audio_fourcc(codec_id));
 	}
 
-	s_write(&s, packet->data, packet->size);
+	return true;
+}
 
-	write_previous_tag_size(&s);
+void flv_packet_audio_ex(struct encoder_packet *packet, enum audio_id_t codec_id, int32_t dts_offset, uint8_t **output,
+			 size_t *size, int type, size_t idx)
+{
+	struct flv_tag tag;
 
-	*output = data.bytes.array;
-	*size = data.bytes.num;
+	if (flv_tag_audio_ex(&tag, packet, codec_id, dts_offset, type, idx)) {
+		flv_write_tag(&tag, output, size);
+	} else {
+		*output = NULL;
+		*size = 0;
+	}
 }
 
 // Y2023 spec
-void flv_packet_ex(struct encoder_packet *packet, enum video_id_t codec_id, int32_t dts_offset, uint8_t **output,
-		   size_t *size, int type, size_t idx)
+static void flv_tag_ex(struct flv_tag *tag, struct encoder_packet *packet, enum video_id_t codec_id,
+		       int32_t dts_offset, int type, size_t idx)
 {
-	struct array_output_data data;
-	struct serializer s;
-	array_output_serializer_init(&s, &data);
-
 	assert(packet->type == OBS_ENCODER_VIDEO);
 
 	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
 
 	bool is_multitrack = idx > 0;
 
-	// packet head
-	int header_metadata_size = 5; // w8+w4cc
-	// 3 extra bytes for composition time offset
-	if ((codec_id == CODEC_H264 || codec_id == CODEC_HEVC) && type == PACKETTYPE_FRAMES) {
-		header_metadata_size += 3; // w24
-	}
-	if (is_multitrack)
-		header_metadata_size += 2; // w8+w8
-
-	s_w8(&s, RTMP_PACKET_TYPE_VIDEO);
-	s_wb24(&s, (uint32_t)packet->size + header_metadata_size);
-	s_wtimestamp(&s, time_ms);
-	s_wb24(&s, 0); // always 0
+	/* Unlike the legacy format, empty packets still get a header */
+	tag_init(tag, RTMP_PACKET_TYPE_VIDEO, time_ms, packet);
 
 	uint8_t frame_type = packet->keyframe ? FT_KEY : FT_INTER;
 
@@ -478,45 +453,75 @@ void flv_packet_ex(struct encoder_packet *packet, enum video_id_t codec_id, int3
 	 * The default trackId is 0.
 	 */
 	if (is_multitrack) {
-		s_w8(&s, FRAME_HEADER_EX | PACKETTYPE_MULTITRACK | frame_type);
-		s_w8(&s, MULTITRACKTYPE_ONE_TRACK | type);
-		s_w4cc(&s, codec_id);
+		tag_w8(tag, FRAME_HEADER_EX | PACKETTYPE_MULTITRACK | frame_type);
+		tag_w8(tag, MULTITRACKTYPE_ONE_TRACK | type);
+		tag_w4cc(tag, video_fourcc(codec_id));
 		// trackId
-		s_w8(&s, (uint8_t)idx);
+		tag_w8(tag, (uint8_t)idx);
 	} else {
-		s_w8(&s, FRAME_HEADER_EX | type | frame_type);
-		s_w4cc(&s, codec_id);
+		tag_w8(tag, FRAME_HEADER_EX | type | frame_type);
+		tag_w4cc(tag, video_fourcc(codec_id));
 	}
 
 	// H.264/HEVC composition time offset
 	if ((codec_id == CODEC_H264 || codec_id == CODEC_HEVC) && type == PACKETTYPE_FRAMES) {
-		s_wb24(&s, get_ms_time(packet, packet->pts - packet->dts));
+		tag_wb24(tag, get_ms_time(packet, packet->pts - packet->dts));
 	}
+}
 
-	// packet data
-	s_write(&s, packet->data, packet->size);
-
-	// packet tail
-	write_previous_tag_size(&s);
+void flv_packet_ex(struct encoder_packet *packet, enum video_id_t codec_id, int32_t dts_offset, uint8_t **output,
+		   size_t *size, int type, size_t idx)
+{
+	struct flv_tag tag;
 
-	*output = data.bytes.array;
-	*size = data.bytes.num;
+	flv_tag_ex(&tag, packet, codec_id, dts_offset, type, idx);
+	flv_write_tag(&tag, output, size);
 }
 
-void flv_packet_start(struct encoder_packet *packet, enum video_id_t codec, uint8_t **output, size_t *size, size_t idx)
+void flv_tag_start(struct flv_tag *tag, struct encoder_packet *packet, enum video_id_t codec, size_t idx)
 {
-	flv_packet_ex(packet, codec, 0, output, size, PACKETTYPE_SEQ_START, idx);
+	flv_tag_ex(tag, packet, codec, 0, PACKETTYPE_SEQ_START, idx);
 }
 
-void flv_packet_frames(struct encoder_packet *packet, enum video_id_t codec, int32_t dts_offset, uint8_t **output,
-		       size_t *size, size_t idx)
+void flv_tag_frames(struct flv_tag *tag, struct encoder_packet *packet, enum video_id_t codec, int32_t dts_offset,
+		    size_t idx)
 {
 	int packet_type = PACKETTYPE_FRAMES;
 	// PACKETTYPE_FRAMESX is an optimization to avoid sending composition
 	// time offsets of 0. See Enhanced RTMP spec.
 	if ((codec == CODEC_H264 || codec == CODEC_HEVC) && packet->dts == packet->pts)
 		packet_type = PACKETTYPE_FRAMESX;
-	flv_packet_ex(packet, codec, dts_offset, output, size, packet_type, idx);
+	flv_tag_ex(tag, packet, codec, dts_offset, packet_type, idx);
+}
+
+void flv_tag_end(struct flv_tag *tag, struct encoder_packet *packet, enum video_id_t codec, size_t idx)
+{
+	flv_tag_ex(tag, packet, codec, 0, PACKETTYPE_SEQ_END, idx);
+}
+
+bool flv_tag_audio_start(struct flv_tag *tag, struct encoder_packet *packet, enum audio_id_t codec, size_t idx)
+{
+	return flv_tag_audio_ex(tag, packet, codec, 0, AUDIO_PACKETTYPE_SEQ_START, idx);
+}
+
+bool flv_tag_audio_frames(struct flv_tag *tag, struct encoder_packet *packet, enum audio_id_t codec,
+			  int32_t dts_offset, size_t idx)
+{
+	return flv_tag_audio_ex(tag, packet, codec, dts_offset, AUDIO_PACKETTYPE_FRAMES, idx);
+}
+
+void flv_packet_start(struct encoder_packet *packet, enum video_id_t codec, uint8_t **output, size_t *size, size_t idx)
+{
+	flv_packet_ex(packet, codec, 0, output, size, PACKETTYPE_SEQ_START, idx);
+}
+
+void flv_packet_frames(struct encoder_packet *packet, enum video_id_t codec, int32_t dts_offset, uint8_t **output,
+		       size_t *size, size_t idx)
+{
+	struct flv_tag tag;
+
+	flv_tag_frames(&tag, packet, codec, dts_offset, idx);
+	flv_write_tag(&tag, output, size);
 }
 
 void flv_packet_end(struct encoder_packet *packet, enum video_id_t codec, uint8_t **output, size_t *size, size_t idx)
@@ -58,6 +58,37 @@ static int32_t get_ms_time(struct encoder_packet *packet, int64_t val)
 	return (int32_t)(val * MILLISECOND_DEN / packet->timebase_den);
 }
 
+/* An FLV tag that still points to the packet data, so that it can be sent
+ * without first copying the data into a buffer holding the whole tag */
+struct flv_tag {
+	uint8_t type;
+	int32_t time_ms;
+
+	/* Codec specific bytes at the start of the tag body */
+	uint8_t header[16];
+	size_t header_size;
+
+	const uint8_t *data;
+	size_t size;
+};
+
+static inline size_t flv_tag_body_size(const struct flv_tag *tag)
+{
+	return tag->header_size + tag->size;
+}
+
+/* Size of the tag in an FLV stream, including its header and trailing size */
+static inline size_t flv_tag_size(const struct flv_tag *tag)
+{
+	return 11 + flv_tag_body_size(tag) + 4;
+}
+
+/* Timestamp as it is stored in the tag header */
+static inline uint32_t flv_tag_timestamp(const struct flv_tag *tag)
+{
+	return ((uint32_t)tag->time_ms & 0xFFFFFF) | (((uint32_t)tag->time_ms >> 24) & 0x7F) << 24;
+}
+
 extern void write_file_info(FILE *file, int64_t duration_ms, int64_t size);
 
 extern void flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size, bool write_header);
@@ -77,3 +108,15 @@ extern void flv_packet_audio_start(struct encoder_packet *packet, enum audio_id_
 				   size_t idx);
 extern void flv_packet_audio_frames(struct encoder_packet *packet, enum audio_id_t codec, int32_t dts_offset,
 				    uint8_t **output, size_t *size, size_t idx);
+
+/* Same as the above, but only build the tag header. Return false for packets
+ * that do not produce a tag. */
+extern bool flv_tag_mux(struct flv_tag *tag, struct encoder_packet *packet, int32_t dts_offset, bool is_header);
+extern void flv_tag_start(struct flv_tag *tag, struct encoder_packet *packet, enum video_id_t codec, size_t idx);
+extern void flv_tag_frames(struct flv_tag *tag, struct encoder_packet *packet, enum video_id_t codec,
+			   int32_t dts_offset, size_t idx);
+extern void flv_tag_end(struct flv_tag *tag, struct encoder_packet *packet, enum video_id_t codec, size_t idx);
+extern bool flv_tag_audio_start(struct flv_tag *tag, struct encoder_packet *packet, enum audio_id_t codec,
+				size_t idx);
+extern bool flv_tag_audio_frames(struct flv_tag *tag, struct encoder_packet *packet, enum audio_id_t codec,
+				 int32_t dts_offset, size_t idx);
@@ -39,6 +39,10 @@
 #define MSG_NOSIGNAL 0
 #endif
 
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
 #ifdef CRYPTO
 
 #ifdef __APPLE__
@@ -1576,11 +1580,38 @@ ReadN(RTMP *r, char *buffer, int n)
     return nOriginalSize - n;
 }
 
+/* Returns TRUE if the send should be retried, otherwise the connection is
+ * closed */
+static int
+HandleSendError(RTMP *r, const char *func, int n)
+{
+    struct linger l;
+    int sockerr = GetSockError();
+    RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d (%d bytes)", func,
+             sockerr, n);
+
+    if (sockerr == EINTR && !RTMP_ctrlC)
+        return TRUE;
+
+    r->last_error_code = sockerr;
+
+    // Force-close the socket. Sometimes a send() error isn't fatal, so
+    // we could end up writing an unpublish message which some services
+    // treat as a clean shutdown. We need to disable lingering too so
+    // the remote side sees an abortive shutdown (RST).
+    l.l_onoff = 1;
+    l.l_linger = 0;
+    setsockopt(r->m_sb.sb_socket, SOL_SOCKET, SO_LINGER, (char *)&l, sizeof(l));
+    RTMPSockBuf_Close(&r->m_sb);
+
+    RTMP_Close(r);
+    return FALSE;
+}
+
 static int
 WriteN(RTMP *r, const char *buffer, int n)
 {
     const char *ptr = buffer;
-    struct linger l;
 
     while (n > 0)
     {
@@ -1596,25 +1627,9 @@ WriteN(RTMP *r, const char *buffer, int n)
 
         if (nBytes < 0)
         {
-            int sockerr = GetSockError();
-            RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d (%d bytes)", __FUNCTION__,
-                     sockerr, n);
-
-            if (sockerr == EINTR && !RTMP_ctrlC)
+            if (HandleSendError(r, __FUNCTION__, n))
                 continue;
 
-            r->last_error_code = sockerr;
-
-            // Force-close the socket. Sometimes a send() error isn't fatal, so
-            // we could end up writing an unpublish message which some services
-            // treat as a clean shutdown. We need to disable lingering too so
-            // the remote side sees an abortive shutdown (RST).
-            l.l_onoff = 1;
-            l.l_linger = 0;
-            setsockopt(r->m_sb.sb_socket, SOL_SOCKET, SO_LINGER, (char *)&l, sizeof(l));
-            RTMPSockBuf_Close(&r->m_sb);
-
-            RTMP_Close(r);
             n = 1;
             break;
         }
@@ -1629,6 +1644,118 @@ WriteN(RTMP *r, const char *buffer, int n)
     return n == 0;
 }
 
+#define WRITEV_BATCH 64
+
+typedef struct RTMPVec
+{
+    const char *buf;
+    int len;
+} RTMPVec;
+
+/* Writes the buffers in order, straight from where they are when the data
+ * goes to a plain socket */
+static int
+WriteV(RTMP *r, RTMPVec *vec, int count)
+{
+    int i;
+
+    /* TLS and HTTP tunneling would turn every buffer into a record or a
+     * request of its own, so those get the data in one piece */
+    if ((r->Link.protocol & RTMP_FEATURE_HTTP) || r->m_sb.sb_ssl)
+    {
+        char *buf, *ptr;
+        int total = 0, ret;
+
+        for (i = 0; i < count; i++)
+            total += vec[i].len;
+
+        buf = malloc(total);
+        if (!buf)
+            return FALSE;
+
+        for (i = 0, ptr = buf; i < count; i++)
+        {
+            memcpy(ptr, vec[i].buf, vec[i].len);
+            ptr += vec[i].len;
+        }
+
+        ret = WriteN(r, buf, total);
+        free(buf);
+        return ret;
+    }
+
+    /* custom senders queue the data themselves */
+    if (r->m_bCustomSend && r->m_customSendFunc)
+    {
+        for (i = 0; i < count; i++)
+        {
+            if (!WriteN(r, vec[i].buf, vec[i].len))
+                return FALSE;
+        }
+        return TRUE;
+    }
+
+    while (count > 0)
+    {
+        int n = count < WRITEV_BATCH ? count : WRITEV_BATCH;
+        int nBytes;
+#ifdef _WIN32
+        WSABUF bufs[WRITEV_BATCH];
+        DWORD sent = 0;
+
+        for (i = 0; i < n; i++)
+        {
+            bufs[i].buf = (char *)vec[i].buf;
+            bufs[i].len = (ULONG)vec[i].len;
+        }
+
+        nBytes = WSASend(r->m_sb.sb_socket, bufs, (DWORD)n, &sent, 0, NULL, NULL) == 0 ? (int)sent : -1;
+#else
+        struct iovec bufs[WRITEV_BATCH];
+        struct msghdr msg;
+
+        for (i = 0; i < n; i++)
+        {
+            bufs[i].iov_base = (void *)vec[i].buf;
+            bufs[i].iov_len = (size_t)vec[i].len;
+        }
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = bufs;
+        msg.msg_iovlen = n;
+
+        nBytes = (int)sendmsg(r->m_sb.sb_socket, &msg, MSG_NOSIGNAL);
+#endif
+
+        if (nBytes < 0)
+        {
+            if (HandleSendError(r, __FUNCTION__, vec[0].len))
+                continue;
+
+            return FALSE;
+        }
+
+        if (nBytes == 0)
+            return FALSE;
+
+        /* skip what was sent, which may end in the middle of a buffer */
+        while (count > 0 && nBytes >= vec->len)
+        {
+            nBytes -= vec->len;
+            vec++;
+            count--;
+        }
+
+        if (nBytes)
+        {
+            vec->buf += nBytes;
+            vec->len -= nBytes;
+        }
+    }
+
+    return TRUE;
+}
+
 #define SAVC(x)	static const AVal av_##x = AVC(#x)
 
 SAVC(app);
@@ -4085,18 +4212,18 @@ RTMP_SendChunk(RTMP *r, RTMPChunk *chunk)
     return wrote;
 }
 
-int
-RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+/* Encodes the header of the first chunk of a packet so that it ends at hend.
+ * Returns the size of the header, or 0 if the packet can't be sent. */
+static int
+EncodePacketHeader(RTMP *r, RTMPPacket *packet, char *hend, char **headerOut,
+                   int *cSizeOut, char *cOut, uint32_t *tOut)
 {
     const RTMPPacket *prevPacket;
     uint32_t last = 0;
     int nSize;
     int hSize, cSize;
-    char *header, *hptr, *hend, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    char *header, *hptr, c;
     uint32_t t;
-    char *buffer, *tbuf = NULL, *toff = NULL;
-    int nChunkSize;
-    int tlen;
 
     if (packet->m_nChannel >= r->m_channelsAllocatedOut)
     {
@@ -4107,7 +4234,7 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
             free(r->m_vecChannelsOut);
             r->m_vecChannelsOut = NULL;
             r->m_channelsAllocatedOut = 0;
-            return FALSE;
+            return 0;
         }
         r->m_vecChannelsOut = packets;
         memset(r->m_vecChannelsOut + r->m_channelsAllocatedOut, 0, sizeof(RTMPPacket*) * (n - r->m_channelsAllocatedOut));
@@ -4142,7 +4269,7 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     {
         RTMP_Log(RTMP_LOGERROR, "sanity failed!! trying to send header of type: 0x%02x.",
                  (unsigned char)packet->m_headerType);
-        return FALSE;
+        return 0;
     }
 
     nSize = packetSize[packet->m_headerType];
@@ -4151,16 +4278,7 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     t = packet->m_nTimeStamp - last;
     packet->m_nLastWireTimeStamp = t;
 
-    if (packet->m_body)
-    {
-        header = packet->m_body - nSize;
-        hend = packet->m_body;
-    }
-    else
-    {
-        header = hbuf + 6;
-        hend = hbuf + sizeof(hbuf);
-    }
+    header = hend - nSize;
 
     if (packet->m_nChannel > 319)
         cSize = 2;
@@ -4217,6 +4335,29 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     if (nSize > 1 && t >= 0xffffff)
         hptr = AMF_EncodeInt32(hptr, hend, t);
 
+    *headerOut = header;
+    *cSizeOut = cSize;
+    *cOut = c;
+    *tOut = t;
+    return hSize;
+}
+
+int
+RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+{
+    int nSize;
+    int hSize, cSize;
+    char *header, *hend, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    uint32_t t;
+    char *buffer, *tbuf = NULL, *toff = NULL;
+    int nChunkSize;
+    int tlen;
+
+    hend = packet->m_body ? packet->m_body : hbuf + sizeof(hbuf);
+    hSize = EncodePacketHeader(r, packet, hend, &header, &cSize, &c, &t);
+    if (!hSize)
+        return FALSE;
+
     nSize = packet->m_nBodySize;
     buffer = packet->m_body;
     nChunkSize = r->m_outChunkSize;
@@ -4320,6 +4461,89 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     return TRUE;
 }
 
+/* Same as RTMP_SendPacket, but the body is prefix followed by data, and both
+ * are written out without being copied into a packet first */
+static int
+SendPacketV(RTMP *r, RTMPPacket *packet, const char *prefix, int prefixSize,
+            const char *data, int dataSize)
+{
+    char hbuf[RTMP_MAX_HEADER_SIZE], cont[7], c;
+    char *header;
+    int hSize, cSize, contSize;
+    int nSize = prefixSize + dataSize;
+    int nChunkSize = r->m_outChunkSize;
+    int off = 0, nVec = 0, ret;
+    uint32_t t;
+    RTMPVec *vec;
+
+    hSize = EncodePacketHeader(r, packet, hbuf + sizeof(hbuf), &header, &cSize, &c, &t);
+    if (!hSize)
+        return FALSE;
+
+    /* header of the type 3 chunks that continue the message */
+    cont[0] = 0xc0 | c;
+    contSize = 1;
+    if (cSize)
+    {
+        int tmp = packet->m_nChannel - 64;
+        cont[contSize++] = tmp & 0xff;
+        if (cSize == 2)
+            cont[contSize++] = tmp >> 8;
+    }
+    if (t >= 0xffffff)
+    {
+        AMF_EncodeInt32(cont + contSize, cont + sizeof(cont), t);
+        contSize += 4;
+    }
+
+    /* a chunk header and at most two pieces of body per chunk */
+    vec = malloc(sizeof(RTMPVec) * 3 * ((nSize + nChunkSize - 1) / nChunkSize + 1));
+    if (!vec)
+        return FALSE;
+
+    do
+    {
+        int len = nSize - off < nChunkSize ? nSize - off : nChunkSize;
+
+        vec[nVec].buf = off ? cont : header;
+        vec[nVec++].len = off ? contSize : hSize;
+
+        if (off < prefixSize)
+        {
+            int n = len < prefixSize - off ? len : prefixSize - off;
+
+            vec[nVec].buf = prefix + off;
+            vec[nVec++].len = n;
+
+            if (len > n)
+            {
+                vec[nVec].buf = data;
+                vec[nVec++].len = len - n;
+            }
+        }
+        else if (len)
+        {
+            vec[nVec].buf = data + (off - prefixSize);
+            vec[nVec++].len = len;
+        }
+
+        off += len;
+    } while (off < nSize);
+
+    RTMP_Log(RTMP_LOGDEBUG2, "%s: fd=%d, size=%d", __FUNCTION__, (int)r->m_sb.sb_socket,
+             nSize);
+
+    ret = WriteV(r, vec, nVec);
+    free(vec);
+    if (!ret)
+        return FALSE;
+
+    if (!r->m_vecChannelsOut[packet->m_nChannel])
+        r->m_vecChannelsOut[packet->m_nChannel] = malloc(sizeof(RTMPPacket));
+    memcpy(r->m_vecChannelsOut[packet->m_nChannel], packet, sizeof(RTMPPacket));
+    return TRUE;
+}
+
 void
 RTMP_Close(RTMP *r)
 {
@@ -5314,6 +5538,34 @@ fail:
     return total;
 }
 
+int
+RTMP_WriteTag(RTMP *r, uint8_t type, uint32_t timestamp, const char *prefix,
+              int prefixSize, const char *data, int dataSize, int streamIdx)
+{
+    RTMPPacket packet = {0};
+
+    packet.m_nChannel = 0x04;	/* source channel */
+    packet.m_nInfoField2 = r->Link.streams[streamIdx].id;
+    packet.m_packetType = type;
+    packet.m_nBodySize = prefixSize + dataSize;
+    packet.m_nTimeStamp = timestamp;
+
+    if (((type == RTMP_PACKET_TYPE_AUDIO || type == RTMP_PACKET_TYPE_VIDEO) &&
+            !timestamp) || type == RTMP_PACKET_TYPE_INFO)
+    {
+        packet.m_headerType = RTMP_PACKET_SIZE_LARGE;
+    }
+    else
+    {
+        packet.m_headerType = RTMP_PACKET_SIZE_MEDIUM;
+    }
+
+    if (!SendPacketV(r, &packet, prefix, prefixSize, data, dataSize))
+        return -1;
+
+    return packet.m_nBodySize;
+}
+
 int
 RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx)
 {
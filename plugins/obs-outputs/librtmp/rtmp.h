@@ -543,6 +543,10 @@ extern "C"
     void RTMP_DropRequest(RTMP *r, int i, int freeit);
     int RTMP_Read(RTMP *r, char *buf, int size);
     int RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx);
+    /* Sends one FLV tag without its tag header, the body being prefix
+     * followed by data.  The data is written to the socket in place. */
+    int RTMP_WriteTag(RTMP *r, uint8_t type, uint32_t timestamp, const char *prefix,
+                      int prefixSize, const char *data, int dataSize, int streamIdx);
 
 #ifdef USE_HASHSWF
     /* hashswf.c */
@@ -108,7 +108,8 @@ struct mp4_track {
 	/* deque of encoder_packet belonging to this track */
 	struct deque packets;
 
-	/* Sample sizes (fixed for PCM) */
+	/* Sample sizes (fixed for PCM), stored big-endian as they are written
+	 * to the stsz box so finalisation does not have to convert them */
 	uint32_t sample_size;
 	DARRAY(uint32_t) sample_sizes;
 	/* Data chunks in file containing samples for this track */
@@ -120,7 +121,7 @@ struct mp4_track {
 	bool needs_ctts;
 	int32_t dts_offset;
 	DARRAY(struct sample_offset) offsets;
-	/* Sync samples, i.e. keyframes (Video only) */
+	/* Sync samples, i.e. keyframes (Video only), stored big-endian */
 	DARRAY(uint32_t) sync_samples;
 
 	/* Temporary array with information about the samples to be included
@@ -148,6 +149,11 @@ struct mp4_mux {
 	/* Offset of placeholder atom/box to contain final mdat header */
 	size_t placeholder_offset;
 
+	/* Space reserved after ftyp so the final moov can go in front of the
+	 * data without rewriting the file (faststart) */
+	size_t moov_reserve;
+	size_t moov_reserve_offset;
+
 	uint8_t track_ctr;
 	/* Audio/Video tracks */
 	DARRAY(struct mp4_track) tracks;
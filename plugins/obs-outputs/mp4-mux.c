@@ -142,6 +142,23 @@ static size_t mp4_write_free(struct mp4_mux *mux)
 	return 16;
 }
 
+/* Free box covering space reserved for the final moov */
+static void mp4_write_moov_reserve(struct mp4_mux *mux)
+{
+	struct serializer *s = mux->serializer;
+	static const uint8_t zeroes[4096] = {0};
+	size_t remaining = mux->moov_reserve - 8;
+
+	s_wb32(s, (uint32_t)mux->moov_reserve);
+	s_write(s, "free", 4);
+
+	while (remaining) {
+		size_t size = min(remaining, sizeof(zeroes));
+		s_write(s, zeroes, size);
+		remaining -= size;
+	}
+}
+
 /// 8.2.2 Movie Header Box
 static size_t mp4_write_mvhd(struct mp4_mux *mux)
 {
@@ -1147,8 +1164,7 @@ static size_t mp4_write_stss(struct mp4_mux *mux, struct mp4_track *track)
 	write_fullbox(s, size, "stss", 0, 0);
 	s_wb32(s, num); // entry_count
 
-	for (size_t idx = 0; idx < num; idx++)
-		s_wb32(s, track->sync_samples.array[idx]); // sample_number
+	s_write(s, track->sync_samples.array, num * sizeof(uint32_t)); // sample_number
 
 	return size;
 }
@@ -1264,9 +1280,7 @@ static size_t mp4_write_stsz(struct mp4_mux *mux, struct mp4_track *track, bool
 		s_wb32(s, 0);                                 // sample_size
 		s_wb32(s, (uint32_t)track->sample_sizes.num); // sample_count
 
-		for (size_t idx = 0; idx < track->sample_sizes.num; idx++) {
-			s_wb32(s, track->sample_sizes.array[idx]); // entry_size
-		}
+		s_write(s, track->sample_sizes.array, track->sample_sizes.num * sizeof(uint32_t)); // entry_size
 	}
 
 	return write_box_size(s, start);
@@ -2240,6 +2254,16 @@ static inline uint64_t get_longest_track_duration(struct mp4_mux *mux)
 	return dur;
 }
 
+/* Converts a value to the byte order it has in the file */
+static inline uint32_t to_be32(uint32_t val)
+{
+	uint8_t bytes[4] = {(uint8_t)(val >> 24), (uint8_t)(val >> 16), (uint8_t)(val >> 8), (uint8_t)val};
+	uint32_t be;
+
+	memcpy(&be, bytes, sizeof(be));
+	return be;
+}
+
 static void process_packets(struct mp4_mux *mux, struct mp4_track *track, uint64_t *mdat_size)
 {
 	size_t count = track->packets.size / sizeof(struct encoder_packet);
@@ -2303,14 +2327,18 @@ static void process_packets(struct mp4_mux *mux, struct mp4_track *track, uint64
 			track->deltas.array[track->deltas.num - 1].count += sample_count;
 		}
 
-		if (!track->sample_size)
-			da_push_back(track->sample_sizes, &size);
+		if (!track->sample_size) {
+			uint32_t entry = to_be32(size);
+			da_push_back(track->sample_sizes, &entry);
+		}
 
 		if (track->type != TRACK_VIDEO)
 			continue;
 
-		if (pkt->keyframe)
-			da_push_back(track->sync_samples, &track->samples);
+		if (pkt->keyframe) {
+			uint32_t entry = to_be32((uint32_t)track->samples);
+			da_push_back(track->sync_samples, &entry);
+		}
 
 		/* Only require ctts box if offet is non-zero */
 		if (offset && !track->needs_ctts)
@@ -2364,6 +2392,12 @@ static void mp4_flush_fragment(struct mp4_mux *mux)
 	// Write file header if not already done
 	if (!mux->fragments_written) {
 		mp4_write_ftyp(mux, true);
+
+		if (mux->moov_reserve) {
+			mux->moov_reserve_offset = serializer_get_pos(s);
+			mp4_write_moov_reserve(mux);
+		}
+
 		/* Placeholder to write mdat header during soft-remux */
 		mux->placeholder_offset = serializer_get_pos(s);
 		mp4_write_free(mux);
@@ -2691,6 +2725,25 @@ bool mp4_mux_add_chapter(struct mp4_mux *mux, int64_t dts_usec, const char *name
 	return true;
 }
 
+uint32_t mp4_mux_fragments_written(struct mp4_mux *mux)
+{
+	return mux->fragments_written;
+}
+
+void mp4_mux_reserve_moov(struct mp4_mux *mux, size_t size)
+{
+	if (mux->fragments_written)
+		return;
+
+	/* Needs to hold at least a box header and fit a 32-bit box size */
+	if (size < 8)
+		size = 0;
+	else if (size > UINT32_MAX)
+		size = UINT32_MAX;
+
+	mux->moov_reserve = size;
+}
+
 bool mp4_mux_finalise(struct mp4_mux *mux)
 {
 	struct serializer *s = mux->serializer;
@@ -2724,8 +2777,27 @@ bool mp4_mux_finalise(struct mp4_mux *mux)
 	mux->serializer = &fs;
 
 	mp4_write_moov(mux, false);
-	s_write(s, ao.bytes.array, ao.bytes.num);
-	info("Full moov size: %zu KiB", ao.bytes.num / 1024);
+
+	size_t moov_size = ao.bytes.num;
+	info("Full moov size: %zu KiB", moov_size / 1024);
+
+	/* The space left behind the moov needs its own free box header */
+	if (mux->moov_reserve && (moov_size == mux->moov_reserve || moov_size + 8 <= mux->moov_reserve)) {
+		serializer_seek(s, (int64_t)mux->moov_reserve_offset, SERIALIZE_SEEK_START);
+		s_write(s, ao.bytes.array, moov_size);
+
+		if (moov_size < mux->moov_reserve) {
+			s_wb32(s, (uint32_t)(mux->moov_reserve - moov_size));
+			s_write(s, "free", 4);
+		}
+	} else {
+		if (mux->moov_reserve) {
+			warn("Reserved moov space (%zu KiB) is too small, writing moov at the end of the file",
+			     mux->moov_reserve / 1024);
+		}
+
+		s_write(s, ao.bytes.array, moov_size);
+	}
 
 	mux->serializer = s; // restore real serializer
 	array_output_serializer_free(&ao);
@@ -38,3 +38,7 @@ void mp4_mux_destroy(struct mp4_mux *mux);
 bool mp4_mux_submit_packet(struct mp4_mux *mux, struct encoder_packet *pkt);
 bool mp4_mux_add_chapter(struct mp4_mux *mux, int64_t dts_usec, const char *name);
 bool mp4_mux_finalise(struct mp4_mux *mux);
+uint32_t mp4_mux_fragments_written(struct mp4_mux *mux);
+/* Reserves space for the final moov at the start of the file, must be called
+ * before the first packet is submitted. */
+void mp4_mux_reserve_moov(struct mp4_mux *mux, size_t size);
@@ -23,6 +23,7 @@
 #include <util/platform.h>
 #include <util/dstr.h>
 #include <util/threading.h>
+#include <util/task.h>
 #include <util/buffered-file-serializer.h>
 
 #include <opts-parser.h>
@@ -42,7 +43,11 @@ struct mp4_output {
 	obs_output_t *output;
 	struct dstr path;
 
-	struct serializer serializer;
+	struct serializer *serializer;
+
+	/* Finishes split files so that packets keep flowing into the next one */
+	os_task_queue_t *finish_queue;
+	volatile long finishing_files;
 
 	volatile bool active;
 	volatile bool stopping;
@@ -55,6 +60,8 @@ struct mp4_output {
 
 	struct mp4_mux *muxer;
 	int flags;
+	size_t moov_reserve;
+	uint32_t fragments_marked;
 
 	int64_t last_dts_usec;
 	DARRAY(struct chapter) chapters;
@@ -144,6 +151,7 @@ static void mp4_output_destory(void *data)
 		bfree(out->chapters.array[i].name);
 	da_free(out->chapters);
 
+	os_task_queue_destroy(out->finish_queue);
 	pthread_mutex_destroy(&out->mutex);
 	dstr_free(&out->path);
 	bfree(out);
@@ -191,6 +199,7 @@ static void *mp4_output_create(obs_data_t *settings, obs_output_t *output)
 {
 	struct mp4_output *out = bzalloc(sizeof(struct mp4_output));
 	out->output = output;
+	out->finish_queue = os_task_queue_create();
 	pthread_mutex_init(&out->mutex, NULL);
 
 	signal_handler_t *sh = obs_output_get_signal_handler(output);
@@ -212,7 +221,7 @@ static inline void apply_flag(int *flags, const char *value, int flag_value)
 		*flags &= ~flag_value;
 }
 
-static int parse_custom_options(const char *opts_str)
+static int parse_custom_options(const char *opts_str, size_t *moov_reserve)
 {
 	int flags = MP4_USE_NEGATIVE_CTS;
 
@@ -229,6 +238,8 @@ static int parse_custom_options(const char *opts_str)
 			apply_flag(&flags, opt.value, MP4_USE_MDTA_KEY_VALUE);
 		} else if (strcmp(opt.name, "use_negative_cts") == 0) {
 			apply_flag(&flags, opt.value, MP4_USE_NEGATIVE_CTS);
+		} else if (strcmp(opt.name, "moov_reserve_kib") == 0) {
+			*moov_reserve = (size_t)strtoull(opt.value, NULL, 10) * 1024;
 		} else {
 			blog(LOG_WARNING, "Unknown muxer option: %s = %s", opt.name, opt.value);
 		}
@@ -239,6 +250,25 @@ static int parse_custom_options(const char *opts_str)
 	return flags;
 }
 
+static bool open_file(struct mp4_output *out)
+{
+	out->serializer = bzalloc(sizeof(struct serializer));
+
+	if (!buffered_file_serializer_init_defaults(out->serializer, out->path.array)) {
+		warn("Unable to open MP4 file '%s'", out->path.array);
+		bfree(out->serializer);
+		out->serializer = NULL;
+		return false;
+	}
+
+	out->muxer = mp4_mux_create(out->output, out->serializer, out->flags);
+	if (out->moov_reserve)
+		mp4_mux_reserve_moov(out->muxer, out->moov_reserve);
+
+	out->fragments_marked = 0;
+	return true;
+}
+
 static bool mp4_output_start(void *data)
 {
 	struct mp4_output *out = data;
@@ -263,17 +293,15 @@ static bool mp4_output_start(void *data)
 
 	/* Allow skipping the remux step for debugging purposes. */
 	const char *muxer_settings = obs_data_get_string(settings, "muxer_settings");
-	out->flags = parse_custom_options(muxer_settings);
+	out->moov_reserve = 0;
+	out->flags = parse_custom_options(muxer_settings, &out->moov_reserve);
 
 	obs_data_release(settings);
 
-	if (!buffered_file_serializer_init_defaults(&out->serializer, out->path.array)) {
-		warn("Unable to open MP4 file '%s'", out->path.array);
+	/* Initialise muxer and start capture */
+	if (!open_file(out))
 		return false;
-	}
 
-	/* Initialise muxer and start capture */
-	out->muxer = mp4_mux_create(out->output, &out->serializer, out->flags);
 	os_atomic_set_bool(&out->active, true);
 	obs_output_begin_data_capture(out->output, 0);
 
@@ -362,47 +390,89 @@ static void generate_filename(struct mp4_output *out, struct dstr *dst, bool ove
 	obs_data_release(settings);
 }
 
-static bool change_file(struct mp4_output *out, struct encoder_packet *pkt)
+/* Each file being finished keeps its whole write buffer around, so only this
+ * many may be pending before splitting waits for them */
+#define MAX_FINISHING_FILES 2
+
+struct finish_file {
+	struct mp4_output *out;
+	struct mp4_mux *muxer;
+	struct serializer *serializer;
+	struct dstr path;
+	struct dstr next_path;
+};
+
+static void finish_file_task(void *param)
 {
+	struct finish_file *file = param;
+	struct mp4_output *out = file->out;
 	uint64_t start_time = os_gettime_ns();
 
-	/* finalise file */
-	for (size_t i = 0; i < out->chapters.num; i++) {
-		struct chapter *chap = &out->chapters.array[i];
-		mp4_mux_add_chapter(out->muxer, chap->dts_usec, chap->name);
+	/* finalise file, then flush/close it and destroy its muxer */
+	mp4_mux_finalise(file->muxer);
+	buffered_file_serializer_free(file->serializer);
+	mp4_mux_destroy(file->muxer);
+
+	info("MP4 file '%s' complete. Finalization took %" PRIu64 " ms.", file->path.array,
+	     (os_gettime_ns() - start_time) / 1000000);
+
+	/* listeners treat this as the previous file being complete */
+	if (file->next_path.len) {
+		calldata_t cd = {0};
+		signal_handler_t *sh = obs_output_get_signal_handler(out->output);
+		calldata_set_string(&cd, "next_file", file->next_path.array);
+		signal_handler_signal(sh, "file_changed", &cd);
+		calldata_free(&cd);
 	}
 
-	mp4_mux_finalise(out->muxer);
+	os_atomic_dec_long(&out->finishing_files);
 
-	info("Waiting for file writer to finish...");
+	bfree(file->serializer);
+	dstr_free(&file->path);
+	dstr_free(&file->next_path);
+	bfree(file);
+}
 
-	/* flush/close file and destroy old muxer */
-	buffered_file_serializer_free(&out->serializer);
-	mp4_mux_destroy(out->muxer);
+static bool change_file(struct mp4_output *out, struct encoder_packet *pkt)
+{
+	struct finish_file *file = bzalloc(sizeof(*file));
 
-	for (size_t i = 0; i < out->chapters.num; i++)
-		bfree(out->chapters.array[i].name);
+	for (size_t i = 0; i < out->chapters.num; i++) {
+		struct chapter *chap = &out->chapters.array[i];
+		mp4_mux_add_chapter(out->muxer, chap->dts_usec, chap->name);
+		bfree(chap->name);
+	}
 
 	da_clear(out->chapters);
 
-	info("MP4 file split complete. Finalization took %" PRIu64 " ms.", (os_gettime_ns() - start_time) / 1000000);
+	/* The old file is finalised and written out in the background, a slow
+	 * disk must not hold up packets meant for the new one. */
+	file->out = out;
+	file->muxer = out->muxer;
+	file->serializer = out->serializer;
+	dstr_copy_dstr(&file->path, &out->path);
+
+	out->muxer = NULL;
+	out->serializer = NULL;
 
 	/* open new file */
 	generate_filename(out, &out->path, out->allow_overwrite);
 	info("Changing output file to '%s'", out->path.array);
 
-	if (!buffered_file_serializer_init_defaults(&out->serializer, out->path.array)) {
-		warn("Unable to open MP4 file '%s'", out->path.array);
-		return false;
+	bool success = open_file(out);
+	if (success)
+		dstr_copy_dstr(&file->next_path, &out->path);
+
+	if (os_atomic_load_long(&out->finishing_files) >= MAX_FINISHING_FILES) {
+		warn("Previous files are still being finished, waiting for them");
+		os_task_queue_wait(out->finish_queue);
 	}
 
-	out->muxer = mp4_mux_create(out->output, &out->serializer, out->flags);
+	os_atomic_inc_long(&out->finishing_files);
+	os_task_queue_queue_task(out->finish_queue, finish_file_task, file);
 
-	calldata_t cd = {0};
-	signal_handler_t *sh = obs_output_get_signal_handler(out->output);
-	calldata_set_string(&cd, "next_file", out->path.array);
-	signal_handler_signal(sh, "file_changed", &cd);
-	calldata_free(&cd);
+	if (!success)
+		return false;
 
 	out->cur_size = 0;
 	out->start_time = pkt->dts_usec;
@@ -428,8 +498,15 @@ static void mp4_output_actual_stop(struct mp4_output *out, int code)
 {
 	os_atomic_set_bool(&out->active, false);
 
+	/* Split files still being finished come before this one */
+	os_task_queue_wait(out->finish_queue);
+
 	uint64_t start_time = os_gettime_ns();
 
+	/* A failed split leaves no file open */
+	if (!out->muxer)
+		goto finish;
+
 	for (size_t i = 0; i < out->chapters.num; i++) {
 		struct chapter *chap = &out->chapters.array[i];
 		mp4_mux_add_chapter(out->muxer, chap->dts_usec, chap->name);
@@ -437,6 +514,7 @@ static void mp4_output_actual_stop(struct mp4_output *out, int code)
 
 	mp4_mux_finalise(out->muxer);
 
+finish:
 	if (code) {
 		obs_output_signal_stop(out->output, code);
 	} else {
@@ -446,8 +524,13 @@ static void mp4_output_actual_stop(struct mp4_output *out, int code)
 	info("Waiting for file writer to finish...");
 
 	/* Flush/close output file and destroy muxer */
-	buffered_file_serializer_free(&out->serializer);
-	obs_queue_task(OBS_TASK_DESTROY, mp4_mux_destroy_task, out->muxer, false);
+	if (out->serializer) {
+		buffered_file_serializer_free(out->serializer);
+		bfree(out->serializer);
+		out->serializer = NULL;
+	}
+	if (out->muxer)
+		obs_queue_task(OBS_TASK_DESTROY, mp4_mux_destroy_task, out->muxer, false);
 	out->muxer = NULL;
 
 	/* Clear chapter data */
@@ -466,12 +549,28 @@ static void push_back_packet(struct mp4_output *out, struct encoder_packet *pack
 	da_push_back(out->split_buffer, &pkt);
 }
 
+/* Lets the file writer report how long each fragment takes to reach the disk */
+static inline void mark_fragments(struct mp4_output *out)
+{
+	uint32_t fragments = mp4_mux_fragments_written(out->muxer);
+
+	if (fragments != out->fragments_marked) {
+		buffered_file_serializer_mark(out->serializer);
+		out->fragments_marked = fragments;
+	}
+}
+
 static inline bool submit_packet(struct mp4_output *out, struct encoder_packet *pkt)
 {
+	bool success;
+
 	out->total_bytes += pkt->size;
 
-	if (!out->split_file_enabled)
-		return mp4_mux_submit_packet(out->muxer, pkt);
+	if (!out->split_file_enabled) {
+		success = mp4_mux_submit_packet(out->muxer, pkt);
+		mark_fragments(out);
+		return success;
+	}
 
 	out->cur_size += pkt->size;
 
@@ -486,7 +585,9 @@ static inline bool submit_packet(struct mp4_output *out, struct encoder_packet *
 		modified.pts -= out->audio_dts_offsets[modified.track_idx];
 	}
 
-	return mp4_mux_submit_packet(out->muxer, &modified);
+	success = mp4_mux_submit_packet(out->muxer, &modified);
+	mark_fragments(out);
+	return success;
 }
 
 static void mp4_output_packet(void *data, struct encoder_packet *packet)
@@ -556,7 +657,7 @@ static void mp4_output_packet(void *data, struct encoder_packet *packet)
 
 	submit_packet(out, packet);
 
-	if (serializer_get_pos(&out->serializer) == -1)
+	if (serializer_get_pos(out->serializer) == -1)
 		mp4_output_actual_stop(out, OBS_OUTPUT_ERROR);
 
 unlock:
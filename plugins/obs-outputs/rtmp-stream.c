@@ -396,23 +396,32 @@ static int handle_socket_read(struct rtmp_stream *stream)
 	return 0;
 }
 
+/* The tag data is sent straight out of the packet, so the packet may only be
+ * released afterwards */
+static inline int write_tag(struct rtmp_stream *stream, const struct flv_tag *tag)
+{
+	return RTMP_WriteTag(&stream->rtmp, tag->type, flv_tag_timestamp(tag), (const char *)tag->header,
+			     (int)tag->header_size, (const char *)tag->data, (int)tag->size, 0);
+}
+
 static int send_packet(struct rtmp_stream *stream, struct encoder_packet *packet, bool is_header)
 {
-	uint8_t *data;
-	size_t size;
+	struct flv_tag tag;
+	size_t size = 0;
 	int ret = 0;
 
 	if (handle_socket_read(stream))
 		return -1;
 
-	flv_packet_mux(packet, is_header ? 0 : stream->start_dts_offset, &data, &size, is_header);
+	if (flv_tag_mux(&tag, packet, is_header ? 0 : stream->start_dts_offset, is_header)) {
+		size = flv_tag_size(&tag);
 
 #ifdef TEST_FRAMEDROPS
-	droptest_cap_data_rate(stream, size);
+		droptest_cap_data_rate(stream, size);
 #endif
 
-	ret = RTMP_Write(&stream->rtmp, (char *)data, (int)size, 0);
-	bfree(data);
+		ret = write_tag(stream, &tag);
+	}
 
 	if (is_header)
 		bfree(packet->data);
@@ -426,27 +435,28 @@ static int send_packet(struct rtmp_stream *stream, struct encoder_packet *packet
 static int send_packet_ex(struct rtmp_stream *stream, struct encoder_packet *packet, bool is_header, bool is_footer,
 			  size_t idx)
 {
-	uint8_t *data;
-	size_t size = 0;
+	struct flv_tag tag;
+	size_t size;
 	int ret = 0;
 
 	if (handle_socket_read(stream))
 		return -1;
 
 	if (is_header) {
-		flv_packet_start(packet, stream->video_codec[idx], &data, &size, idx);
+		flv_tag_start(&tag, packet, stream->video_codec[idx], idx);
 	} else if (is_footer) {
-		flv_packet_end(packet, stream->video_codec[idx], &data, &size, idx);
+		flv_tag_end(&tag, packet, stream->video_codec[idx], idx);
 	} else {
-		flv_packet_frames(packet, stream->video_codec[idx], stream->start_dts_offset, &data, &size, idx);
+		flv_tag_frames(&tag, packet, stream->video_codec[idx], stream->start_dts_offset, idx);
 	}
 
+	size = flv_tag_size(&tag);
+
 #ifdef TEST_FRAMEDROPS
 	droptest_cap_data_rate(stream, size);
 #endif
 
-	ret = RTMP_Write(&stream->rtmp, (char *)data, (int)size, 0);
-	bfree(data);
+	ret = write_tag(stream, &tag);
 
 	if (is_header || is_footer) // manually created packets
 		bfree(packet->data);
@@ -459,21 +469,21 @@ static int send_packet_ex(struct rtmp_stream *stream, struct encoder_packet *pac
 
 static int send_audio_packet_ex(struct rtmp_stream *stream, struct encoder_packet *packet, bool is_header, size_t idx)
 {
-	uint8_t *data;
-	size_t size = 0;
+	struct flv_tag tag;
+	bool has_tag;
 	int ret = 0;
 
 	if (handle_socket_read(stream))
 		return -1;
 
 	if (is_header) {
-		flv_packet_audio_start(packet, stream->audio_codec[idx], &data, &size, idx);
+		has_tag = flv_tag_audio_start(&tag, packet, stream->audio_codec[idx], idx);
 	} else {
-		flv_packet_audio_frames(packet, stream->audio_codec[idx], stream->start_dts_offset, &data, &size, idx);
+		has_tag = flv_tag_audio_frames(&tag, packet, stream->audio_codec[idx], stream->start_dts_offset, idx);
 	}
 
-	ret = RTMP_Write(&stream->rtmp, (char *)data, (int)size, 0);
-	bfree(data);
+	if (has_tag)
+		ret = write_tag(stream, &tag);
 
 	if (is_header)
 		bfree(packet->data);
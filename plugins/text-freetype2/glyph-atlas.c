@@ -0,0 +1,257 @@
+/******************************************************************************
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs-module.h>
+#include <util/threading.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include "text-freetype2.h"
+
+/* protects the atlas list, the atlases and the FreeType library.  it is always
+ * taken before the graphics context */
+static pthread_mutex_t atlas_mutex;
+static struct glyph_atlas *first_atlas = NULL;
+
+void glyph_atlas_init(void)
+{
+	pthread_mutex_init_recursive(&atlas_mutex);
+}
+
+void glyph_atlas_free(void)
+{
+	pthread_mutex_destroy(&atlas_mutex);
+}
+
+void glyph_atlas_lock(void)
+{
+	pthread_mutex_lock(&atlas_mutex);
+}
+
+void glyph_atlas_unlock(void)
+{
+	pthread_mutex_unlock(&atlas_mutex);
+}
+
+static void free_glyphs(struct glyph_atlas *atlas)
+{
+	for (uint32_t i = 0; i < num_cache_slots; i++) {
+		if (atlas->glyphs[i] != NULL) {
+			bfree(atlas->glyphs[i]);
+			atlas->glyphs[i] = NULL;
+		}
+	}
+}
+
+static struct glyph_atlas *create_atlas(const char *path, FT_Long index, uint16_t size, bool antialiasing)
+{
+	struct glyph_atlas *atlas = bzalloc(sizeof(struct glyph_atlas));
+
+	if (FT_New_Face(ft2_lib, path, index, &atlas->face) != 0) {
+		bfree(atlas);
+		return NULL;
+	}
+
+	FT_Set_Pixel_Sizes(atlas->face, 0, size);
+	FT_Select_Charmap(atlas->face, FT_ENCODING_UNICODE);
+
+	atlas->refs = 1;
+	atlas->path = bstrdup(path);
+	atlas->index = index;
+	atlas->size = size;
+	atlas->antialiasing = antialiasing;
+	atlas->width = GLYPH_ATLAS_MIN_SIZE;
+	atlas->height = GLYPH_ATLAS_MIN_SIZE;
+	atlas->texbuf = bzalloc((size_t)atlas->width * atlas->height);
+	return atlas;
+}
+
+struct glyph_atlas *glyph_atlas_acquire(const char *path, FT_Long index, uint16_t size, bool antialiasing)
+{
+	struct glyph_atlas *atlas;
+
+	glyph_atlas_lock();
+
+	for (atlas = first_atlas; atlas; atlas = atlas->next) {
+		if (atlas->index == index && atlas->size == size && atlas->antialiasing == antialiasing &&
+		    strcmp(atlas->path, path) == 0) {
+			atlas->refs++;
+			goto done;
+		}
+	}
+
+	atlas = create_atlas(path, index, size, antialiasing);
+	if (atlas) {
+		atlas->shared = true;
+		atlas->next = first_atlas;
+		first_atlas = atlas;
+	}
+
+done:
+	glyph_atlas_unlock();
+	return atlas;
+}
+
+/* an atlas of the same font that is not shared with other sources, for text
+ * that does not fit next to the glyphs of others */
+struct glyph_atlas *glyph_atlas_create_private(const struct glyph_atlas *shared)
+{
+	struct glyph_atlas *atlas;
+
+	glyph_atlas_lock();
+	atlas = create_atlas(shared->path, shared->index, shared->size, shared->antialiasing);
+	glyph_atlas_unlock();
+
+	return atlas;
+}
+
+void glyph_atlas_release(struct glyph_atlas *atlas)
+{
+	if (!atlas)
+		return;
+
+	glyph_atlas_lock();
+
+	if (--atlas->refs > 0) {
+		glyph_atlas_unlock();
+		return;
+	}
+
+	if (atlas->shared) {
+		struct glyph_atlas **prev = &first_atlas;
+		while (*prev != atlas)
+			prev = &(*prev)->next;
+		*prev = atlas->next;
+	}
+
+	FT_Done_Face(atlas->face);
+
+	glyph_atlas_unlock();
+
+	/* sources hold their own reference to the texture they draw with */
+	glyph_texture_release(atlas->tex);
+
+	free_glyphs(atlas);
+	bfree(atlas->texbuf);
+	bfree(atlas->path);
+	bfree(atlas);
+}
+
+static void grow(struct glyph_atlas *atlas)
+{
+	uint32_t width = atlas->width * 2;
+	uint32_t height = atlas->height * 2;
+	uint8_t *texbuf = bzalloc((size_t)width * height);
+
+	for (uint32_t y = 0; y < atlas->height; y++)
+		memcpy(texbuf + (size_t)y * width, atlas->texbuf + (size_t)y * atlas->width, atlas->width);
+
+	/* glyphs keep their position in pixels */
+	for (uint32_t i = 0; i < num_cache_slots; i++) {
+		struct glyph_info *glyph = atlas->glyphs[i];
+		if (glyph) {
+			glyph->u *= 0.5f;
+			glyph->u2 *= 0.5f;
+			glyph->v *= 0.5f;
+			glyph->v2 *= 0.5f;
+		}
+	}
+
+	bfree(atlas->texbuf);
+	atlas->texbuf = texbuf;
+	atlas->width = width;
+	atlas->height = height;
+	atlas->dirty = true;
+	os_atomic_inc_long(&atlas->generation);
+}
+
+/* finds space for a glyph, growing the atlas if needed.  returns false once
+ * the atlas is full */
+bool glyph_atlas_reserve(struct glyph_atlas *atlas, uint32_t w, uint32_t h, uint32_t *x, uint32_t *y)
+{
+	for (;;) {
+		uint32_t dx = atlas->x;
+		uint32_t dy = atlas->y;
+		uint32_t row_h = atlas->row_h;
+
+		if (dx + w >= atlas->width) {
+			dx = 0;
+			dy += row_h + 1;
+			row_h = 0;
+		}
+
+		if (dx + w < atlas->width && dy + h < atlas->height) {
+			*x = dx;
+			*y = dy;
+			atlas->x = dx + w + 1;
+			atlas->y = dy;
+			atlas->row_h = row_h > h ? row_h : h;
+			atlas->dirty = true;
+			return true;
+		}
+
+		if (atlas->width >= GLYPH_ATLAS_MAX_SIZE)
+			return false;
+
+		grow(atlas);
+	}
+}
+
+/* drops every glyph so the atlas can be filled again from scratch */
+void glyph_atlas_flush(struct glyph_atlas *atlas)
+{
+	free_glyphs(atlas);
+	memset(atlas->texbuf, 0, (size_t)atlas->width * atlas->height);
+	atlas->x = 0;
+	atlas->y = 0;
+	atlas->row_h = 0;
+	atlas->dirty = true;
+	os_atomic_inc_long(&atlas->generation);
+}
+
+void glyph_atlas_upload(struct glyph_atlas *atlas)
+{
+	if (!atlas->dirty)
+		return;
+
+	struct glyph_texture *tex = bzalloc(sizeof(*tex));
+	tex->refs = 1;
+
+	obs_enter_graphics();
+	tex->tex = gs_texture_create(atlas->width, atlas->height, GS_A8, 1, (const uint8_t **)&atlas->texbuf, 0);
+	obs_leave_graphics();
+
+	glyph_texture_release(atlas->tex);
+	atlas->tex = tex;
+	atlas->dirty = false;
+}
+
+struct glyph_texture *glyph_texture_addref(struct glyph_texture *tex)
+{
+	if (tex)
+		os_atomic_inc_long(&tex->refs);
+	return tex;
+}
+
+void glyph_texture_release(struct glyph_texture *tex)
+{
+	if (!tex || os_atomic_dec_long(&tex->refs) > 0)
+		return;
+
+	obs_enter_graphics();
+	gs_texture_destroy(tex->tex);
+	obs_leave_graphics();
+
+	bfree(tex);
+}
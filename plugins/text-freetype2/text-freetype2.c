@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <obs-module.h>
 #include <util/platform.h>
+#include <util/threading.h>
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include <sys/stat.h>
@@ -33,8 +34,6 @@ MODULE_EXPORT const char *obs_module_description(void)
 	return "FreeType2 text source";
 }
 
-uint32_t texbuf_w = 2048, texbuf_h = 2048;
-
 static const char *ft2_source_get_name(void *unused);
 static void *ft2_source_create(obs_data_t *settings, obs_source_t *source);
 static void ft2_source_destroy(void *data);
@@ -107,6 +106,7 @@ static void init_plugin(void)
 	if (!load_cached_os_font_list())
 		load_os_font_list();
 
+	glyph_atlas_init();
 	plugin_initialized = true;
 }
 
@@ -128,6 +128,7 @@ void obs_module_unload(void)
 {
 	if (plugin_initialized) {
 		free_os_font_list();
+		glyph_atlas_free();
 		FT_Done_FreeType(ft2_lib);
 	}
 }
@@ -219,17 +220,9 @@ static void ft2_source_destroy(void *data)
 {
 	struct ft2_source *srcdata = data;
 
-	if (srcdata->font_face != NULL) {
-		FT_Done_Face(srcdata->font_face);
-		srcdata->font_face = NULL;
-	}
-
-	for (uint32_t i = 0; i < num_cache_slots; i++) {
-		if (srcdata->cacheglyphs[i] != NULL) {
-			bfree(srcdata->cacheglyphs[i]);
-			srcdata->cacheglyphs[i] = NULL;
-		}
-	}
+	struct glyph_atlas *atlas = srcdata->atlas;
+	srcdata->atlas = NULL;
+	glyph_atlas_release(atlas);
 
 	if (srcdata->font_name != NULL)
 		bfree(srcdata->font_name);
@@ -237,21 +230,17 @@ static void ft2_source_destroy(void *data)
 		bfree(srcdata->font_style);
 	if (srcdata->text != NULL)
 		bfree(srcdata->text);
-	if (srcdata->texbuf != NULL)
-		bfree(srcdata->texbuf);
 	if (srcdata->text_file != NULL)
 		bfree(srcdata->text_file);
 
 	obs_enter_graphics();
 
-	if (srcdata->tex != NULL) {
-		gs_texture_destroy(srcdata->tex);
-		srcdata->tex = NULL;
-	}
 	if (srcdata->vbuf != NULL) {
 		gs_vertexbuffer_destroy(srcdata->vbuf);
 		srcdata->vbuf = NULL;
 	}
+	glyph_texture_release(srcdata->tex);
+	srcdata->tex = NULL;
 	if (srcdata->draw_effect != NULL) {
 		gs_effect_destroy(srcdata->draw_effect);
 		srcdata->draw_effect = NULL;
@@ -268,18 +257,22 @@ static void ft2_source_render(void *data, gs_effect_t *effect)
 	if (srcdata == NULL)
 		return;
 
-	if (srcdata->tex == NULL || srcdata->vbuf == NULL)
+	if (srcdata->atlas == NULL || srcdata->vbuf == NULL)
 		return;
 	if (srcdata->text == NULL || *srcdata->text == 0)
 		return;
 
+	if (srcdata->tex == NULL)
+		return;
+
 	gs_reset_blend_state();
 	if (srcdata->outline_text)
 		draw_outlines(srcdata);
 	if (srcdata->drop_shadow)
 		draw_drop_shadow(srcdata);
 
-	draw_uv_vbuffer(srcdata->vbuf, srcdata->tex, srcdata->draw_effect, (uint32_t)wcslen(srcdata->text) * 6, true);
+	draw_uv_vbuffer(srcdata->vbuf, srcdata->tex->tex, srcdata->draw_effect, (uint32_t)wcslen(srcdata->text) * 6,
+			true);
 
 	UNUSED_PARAMETER(effect);
 }
@@ -289,6 +282,23 @@ static void ft2_video_tick(void *data, float seconds)
 	struct ft2_source *srcdata = data;
 	if (srcdata == NULL)
 		return;
+
+	/* another source grew or flushed the atlas since the vertex buffer was
+	 * built.  render keeps drawing with the texture the vertex buffer was
+	 * built against until then */
+	if (srcdata->atlas) {
+		glyph_atlas_lock();
+		if (srcdata->atlas_generation != os_atomic_load_long(&srcdata->atlas->generation)) {
+			refresh_text(srcdata);
+		} else if (srcdata->tex != srcdata->atlas->tex) {
+			obs_enter_graphics();
+			glyph_texture_release(srcdata->tex);
+			srcdata->tex = glyph_texture_addref(srcdata->atlas->tex);
+			obs_leave_graphics();
+		}
+		glyph_atlas_unlock();
+	}
+
 	if (!srcdata->from_file || !srcdata->text_file)
 		return;
 
@@ -301,8 +311,7 @@ static void ft2_video_tick(void *data, float seconds)
 				read_from_end(srcdata, srcdata->text_file);
 			else
 				load_text_from_file(srcdata, srcdata->text_file);
-			cache_glyphs(srcdata, srcdata->text);
-			set_up_vertex_buffer(srcdata);
+			refresh_text(srcdata);
 			srcdata->update_file = false;
 		}
 
@@ -320,15 +329,16 @@ static bool init_font(struct ft2_source *srcdata)
 	FT_Long index;
 	const char *path =
 		get_font_path(srcdata->font_name, srcdata->font_size, srcdata->font_style, srcdata->font_flags, &index);
+
+	struct glyph_atlas *old_atlas = srcdata->atlas;
+	srcdata->atlas = NULL;
+	glyph_atlas_release(old_atlas);
+
 	if (!path)
 		return false;
 
-	if (srcdata->font_face != NULL) {
-		FT_Done_Face(srcdata->font_face);
-		srcdata->font_face = NULL;
-	}
-
-	return FT_New_Face(ft2_lib, path, index, &srcdata->font_face) == 0;
+	srcdata->atlas = glyph_atlas_acquire(path, index, srcdata->font_size, srcdata->antialiasing);
+	return srcdata->atlas != NULL;
 }
 
 static void ft2_source_update(void *data, obs_data_t *settings)
@@ -402,8 +412,6 @@ static void ft2_source_update(void *data, obs_data_t *settings)
 	if (ft2_lib == NULL)
 		goto error;
 
-	const size_t texbuf_size = (size_t)texbuf_w * (size_t)texbuf_h;
-
 	if (srcdata->draw_effect == NULL) {
 		char *effect_file = NULL;
 		char *error_string = NULL;
@@ -428,10 +436,7 @@ static void ft2_source_update(void *data, obs_data_t *settings)
 	const bool aa_changed = srcdata->antialiasing != new_aa_setting;
 	if (aa_changed) {
 		srcdata->antialiasing = new_aa_setting;
-		if (srcdata->texbuf != NULL) {
-			memset(srcdata->texbuf, 0, texbuf_size);
-		}
-		cache_standard_glyphs(srcdata);
+		vbuf_needs_update = true;
 	}
 
 	srcdata->file_load_failed = false;
@@ -439,7 +444,7 @@ static void ft2_source_update(void *data, obs_data_t *settings)
 
 	if (srcdata->font_name != NULL) {
 		if (strcmp(font_name, srcdata->font_name) == 0 && strcmp(font_style, srcdata->font_style) == 0 &&
-		    font_flags == srcdata->font_flags && font_size == srcdata->font_size)
+		    font_flags == srcdata->font_flags && font_size == srcdata->font_size && !aa_changed)
 			goto skip_font_load;
 
 		bfree(srcdata->font_name);
@@ -455,22 +460,12 @@ static void ft2_source_update(void *data, obs_data_t *settings)
 	srcdata->font_size = font_size;
 	srcdata->font_flags = font_flags;
 
-	if (!init_font(srcdata) || srcdata->font_face == NULL) {
+	if (!init_font(srcdata)) {
 		blog(LOG_WARNING, "FT2-text: Failed to load font %s", srcdata->font_name);
 		goto error;
-	} else {
-		FT_Set_Pixel_Sizes(srcdata->font_face, 0, srcdata->font_size);
-		FT_Select_Charmap(srcdata->font_face, FT_ENCODING_UNICODE);
 	}
 
-	if (srcdata->texbuf != NULL) {
-		bfree(srcdata->texbuf);
-		srcdata->texbuf = NULL;
-	}
-	srcdata->texbuf = bzalloc(texbuf_size);
-
-	if (srcdata->font_face)
-		cache_standard_glyphs(srcdata);
+	cache_standard_glyphs(srcdata);
 
 skip_font_load:
 	if (from_file) {
@@ -513,10 +508,7 @@ skip_font_load:
 		os_utf8_to_wcs_ptr(tmp, strlen(tmp), &srcdata->text);
 	}
 
-	if (srcdata->font_face) {
-		cache_glyphs(srcdata, srcdata->text);
-		set_up_vertex_buffer(srcdata);
-	}
+	refresh_text(srcdata);
 
 error:
 	obs_data_release(font_obj);
@@ -21,7 +21,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <ft2build.h>
 
 #define num_cache_slots 65535
-#define src_glyph srcdata->cacheglyphs[glyph_index]
+#define src_glyph srcdata->atlas->glyphs[glyph_index]
+
+#define GLYPH_ATLAS_MIN_SIZE 256
+#define GLYPH_ATLAS_MAX_SIZE 2048
 
 struct glyph_info {
 	float u, v, u2, v2;
@@ -29,6 +32,40 @@ struct glyph_info {
 	FT_Pos xadv;
 };
 
+/* glyphs of one font face and size, shared by every source using it.  the
+ * atlas starts small and grows as glyphs are added, once it cannot grow any
+ * more it is flushed and the glyphs are cached again as they are needed */
+/* every upload creates a new texture, sources keep the one their vertex buffer
+ * was built against until they rebuild it */
+struct glyph_texture {
+	gs_texture_t *tex;
+	volatile long refs;
+};
+
+struct glyph_atlas {
+	struct glyph_atlas *next;
+	long refs;
+	bool shared;
+
+	char *path;
+	FT_Long index;
+	uint16_t size;
+	bool antialiasing;
+
+	FT_Face face;
+	struct glyph_info *glyphs[num_cache_slots];
+
+	uint8_t *texbuf;
+	uint32_t width, height;
+	uint32_t x, y, row_h;
+	bool dirty;
+	struct glyph_texture *tex;
+
+	/* bumped whenever the texture coordinates of cached glyphs change or
+	 * glyphs are dropped, sources have to rebuild their vertex buffers */
+	volatile long generation;
+};
+
 struct ft2_source {
 	char *font_name;
 	char *font_style;
@@ -46,19 +83,15 @@ struct ft2_source {
 
 	uint32_t cx, cy, max_h, custom_width;
 	uint32_t outline_width;
-	uint32_t texbuf_x, texbuf_y;
 	uint32_t color[2];
 
 	int32_t cur_scroll, scroll_speed;
 
-	gs_texture_t *tex;
-
-	struct glyph_info *cacheglyphs[num_cache_slots];
+	struct glyph_atlas *atlas;
+	long atlas_generation;
 
-	FT_Face font_face;
-
-	uint8_t *texbuf;
 	gs_vertbuffer_t *vbuf;
+	struct glyph_texture *tex;
 
 	gs_effect_t *draw_effect;
 	bool outline_text, drop_shadow;
@@ -70,6 +103,23 @@ struct ft2_source {
 
 extern FT_Library ft2_lib;
 
+void glyph_atlas_init(void);
+void glyph_atlas_free(void);
+
+void glyph_atlas_lock(void);
+void glyph_atlas_unlock(void);
+
+struct glyph_atlas *glyph_atlas_acquire(const char *path, FT_Long index, uint16_t size, bool antialiasing);
+struct glyph_atlas *glyph_atlas_create_private(const struct glyph_atlas *shared);
+void glyph_atlas_release(struct glyph_atlas *atlas);
+
+bool glyph_atlas_reserve(struct glyph_atlas *atlas, uint32_t w, uint32_t h, uint32_t *x, uint32_t *y);
+void glyph_atlas_flush(struct glyph_atlas *atlas);
+void glyph_atlas_upload(struct glyph_atlas *atlas);
+
+struct glyph_texture *glyph_texture_addref(struct glyph_texture *tex);
+void glyph_texture_release(struct glyph_texture *tex);
+
 void draw_outlines(struct ft2_source *srcdata);
 void draw_drop_shadow(struct ft2_source *srcdata);
 
@@ -81,6 +131,7 @@ void read_from_end(struct ft2_source *srcdata, const char *filename);
 
 void cache_standard_glyphs(struct ft2_source *srcdata);
 void cache_glyphs(struct ft2_source *srcdata, wchar_t *cache_glyphs);
+void refresh_text(struct ft2_source *srcdata);
 
 void set_up_vertex_buffer(struct ft2_source *srcdata);
 void fill_vertex_buffer(struct ft2_source *srcdata);
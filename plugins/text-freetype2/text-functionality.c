@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <obs-module.h>
 #include <util/platform.h>
+#include <util/threading.h>
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include <sys/stat.h>
@@ -26,8 +27,6 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 float offsets[16] = {-2.0f, 0.0f, 0.0f, -2.0f, 2.0f,  0.0f, 2.0f,  0.0f,
 		     0.0f,  2.0f, 0.0f, 2.0f,  -2.0f, 0.0f, -2.0f, 0.0f};
 
-extern uint32_t texbuf_w, texbuf_h;
-
 void draw_outlines(struct ft2_source *srcdata)
 {
 	if (!srcdata->text)
@@ -36,8 +35,8 @@ void draw_outlines(struct ft2_source *srcdata)
 	gs_matrix_push();
 	for (int32_t i = 0; i < 8; i++) {
 		gs_matrix_translate3f(offsets[i * 2], offsets[(i * 2) + 1], 0.0f);
-		draw_uv_vbuffer(srcdata->vbuf, srcdata->tex, srcdata->draw_effect, (uint32_t)wcslen(srcdata->text) * 6,
-				false);
+		draw_uv_vbuffer(srcdata->vbuf, srcdata->tex->tex, srcdata->draw_effect,
+				(uint32_t)wcslen(srcdata->text) * 6, false);
 	}
 	gs_matrix_identity();
 	gs_matrix_pop();
@@ -50,7 +49,8 @@ void draw_drop_shadow(struct ft2_source *srcdata)
 
 	gs_matrix_push();
 	gs_matrix_translate3f(4.0f, 4.0f, 0.0f);
-	draw_uv_vbuffer(srcdata->vbuf, srcdata->tex, srcdata->draw_effect, (uint32_t)wcslen(srcdata->text) * 6, false);
+	draw_uv_vbuffer(srcdata->vbuf, srcdata->tex->tex, srcdata->draw_effect, (uint32_t)wcslen(srcdata->text) * 6,
+			false);
 	gs_matrix_identity();
 	gs_matrix_pop();
 }
@@ -61,9 +61,12 @@ void set_up_vertex_buffer(struct ft2_source *srcdata)
 	uint32_t x = 0, space_pos = 0, word_width = 0;
 	size_t len;
 
-	if (!srcdata->text)
+	if (!srcdata->text || !srcdata->atlas)
 		return;
 
+	glyph_atlas_lock();
+	srcdata->atlas_generation = os_atomic_load_long(&srcdata->atlas->generation);
+
 	if (srcdata->custom_width >= 100)
 		srcdata->cx = srcdata->custom_width;
 	else
@@ -79,6 +82,7 @@ void set_up_vertex_buffer(struct ft2_source *srcdata)
 
 	if (*srcdata->text == 0) {
 		obs_leave_graphics();
+		glyph_atlas_unlock();
 		return;
 	}
 
@@ -114,7 +118,7 @@ void set_up_vertex_buffer(struct ft2_source *srcdata)
 		if (srcdata->text[i] == L' ')
 			space_pos = i;
 	next_char:;
-		glyph_index = FT_Get_Char_Index(srcdata->font_face, srcdata->text[i]);
+		glyph_index = FT_Get_Char_Index(srcdata->atlas->face, srcdata->text[i]);
 		if (src_glyph)
 			word_width += src_glyph->xadv;
 	eos_skip:;
@@ -123,7 +127,13 @@ void set_up_vertex_buffer(struct ft2_source *srcdata)
 skip_word_wrap:;
 	fill_vertex_buffer(srcdata);
 	gs_vertexbuffer_flush(srcdata->vbuf);
+
+	/* only let go of the previous texture now that nothing refers to its
+	 * texture coordinates any more */
+	glyph_texture_release(srcdata->tex);
+	srcdata->tex = glyph_texture_addref(srcdata->atlas->tex);
 	obs_leave_graphics();
+	glyph_atlas_unlock();
 }
 
 void fill_vertex_buffer(struct ft2_source *srcdata)
@@ -163,7 +173,7 @@ void fill_vertex_buffer(struct ft2_source *srcdata)
 		if (srcdata->text[i] == L'\r')
 			goto skip_glyph;
 
-		glyph_index = FT_Get_Char_Index(srcdata->font_face, srcdata->text[i]);
+		glyph_index = FT_Get_Char_Index(srcdata->atlas->face, srcdata->text[i]);
 		if (src_glyph == NULL)
 			goto skip_glyph;
 
@@ -191,21 +201,16 @@ void fill_vertex_buffer(struct ft2_source *srcdata)
 	srcdata->cy = max_y;
 }
 
+static void cache_glyph_string(struct ft2_source *srcdata, const wchar_t *cache_glyphs, bool may_flush);
+
 void cache_standard_glyphs(struct ft2_source *srcdata)
 {
-	for (uint32_t i = 0; i < num_cache_slots; i++) {
-		if (srcdata->cacheglyphs[i] != NULL) {
-			bfree(srcdata->cacheglyphs[i]);
-			srcdata->cacheglyphs[i] = NULL;
-		}
-	}
-
-	srcdata->texbuf_x = 0;
-	srcdata->texbuf_y = 0;
-
-	cache_glyphs(srcdata, L"abcdefghijklmnopqrstuvwxyz"
-			      L"ABCDEFGHIJKLMNOPQRSTUVWXYZ1234567890"
-			      L"!@#$%^&*()-_=+,<.>/?\\|[]{}`~ \'\"\0");
+	/* only fills spare space, the glyphs of other sources are worth more */
+	cache_glyph_string(srcdata,
+			   L"abcdefghijklmnopqrstuvwxyz"
+			   L"ABCDEFGHIJKLMNOPQRSTUVWXYZ1234567890"
+			   L"!@#$%^&*()-_=+,<.>/?\\|[]{}`~ \'\"\0",
+			   false);
 }
 
 FT_Render_Mode get_render_mode(struct ft2_source *srcdata)
@@ -216,17 +221,17 @@ FT_Render_Mode get_render_mode(struct ft2_source *srcdata)
 void load_glyph(struct ft2_source *srcdata, const FT_UInt glyph_index, const FT_Render_Mode render_mode)
 {
 	const FT_Int32 load_mode = render_mode == FT_RENDER_MODE_MONO ? FT_LOAD_TARGET_MONO : FT_LOAD_DEFAULT;
-	FT_Load_Glyph(srcdata->font_face, glyph_index, load_mode);
+	FT_Load_Glyph(srcdata->atlas->face, glyph_index, load_mode);
 }
 
-struct glyph_info *init_glyph(FT_GlyphSlot slot, const uint32_t dx, const uint32_t dy, const uint32_t g_w,
-			      const uint32_t g_h)
+struct glyph_info *init_glyph(struct glyph_atlas *atlas, FT_GlyphSlot slot, const uint32_t dx, const uint32_t dy,
+			      const uint32_t g_w, const uint32_t g_h)
 {
 	struct glyph_info *glyph = bzalloc(sizeof(struct glyph_info));
-	glyph->u = (float)dx / (float)texbuf_w;
-	glyph->u2 = (float)(dx + g_w) / (float)texbuf_w;
-	glyph->v = (float)dy / (float)texbuf_h;
-	glyph->v2 = (float)(dy + g_h) / (float)texbuf_h;
+	glyph->u = (float)dx / (float)atlas->width;
+	glyph->u2 = (float)(dx + g_w) / (float)atlas->width;
+	glyph->v = (float)dy / (float)atlas->height;
+	glyph->v2 = (float)(dy + g_h) / (float)atlas->height;
 	glyph->w = g_w;
 	glyph->h = g_h;
 	glyph->yoff = slot->bitmap_top;
@@ -248,7 +253,7 @@ uint8_t get_pixel_value(const unsigned char *buf_row, FT_Render_Mode render_mode
 	return pixel_set ? 255 : 0;
 }
 
-void rasterize(struct ft2_source *srcdata, FT_GlyphSlot slot, const FT_Render_Mode render_mode, const uint32_t dx,
+void rasterize(struct glyph_atlas *atlas, FT_GlyphSlot slot, const FT_Render_Mode render_mode, const uint32_t dx,
 	       const uint32_t dy)
 {
 	/**
@@ -261,35 +266,54 @@ void rasterize(struct ft2_source *srcdata, FT_GlyphSlot slot, const FT_Render_Mo
 
 	for (uint32_t y = 0; y < slot->bitmap.rows; y++) {
 		const uint32_t row_start = y * pitch;
-		const uint32_t row = (dy + y) * texbuf_w;
+		const uint32_t row = (dy + y) * atlas->width;
 
 		for (uint32_t x = 0; x < slot->bitmap.width; x++) {
 			const uint32_t row_pixel_position = dx + x;
 			const uint8_t pixel_value = get_pixel_value(&slot->bitmap.buffer[row_start], render_mode, x);
-			srcdata->texbuf[row_pixel_position + row] = pixel_value;
+			atlas->texbuf[row_pixel_position + row] = pixel_value;
 		}
 	}
 }
 
-void cache_glyphs(struct ft2_source *srcdata, wchar_t *cache_glyphs)
+static struct glyph_atlas *move_to_private_atlas(struct ft2_source *srcdata)
 {
-	if (!srcdata->font_face || !cache_glyphs)
-		return;
+	struct glyph_atlas *shared = srcdata->atlas;
+	struct glyph_atlas *atlas = glyph_atlas_create_private(shared);
 
-	FT_GlyphSlot slot = srcdata->font_face->glyph;
+	if (!atlas) {
+		glyph_atlas_flush(shared);
+		return shared;
+	}
 
-	uint32_t dx = srcdata->texbuf_x;
-	uint32_t dy = srcdata->texbuf_y;
+	/* glyphs placed before running out of space are still used by others */
+	glyph_atlas_upload(shared);
 
-	int32_t cached_glyphs = 0;
-	const size_t len = wcslen(cache_glyphs);
+	srcdata->atlas = atlas;
+	glyph_atlas_release(shared);
+	return atlas;
+}
+
+static void cache_glyph_string(struct ft2_source *srcdata, const wchar_t *cache_glyphs, bool may_flush)
+{
+	struct glyph_atlas *atlas = srcdata->atlas;
+
+	if (!atlas || !cache_glyphs)
+		return;
 
+	glyph_atlas_lock();
+
+	FT_GlyphSlot slot = atlas->face->glyph;
+	const size_t len = wcslen(cache_glyphs);
 	const FT_Render_Mode render_mode = get_render_mode(srcdata);
+	bool flushed = !may_flush;
 
 	for (size_t i = 0; i < len; i++) {
-		const FT_UInt glyph_index = FT_Get_Char_Index(srcdata->font_face, cache_glyphs[i]);
+		const FT_UInt glyph_index = FT_Get_Char_Index(atlas->face, cache_glyphs[i]);
 
 		if (src_glyph != NULL) {
+			if (srcdata->max_h < (uint32_t)src_glyph->h)
+				srcdata->max_h = src_glyph->h;
 			continue;
 		}
 
@@ -298,50 +322,58 @@ void cache_glyphs(struct ft2_source *srcdata, wchar_t *cache_glyphs)
 
 		const uint32_t g_w = slot->bitmap.width;
 		const uint32_t g_h = slot->bitmap.rows;
+		uint32_t dx, dy;
 
 		if (srcdata->max_h < g_h) {
 			srcdata->max_h = g_h;
 		}
 
-		if (dx + g_w >= texbuf_w) {
-			dx = 0;
-			dy += srcdata->max_h + 1;
-		}
+		if (!glyph_atlas_reserve(atlas, g_w, g_h, &dx, &dy)) {
+			/* start over once with an empty atlas.  flushing one that
+			 * other sources use would make them evict these glyphs
+			 * again when they rebuild, so move to a private one */
+			if (!flushed) {
+				if (atlas->refs > 1)
+					atlas = move_to_private_atlas(srcdata);
+				else
+					glyph_atlas_flush(atlas);
+
+				slot = atlas->face->glyph;
+				flushed = true;
+				i = (size_t)-1;
+				continue;
+			}
 
-		if (dy + g_h >= texbuf_h) {
-			blog(LOG_WARNING, "Out of space trying to render glyphs");
+			if (may_flush)
+				blog(LOG_WARNING, "Out of space trying to render glyphs");
 			break;
 		}
 
-		src_glyph = init_glyph(slot, dx, dy, g_w, g_h);
-		rasterize(srcdata, slot, render_mode, dx, dy);
-
-		dx += (g_w + 1);
-		if (dx >= texbuf_w) {
-			dx = 0;
-			dy += srcdata->max_h;
-		}
-
-		cached_glyphs++;
+		src_glyph = init_glyph(atlas, slot, dx, dy, g_w, g_h);
+		rasterize(atlas, slot, render_mode, dx, dy);
 	}
 
-	srcdata->texbuf_x = dx;
-	srcdata->texbuf_y = dy;
+	glyph_atlas_upload(atlas);
 
-	if (cached_glyphs > 0) {
-
-		obs_enter_graphics();
+	glyph_atlas_unlock();
+}
 
-		if (srcdata->tex != NULL) {
-			gs_texture_t *tmp_texture = srcdata->tex;
-			srcdata->tex = NULL;
-			gs_texture_destroy(tmp_texture);
-		}
+void cache_glyphs(struct ft2_source *srcdata, wchar_t *cache_glyphs)
+{
+	cache_glyph_string(srcdata, cache_glyphs, true);
+}
 
-		srcdata->tex = gs_texture_create(texbuf_w, texbuf_h, GS_A8, 1, (const uint8_t **)&srcdata->texbuf, 0);
+/* the glyphs of the text have to stay in the atlas until the vertex buffer is
+ * built from them */
+void refresh_text(struct ft2_source *srcdata)
+{
+	if (!srcdata->atlas)
+		return;
 
-		obs_leave_graphics();
-	}
+	glyph_atlas_lock();
+	cache_glyphs(srcdata, srcdata->text);
+	set_up_vertex_buffer(srcdata);
+	glyph_atlas_unlock();
 }
 
 time_t get_modified_timestamp(char *filename)
@@ -508,11 +540,11 @@ uint32_t get_ft2_text_width(wchar_t *text, struct ft2_source *srcdata)
 		return 0;
 	}
 
-	FT_GlyphSlot slot = srcdata->font_face->glyph;
+	FT_GlyphSlot slot = srcdata->atlas->face->glyph;
 	uint32_t w = 0, max_w = 0;
 	const size_t len = wcslen(text);
 	for (size_t i = 0; i < len; i++) {
-		const FT_UInt glyph_index = FT_Get_Char_Index(srcdata->font_face, text[i]);
+		const FT_UInt glyph_index = FT_Get_Char_Index(srcdata->atlas->face, text[i]);
 
 		if (text[i] == L'\n')
 			w = 0;
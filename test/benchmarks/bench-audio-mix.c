@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <media-io/audio-io.h>
+#include <media-io/audio-mix.h>
+
+/* Runs one audio tick worth of gain, mix and clamp work for N sources with
+ * every mix and channel active, using the SIMD kernels and the plain loops
+ * they replaced. */
+
+#define CHANNELS 8
+#define TICKS 200
+
+#define MIX_FLOATS (CHANNELS * AUDIO_OUTPUT_FRAMES)
+
+typedef float audio_buf[MAX_AUDIO_MIXES][MIX_FLOATS];
+
+static void scalar_gain(float *data, float gain, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		data[i] *= gain;
+}
+
+static void scalar_add(float *dst, const float *src, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] += src[i];
+}
+
+static void scalar_clamp(float *data, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		float val = data[i];
+		val = (val == val) ? val : 0.0f;
+		val = (val > 1.0f) ? 1.0f : val;
+		val = (val < -1.0f) ? -1.0f : val;
+		data[i] = val;
+	}
+}
+
+static void run_tick(audio_buf *mix, audio_buf *sources, audio_buf *scratch, size_t num_sources, bool simd)
+{
+	memset(mix, 0, sizeof(*mix));
+
+	for (size_t s = 0; s < num_sources; s++) {
+		memcpy(scratch, &sources[s], sizeof(*scratch));
+
+		for (size_t m = 0; m < MAX_AUDIO_MIXES; m++) {
+			if (simd)
+				audio_mix_gain((*scratch)[m], 0.7f, MIX_FLOATS);
+			else
+				scalar_gain((*scratch)[m], 0.7f, MIX_FLOATS);
+
+			for (size_t ch = 0; ch < CHANNELS; ch++) {
+				float *dst = (*mix)[m] + ch * AUDIO_OUTPUT_FRAMES;
+				const float *src = (*scratch)[m] + ch * AUDIO_OUTPUT_FRAMES;
+
+				if (simd)
+					audio_mix_add(dst, src, AUDIO_OUTPUT_FRAMES);
+				else
+					scalar_add(dst, src, AUDIO_OUTPUT_FRAMES);
+			}
+		}
+	}
+
+	for (size_t m = 0; m < MAX_AUDIO_MIXES; m++) {
+		if (simd)
+			audio_mix_clamp((*mix)[m], MIX_FLOATS);
+		else
+			scalar_clamp((*mix)[m], MIX_FLOATS);
+	}
+}
+
+static double bench(audio_buf *mix, audio_buf *sources, audio_buf *scratch, size_t num_sources, bool simd)
+{
+	run_tick(mix, sources, scratch, num_sources, simd);
+
+	uint64_t start = os_gettime_ns();
+	for (int i = 0; i < TICKS; i++)
+		run_tick(mix, sources, scratch, num_sources, simd);
+
+	return (double)(os_gettime_ns() - start) / TICKS / 1000.0;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t source_counts[] = {10, 40, 100};
+
+	UNUSED_PARAMETER(argc);
+	UNUSED_PARAMETER(argv);
+
+	printf("%-8s %14s %14s\n", "sources", "scalar us/tick", "simd us/tick");
+
+	for (size_t c = 0; c < sizeof(source_counts) / sizeof(source_counts[0]); c++) {
+		size_t num_sources = source_counts[c];
+		audio_buf *sources = bmalloc(sizeof(audio_buf) * num_sources);
+		audio_buf *scratch = bmalloc(sizeof(audio_buf));
+		audio_buf *mix_scalar = bmalloc(sizeof(audio_buf));
+		audio_buf *mix_simd = bmalloc(sizeof(audio_buf));
+
+		float *samples = sources[0][0];
+		for (size_t i = 0; i < num_sources * MAX_AUDIO_MIXES * MIX_FLOATS; i++)
+			samples[i] = (float)rand() / (float)RAND_MAX * 0.4f - 0.2f;
+
+		double scalar_us = bench(mix_scalar, sources, scratch, num_sources, false);
+		double simd_us = bench(mix_simd, sources, scratch, num_sources, true);
+		bool match = memcmp(mix_scalar, mix_simd, sizeof(audio_buf)) == 0;
+
+		printf("%-8zu %14.1f %14.1f%s\n", num_sources, scalar_us, simd_us, match ? "" : "  (output mismatch)");
+
+		bfree(sources);
+		bfree(scratch);
+		bfree(mix_scalar);
+		bfree(mix_simd);
+	}
+
+	return 0;
+}
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <media-io/format-conversion.h>
+
+#define ITERATIONS 200
+
+struct bench_frame {
+	uint32_t width;
+	uint32_t height;
+
+	uint8_t *packed;
+	uint32_t packed_linesize;
+
+	uint8_t *planes[3];
+	uint32_t linesize[3];
+};
+
+static void frame_init(struct bench_frame *frame, uint32_t width, uint32_t height)
+{
+	frame->width = width;
+	frame->height = height;
+
+	frame->packed_linesize = width * 4;
+	frame->packed = bmalloc((size_t)frame->packed_linesize * height);
+
+	for (size_t i = 0; i < 3; i++) {
+		frame->linesize[i] = width;
+		frame->planes[i] = bmalloc((size_t)width * height);
+	}
+
+	for (size_t i = 0; i < (size_t)frame->packed_linesize * height; i++)
+		frame->packed[i] = (uint8_t)rand();
+	for (size_t i = 0; i < 3; i++)
+		for (size_t j = 0; j < (size_t)width * height; j++)
+			frame->planes[i][j] = (uint8_t)rand();
+}
+
+static void frame_free(struct bench_frame *frame)
+{
+	bfree(frame->packed);
+	for (size_t i = 0; i < 3; i++)
+		bfree(frame->planes[i]);
+}
+
+enum kernel {
+	KERNEL_UYVX_TO_I420,
+	KERNEL_UYVX_TO_NV12,
+	KERNEL_UYVX_TO_I444,
+	KERNEL_DECOMPRESS_420,
+	KERNEL_DECOMPRESS_NV12,
+	KERNEL_DECOMPRESS_422,
+	KERNEL_COUNT,
+};
+
+static const char *kernel_names[KERNEL_COUNT] = {
+	"compress_uyvx_to_i420", "compress_uyvx_to_nv12", "convert_uyvx_to_i444",
+	"decompress_420",        "decompress_nv12",       "decompress_422",
+};
+
+static void run_kernel(enum kernel kernel, struct bench_frame *frame)
+{
+	const uint8_t *const planes[3] = {frame->planes[0], frame->planes[1], frame->planes[2]};
+	uint32_t chroma_linesize[3] = {frame->width, frame->width / 2, frame->width / 2};
+
+	switch (kernel) {
+	case KERNEL_UYVX_TO_I420:
+		compress_uyvx_to_i420(frame->packed, frame->packed_linesize, 0, frame->height, frame->planes,
+				      frame->linesize);
+		break;
+	case KERNEL_UYVX_TO_NV12:
+		compress_uyvx_to_nv12(frame->packed, frame->packed_linesize, 0, frame->height, frame->planes,
+				      frame->linesize);
+		break;
+	case KERNEL_UYVX_TO_I444:
+		convert_uyvx_to_i444(frame->packed, frame->packed_linesize, 0, frame->height, frame->planes,
+				     frame->linesize);
+		break;
+	case KERNEL_DECOMPRESS_420:
+		decompress_420(planes, chroma_linesize, 0, frame->height, frame->packed, frame->packed_linesize);
+		break;
+	case KERNEL_DECOMPRESS_NV12:
+		decompress_nv12(planes, frame->linesize, 0, frame->height, frame->packed, frame->packed_linesize);
+		break;
+	case KERNEL_DECOMPRESS_422:
+		/* 4:2:2 input is two bytes per pixel, read from the first plane */
+		decompress_422(frame->planes[0], frame->width, 0, frame->height / 2, frame->packed,
+			       frame->packed_linesize, true);
+		break;
+	case KERNEL_COUNT:
+		break;
+	}
+}
+
+static double bench_kernel(enum kernel kernel, struct bench_frame *frame)
+{
+	uint64_t start;
+	uint64_t elapsed;
+
+	/* warm up caches and the dispatch */
+	run_kernel(kernel, frame);
+
+	start = os_gettime_ns();
+	for (int i = 0; i < ITERATIONS; i++)
+		run_kernel(kernel, frame);
+	elapsed = os_gettime_ns() - start;
+
+	double pixels = (double)frame->width * (double)frame->height * ITERATIONS;
+	if (kernel == KERNEL_DECOMPRESS_422)
+		pixels /= 2.0;
+
+	return pixels / ((double)elapsed / 1000.0);
+}
+
+static const char *isa_name(enum format_conversion_isa isa)
+{
+	switch (isa) {
+	case FORMAT_CONVERSION_ISA_SSE2:
+		return "SSE2";
+	case FORMAT_CONVERSION_ISA_AVX2:
+		return "AVX2";
+	case FORMAT_CONVERSION_ISA_AUTO:
+		break;
+	}
+
+	return "auto";
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t sizes[][2] = {{1920, 1080}, {2560, 1440}, {3840, 2160}};
+	enum format_conversion_isa isas[] = {FORMAT_CONVERSION_ISA_SSE2, FORMAT_CONVERSION_ISA_AVX2};
+
+	UNUSED_PARAMETER(argc);
+	UNUSED_PARAMETER(argv);
+
+	printf("detected: %s\n\n", isa_name(format_conversion_get_isa()));
+	printf("%-24s %-10s %-6s %10s\n", "kernel", "size", "isa", "MPix/s");
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		struct bench_frame frame;
+		frame_init(&frame, sizes[s][0], sizes[s][1]);
+
+		for (int k = 0; k < KERNEL_COUNT; k++) {
+			for (size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); i++) {
+				if (!format_conversion_set_isa(isas[i]))
+					continue;
+
+				double mpix = bench_kernel((enum kernel)k, &frame);
+				char size[16];
+				snprintf(size, sizeof(size), "%ux%u", frame.width, frame.height);
+				printf("%-24s %-10s %-6s %10.1f\n", kernel_names[k], size, isa_name(isas[i]), mpix);
+			}
+		}
+
+		frame_free(&frame);
+	}
+
+	format_conversion_set_isa(FORMAT_CONVERSION_ISA_AUTO);
+	return 0;
+}
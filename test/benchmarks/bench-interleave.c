@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <util/bmem.h>
+#include <util/darray.h>
+#include <util/platform.h>
+
+#include "obs-interleave.h"
+
+/* Feeds synthetic multitrack packet streams through the output interleave
+ * queue, and through the sorted array it replaced, while keeping a fixed
+ * delay window of packets queued. */
+
+#define STREAM_SECONDS 60
+#define VIDEO_FPS 60
+#define AUDIO_PACKETS_PER_SEC (48000.0 / 1024.0)
+
+struct stream {
+	DARRAY(struct encoder_packet) packets;
+};
+
+static void stream_init(struct stream *stream, size_t video_tracks, size_t audio_tracks)
+{
+	da_init(stream->packets);
+
+	for (size_t i = 0; i < video_tracks; i++) {
+		for (int64_t f = 0; f < STREAM_SECONDS * VIDEO_FPS; f++) {
+			struct encoder_packet *packet = da_push_back_new(stream->packets);
+			packet->type = OBS_ENCODER_VIDEO;
+			packet->track_idx = i;
+			packet->timebase_num = 1;
+			packet->timebase_den = VIDEO_FPS;
+			packet->dts_usec = f * 1000000 / VIDEO_FPS;
+		}
+	}
+
+	for (size_t i = 0; i < audio_tracks; i++) {
+		/* audio encoders run slightly out of phase with each other */
+		int64_t phase = (int64_t)i * 1500;
+
+		for (int64_t f = 0; f < (int64_t)(STREAM_SECONDS * AUDIO_PACKETS_PER_SEC); f++) {
+			struct encoder_packet *packet = da_push_back_new(stream->packets);
+			packet->type = OBS_ENCODER_AUDIO;
+			packet->track_idx = i;
+			packet->timebase_num = 1;
+			packet->timebase_den = 48000;
+			packet->dts_usec = phase + (int64_t)((double)f * 1000000.0 / AUDIO_PACKETS_PER_SEC);
+		}
+	}
+
+	/* packets arrive in timestamp order per track, with a different
+	 * encoder latency for each track */
+	int64_t latency[INTERLEAVE_MAX_TRACKS];
+	for (size_t i = 0; i < INTERLEAVE_MAX_TRACKS; i++)
+		latency[i] = rand() % 20000;
+
+	for (size_t i = 0; i < stream->packets.num; i++) {
+		struct encoder_packet *packet = &stream->packets.array[i];
+		size_t track = interleave_track_index(packet->type, packet->track_idx);
+		packet->sys_dts_usec = packet->dts_usec + latency[track];
+	}
+
+	for (size_t i = 1; i < stream->packets.num; i++) {
+		struct encoder_packet packet = stream->packets.array[i];
+		size_t j = i;
+
+		while (j > 0 && stream->packets.array[j - 1].sys_dts_usec > packet.sys_dts_usec) {
+			stream->packets.array[j] = stream->packets.array[j - 1];
+			j--;
+		}
+		stream->packets.array[j] = packet;
+	}
+}
+
+static void stream_free(struct stream *stream)
+{
+	da_free(stream->packets);
+}
+
+/* the previous implementation: a linear scan and insert into one array */
+static void array_insert(struct darray *da, struct encoder_packet *out)
+{
+	DARRAY(struct encoder_packet) packets;
+	size_t idx;
+
+	packets.da = *da;
+
+	for (idx = 0; idx < packets.num; idx++) {
+		struct encoder_packet *cur_packet = packets.array + idx;
+
+		if (out->dts_usec == cur_packet->dts_usec && out->type == OBS_ENCODER_VIDEO &&
+		    cur_packet->type == OBS_ENCODER_VIDEO && out->track_idx > cur_packet->track_idx)
+			continue;
+
+		if (out->dts_usec == cur_packet->dts_usec && out->type == OBS_ENCODER_VIDEO) {
+			break;
+		} else if (out->dts_usec < cur_packet->dts_usec) {
+			break;
+		}
+	}
+
+	da_insert(packets, idx, out);
+	*da = packets.da;
+}
+
+static double bench_array(struct stream *stream, int64_t window_usec, uint64_t *checksum)
+{
+	DARRAY(struct encoder_packet) queue;
+	uint64_t start = os_gettime_ns();
+
+	da_init(queue);
+
+	for (size_t i = 0; i < stream->packets.num; i++) {
+		struct encoder_packet *packet = &stream->packets.array[i];
+		int64_t oldest_usec = packet->sys_dts_usec - window_usec;
+
+		array_insert(&queue.da, packet);
+
+		while (queue.num && queue.array[0].dts_usec < oldest_usec) {
+			*checksum = *checksum * 31 + (uint64_t)queue.array[0].dts_usec + queue.array[0].track_idx;
+			da_erase(queue, 0);
+		}
+	}
+
+	da_free(queue);
+	return (double)(os_gettime_ns() - start) / (double)stream->packets.num;
+}
+
+static double bench_queue(struct stream *stream, int64_t window_usec, uint64_t *checksum)
+{
+	struct interleave_queue iq = {0};
+	uint64_t start = os_gettime_ns();
+
+	for (size_t i = 0; i < stream->packets.num; i++) {
+		struct encoder_packet packet = stream->packets.array[i];
+		int64_t oldest_usec = packet.sys_dts_usec - window_usec;
+		struct interleave_entry *front;
+
+		interleave_queue_push(&iq, &packet);
+
+		while ((front = interleave_queue_front(&iq)) != NULL && front->packet.dts_usec < oldest_usec) {
+			interleave_queue_pop(&iq, &packet);
+			*checksum = *checksum * 31 + (uint64_t)packet.dts_usec + packet.track_idx;
+		}
+	}
+
+	interleave_queue_free(&iq);
+	return (double)(os_gettime_ns() - start) / (double)stream->packets.num;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t video_tracks[] = {1, 2, 4, 6};
+	int64_t windows_ms[] = {100, 2000, 10000};
+
+	UNUSED_PARAMETER(argc);
+	UNUSED_PARAMETER(argv);
+
+	printf("%-8s %-8s %-10s %12s %12s\n", "video", "audio", "window", "array ns/pkt", "queue ns/pkt");
+
+	for (size_t v = 0; v < sizeof(video_tracks) / sizeof(video_tracks[0]); v++) {
+		struct stream stream;
+		stream_init(&stream, video_tracks[v], MAX_OUTPUT_AUDIO_ENCODERS);
+
+		for (size_t w = 0; w < sizeof(windows_ms) / sizeof(windows_ms[0]); w++) {
+			int64_t window_usec = windows_ms[w] * 1000;
+			uint64_t array_sum = 0;
+			uint64_t queue_sum = 0;
+
+			double array_ns = bench_array(&stream, window_usec, &array_sum);
+			double queue_ns = bench_queue(&stream, window_usec, &queue_sum);
+
+			printf("%-8zu %-8d %-10lld %12.1f %12.1f%s\n", video_tracks[v], MAX_OUTPUT_AUDIO_ENCODERS,
+			       (long long)windows_ms[w], array_ns, queue_ns,
+			       array_sum == queue_sum ? "" : "  (order mismatch)");
+		}
+
+		stream_free(&stream);
+	}
+
+	return 0;
+}
@@ -0,0 +1,925 @@
+/* rtmp-stream.c keeps all of its state handling static, so it is built into
+ * the benchmark and driven the same way the output core would drive it */
+#include "rtmp-stream.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+
+/* Streams synthetic H.264 and AAC packets at real time rate through
+ * rtmp_stream into a local RTMP sink that can cap bandwidth, add latency and
+ * stall, then reports the throughput the sink saw, the CPU time used by the
+ * send thread, the delay from submitting a frame to the sink parsing it, and
+ * the frames dropped or bitrate changes made while congested.
+ *
+ * The sink does the plain RTMP handshake, answers connect, createStream and
+ * publish, and understands both legacy and enhanced (E-RTMP) video tags.
+ *
+ * Pass a sink name to run only that scenario. */
+
+#define STREAM_SECONDS 20
+#define DRAIN_TIMEOUT_SEC 10
+
+#define VIDEO_FPS 60
+#define VIDEO_KEYINT (2 * VIDEO_FPS)
+#define VIDEO_BITRATE 6000
+#define AUDIO_BITRATE 160
+#define AUDIO_PACKETS_PER_SEC (48000.0 / 1024.0)
+#define AUDIO_PACKET_SIZE ((size_t)(AUDIO_BITRATE * 1000 / 8 / AUDIO_PACKETS_PER_SEC))
+
+/* relative frame sizes in an IBBP group of pictures */
+#define KEYFRAME_WEIGHT 10.0
+#define PFRAME_WEIGHT 1.5
+#define BFRAME_WEIGHT 0.6
+
+#define HANDSHAKE_SIZE 1536
+#define MAX_CHUNK_STREAMS 64
+#define SINK_STREAM_ID 1
+
+/* loopback sockets grow their buffers to megabytes, which would hide any
+ * congestion from rtmp_stream, so both ends use buffers closer to what a
+ * connection to an ingest server ends up with */
+#define SENDER_SEND_BUF (256 * 1024)
+#define SINK_RECV_BUF (64 * 1024)
+#define SINK_WINDOW (256 * 1024)
+
+struct sink_config {
+	const char *name;
+	int cap_kbps; /* 0 for no cap */
+	int latency_ms;
+	int stall_ms; /* stops reading for stall_ms out of every stall_every_ms */
+	int stall_every_ms;
+};
+
+static const struct sink_config scenarios[] = {
+	{"unlimited", 0, 0, 0, 0},
+	{"8mbps", 8000, 20, 0, 0},
+	{"5mbps", 5000, 20, 0, 0},
+	{"3mbps", 3000, 50, 0, 0},
+	{"stalls", 0, 20, 1000, 8000},
+};
+
+/* ------------------------------------------------------------------------- */
+/* sink                                                                      */
+
+struct chunk_stream {
+	uint32_t timestamp;
+	uint32_t delta;
+	uint32_t length;
+	uint8_t type;
+	bool extended;
+	DARRAY(uint8_t) body;
+};
+
+struct delayed_data {
+	uint64_t ready_ns;
+	size_t size;
+};
+
+struct arrival {
+	uint64_t time_ns;
+	uint32_t timestamp;
+};
+
+struct sink {
+	struct sink_config config;
+	int listen_fd;
+	int fd;
+	int port;
+	pthread_t thread;
+
+	/* received data is held back here until latency_ms passed */
+	struct deque delayed;
+	struct deque delayed_bytes;
+
+	double tokens;
+	uint64_t last_refill_ns;
+
+	DARRAY(uint8_t) input;
+	uint32_t chunk_size;
+	struct chunk_stream streams[MAX_CHUNK_STREAMS];
+
+	/* stats, only valid once the sink thread exited */
+	uint64_t publish_ns;
+	uint64_t last_recv_ns;
+	uint64_t bytes;
+	int video_frames[OBS_NAL_PRIORITY_HIGHEST + 1];
+	int audio_frames;
+	DARRAY(struct arrival) arrivals;
+};
+
+static inline uint32_t rb24(const uint8_t *data)
+{
+	return ((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2];
+}
+
+static inline uint32_t rb32(const uint8_t *data)
+{
+	return ((uint32_t)data[0] << 24) | rb24(data + 1);
+}
+
+static bool recv_all(int fd, void *data, size_t size)
+{
+	uint8_t *pos = data;
+
+	while (size) {
+		ssize_t ret = recv(fd, pos, size, 0);
+		if (ret <= 0)
+			return false;
+		pos += ret;
+		size -= (size_t)ret;
+	}
+
+	return true;
+}
+
+static bool send_all(int fd, const void *data, size_t size)
+{
+	const uint8_t *pos = data;
+
+	while (size) {
+		ssize_t ret = send(fd, pos, size, MSG_NOSIGNAL);
+		if (ret <= 0)
+			return false;
+		pos += ret;
+		size -= (size_t)ret;
+	}
+
+	return true;
+}
+
+static bool sink_handshake(struct sink *sink)
+{
+	uint8_t c0c1[1 + HANDSHAKE_SIZE];
+	uint8_t s0s1s2[1 + 2 * HANDSHAKE_SIZE] = {0};
+	uint8_t c2[HANDSHAKE_SIZE];
+
+	if (!recv_all(sink->fd, c0c1, sizeof(c0c1)))
+		return false;
+
+	/* a zero server version in S1 keeps librtmp on the plain handshake */
+	s0s1s2[0] = 3;
+	for (size_t i = 9; i <= HANDSHAKE_SIZE; i++)
+		s0s1s2[i] = (uint8_t)rand();
+	memcpy(s0s1s2 + 1 + HANDSHAKE_SIZE, c0c1 + 1, HANDSHAKE_SIZE);
+
+	return send_all(sink->fd, s0s1s2, sizeof(s0s1s2)) && recv_all(sink->fd, c2, sizeof(c2));
+}
+
+static bool sink_send_invoke(struct sink *sink, const char *data, size_t size)
+{
+	uint8_t buf[512];
+	uint8_t *pos = buf;
+
+	*pos++ = 0x03;
+	memset(pos, 0, 3);
+	pos += 3;
+	*pos++ = (uint8_t)(size >> 16);
+	*pos++ = (uint8_t)(size >> 8);
+	*pos++ = (uint8_t)size;
+	*pos++ = RTMP_PACKET_TYPE_INVOKE;
+	*pos++ = SINK_STREAM_ID;
+	memset(pos, 0, 3);
+	pos += 3;
+
+	for (size_t offset = 0; offset < size; offset += RTMP_DEFAULT_CHUNKSIZE) {
+		size_t chunk = size - offset < RTMP_DEFAULT_CHUNKSIZE ? size - offset : RTMP_DEFAULT_CHUNKSIZE;
+
+		if (offset)
+			*pos++ = 0xC3;
+		memcpy(pos, data + offset, chunk);
+		pos += chunk;
+	}
+
+	return send_all(sink->fd, buf, pos - buf);
+}
+
+static char *encode_status(char *enc, char *end, const char *code)
+{
+	AVal av_level = AVC("level");
+	AVal av_status = AVC("status");
+	AVal av_code = AVC("code");
+	AVal av_value = {(char *)code, (int)strlen(code)};
+
+	*enc++ = AMF_OBJECT;
+	enc = AMF_EncodeNamedString(enc, end, &av_level, &av_status);
+	enc = AMF_EncodeNamedString(enc, end, &av_code, &av_value);
+	*enc++ = 0;
+	*enc++ = 0;
+	*enc++ = AMF_OBJECT_END;
+	return enc;
+}
+
+static inline bool is_method(const AVal *method, const char *name)
+{
+	return method->av_len == (int)strlen(name) && memcmp(method->av_val, name, method->av_len) == 0;
+}
+
+static void sink_handle_invoke(struct sink *sink, const uint8_t *data, size_t size)
+{
+	AVal av_result = AVC("_result");
+	AVal av_on_status = AVC("onStatus");
+	char reply[256];
+	char *end = reply + sizeof(reply);
+	char *enc = reply;
+	AMFObject obj;
+	AVal method;
+	double txn;
+
+	if (AMF_Decode(&obj, (const char *)data, (int)size, FALSE) < 0)
+		return;
+
+	AMFProp_GetString(AMF_GetProp(&obj, NULL, 0), &method);
+	txn = AMFProp_GetNumber(AMF_GetProp(&obj, NULL, 1));
+
+	if (is_method(&method, "connect")) {
+		enc = AMF_EncodeString(enc, end, &av_result);
+		enc = AMF_EncodeNumber(enc, end, txn);
+		*enc++ = AMF_NULL;
+		enc = encode_status(enc, end, "NetConnection.Connect.Success");
+
+	} else if (is_method(&method, "createStream")) {
+		enc = AMF_EncodeString(enc, end, &av_result);
+		enc = AMF_EncodeNumber(enc, end, txn);
+		*enc++ = AMF_NULL;
+		enc = AMF_EncodeNumber(enc, end, SINK_STREAM_ID);
+
+	} else if (is_method(&method, "publish")) {
+		enc = AMF_EncodeString(enc, end, &av_on_status);
+		enc = AMF_EncodeNumber(enc, end, 0.0);
+		*enc++ = AMF_NULL;
+		enc = encode_status(enc, end, "NetStream.Publish.Start");
+		sink->publish_ns = os_gettime_ns();
+	}
+
+	AMF_Reset(&obj);
+
+	if (enc > reply)
+		sink_send_invoke(sink, reply, enc - reply);
+}
+
+/* returns the NAL priority of single track H.264 frames, or -1 for anything
+ * else, such as sequence headers */
+static int video_priority(const uint8_t *data, size_t size)
+{
+	size_t nal;
+
+	if (!size)
+		return -1;
+
+	if (data[0] & 0x80) {
+		uint8_t packet_type = data[0] & 0x0F;
+
+		if (size < 5 || memcmp(data + 1, "avc1", 4) != 0)
+			return -1;
+
+		if (packet_type == 1) /* coded frames, with composition time */
+			nal = 12;
+		else if (packet_type == 3) /* coded frames, without */
+			nal = 9;
+		else
+			return -1;
+	} else {
+		if ((data[0] & 0x0F) != 7 || size < 2 || data[1] != 1)
+			return -1;
+		nal = 9;
+	}
+
+	return nal < size ? (data[nal] >> 5) & 3 : -1;
+}
+
+static void sink_handle_message(struct sink *sink, struct chunk_stream *cs, uint64_t now)
+{
+	const uint8_t *data = cs->body.array;
+	size_t size = cs->body.num;
+
+	switch (cs->type) {
+	case RTMP_PACKET_TYPE_CHUNK_SIZE:
+		if (size >= 4)
+			sink->chunk_size = rb32(data) & 0x7FFFFFFF;
+		break;
+
+	case RTMP_PACKET_TYPE_INVOKE:
+		sink_handle_invoke(sink, data, size);
+		break;
+
+	case RTMP_PACKET_TYPE_AUDIO:
+		sink->audio_frames++;
+		break;
+
+	case RTMP_PACKET_TYPE_VIDEO: {
+		int priority = video_priority(data, size);
+		if (priority >= 0) {
+			struct arrival *arrival = da_push_back_new(sink->arrivals);
+			arrival->time_ns = now;
+			arrival->timestamp = cs->timestamp;
+			sink->video_frames[priority]++;
+		}
+		break;
+	}
+	}
+}
+
+static const size_t message_header_sizes[] = {11, 7, 3, 0};
+
+/* returns the size of the chunk at the start of data, or 0 if it did not
+ * fully arrive yet */
+static size_t sink_parse_chunk(struct sink *sink, const uint8_t *data, size_t size, uint64_t now)
+{
+	struct chunk_stream *cs;
+	uint8_t fmt, type;
+	uint32_t csid, length, timestamp = 0;
+	size_t pos = 1;
+	size_t payload;
+	bool extended, new_message;
+
+	if (!size)
+		return 0;
+
+	fmt = data[0] >> 6;
+	csid = data[0] & 0x3F;
+
+	if (csid < 2) {
+		pos += csid + 1;
+		if (size < pos)
+			return 0;
+		csid = 64 + data[1] + (csid == 1 ? data[2] * 256 : 0);
+	}
+
+	/* librtmp only uses the first few chunk streams */
+	if (csid >= MAX_CHUNK_STREAMS)
+		return 0;
+
+	cs = &sink->streams[csid];
+	new_message = cs->body.num == 0;
+	length = cs->length;
+	type = cs->type;
+	extended = cs->extended;
+
+	if (size < pos + message_header_sizes[fmt])
+		return 0;
+
+	if (fmt <= 2) {
+		timestamp = rb24(data + pos);
+		extended = timestamp == 0xFFFFFF;
+	}
+	if (fmt <= 1) {
+		length = rb24(data + pos + 3);
+		type = data[pos + 6];
+	}
+	pos += message_header_sizes[fmt];
+
+	if (extended) {
+		if (size < pos + 4)
+			return 0;
+		timestamp = rb32(data + pos);
+		pos += 4;
+	}
+
+	payload = length - cs->body.num;
+	if (payload > sink->chunk_size)
+		payload = sink->chunk_size;
+	if (size < pos + payload)
+		return 0;
+
+	if (fmt == 0) {
+		cs->timestamp = timestamp;
+		cs->delta = 0;
+	} else if (fmt <= 2) {
+		cs->timestamp += timestamp;
+		cs->delta = timestamp;
+	} else if (new_message) {
+		cs->timestamp += cs->delta;
+	}
+
+	cs->length = length;
+	cs->type = type;
+	cs->extended = extended;
+	da_push_back_array(cs->body, data + pos, payload);
+
+	if (cs->body.num == cs->length) {
+		sink_handle_message(sink, cs, now);
+		da_resize(cs->body, 0);
+	}
+
+	return pos + payload;
+}
+
+static void sink_deliver(struct sink *sink, uint64_t now, bool flush)
+{
+	size_t pos = 0;
+	size_t ret;
+
+	while (sink->delayed.size) {
+		struct delayed_data *front = deque_data(&sink->delayed, 0);
+		size_t offset = sink->input.num;
+
+		if (!flush && front->ready_ns > now)
+			break;
+
+		da_resize(sink->input, offset + front->size);
+		deque_pop_front(&sink->delayed_bytes, sink->input.array + offset, front->size);
+		deque_pop_front(&sink->delayed, NULL, sizeof(*front));
+	}
+
+	while ((ret = sink_parse_chunk(sink, sink->input.array + pos, sink->input.num - pos, now)) != 0)
+		pos += ret;
+
+	if (pos)
+		da_erase_range(sink->input, 0, pos);
+}
+
+static bool sink_stalled(struct sink *sink, uint64_t now)
+{
+	const struct sink_config *config = &sink->config;
+	uint64_t pos;
+
+	if (!config->stall_ms || !sink->publish_ns)
+		return false;
+
+	pos = (now - sink->publish_ns) / MSEC_TO_NSEC % (uint64_t)config->stall_every_ms;
+	return pos >= (uint64_t)(config->stall_every_ms - config->stall_ms);
+}
+
+/* token bucket with up to 20ms of burst */
+static size_t sink_allowance(struct sink *sink, uint64_t now)
+{
+	double bytes_per_ns = (double)sink->config.cap_kbps * 1000.0 / 8.0 / (double)SEC_TO_NSEC;
+	double burst = bytes_per_ns * 20.0 * (double)MSEC_TO_NSEC;
+
+	if (!sink->config.cap_kbps)
+		return SINK_RECV_BUF;
+
+	if (burst < 1500.0)
+		burst = 1500.0;
+
+	sink->tokens += (double)(now - sink->last_refill_ns) * bytes_per_ns;
+	sink->last_refill_ns = now;
+	if (sink->tokens > burst)
+		sink->tokens = burst;
+
+	return sink->tokens >= 1.0 ? (size_t)sink->tokens : 0;
+}
+
+static void *sink_thread(void *data)
+{
+	struct sink *sink = data;
+	uint64_t latency_ns = (uint64_t)sink->config.latency_ms * MSEC_TO_NSEC;
+	uint8_t *buf = bmalloc(SINK_RECV_BUF);
+	bool eof = false;
+
+	os_set_thread_name("bench-rtmp-stream: sink");
+
+	sink->fd = accept(sink->listen_fd, NULL, NULL);
+	if (sink->fd == -1 || !sink_handshake(sink))
+		goto finish;
+
+	sink->last_refill_ns = os_gettime_ns();
+
+	for (;;) {
+		uint64_t now = os_gettime_ns();
+		struct pollfd pfd = {.fd = sink->fd, .events = POLLIN};
+		struct delayed_data delayed;
+		size_t allowance;
+		ssize_t ret;
+
+		sink_deliver(sink, now, false);
+
+		if (eof) {
+			if (!sink->delayed.size)
+				break;
+			os_sleep_ms(1);
+			continue;
+		}
+
+		if (sink_stalled(sink, now) || sink->delayed_bytes.size >= SINK_WINDOW) {
+			os_sleep_ms(1);
+			continue;
+		}
+
+		allowance = sink_allowance(sink, now);
+		if (!allowance) {
+			os_sleep_ms(1);
+			continue;
+		}
+
+		if (poll(&pfd, 1, 1) <= 0)
+			continue;
+
+		ret = recv(sink->fd, buf, allowance, 0);
+		if (ret <= 0) {
+			eof = true;
+			continue;
+		}
+
+		now = os_gettime_ns();
+		sink->tokens -= (double)ret;
+		if (sink->publish_ns) {
+			sink->bytes += (uint64_t)ret;
+			sink->last_recv_ns = now;
+		}
+
+		delayed.ready_ns = now + latency_ns;
+		delayed.size = (size_t)ret;
+		deque_push_back(&sink->delayed, &delayed, sizeof(delayed));
+		deque_push_back(&sink->delayed_bytes, buf, (size_t)ret);
+	}
+
+	sink_deliver(sink, os_gettime_ns(), true);
+
+finish:
+	bfree(buf);
+	return NULL;
+}
+
+static struct sink *sink_create(const struct sink_config *config)
+{
+	struct sink *sink = bzalloc(sizeof(*sink));
+	struct sockaddr_in addr = {0};
+	socklen_t addr_len = sizeof(addr);
+	int recv_buf = SINK_RECV_BUF;
+
+	sink->config = *config;
+	sink->chunk_size = RTMP_DEFAULT_CHUNKSIZE;
+	sink->fd = -1;
+	sink->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (sink->listen_fd == -1)
+		goto fail;
+
+	setsockopt(sink->listen_fd, SOL_SOCKET, SO_RCVBUF, &recv_buf, sizeof(recv_buf));
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(sink->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(sink->listen_fd, 1) != 0 ||
+	    getsockname(sink->listen_fd, (struct sockaddr *)&addr, &addr_len) != 0)
+		goto fail;
+
+	sink->port = ntohs(addr.sin_port);
+
+	if (pthread_create(&sink->thread, NULL, sink_thread, sink) != 0)
+		goto fail;
+
+	return sink;
+
+fail:
+	if (sink->listen_fd != -1)
+		close(sink->listen_fd);
+	bfree(sink);
+	return NULL;
+}
+
+/* waits for the sender to disconnect and everything it sent to be parsed */
+static void sink_wait(struct sink *sink)
+{
+	/* wakes up the sink if the sender never connected */
+	shutdown(sink->listen_fd, SHUT_RDWR);
+	pthread_join(sink->thread, NULL);
+}
+
+static void sink_destroy(struct sink *sink)
+{
+	if (sink->fd != -1)
+		close(sink->fd);
+	close(sink->listen_fd);
+
+	for (size_t i = 0; i < MAX_CHUNK_STREAMS; i++)
+		da_free(sink->streams[i].body);
+	deque_free(&sink->delayed);
+	deque_free(&sink->delayed_bytes);
+	da_free(sink->input);
+	da_free(sink->arrivals);
+	bfree(sink);
+}
+
+/* ------------------------------------------------------------------------- */
+/* sender                                                                    */
+
+struct run_stats {
+	int video_sent[OBS_NAL_PRIORITY_HIGHEST + 1];
+	int audio_sent;
+	int dropped_frames;
+	size_t unsent;
+	long min_bitrate;
+	long last_bitrate;
+	int bitrate_changes;
+	uint64_t start_ns;
+	uint64_t send_cpu_ns;
+	uint64_t elapsed_ns;
+};
+
+/* packet data carries its reference count in front, like encoder output */
+static uint8_t *alloc_packet_data(size_t size)
+{
+	long *refs = bmalloc(sizeof(long) + size);
+	*refs = 1;
+	memset(refs + 1, 0xAA, size);
+	return (uint8_t *)(refs + 1);
+}
+
+static inline void release_packet_data(uint8_t *data)
+{
+	long *refs = (long *)data - 1;
+
+	if (os_atomic_dec_long(refs) == 0)
+		bfree(refs);
+}
+
+static size_t make_video_frame(uint8_t *data, long bitrate, int64_t frame, int *priority)
+{
+	static const uint8_t start_code[4] = {0, 0, 0, 1};
+	double gop_weight =
+		KEYFRAME_WEIGHT + PFRAME_WEIGHT * (VIDEO_KEYINT / 3 - 1) + BFRAME_WEIGHT * (VIDEO_KEYINT * 2 / 3);
+	double gop_bytes = (double)bitrate * 1000.0 / 8.0 * VIDEO_KEYINT / VIDEO_FPS;
+	double weight;
+
+	if (frame % VIDEO_KEYINT == 0) {
+		*priority = OBS_NAL_PRIORITY_HIGHEST;
+		weight = KEYFRAME_WEIGHT;
+		data[4] = 0x65; /* IDR slice */
+	} else if (frame % 3 == 0) {
+		*priority = OBS_NAL_PRIORITY_HIGH;
+		weight = PFRAME_WEIGHT;
+		data[4] = 0x41; /* referenced slice */
+	} else {
+		*priority = OBS_NAL_PRIORITY_DISPOSABLE;
+		weight = BFRAME_WEIGHT;
+		data[4] = 0x01; /* unreferenced slice */
+	}
+
+	memcpy(data, start_code, sizeof(start_code));
+	return sizeof(start_code) + 1 + (size_t)(gop_bytes * weight / gop_weight);
+}
+
+static inline size_t max_video_frame_size(void)
+{
+	uint8_t header[5];
+	int priority;
+
+	return make_video_frame(header, VIDEO_BITRATE, 0, &priority);
+}
+
+static void stream_packets(struct rtmp_stream *stream, struct run_stats *stats)
+{
+	int64_t video_frames = STREAM_SECONDS * VIDEO_FPS;
+	int64_t audio_packets = (int64_t)(STREAM_SECONDS * AUDIO_PACKETS_PER_SEC);
+	uint8_t *video_data = alloc_packet_data(max_video_frame_size());
+	uint8_t *audio_data = alloc_packet_data(AUDIO_PACKET_SIZE);
+	int64_t v = 0;
+	int64_t a = 0;
+
+	stats->min_bitrate = stream->dbr_cur_bitrate;
+	stats->last_bitrate = stream->dbr_cur_bitrate;
+	stats->start_ns = os_gettime_ns();
+
+	while (v < video_frames || a < audio_packets) {
+		int64_t video_usec = v * 1000000 / VIDEO_FPS;
+		int64_t audio_usec = (int64_t)((double)a * 1000000.0 / AUDIO_PACKETS_PER_SEC);
+		bool video = v < video_frames && (a >= audio_packets || video_usec <= audio_usec);
+		struct encoder_packet packet = {.timebase_num = 1};
+
+		packet.dts_usec = video ? video_usec : audio_usec;
+		packet.sys_dts_usec = packet.dts_usec;
+		os_sleepto_ns(stats->start_ns + (uint64_t)packet.dts_usec * 1000);
+
+		if (video) {
+			int priority;
+
+			packet.type = OBS_ENCODER_VIDEO;
+			packet.timebase_den = VIDEO_FPS;
+			packet.pts = packet.dts = v;
+			packet.data = video_data;
+			packet.size = make_video_frame(video_data, stream->dbr_cur_bitrate, v++, &priority);
+			stats->video_sent[priority]++;
+		} else {
+			packet.type = OBS_ENCODER_AUDIO;
+			packet.timebase_den = 48000;
+			packet.pts = packet.dts = a++ * 1024;
+			packet.data = audio_data;
+			packet.size = AUDIO_PACKET_SIZE;
+			stats->audio_sent++;
+		}
+
+		rtmp_stream_data(stream, &packet);
+
+		/* the bitrate only changes from within rtmp_stream_data */
+		if (stream->dbr_cur_bitrate != stats->last_bitrate) {
+			stats->last_bitrate = stream->dbr_cur_bitrate;
+			stats->bitrate_changes++;
+			if (stats->last_bitrate < stats->min_bitrate)
+				stats->min_bitrate = stats->last_bitrate;
+		}
+	}
+
+	release_packet_data(video_data);
+	release_packet_data(audio_data);
+}
+
+static void wait_for_drain(struct rtmp_stream *stream)
+{
+	uint64_t timeout = os_gettime_ns() + DRAIN_TIMEOUT_SEC * SEC_TO_NSEC;
+
+	while (!disconnected(stream) && os_gettime_ns() < timeout) {
+		size_t num_packets;
+
+		pthread_mutex_lock(&stream->packets_mutex);
+		num_packets = num_buffered_packets(stream);
+		pthread_mutex_unlock(&stream->packets_mutex);
+
+		if (!num_packets)
+			break;
+		os_sleep_ms(10);
+	}
+}
+
+static uint64_t thread_cpu_ns(pthread_t thread)
+{
+	struct timespec ts;
+	clockid_t clock;
+
+	if (pthread_getcpuclockid(thread, &clock) != 0 || clock_gettime(clock, &ts) != 0)
+		return 0;
+
+	return (uint64_t)ts.tv_sec * SEC_TO_NSEC + (uint64_t)ts.tv_nsec;
+}
+
+/* try_connect and init_send without the metadata, which needs encoders */
+static bool connect_stream(struct rtmp_stream *stream)
+{
+	int send_buf = SENDER_SEND_BUF;
+
+	RTMP_Init(&stream->rtmp);
+	if (!RTMP_SetupURL(&stream->rtmp, stream->path.array))
+		return false;
+
+	RTMP_EnableWrite(&stream->rtmp);
+	RTMP_AddStream(&stream->rtmp, stream->key.array);
+
+	stream->rtmp.m_outChunkSize = 4096;
+	stream->rtmp.m_bSendChunkSizeInfo = true;
+	stream->rtmp.m_bUseNagle = true;
+
+	if (!RTMP_Connect(&stream->rtmp, NULL) || !RTMP_ConnectStream(&stream->rtmp, 0))
+		return false;
+
+	setsockopt(stream->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_SNDBUF, &send_buf, sizeof(send_buf));
+
+	if (!reset_semaphore(stream) || pthread_create(&stream->send_thread, NULL, send_thread, stream) != 0)
+		return false;
+
+	os_atomic_set_bool(&stream->active, true);
+	return true;
+}
+
+static bool run_stream(int port, bool dbr, struct run_stats *stats)
+{
+	struct rtmp_stream *stream = rtmp_stream_create(NULL, NULL);
+	uint64_t cpu_start;
+
+	if (!stream)
+		return false;
+
+	/* what init_connect takes from the service, the output settings and the
+	 * encoders */
+	dstr_printf(&stream->path, "rtmp://127.0.0.1:%d/live", port);
+	dstr_copy(&stream->key, "bench");
+	stream->drop_threshold_usec = 700 * MSEC_TO_USEC;
+	stream->pframe_drop_threshold_usec = 900 * MSEC_TO_USEC;
+	stream->max_shutdown_time_sec = 30;
+	stream->video_codec[0] = CODEC_H264;
+	stream->audio_codec[0] = AUDIO_CODEC_AAC;
+	stream->audio_bitrate = AUDIO_BITRATE;
+	stream->dbr_orig_bitrate = VIDEO_BITRATE;
+	stream->dbr_cur_bitrate = VIDEO_BITRATE;
+	stream->dbr_inc_bitrate = VIDEO_BITRATE / 10;
+	stream->dbr_enabled = dbr;
+
+	if (!connect_stream(stream)) {
+		RTMP_Close(&stream->rtmp);
+		rtmp_stream_destroy(stream);
+		return false;
+	}
+
+	cpu_start = thread_cpu_ns(stream->send_thread);
+
+	stream_packets(stream, stats);
+	wait_for_drain(stream);
+
+	stats->send_cpu_ns = thread_cpu_ns(stream->send_thread) - cpu_start;
+	stats->elapsed_ns = os_gettime_ns() - stats->start_ns;
+	stats->dropped_frames = stream->dropped_frames;
+
+	pthread_mutex_lock(&stream->packets_mutex);
+	stats->unsent = num_buffered_packets(stream);
+	pthread_mutex_unlock(&stream->packets_mutex);
+
+	rtmp_stream_stop(stream, 0);
+	rtmp_stream_destroy(stream);
+	return true;
+}
+
+static int compare_int64(const void *a, const void *b)
+{
+	int64_t val_a = *(const int64_t *)a;
+	int64_t val_b = *(const int64_t *)b;
+	return (val_a > val_b) - (val_a < val_b);
+}
+
+static void print_result(const struct sink *sink, const struct run_stats *stats, bool dbr)
+{
+	size_t count = sink->arrivals.num;
+	int64_t *delays = bmalloc(sizeof(int64_t) * (count ? count : 1));
+	double delay_avg = 0.0;
+	double kbps = 0.0;
+	char dropped[32];
+	char bitrate[32];
+
+	for (size_t i = 0; i < count; i++) {
+		const struct arrival *arrival = &sink->arrivals.array[i];
+		uint64_t submitted = stats->start_ns + (uint64_t)arrival->timestamp * MSEC_TO_NSEC;
+
+		delays[i] = (int64_t)(arrival->time_ns - submitted);
+		delay_avg += (double)delays[i];
+	}
+
+	qsort(delays, count, sizeof(int64_t), compare_int64);
+
+	if (count)
+		delay_avg /= (double)count;
+	if (sink->last_recv_ns > sink->publish_ns)
+		kbps = (double)sink->bytes * 8.0 * 1000000.0 / (double)(sink->last_recv_ns - sink->publish_ns);
+
+	/* dropped by rtmp_stream, as b-frames/p-frames */
+	snprintf(dropped, sizeof(dropped), "%d/%d",
+		 stats->video_sent[OBS_NAL_PRIORITY_DISPOSABLE] - sink->video_frames[OBS_NAL_PRIORITY_DISPOSABLE],
+		 stats->video_sent[OBS_NAL_PRIORITY_HIGH] - sink->video_frames[OBS_NAL_PRIORITY_HIGH]);
+	snprintf(bitrate, sizeof(bitrate), "%ld/%ld (%d)", stats->min_bitrate, stats->last_bitrate,
+		 stats->bitrate_changes);
+
+	printf("%-10s %-4s %9.0f %8.2f %9.1f %9.1f %9.1f %8d %9s %7zu %16s%s\n", sink->config.name, dbr ? "on" : "off",
+	       kbps, (double)stats->send_cpu_ns * 100.0 / (double)stats->elapsed_ns, delay_avg / MSEC_TO_NSEC,
+	       count ? (double)delays[count * 95 / 100] / MSEC_TO_NSEC : 0.0,
+	       count ? (double)delays[count - 1] / MSEC_TO_NSEC : 0.0, stats->dropped_frames, dropped, stats->unsent,
+	       bitrate,
+	       sink->video_frames[OBS_NAL_PRIORITY_HIGHEST] == stats->video_sent[OBS_NAL_PRIORITY_HIGHEST]
+		       ? ""
+		       : "  (keyframes lost)");
+
+	bfree(delays);
+}
+
+static void log_handler(int lvl, const char *msg, va_list args, void *param)
+{
+	UNUSED_PARAMETER(param);
+
+	if (lvl > LOG_WARNING)
+		return;
+
+	vfprintf(stderr, msg, args);
+	fputc('\n', stderr);
+}
+
+const char *obs_module_text(const char *lookup_string)
+{
+	return lookup_string;
+}
+
+int main(int argc, char *argv[])
+{
+	base_set_log_handler(log_handler, NULL);
+
+	printf("%-10s %-4s %9s %8s %9s %9s %9s %8s %9s %7s %16s\n", "sink", "dbr", "kbps", "send cpu", "delay ms",
+	       "p95 ms", "max ms", "dropped", "b/p", "unsent", "min/last (n)");
+
+	for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+		if (argc > 1 && strcmp(argv[1], scenarios[i].name) != 0)
+			continue;
+
+		for (int dbr = 0; dbr < 2; dbr++) {
+			struct sink *sink = sink_create(&scenarios[i]);
+			struct run_stats stats = {0};
+			bool success;
+
+			if (!sink) {
+				fprintf(stderr, "Failed to create sink\n");
+				return 1;
+			}
+
+			success = run_stream(sink->port, dbr, &stats);
+			sink_wait(sink);
+
+			if (success)
+				print_result(sink, &stats, dbr);
+			else
+				fprintf(stderr, "Failed to connect to sink '%s'\n", scenarios[i].name);
+
+			sink_destroy(sink);
+			if (!success)
+				return 1;
+		}
+	}
+
+	return 0;
+}
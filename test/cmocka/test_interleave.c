@@ -0,0 +1,167 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <util/bmem.h>
+
+#include "obs-interleave.h"
+
+#define VIDEO_TRACKS 2
+#define AUDIO_TRACKS 3
+#define PACKETS_PER_TRACK 200
+
+/* packet data is reference counted the same way encoders allocate it */
+static uint8_t *create_packet_data(void)
+{
+	long *refs = bmalloc(sizeof(long) + 16);
+	*refs = 1;
+	return (uint8_t *)(refs + 1);
+}
+
+static long packet_data_refs(const uint8_t *data)
+{
+	return ((const long *)data)[-1];
+}
+
+static void push_packet(struct interleave_queue *iq, enum obs_encoder_type type, size_t track_idx, int64_t dts_usec,
+			int64_t seq, uint8_t *data)
+{
+	struct encoder_packet src = {
+		.type = type,
+		.track_idx = track_idx,
+		.dts_usec = dts_usec,
+		.pts = seq,
+		.data = data,
+		.size = 16,
+	};
+	struct encoder_packet packet;
+
+	obs_encoder_packet_ref(&packet, &src);
+	interleave_queue_push(iq, &packet);
+}
+
+/* video at 60 fps, audio tracks at ~21.3ms and out of phase with each other */
+static void push_streams(struct interleave_queue *iq, uint8_t *data)
+{
+	for (int64_t i = 0; i < PACKETS_PER_TRACK; i++) {
+		for (size_t v = 0; v < VIDEO_TRACKS; v++)
+			push_packet(iq, OBS_ENCODER_VIDEO, v, i * 1000000 / 60, i, data);
+		for (size_t a = 0; a < AUDIO_TRACKS; a++)
+			push_packet(iq, OBS_ENCODER_AUDIO, a, i * 21333 + (int64_t)a * 1500, i, data);
+	}
+}
+
+static void track_order_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct interleave_queue iq = {0};
+	uint8_t *data = create_packet_data();
+	int64_t next[INTERLEAVE_MAX_TRACKS] = {0};
+	struct encoder_packet packet;
+	struct encoder_packet prev = {0};
+	size_t popped = 0;
+
+	push_streams(&iq, data);
+	assert_int_equal(interleave_queue_size(&iq), PACKETS_PER_TRACK * (VIDEO_TRACKS + AUDIO_TRACKS));
+
+	/* the front of each track is its oldest packet */
+	for (size_t v = 0; v < VIDEO_TRACKS; v++)
+		assert_int_equal(interleave_queue_first(&iq, OBS_ENCODER_VIDEO, v)->packet.pts, 0);
+	for (size_t a = 0; a < AUDIO_TRACKS; a++)
+		assert_int_equal(interleave_queue_last(&iq, OBS_ENCODER_AUDIO, a)->packet.pts, PACKETS_PER_TRACK - 1);
+
+	while (interleave_queue_pop(&iq, &packet)) {
+		size_t track = interleave_track_index(packet.type, packet.track_idx);
+
+		/* every track comes out in the order it went in */
+		assert_int_equal(packet.pts, next[track]++);
+
+		/* and the tracks are merged by dts, video first on ties */
+		if (popped++) {
+			assert_true(prev.dts_usec <= packet.dts_usec);
+			if (prev.dts_usec == packet.dts_usec && prev.type == packet.type &&
+			    packet.type == OBS_ENCODER_VIDEO)
+				assert_true(prev.track_idx < packet.track_idx);
+			if (prev.dts_usec == packet.dts_usec && prev.type != packet.type)
+				assert_int_equal(prev.type, OBS_ENCODER_VIDEO);
+		}
+
+		prev = packet;
+		obs_encoder_packet_release(&packet);
+	}
+
+	assert_int_equal(popped, PACKETS_PER_TRACK * (VIDEO_TRACKS + AUDIO_TRACKS));
+	assert_int_equal(interleave_queue_size(&iq), 0);
+	assert_null(interleave_queue_front(&iq));
+	assert_int_equal(packet_data_refs(data), 1);
+
+	interleave_queue_free(&iq);
+	bfree(data - sizeof(long));
+}
+
+static void out_of_order_push_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct interleave_queue iq = {0};
+	struct encoder_packet packet;
+	const int64_t dts[] = {0, 40, 20, 60, 10, 50};
+
+	/* a late packet is sorted into its track rather than appended */
+	for (size_t i = 0; i < sizeof(dts) / sizeof(dts[0]); i++)
+		push_packet(&iq, OBS_ENCODER_AUDIO, 0, dts[i], (int64_t)i, NULL);
+
+	int64_t last = -1;
+	while (interleave_queue_pop(&iq, &packet)) {
+		assert_true(packet.dts_usec > last);
+		last = packet.dts_usec;
+	}
+
+	interleave_queue_free(&iq);
+}
+
+static void drain_on_stop_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct interleave_queue iq = {0};
+	uint8_t *data = create_packet_data();
+	struct encoder_packet packet;
+
+	push_streams(&iq, data);
+
+	/* send some of the packets, then stop with the rest still queued */
+	for (size_t i = 0; i < PACKETS_PER_TRACK; i++) {
+		assert_true(interleave_queue_pop(&iq, &packet));
+		obs_encoder_packet_release(&packet);
+	}
+
+	assert_int_equal(packet_data_refs(data), 1 + PACKETS_PER_TRACK * (VIDEO_TRACKS + AUDIO_TRACKS - 1));
+
+	/* stopping an output releases every packet that is still queued */
+	interleave_queue_free(&iq);
+	assert_int_equal(packet_data_refs(data), 1);
+	assert_int_equal(interleave_queue_size(&iq), 0);
+	assert_false(interleave_queue_pop(&iq, &packet));
+
+	/* and leaves the queue ready to be used for the next start */
+	push_packet(&iq, OBS_ENCODER_VIDEO, 0, 0, 0, data);
+	assert_int_equal(interleave_queue_size(&iq), 1);
+	interleave_queue_free(&iq);
+	assert_int_equal(packet_data_refs(data), 1);
+
+	bfree(data - sizeof(long));
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(track_order_test),
+		cmocka_unit_test(out_of_order_push_test),
+		cmocka_unit_test(drain_on_stop_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
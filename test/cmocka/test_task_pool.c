@@ -0,0 +1,156 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <util/task.h>
+#include <util/bmem.h>
+#include <util/threading.h>
+
+#define POOL_THREADS 4
+
+struct range_data {
+	volatile long *hits;
+	uint32_t granularity;
+	bool misaligned;
+};
+
+static void mark_range(void *param, uint32_t start, uint32_t end)
+{
+	struct range_data *data = param;
+
+	if (start % data->granularity)
+		data->misaligned = true;
+
+	for (uint32_t i = start; i < end; i++)
+		os_atomic_inc_long(&data->hits[i]);
+}
+
+static void run_range(os_task_pool_t *pool, uint32_t count, uint32_t granularity)
+{
+	struct range_data data = {
+		.hits = bzalloc(count * sizeof(long)),
+		.granularity = granularity,
+	};
+
+	os_task_pool_for(pool, count, granularity, mark_range, &data);
+
+	/* every index has been processed exactly once by the time it returns */
+	for (uint32_t i = 0; i < count; i++)
+		assert_int_equal(data.hits[i], 1);
+	assert_false(data.misaligned);
+
+	bfree((void *)data.hits);
+}
+
+static void run_and_wait_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	os_task_pool_t *pool = os_task_pool_create(POOL_THREADS);
+	assert_non_null(pool);
+	assert_int_equal(os_task_pool_threads(pool), POOL_THREADS);
+
+	run_range(pool, 1, 1);
+	run_range(pool, 7, 1);
+	run_range(pool, 1080, 1);
+	run_range(pool, 1080, 16);
+	run_range(pool, 100000, 64);
+
+	/* without a pool the caller does all of the work */
+	run_range(NULL, 1080, 2);
+
+	os_task_pool_destroy(pool);
+}
+
+#define OUTER_COUNT 8
+#define INNER_COUNT 256
+
+struct nested_data {
+	os_task_pool_t *pool;
+	volatile long hits[OUTER_COUNT * INNER_COUNT];
+};
+
+struct inner_data {
+	struct nested_data *nested;
+	uint32_t outer;
+};
+
+static void inner_range(void *param, uint32_t start, uint32_t end)
+{
+	struct inner_data *inner = param;
+
+	for (uint32_t i = start; i < end; i++)
+		os_atomic_inc_long(&inner->nested->hits[inner->outer * INNER_COUNT + i]);
+}
+
+static void outer_range(void *param, uint32_t start, uint32_t end)
+{
+	struct nested_data *nested = param;
+
+	for (uint32_t i = start; i < end; i++) {
+		struct inner_data inner = {nested, i};
+		os_task_pool_for(nested->pool, INNER_COUNT, 1, inner_range, &inner);
+	}
+}
+
+static void nested_wait_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct nested_data *nested = bzalloc(sizeof(*nested));
+	nested->pool = os_task_pool_create(POOL_THREADS);
+	assert_non_null(nested->pool);
+
+	/* tasks that wait on the pool themselves must not deadlock, even when
+	 * every pool thread is busy with the outer job */
+	for (int run = 0; run < 50; run++) {
+		memset((void *)nested->hits, 0, sizeof(nested->hits));
+		os_task_pool_for(nested->pool, OUTER_COUNT, 1, outer_range, nested);
+
+		for (size_t i = 0; i < OUTER_COUNT * INNER_COUNT; i++)
+			assert_int_equal(nested->hits[i], 1);
+	}
+
+	os_task_pool_destroy(nested->pool);
+	bfree(nested);
+}
+
+static void count_range(void *param, uint32_t start, uint32_t end)
+{
+	for (uint32_t i = start; i < end; i++)
+		os_atomic_inc_long(param);
+}
+
+static void destroy_pending_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	/* callers usually finish small jobs before the pool threads wake up,
+	 * which leaves wakeups pending for jobs that no longer exist */
+	for (int run = 0; run < 100; run++) {
+		os_task_pool_t *pool = os_task_pool_create(POOL_THREADS);
+		volatile long total = 0;
+
+		assert_non_null(pool);
+
+		for (int i = 0; i < 20; i++)
+			os_task_pool_for(pool, POOL_THREADS * 2, 1, count_range, (void *)&total);
+
+		os_task_pool_destroy(pool);
+		assert_int_equal(total, 20 * POOL_THREADS * 2);
+	}
+
+	os_task_pool_destroy(NULL);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(run_and_wait_test),
+		cmocka_unit_test(nested_wait_test),
+		cmocka_unit_test(destroy_pending_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,202 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <obs.h>
+#include <media-io/video-io.h>
+#include <media-io/video-frame.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#define TEST_FRAMES 60
+
+struct test_input {
+	video_t *video;
+	volatile long frames;
+	uint64_t last_ts;
+	bool out_of_order;
+	bool disconnect_self;
+	volatile bool disconnected;
+	volatile bool returned;
+	uint32_t sleep_ms;
+	pthread_t thread;
+};
+
+static void test_callback(void *param, struct video_data *frame)
+{
+	struct test_input *input = param;
+
+	if (frame->timestamp < input->last_ts)
+		input->out_of_order = true;
+	input->last_ts = frame->timestamp;
+	input->thread = pthread_self();
+
+	if (os_atomic_inc_long(&input->frames) == 1 && input->disconnect_self) {
+		video_output_disconnect(input->video, test_callback, input);
+		os_atomic_set_bool(&input->disconnected, true);
+	}
+
+	if (input->sleep_ms)
+		os_sleep_ms(input->sleep_ms);
+
+	os_atomic_set_bool(&input->returned, true);
+}
+
+static video_t *open_threaded_output(void)
+{
+	struct video_output_info info = {
+		.name = "test",
+		.format = VIDEO_FORMAT_RGBA,
+		.fps_num = 1000,
+		.fps_den = 1,
+		.width = 16,
+		.height = 16,
+		.cache_size = 8,
+		.colorspace = VIDEO_CS_709,
+		.range = VIDEO_RANGE_PARTIAL,
+	};
+	video_t *video = NULL;
+
+	assert_int_equal(video_output_open(&video, &info), VIDEO_OUTPUT_SUCCESS);
+	video_output_set_threaded_inputs(video, true);
+	return video;
+}
+
+static void output_frames(video_t *video, int count)
+{
+	uint64_t frame_time = video_output_get_frame_time(video);
+
+	for (int i = 0; i < count; i++) {
+		struct video_frame frame;
+
+		if (video_output_lock_frame(video, &frame, 1, (uint64_t)i * frame_time)) {
+			frame.data[0][0] = (uint8_t)i;
+			video_output_unlock_frame(video);
+		}
+		os_sleep_ms(1);
+	}
+}
+
+static void wait_for_frames(struct test_input *input, long count)
+{
+	for (int i = 0; i < 1000 && os_atomic_load_long(&input->frames) < count; i++)
+		os_sleep_ms(1);
+}
+
+static void connect_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	video_t *video = open_threaded_output();
+	struct test_input a = {.video = video};
+	struct test_input b = {.video = video};
+
+	assert_true(video_output_connect(video, NULL, test_callback, &a));
+	assert_true(video_output_connect(video, NULL, test_callback, &b));
+	assert_true(video_output_active(video));
+
+	output_frames(video, TEST_FRAMES);
+	wait_for_frames(&a, 1);
+	wait_for_frames(&b, 1);
+
+	video_output_disconnect(video, test_callback, &a);
+	video_output_disconnect(video, test_callback, &b);
+	assert_false(video_output_active(video));
+	video_output_close(video);
+
+	assert_true(a.frames > 0);
+	assert_true(b.frames > 0);
+	assert_false(a.out_of_order);
+	assert_false(b.out_of_order);
+
+	/* each input is called from its own thread */
+	assert_false(pthread_equal(a.thread, b.thread));
+}
+
+static void disconnect_in_callback_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	video_t *video = open_threaded_output();
+	struct test_input input = {.video = video, .disconnect_self = true};
+	struct test_input other = {.video = video};
+
+	assert_true(video_output_connect(video, NULL, test_callback, &input));
+	assert_true(video_output_connect(video, NULL, test_callback, &other));
+
+	output_frames(video, TEST_FRAMES / 2);
+	wait_for_frames(&input, 1);
+
+	/* the remaining input must keep receiving frames, which requires the
+	 * self-disconnected input to have released the frames it queued */
+	long other_frames = os_atomic_load_long(&other.frames);
+	output_frames(video, TEST_FRAMES / 2);
+	wait_for_frames(&other, other_frames + 1);
+	assert_int_equal(input.frames, 1);
+	assert_true(other.frames > other_frames);
+
+	/* reconnecting joins the exited thread, and the same callback can be
+	 * connected again, this time on the video thread */
+	for (int i = 0; i < 1000 && !os_atomic_load_bool(&input.returned); i++)
+		os_sleep_ms(1);
+	input.disconnect_self = false;
+	assert_true(video_output_connect3(video, NULL, 1, false, test_callback, &input));
+	output_frames(video, TEST_FRAMES / 2);
+	wait_for_frames(&input, 2);
+	video_output_disconnect(video, test_callback, &input);
+
+	video_output_close(video);
+
+	assert_true(input.frames > 1);
+}
+
+static void close_with_inputs_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	video_t *video = open_threaded_output();
+	struct test_input slow = {.video = video, .sleep_ms = 1};
+	struct test_input self = {.video = video, .disconnect_self = true, .sleep_ms = 20};
+
+	assert_true(video_output_connect(video, NULL, test_callback, &slow));
+	assert_true(video_output_connect(video, NULL, test_callback, &self));
+
+	/* close while both inputs still have queued frames and one of them
+	 * is still inside the callback that disconnected it */
+	output_frames(video, TEST_FRAMES / 4);
+	wait_for_frames(&slow, 1);
+	for (int i = 0; i < 1000 && !os_atomic_load_bool(&self.disconnected); i++)
+		os_sleep_ms(1);
+	video_output_close(video);
+
+	assert_true(slow.frames > 0);
+	assert_int_equal(self.frames, 1);
+
+	/* no input thread may outlive the output */
+	assert_true(os_atomic_load_bool(&self.returned));
+}
+
+static int setup(void **state)
+{
+	UNUSED_PARAMETER(state);
+	return obs_startup("en-US", NULL, NULL) ? 0 : -1;
+}
+
+static int teardown(void **state)
+{
+	UNUSED_PARAMETER(state);
+	obs_shutdown();
+	return 0;
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(connect_test),
+		cmocka_unit_test(disconnect_in_callback_test),
+		cmocka_unit_test(close_with_inputs_test),
+	};
+
+	return cmocka_run_group_tests(tests, setup, teardown);
+}